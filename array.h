@@ -29,10 +29,13 @@
 #include <cassert>
 #endif
 
+#include <cstdint>
+#include <cstring>
 #include <limits>
 #include <memory>
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 // Some things in this header are unbearably slow without optimization if they
 // don't get inlined.
@@ -1244,27 +1247,28 @@ NDARRAY_INLINE NDARRAY_HOST_DEVICE void for_each_index_in_order(
   for_each_index_in_order_impl(fn, std::tuple<>(), std::get<sizeof...(Is) - 1 - Is>(dims)...);
 }
 
+// These are function objects rather than functions, so they can be inlined
+// into loops that are not inlined into the caller, such as the loops of
+// custom copy_shape_traits.
 template <typename TSrc, typename TDst>
-NDARRAY_INLINE NDARRAY_HOST_DEVICE void move_assign(TSrc& src, TDst& dst) {
-  dst = std::move(src);
-}
+struct move_assign {
+  NDARRAY_INLINE NDARRAY_HOST_DEVICE void operator()(TSrc& src, TDst& dst) const {
+    dst = std::move(src);
+  }
+};
 
 template <typename TSrc, typename TDst>
-NDARRAY_INLINE NDARRAY_HOST_DEVICE void copy_assign(const TSrc& src, TDst& dst) {
-  dst = src;
-}
+struct copy_assign {
+  NDARRAY_INLINE NDARRAY_HOST_DEVICE void operator()(const TSrc& src, TDst& dst) const {
+    dst = src;
+  }
+};
 
-template <size_t D, class Ptr0>
-NDARRAY_INLINE NDARRAY_HOST_DEVICE void advance(Ptr0& ptr0) {
-  std::get<0>(ptr0) += std::get<D>(std::get<1>(ptr0));
-}
-template <size_t D, class Ptr0, class Ptr1>
-NDARRAY_INLINE NDARRAY_HOST_DEVICE void advance(Ptr0& ptr0, Ptr1& ptr1) {
-  std::get<0>(ptr0) += std::get<D>(std::get<1>(ptr0));
-  std::get<0>(ptr1) += std::get<D>(std::get<1>(ptr1));
+template <size_t D, class... Ptrs>
+NDARRAY_INLINE NDARRAY_HOST_DEVICE void advance(Ptrs&... ptrs) {
+  int unused[] = {(std::get<0>(ptrs) += std::get<D>(std::get<1>(ptrs)), 0)...};
+  (void)unused;
 }
-// If we ever need other than 1- or 2-way for_each_value, add a variadic
-// version of advance.
 
 template <class Fn, class Ptr0, class... Ptrs>
 NDARRAY_UNIQUE NDARRAY_HOST_DEVICE void for_each_value_in_order_inner_dense(
@@ -1557,15 +1561,17 @@ NDARRAY_INLINE NDARRAY_HOST_DEVICE dim<> fuse(const dim<>& inner, const dim<>& o
       inner.min() + outer.min() * inner.extent(), inner.extent() * outer.extent(), inner.stride());
 }
 
-struct copy_dims {
-  dim<> src;
-  dim<> dst;
+// The dims of several shapes in the same dimension.
+template <size_t N>
+struct multi_dims {
+  std::array<dim<>, N> dims;
 };
 
 inline bool operator<(const dim<>& l, const dim<>& r) { return l.stride() < r.stride(); }
 
-inline bool operator<(const copy_dims& l, const copy_dims& r) {
-  return l.dst.stride() < r.dst.stride();
+template <size_t N>
+inline bool operator<(const multi_dims<N>& l, const multi_dims<N>& r) {
+  return l.dims[0].stride() < r.dims[0].stride();
 }
 
 // We need a sort that only needs to deal with very small lists,
@@ -1612,31 +1618,39 @@ NDARRAY_HOST_DEVICE shape_of_rank<Shape::rank()> dynamic_optimize_shape(const Sh
   return shape_of_rank<Shape::rank()>(array_to_tuple(dims));
 }
 
-// Optimize a src and dst shape. The dst shape is made dense, and contiguous
-// dimensions are fused.
-template <class ShapeSrc, class ShapeDst,
-    class = enable_if_shapes_copy_compatible<ShapeDst, ShapeSrc>>
-NDARRAY_HOST_DEVICE auto dynamic_optimize_copy_shapes(const ShapeSrc& src, const ShapeDst& dst) {
-  constexpr size_t rank = ShapeSrc::rank();
-  static_assert(rank == ShapeDst::rank(), "copy shapes must have same rank.");
-  auto src_dims = internal::tuple_to_array<dim<>>(src.dims());
-  auto dst_dims = internal::tuple_to_array<dim<>>(dst.dims());
+// Optimize several shapes of the same rank for visiting the same indices in
+// any order. The dims are sorted by the stride of the first shape, and dims that
+// are contiguous in all of the shapes are fused.
+template <class Shape0, class... Shapes>
+NDARRAY_HOST_DEVICE auto dynamic_optimize_shapes(const Shape0& shape0, const Shapes&... shapes) {
+  constexpr size_t rank = Shape0::rank();
+  constexpr size_t n = sizeof...(Shapes) + 1;
+  static_assert(all(Shapes::rank() == rank...), "shapes must have same rank.");
+  const std::array<std::array<dim<>, rank>, n> shape_dims = {
+      {tuple_to_array<dim<>>(shape0.dims()), tuple_to_array<dim<>>(shapes.dims())...}};
 
-  std::array<copy_dims, rank> dims;
+  std::array<multi_dims<n>, rank> dims;
   for (size_t i = 0; i < rank; i++) {
-    dims[i] = {src_dims[i], dst_dims[i]};
+    for (size_t j = 0; j < n; j++) {
+      dims[i].dims[j] = shape_dims[j][i];
+    }
   }
 
-  // Sort the dims by the dst stride.
+  // Sort the dims by the stride of the first shape.
   bubble_sort(dims.begin(), dims.end());
 
-  // Find dimensions that are contiguous and fuse them.
+  // Find dimensions that are contiguous in all of the shapes and fuse them.
   size_t new_rank = dims.size();
   for (size_t i = 0; i + 1 < new_rank;) {
-    if (dims[i].src.extent() == dims[i].dst.extent() && can_fuse(dims[i].src, dims[i + 1].src) &&
-        can_fuse(dims[i].dst, dims[i + 1].dst)) {
-      dims[i].src = fuse(dims[i].src, dims[i + 1].src);
-      dims[i].dst = fuse(dims[i].dst, dims[i + 1].dst);
+    bool fusable = true;
+    for (size_t j = 0; j < n; j++) {
+      fusable = fusable && dims[i].dims[j].extent() == dims[i].dims[0].extent() &&
+                can_fuse(dims[i].dims[j], dims[i + 1].dims[j]);
+    }
+    if (fusable) {
+      for (size_t j = 0; j < n; j++) {
+        dims[i].dims[j] = fuse(dims[i].dims[j], dims[i + 1].dims[j]);
+      }
       for (size_t j = i + 1; j + 1 < new_rank; j++) {
         dims[j] = dims[j + 1];
       }
@@ -1649,16 +1663,29 @@ NDARRAY_HOST_DEVICE auto dynamic_optimize_copy_shapes(const ShapeSrc& src, const
   // Unfortunately, we can't make the rank of the resulting shape dynamic. Fill
   // the end of the array with size 1 dimensions.
   for (size_t i = new_rank; i < dims.size(); i++) {
-    dims[i] = {dim<>(0, 1, 0), dim<>(0, 1, 0)};
+    for (size_t j = 0; j < n; j++) {
+      dims[i].dims[j] = dim<>(0, 1, 0);
+    }
   }
 
-  for (size_t i = 0; i < dims.size(); i++) {
-    src_dims[i] = dims[i].src;
-    dst_dims[i] = dims[i].dst;
+  std::array<shape_of_rank<rank>, n> result;
+  for (size_t j = 0; j < n; j++) {
+    std::array<dim<>, rank> dims_j;
+    for (size_t i = 0; i < rank; i++) {
+      dims_j[i] = dims[i].dims[j];
+    }
+    result[j] = shape_of_rank<rank>(array_to_tuple(dims_j));
   }
+  return result;
+}
 
-  return std::make_pair(
-      shape_of_rank<rank>(array_to_tuple(src_dims)), shape_of_rank<rank>(array_to_tuple(dst_dims)));
+// Optimize a src and dst shape. The dst shape is made dense, and contiguous
+// dimensions are fused.
+template <class ShapeSrc, class ShapeDst,
+    class = enable_if_shapes_copy_compatible<ShapeDst, ShapeSrc>>
+NDARRAY_HOST_DEVICE auto dynamic_optimize_copy_shapes(const ShapeSrc& src, const ShapeDst& dst) {
+  auto opt = dynamic_optimize_shapes(dst, src);
+  return std::make_pair(opt[1], opt[0]);
 }
 
 template <class Shape>
@@ -1690,6 +1717,209 @@ NDARRAY_HOST_DEVICE T* pointer_add(T* x, index_t offset) {
   return x != nullptr ? x + offset : x;
 }
 
+// Call `fn(std::integral_constant<size_t, I>())` for `I` in `[0, N)`. The
+// indices are compile-time constants, so arrays indexed by them can be kept
+// in registers.
+template <class Fn, size_t... Is>
+NDARRAY_INLINE void unroll(const Fn& fn, index_sequence<Is...>) {
+  int unused[] = {(fn(std::integral_constant<size_t, Is>()), 0)...};
+  (void)unused;
+}
+template <size_t N, class Fn>
+NDARRAY_INLINE void unroll(const Fn& fn) {
+  unroll(fn, make_index_sequence<N>());
+}
+
+// The size in bytes of the vector registers of the target.
+#if defined(__AVX512F__)
+constexpr index_t vector_bytes = 64;
+#elif defined(__AVX__)
+constexpr index_t vector_bytes = 32;
+#else
+constexpr index_t vector_bytes = 16;
+#endif
+
+// Copies where the innermost dimension of the src is not the innermost
+// dimension of the dst are done in tiles of `transpose_tile` x
+// `transpose_tile` elements, so the rows of the src and dst of a tile stay in
+// the cache.
+constexpr index_t transpose_tile = 64;
+
+// The type of the values of copies that can use a `transpose_kernel`.
+template <class Fn>
+struct transpose_value_type {
+  using type = void;
+};
+template <class T>
+struct transpose_value_type<copy_assign<T, T>> {
+  using type = T;
+};
+template <class T>
+struct transpose_value_type<copy_assign<const T, T>> {
+  using type = T;
+};
+template <class T>
+struct transpose_value_type<move_assign<T, T>> {
+  using type = T;
+};
+
+// Transposes blocks of `lanes` x `lanes` values in vector registers. The
+// default has no kernel.
+template <class T, class = void>
+struct transpose_kernel {
+  static constexpr index_t lanes = 0;
+
+  template <class TSrc, class TDst>
+  NDARRAY_HOST_DEVICE static void run(TSrc, index_t, TDst, index_t) {}
+};
+
+#if !defined(__CUDA__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12))
+template <class T>
+struct transpose_kernel<T, std::enable_if_t<std::is_arithmetic<T>::value &&
+                                            !std::is_same<T, bool>::value && sizeof(T) <= 8>> {
+  static constexpr index_t lanes = vector_bytes / sizeof(T) < 16 ? vector_bytes / sizeof(T) : 16;
+  typedef T vector_type __attribute__((vector_size(lanes * sizeof(T))));
+
+  // Exchange the off diagonal `S` x `S` blocks of the rows `a` and `b`, which
+  // are `S` rows apart.
+  static constexpr int shuffle_a(index_t s, index_t k) {
+    return static_cast<int>(k & s ? lanes + k - s : k);
+  }
+  static constexpr int shuffle_b(index_t s, index_t k) {
+    return static_cast<int>(k & s ? lanes + k : k + s);
+  }
+  template <index_t S, size_t... Ks>
+  static NDARRAY_INLINE void exchange(vector_type& a, vector_type& b, index_sequence<Ks...>) {
+    vector_type a_s = __builtin_shufflevector(a, b, shuffle_a(S, Ks)...);
+    b = __builtin_shufflevector(a, b, shuffle_b(S, Ks)...);
+    a = a_s;
+  }
+
+  template <index_t S>
+  static NDARRAY_INLINE void transpose(vector_type* rows, std::false_type) {
+    unroll<lanes>([&](auto i) {
+      if ((i & S) == 0) { exchange<S>(rows[i], rows[i + S], make_index_sequence<lanes>()); }
+    });
+    transpose<S * 2>(rows, std::integral_constant<bool, (S * 2 >= lanes)>());
+  }
+  template <index_t S>
+  static NDARRAY_INLINE void transpose(vector_type*, std::true_type) {}
+
+  // Transpose the `lanes` rows of `src` to the `lanes` rows of `dst`.
+  static NDARRAY_INLINE void run(const T* src, index_t src_stride, T* dst, index_t dst_stride) {
+    vector_type rows[lanes];
+    unroll<lanes>(
+        [&](auto i) { std::memcpy(&rows[i], src + i * src_stride, sizeof(vector_type)); });
+    transpose<1>(rows, std::false_type());
+    unroll<lanes>(
+        [&](auto i) { std::memcpy(dst + i * dst_stride, &rows[i], sizeof(vector_type)); });
+  }
+};
+#endif
+
+template <class Fn, class TSrc, class TDst>
+NDARRAY_INLINE NDARRAY_HOST_DEVICE void transpose_copy_block(index_t x0, index_t x1, index_t y0,
+    index_t y1, TSrc src, index_t src_stride_x, index_t src_stride_y, TDst dst,
+    index_t dst_stride_x, index_t dst_stride_y, Fn&& fn) {
+  for (index_t y = y0; y < y1; y++) {
+    for (index_t x = x0; x < x1; x++) {
+      fn(src[x * src_stride_x + y * src_stride_y], dst[x * dst_stride_x + y * dst_stride_y]);
+    }
+  }
+}
+
+// Call `fn` for each of the `extent_x` x `extent_y` values of `src` and `dst`,
+// where `x` is the innermost dimension of `dst`, and `y` is the innermost
+// dimension of `src`, in tiles.
+template <class Fn, class TSrc, class TDst>
+NDARRAY_HOST_DEVICE void transpose_copy(index_t extent_x, index_t extent_y, TSrc src,
+    index_t src_stride_x, index_t src_stride_y, TDst dst, index_t dst_stride_x,
+    index_t dst_stride_y, Fn&& fn) {
+  using kernel = transpose_kernel<typename transpose_value_type<std::decay_t<Fn>>::type>;
+  constexpr index_t lanes = kernel::lanes;
+  const bool vectorize = lanes > 0 && src_stride_y == 1 && dst_stride_x == 1;
+  for (index_t y0 = 0; y0 < extent_y; y0 += transpose_tile) {
+    const index_t y1 = std::min(extent_y, y0 + transpose_tile);
+    for (index_t x0 = 0; x0 < extent_x; x0 += transpose_tile) {
+      const index_t x1 = std::min(extent_x, x0 + transpose_tile);
+      index_t y = y0;
+      if (vectorize) {
+        for (; y + lanes <= y1; y += lanes) {
+          index_t x = x0;
+          for (; x + lanes <= x1; x += lanes) {
+            kernel::run(&src[x * src_stride_x + y], src_stride_x, &dst[x + y * dst_stride_y],
+                dst_stride_y);
+          }
+          transpose_copy_block(x, x1, y, y + lanes, src, src_stride_x, src_stride_y, dst,
+              dst_stride_x, dst_stride_y, fn);
+        }
+      }
+      transpose_copy_block(
+          x0, x1, y, y1, src, src_stride_x, src_stride_y, dst, dst_stride_x, dst_stride_y, fn);
+    }
+  }
+}
+
+// If the innermost dimension of the src is not the innermost dimension of the
+// dst, call `fn` for each pair of values of the src and dst in tiles, and
+// return true. The dims of the shapes should be sorted by the dst stride, as
+// `optimize_copy_shapes` does.
+template <class ShapeSrc, class ShapeDst, class TSrc, class TDst, class Fn>
+NDARRAY_HOST_DEVICE bool for_each_value_transposed(
+    const ShapeSrc& shape_src, TSrc src, const ShapeDst& shape_dst, TDst dst, Fn&& fn) {
+  constexpr size_t rank = ShapeDst::rank();
+  if (rank < 2) { return false; }
+  auto src_dims = tuple_to_array<dim<>>(shape_src.dims());
+  auto dst_dims = tuple_to_array<dim<>>(shape_dst.dims());
+
+  size_t inner = 0;
+  for (size_t d = 1; d < rank; d++) {
+    if (dst_dims[d].extent() > 1 && src_dims[d].stride() != 0 &&
+        abs(src_dims[d].stride()) < abs(src_dims[inner].stride())) {
+      inner = d;
+    }
+  }
+  if (inner == 0) { return false; }
+
+  const dim<> src_x = src_dims[0];
+  const dim<> src_y = src_dims[inner];
+  const dim<> dst_x = dst_dims[0];
+  const dim<> dst_y = dst_dims[inner];
+
+  // Loop over the other dimensions, and transpose the x and y dimensions for
+  // each of them.
+  src += shape_src(shape_dst.min());
+  for (size_t d = 0; d < rank; d++) {
+    const index_t extent = d == 0 || d == inner ? 1 : dst_dims[d].extent();
+    src_dims[d] = dim<>(dst_dims[d].min(), extent, src_dims[d].stride());
+    dst_dims[d] = dim<>(dst_dims[d].min(), extent, dst_dims[d].stride());
+  }
+  const shape_of_rank<rank> other_src(array_to_tuple(src_dims));
+  const shape_of_rank<rank> other_dst(array_to_tuple(dst_dims));
+  nda::for_each_value_in_order(
+      other_dst, other_src, src, other_dst, dst, [&](auto& src_xy, auto& dst_xy) {
+        transpose_copy(dst_x.extent(), dst_y.extent(), &src_xy, src_x.stride(), src_y.stride(),
+            &dst_xy, dst_x.stride(), dst_y.stride(), fn);
+      });
+  return true;
+}
+
+// The default implementation of `copy_shape_traits<>::for_each_value`, which
+// specializations can fall back to.
+template <class ShapeSrc, class TSrc, class ShapeDst, class TDst, class Fn>
+NDARRAY_HOST_DEVICE void for_each_copy_value(
+    const ShapeSrc& shape_src, TSrc src, const ShapeDst& shape_dst, TDst dst, Fn&& fn) {
+  // For this function, we don't care about the order in which the callback is
+  // called. Optimize the shapes for memory access order.
+  auto opt_shape = optimize_copy_shapes(shape_src, shape_dst);
+  const auto& opt_shape_src = opt_shape.first;
+  const auto& opt_shape_dst = opt_shape.second;
+
+  // If the innermost dimensions of the shapes are different, copy in tiles.
+  if (for_each_value_transposed(opt_shape_src, src, opt_shape_dst, dst, fn)) { return; }
+  nda::for_each_value_in_order(opt_shape_dst, opt_shape_src, src, opt_shape_dst, dst, fn);
+}
+
 } // namespace internal
 
 /** Shape traits enable some behaviors to be customized per shape type. */
@@ -1730,13 +1960,7 @@ public:
   template <class Fn, class TSrc, class TDst>
   NDARRAY_HOST_DEVICE static void for_each_value(
       const ShapeSrc& shape_src, TSrc src, const ShapeDst& shape_dst, TDst dst, Fn&& fn) {
-    // For this function, we don't care about the order in which the callback is
-    // called. Optimize the shapes for memory access order.
-    auto opt_shape = internal::optimize_copy_shapes(shape_src, shape_dst);
-    const auto& opt_shape_src = opt_shape.first;
-    const auto& opt_shape_dst = opt_shape.second;
-
-    for_each_value_in_order(opt_shape_dst, opt_shape_src, src, opt_shape_dst, dst, fn);
+    internal::for_each_copy_value(shape_src, src, shape_dst, dst, fn);
   }
 };
 
@@ -2425,7 +2649,7 @@ public:
     pointer intersection_base =
         internal::pointer_add(new_array.base_, new_shape(intersection.min()));
     copy_shape_traits_type::for_each_value(
-        shape_, base_, intersection, intersection_base, internal::move_assign<T, T>);
+        shape_, base_, intersection, intersection_base, internal::move_assign<T, T>());
 
     *this = std::move(new_array);
   }
@@ -2556,7 +2780,7 @@ void copy(const array_ref<TSrc, ShapeSrc>& src, const array_ref<TDst, ShapeDst>&
   assert(src.shape().is_in_range(dst.shape().min()) && src.shape().is_in_range(dst.shape().max()));
 
   copy_shape_traits<ShapeSrc, ShapeDst>::for_each_value(
-      src.shape(), src.base(), dst.shape(), dst.base(), internal::copy_assign<TSrc, TDst>);
+      src.shape(), src.base(), dst.shape(), dst.base(), internal::copy_assign<TSrc, TDst>());
 }
 template <class TSrc, class TDst, class ShapeSrc, class ShapeDst, class AllocDst,
     class = internal::enable_if_shapes_copy_compatible<ShapeDst, ShapeSrc>>
@@ -2613,7 +2837,7 @@ void move(const array_ref<TSrc, ShapeSrc>& src, const array_ref<TDst, ShapeDst>&
   assert(src.shape().is_in_range(dst.shape().min()) && src.shape().is_in_range(dst.shape().max()));
 
   copy_shape_traits<ShapeSrc, ShapeDst>::for_each_value(
-      src.shape(), src.base(), dst.shape(), dst.base(), internal::move_assign<TSrc, TDst>);
+      src.shape(), src.base(), dst.shape(), dst.base(), internal::move_assign<TSrc, TDst>());
 }
 template <class TSrc, class TDst, class ShapeSrc, class ShapeDst, class AllocDst,
     class = internal::enable_if_shapes_copy_compatible<ShapeDst, ShapeSrc>>
@@ -2698,6 +2922,75 @@ void generate(array<T, Shape, Alloc>& dst, Generator&& g) {
   generate(dst.ref(), g);
 }
 
+namespace internal {
+
+template <class T, class Shape>
+NDARRAY_HOST_DEVICE const array_ref<T, Shape>& as_array_ref(const array_ref<T, Shape>& a) {
+  return a;
+}
+template <class T, class Shape, class Alloc>
+array_ref<T, Shape> as_array_ref(array<T, Shape, Alloc>& a) {
+  return a.ref();
+}
+template <class T, class Shape, class Alloc>
+array_ref<const T, Shape> as_array_ref(const array<T, Shape, Alloc>& a) {
+  return a.cref();
+}
+
+// Shapes that map indices to flat offsets with a stride per dimension.
+template <class Shape>
+struct is_affine_shape : std::false_type {};
+template <class... Dims>
+struct is_affine_shape<shape<Dims...>> : std::true_type {};
+
+template <class Fn, size_t... Is, class T0, class Shape0, class... Ts, class... Shapes>
+NDARRAY_HOST_DEVICE void for_each_value_impl(Fn&& fn, index_sequence<Is...>, std::true_type,
+    const array_ref<T0, Shape0>& a0, const array_ref<Ts, Shapes>&... arrays) {
+  auto opt = dynamic_optimize_shapes(a0.shape(), arrays.shape()...);
+  for_each_value_in_order<Shape0::rank() - 1>(opt[0].extent(), fn,
+      std::make_pair(a0.base(), opt[0].stride()),
+      std::make_pair(arrays.base() + arrays.shape()(a0.shape().min()), opt[Is + 1].stride())...);
+}
+// If any of the shapes are not affine, visit the indices of `a0` in the order
+// of its shape_traits, and compute the offsets of each index in each array.
+template <class Fn, size_t... Is, class T0, class Shape0, class... Ts, class... Shapes>
+NDARRAY_HOST_DEVICE void for_each_value_impl(Fn&& fn, index_sequence<Is...>, std::false_type,
+    const array_ref<T0, Shape0>& a0, const array_ref<Ts, Shapes>&... arrays) {
+  for_each_index(a0.shape(),
+      [&](const typename Shape0::index_type& i) { fn(a0[i], arrays[i]...); });
+}
+
+template <class Fn, size_t... Is, class T0, class Shape0, class... Ts, class... Shapes>
+NDARRAY_HOST_DEVICE void for_each_value_impl(Fn&& fn, index_sequence<Is...> indices,
+    const array_ref<T0, Shape0>& a0, const array_ref<Ts, Shapes>&... arrays) {
+  if (a0.shape().empty()) { return; }
+  assert(all(arrays.shape().is_in_range(a0.shape().min()) &&
+             arrays.shape().is_in_range(a0.shape().max())...));
+
+  using all_affine = std::integral_constant<bool,
+      all(is_affine_shape<Shape0>::value, is_affine_shape<Shapes>::value...)>;
+  for_each_value_impl(fn, indices, all_affine(), a0, arrays...);
+}
+
+} // namespace internal
+
+/** Call `fn(a(i), arrays(i)...)` for each index `i` in the array or
+ * array_ref `a`. `arrays` must be arrays or array_refs with the same rank as
+ * `a` that contain the indices of `a`. The order of the calls is unspecified:
+ * the shapes of all of the arrays are optimized together, ordering the loops by
+ * the strides of `a`, and fusing dimensions that are contiguous in all of the
+ * arrays. If the innermost dimension is dense in all of the arrays, the inner
+ * loop can be vectorized. If any of the shapes are not affine, e.g. a
+ * `tiled_shape`, the indices of `a` are visited with `for_each_index`
+ * instead. */
+template <class Fn, class A, class... Arrays>
+NDARRAY_HOST_DEVICE auto for_each_value(Fn&& fn, A&& a, Arrays&&... arrays)
+    -> decltype(internal::for_each_value_impl(fn, internal::make_index_sequence<sizeof...(Arrays)>(),
+        internal::as_array_ref(a), internal::as_array_ref(arrays)...)) {
+  internal::for_each_value_impl(fn, internal::make_index_sequence<sizeof...(Arrays)>(),
+      internal::as_array_ref(a), internal::as_array_ref(arrays)...);
+}
+
 /** Check if two array or array_refs have equal contents. */
 template <class TA, class ShapeA, class TB, class ShapeB>
 NDARRAY_HOST_DEVICE bool equal(const array_ref<TA, ShapeA>& a, const array_ref<TB, ShapeB>& b) {
@@ -2967,6 +3260,304 @@ template <class T, size_t N, size_t Alignment = sizeof(T),
     class = std::enable_if_t<std::is_trivial<T>::value>>
 using uninitialized_auto_allocator = uninitialized_allocator<auto_allocator<T, N, Alignment>>;
 
+/** Allocator satisfying the `std::allocator` interface that allocates memory
+ * aligned to `Alignment` bytes, which must be a power of 2. */
+template <class T, size_t Alignment = 64>
+class aligned_allocator {
+  static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of 2.");
+  static_assert(Alignment >= alignof(T), "Alignment must be at least the alignment of T.");
+
+public:
+  using value_type = T;
+
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  template <class U>
+  struct rebind {
+    using other = aligned_allocator<U, Alignment>;
+  };
+
+  aligned_allocator() noexcept {}
+  template <class U, size_t U_A>
+  aligned_allocator(const aligned_allocator<U, U_A>&) noexcept {}
+
+  value_type* allocate(size_t n) {
+    // Allocate enough to align the result, and to store the pointer to the
+    // allocation before it.
+    size_t size = n * sizeof(T) + Alignment + sizeof(void*);
+    char* allocation = static_cast<char*>(::operator new(size));
+    uintptr_t result = reinterpret_cast<uintptr_t>(allocation + sizeof(void*));
+    result = (result + Alignment - 1) & ~static_cast<uintptr_t>(Alignment - 1);
+    reinterpret_cast<void**>(result)[-1] = allocation;
+    return reinterpret_cast<value_type*>(result);
+  }
+  void deallocate(value_type* ptr, size_t) noexcept {
+    ::operator delete(reinterpret_cast<void**>(ptr)[-1]);
+  }
+
+  template <class U, size_t U_A>
+  friend bool operator==(const aligned_allocator&, const aligned_allocator<U, U_A>&) {
+    return true;
+  }
+  template <class U, size_t U_A>
+  friend bool operator!=(const aligned_allocator&, const aligned_allocator<U, U_A>&) {
+    return false;
+  }
+};
+
+/** Allocator equivalent to `aligned_allocator<T, Alignment>` that does not
+ * default construct values. */
+template <class T, size_t Alignment = 64, class = std::enable_if_t<std::is_trivial<T>::value>>
+using uninitialized_aligned_allocator = uninitialized_allocator<aligned_allocator<T, Alignment>>;
+
+/** A region of memory that allocations are bump-allocated from. Memory is
+ * never returned to the arena by individual deallocations. Instead, `mark`
+ * records the current position of the arena, and `release` frees all of the
+ * allocations made since the mark in O(1). Memory released from the arena is
+ * kept by the arena and reused by later allocations, so an arena that is
+ * used repeatedly for the same temporaries only allocates memory from the
+ * system the first time. An arena is not thread safe. Use `thread_arena` to
+ * get an arena that is only used by the calling thread. */
+class arena {
+  struct block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  // The blocks of the arena. The blocks before `open_` are in use, and the
+  // blocks after it are available to be reused.
+  std::vector<block> blocks_;
+  size_t open_;
+  // The unused part of the last open block.
+  char* next_;
+  char* end_;
+
+  void* allocate_block(size_t size, size_t alignment) {
+    size_t min_size = size + alignment - 1;
+    if (open_ == blocks_.size() || blocks_[open_].size < min_size) {
+      // Make a new block, with at least double the size of the last block, so
+      // the number of blocks is logarithmic in the total size of the arena.
+      size_t block_size = std::max<size_t>(min_size, 64 * 1024);
+      if (open_ > 0) { block_size = std::max(block_size, blocks_[open_ - 1].size * 2); }
+      block b{std::unique_ptr<char[]>(new char[block_size]), block_size};
+      if (open_ == blocks_.size()) {
+        blocks_.push_back(std::move(b));
+      } else {
+        // The unused block is too small, replace it.
+        blocks_[open_] = std::move(b);
+      }
+    }
+    next_ = blocks_[open_].data.get();
+    end_ = next_ + blocks_[open_].size;
+    open_++;
+    return allocate(size, alignment);
+  }
+
+public:
+  /** The position of the arena, to release allocations to with `release`. */
+  struct mark_type {
+    size_t open;
+    char* next;
+  };
+
+  arena() : open_(0), next_(nullptr), end_(nullptr) {}
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  /** Allocate `size` bytes from the arena, aligned to `alignment` bytes, which
+   * must be a power of 2. */
+  void* allocate(size_t size, size_t alignment) {
+    assert((alignment & (alignment - 1)) == 0);
+    uintptr_t next = reinterpret_cast<uintptr_t>(next_);
+    uintptr_t aligned = (next + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    if (next_ && aligned + size <= reinterpret_cast<uintptr_t>(end_)) {
+      next_ = reinterpret_cast<char*>(aligned + size);
+      return reinterpret_cast<void*>(aligned);
+    }
+    return allocate_block(size, alignment);
+  }
+
+  /** Get the current position of the arena. */
+  mark_type mark() const { return {open_, next_}; }
+
+  /** Release all allocations made since `m` was obtained from `mark`. */
+  void release(const mark_type& m) {
+    assert(m.open <= open_);
+    open_ = m.open;
+    next_ = m.next;
+    end_ = open_ > 0 ? blocks_[open_ - 1].data.get() + blocks_[open_ - 1].size : nullptr;
+  }
+
+  /** Release all of the allocations of the arena. */
+  void reset() { release({0, nullptr}); }
+
+  /** The total size of the memory owned by the arena. */
+  size_t capacity() const {
+    size_t result = 0;
+    for (const block& b : blocks_) {
+      result += b.size;
+    }
+    return result;
+  }
+};
+
+/** Get an arena that is only used by the calling thread. */
+inline arena& thread_arena() {
+  static thread_local arena a;
+  return a;
+}
+
+/** Releases all of the allocations of an arena made during the lifetime of
+ * this object when it is destroyed. Arrays allocated from the arena in the
+ * scope must be destroyed before the scope ends, typically by declaring them
+ * after the `arena_scope`. */
+class arena_scope {
+  arena& arena_;
+  arena::mark_type mark_;
+
+public:
+  explicit arena_scope(arena& a = thread_arena()) : arena_(a), mark_(a.mark()) {}
+  ~arena_scope() { arena_.release(mark_); }
+
+  arena_scope(const arena_scope&) = delete;
+  arena_scope& operator=(const arena_scope&) = delete;
+};
+
+/** Allocator satisfying the `std::allocator` interface that bump-allocates
+ * from an `arena`, by default the arena of the thread constructing the
+ * allocator. Deallocation does nothing, memory is reclaimed when an enclosing
+ * `arena_scope` ends. Allocation and deallocation are O(1), and when the
+ * arena is reused, do not need to allocate memory from the system. Like the
+ * arena, this allocator must only be used by one thread at a time. */
+template <class T, size_t Alignment = alignof(T)>
+class arena_allocator {
+  arena* arena_;
+
+  template <class U, size_t U_A>
+  friend class arena_allocator;
+
+public:
+  using value_type = T;
+
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  template <class U>
+  struct rebind {
+    using other = arena_allocator<U, Alignment>;
+  };
+
+  arena_allocator() : arena_(&thread_arena()) {}
+  explicit arena_allocator(arena& a) : arena_(&a) {}
+  template <class U, size_t U_A>
+  arena_allocator(const arena_allocator<U, U_A>& other) noexcept : arena_(other.arena_) {}
+
+  value_type* allocate(size_t n) {
+    return reinterpret_cast<value_type*>(
+        arena_->allocate(n * sizeof(T), std::max(alignof(T), Alignment)));
+  }
+  void deallocate(value_type*, size_t) noexcept {}
+
+  /** The arena this allocator allocates from. */
+  arena& get_arena() const { return *arena_; }
+
+  template <class U, size_t U_A>
+  friend bool operator==(const arena_allocator& a, const arena_allocator<U, U_A>& b) {
+    return a.arena_ == b.arena_;
+  }
+  template <class U, size_t U_A>
+  friend bool operator!=(const arena_allocator& a, const arena_allocator<U, U_A>& b) {
+    return a.arena_ != b.arena_;
+  }
+};
+
+/** Allocator equivalent to `arena_allocator<T, Alignment>` that does not
+ * default construct values. */
+template <class T, size_t Alignment = alignof(T),
+    class = std::enable_if_t<std::is_trivial<T>::value>>
+using uninitialized_arena_allocator = uninitialized_allocator<arena_allocator<T, Alignment>>;
+
+/** The alignment in bytes of the memory allocated by an allocator `Alloc`.
+ * This is the alignment of `data()` of an `array` using this allocator. */
+template <class Alloc>
+struct allocator_alignment
+    : std::integral_constant<size_t, alignof(typename std::allocator_traits<Alloc>::value_type)> {};
+template <class T, size_t Alignment>
+struct allocator_alignment<aligned_allocator<T, Alignment>>
+    : std::integral_constant<size_t, Alignment> {};
+template <class T, size_t Alignment>
+struct allocator_alignment<arena_allocator<T, Alignment>>
+    : std::integral_constant<size_t, std::max(alignof(T), Alignment)> {};
+template <class T, size_t N, size_t Alignment, class BaseAlloc>
+struct allocator_alignment<auto_allocator<T, N, Alignment, BaseAlloc>>
+    : std::integral_constant<size_t, std::min(Alignment, allocator_alignment<BaseAlloc>::value)> {};
+template <class BaseAlloc>
+struct allocator_alignment<uninitialized_allocator<BaseAlloc>> : allocator_alignment<BaseAlloc> {};
+
+/** Make a shape with the same type as `s`, where dimension 0 is dense if its
+ * stride is unknown, and the stride of dimension 1 is padded such that the
+ * rows, the elements with the min index in dimension 0, are aligned to
+ * `Alignment` bytes relative to each other, for elements of type `T`. The
+ * default `Alignment` is the size of a cache line. Only unknown strides are
+ * replaced, the strides of dimensions 2 and greater are resolved with
+ * `shape::resolve`. Allocating an array with this shape and an allocator with
+ * `allocator_alignment` of at least `Alignment` makes every row of the array
+ * aligned. */
+template <class T, size_t Alignment = 64, class Shape>
+NDARRAY_HOST_DEVICE Shape make_row_aligned(Shape s) {
+  static_assert(Shape::rank() >= 2, "Shape must have at least 2 dimensions.");
+  static_assert(Alignment % sizeof(T) == 0, "Alignment must be a multiple of sizeof(T).");
+  auto& d0 = s.template dim<0>();
+  auto& d1 = s.template dim<1>();
+  if (internal::is_dynamic(d0.stride())) { d0.set_stride(1); }
+  if (internal::is_dynamic(d1.stride())) {
+    const index_t alignment = Alignment / sizeof(T);
+    const index_t row = std::max<index_t>(1, d0.extent() * internal::abs(d0.stride()));
+    d1.set_stride((row + alignment - 1) / alignment * alignment);
+  }
+  s.resolve();
+  return s;
+}
+
+namespace internal {
+
+// Returns true if the strides of the dimensions other than dimension 0 are a
+// multiple of `alignment` bytes.
+template <class Dims, size_t... Is>
+bool are_row_strides_aligned(const Dims& dims, index_t elem_size, index_t alignment,
+    index_sequence<Is...>) {
+  return all((Is == 0 || std::get<Is>(dims).stride() * elem_size % alignment == 0)...);
+}
+
+} // namespace internal
+
+/** Returns `true` if the rows of `a`, the elements with the min index in
+ * dimension 0, are all aligned to `Alignment` bytes. */
+template <size_t Alignment, class T, class Shape>
+bool is_aligned(const array_ref<T, Shape>& a) {
+  return reinterpret_cast<uintptr_t>(a.base()) % Alignment == 0 &&
+         internal::are_row_strides_aligned(a.shape().dims(), sizeof(T), Alignment,
+             typename Shape::dim_indices());
+}
+template <size_t Alignment, class T, class Shape, class Alloc>
+bool is_aligned(const array<T, Shape, Alloc>& a) {
+  return is_aligned<Alignment>(a.cref());
+}
+
+/** Returns `ptr`, and tells the compiler that `ptr` is aligned to `Alignment`
+ * bytes, so it can use aligned loads and stores. */
+template <size_t Alignment, class T>
+NDARRAY_INLINE T* assume_aligned(T* ptr) {
+  assert(reinterpret_cast<uintptr_t>(ptr) % Alignment == 0);
+#if defined(__GNUC__)
+  return static_cast<T*>(__builtin_assume_aligned(ptr, Alignment));
+#else
+  return ptr;
+#endif
+}
+
 } // namespace nda
 
 #endif // NDARRAY_ARRAY_H
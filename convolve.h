@@ -0,0 +1,523 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** \file convolve.h
+ * \brief Optional helpers for filtering images with separable kernels.
+ */
+#ifndef NDARRAY_CONVOLVE_H
+#define NDARRAY_CONVOLVE_H
+
+#include "array.h"
+#include "image.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace nda {
+
+/** How a filter reads the values of its input outside of the bounds of the
+ * input. */
+enum class border_mode {
+  /** The values outside of the input are zero. */
+  zero,
+  /** Indices outside of the input are clamped to the nearest edge of the
+   * input. */
+  clamp,
+  /** Indices outside of the input are reflected about the edges of the
+   * input, i.e. `min - 1` reads `min`, and `min - 2` reads `min + 1`. */
+  mirror,
+};
+
+namespace internal {
+
+// The index of `range` read by the index `i` outside of `range`, when the
+// border is clamped or mirrored.
+inline index_t border_index(index_t i, const interval<>& range, border_mode border) {
+  if (border == border_mode::mirror) {
+    const index_t period = 2 * range.extent();
+    index_t m = (i - range.min()) % period;
+    if (m < 0) { m += period; }
+    if (m >= range.extent()) { m = period - 1 - m; }
+    return range.min() + m;
+  }
+  return nda::clamp(i, range);
+}
+
+// Convert the filtered value `x` to `T`. Integer results are rounded and
+// saturated to the range of `T`.
+template <class T, class Acc>
+NDARRAY_INLINE T convert_saturate(Acc x, std::true_type) {
+  x = std::max(x, static_cast<Acc>(std::numeric_limits<T>::lowest()));
+  x = std::min(x, static_cast<Acc>(std::numeric_limits<T>::max()));
+  return static_cast<T>(std::floor(x + static_cast<Acc>(0.5)));
+}
+template <class T, class Acc>
+NDARRAY_INLINE T convert_saturate(Acc x, std::false_type) {
+  return static_cast<T>(x);
+}
+template <class T, class Acc>
+NDARRAY_INLINE T convert_saturate(Acc x) {
+  return convert_saturate<T>(x, std::is_integral<T>());
+}
+
+// The rows of an image filtered together: one channel of a planar image, or
+// all of the channels of a chunky image. The `channels` values of each pixel
+// of a row are dense, and the pixels of a row are dense.
+template <class T>
+struct image_plane {
+  // The value at (`x.min()`, `y.min()`).
+  T* base;
+  interval<> x;
+  interval<> y;
+  index_t stride_y;
+  index_t channels;
+
+  // The first value of row `at_y`.
+  T* row(index_t at_y) const { return base + (at_y - y.min()) * stride_y; }
+};
+
+// Call `fn` with each pair of planes of `in` and `out` to filter.
+template <class TIn, class TOut, class Fn>
+void for_each_plane(const planar_image_ref<TIn>& in, const planar_image_ref<TOut>& out,
+    const Fn& fn) {
+  assert(in.c().min() <= out.c().min() && out.c().max() <= in.c().max());
+  const interval<> in_x(in.x().min(), in.x().extent());
+  const interval<> in_y(in.y().min(), in.y().extent());
+  const interval<> out_x(out.x().min(), out.x().extent());
+  const interval<> out_y(out.y().min(), out.y().extent());
+  for (index_t c : out.c()) {
+    fn(image_plane<TIn>{&in(in_x.min(), in_y.min(), c), in_x, in_y, in.y().stride(), 1},
+        image_plane<TOut>{&out(out_x.min(), out_y.min(), c), out_x, out_y, out.y().stride(), 1});
+  }
+}
+template <class TIn, class TOut, index_t Channels, class Fn>
+void for_each_plane(const chunky_image_ref<TIn, Channels>& in,
+    const chunky_image_ref<TOut, Channels>& out, const Fn& fn) {
+  const index_t channels = out.c().extent();
+  assert(in.c().extent() == channels);
+  assert(in.x().stride() == channels && out.x().stride() == channels);
+  const interval<> in_x(in.x().min(), in.x().extent());
+  const interval<> in_y(in.y().min(), in.y().extent());
+  const interval<> out_x(out.x().min(), out.x().extent());
+  const interval<> out_y(out.y().min(), out.y().extent());
+  fn(image_plane<TIn>{&in(in_x.min(), in_y.min(), 0), in_x, in_y, in.y().stride(), channels},
+      image_plane<TOut>{
+          &out(out_x.min(), out_y.min(), 0), out_x, out_y, out.y().stride(), channels});
+}
+
+// The loops below are split into blocks of this many values, which the
+// compiler can vectorize without runtime checks.
+constexpr index_t filter_block = 64;
+
+// Convert `n` values from `in` to `out`.
+template <class TIn, class T>
+void convert_values(const TIn* in, T* out, index_t n) {
+  index_t i = 0;
+  for (; i + filter_block <= n; i += filter_block) {
+    T block[filter_block];
+    for (index_t j = 0; j < filter_block; j++) {
+      block[j] = in[i + j];
+    }
+    std::copy(block, block + filter_block, out + i);
+  }
+  for (; i < n; i++) {
+    out[i] = in[i];
+  }
+}
+
+// Load the pixels `xs` of row `y` of `in` to `out`, reading the pixels outside
+// of `in` according to `border`.
+template <class TIn, class T>
+void load_row(const image_plane<const TIn>& in, index_t y, const interval<>& xs,
+    border_mode border, T* out) {
+  const index_t channels = in.channels;
+  if (!in.y.is_in_range(y)) {
+    if (border == border_mode::zero) {
+      std::fill(out, out + xs.extent() * channels, static_cast<T>(0));
+      return;
+    }
+    y = border_index(y, in.y, border);
+  }
+  const TIn* row = in.row(y);
+
+  // Copy the pixels inside the input with one loop, and the pixels outside
+  // of it one at a time.
+  const index_t x0 = std::min(std::max(xs.min(), in.x.min()), xs.max() + 1);
+  const index_t x1 = std::max(std::min(xs.max(), in.x.max()) + 1, x0);
+  auto load_border = [&](index_t x) {
+    T* out_x = out + (x - xs.min()) * channels;
+    if (border == border_mode::zero) {
+      std::fill(out_x, out_x + channels, static_cast<T>(0));
+    } else {
+      const TIn* in_x = row + (border_index(x, in.x, border) - in.x.min()) * channels;
+      std::copy(in_x, in_x + channels, out_x);
+    }
+  };
+  for (index_t x = xs.min(); x < x0; x++) {
+    load_border(x);
+  }
+  convert_values(row + (x0 - in.x.min()) * channels, out + (x0 - xs.min()) * channels,
+      (x1 - x0) * channels);
+  for (index_t x = x1; x <= xs.max(); x++) {
+    load_border(x);
+  }
+}
+
+// Compute `width` values of a row filtered in x by the `taps` `weights`, from a
+// row `in` of values `stride` apart.
+template <class T>
+void filter_row(const T* in, index_t stride, const T* weights, index_t taps, T* out,
+    index_t width) {
+  index_t i = 0;
+  for (; i + filter_block <= width; i += filter_block) {
+    T sums[filter_block] = {0};
+    for (index_t k = 0; k < taps; k++) {
+      const T* in_k = in + i + k * stride;
+      const T w = weights[k];
+      for (index_t j = 0; j < filter_block; j++) {
+        sums[j] += in_k[j] * w;
+      }
+    }
+    std::copy(sums, sums + filter_block, out + i);
+  }
+  for (; i < width; i++) {
+    T sum = 0;
+    for (index_t k = 0; k < taps; k++) {
+      sum += in[i + k * stride] * weights[k];
+    }
+    out[i] = sum;
+  }
+}
+
+// Compute `width` values of a row filtered in y by the `taps` `weights`, from
+// the `rows`.
+template <class T, class TOut>
+void filter_rows(const T* const* rows, const T* weights, index_t taps, TOut* out, index_t width) {
+  index_t i = 0;
+  for (; i + filter_block <= width; i += filter_block) {
+    T sums[filter_block] = {0};
+    for (index_t k = 0; k < taps; k++) {
+      const T* row_k = rows[k] + i;
+      const T w = weights[k];
+      for (index_t j = 0; j < filter_block; j++) {
+        sums[j] += row_k[j] * w;
+      }
+    }
+    TOut* out_i = out + i;
+    for (index_t j = 0; j < filter_block; j++) {
+      out_i[j] = convert_saturate<TOut>(sums[j]);
+    }
+  }
+  for (; i < width; i++) {
+    T sum = 0;
+    for (index_t k = 0; k < taps; k++) {
+      sum += rows[k][i] * weights[k];
+    }
+    out[i] = convert_saturate<TOut>(sum);
+  }
+}
+
+// The weights of a 1D kernel, which reads the indices `taps` relative to the
+// index of each output.
+template <class T>
+struct kernel_1d {
+  static_assert(std::is_floating_point<T>::value, "The kernels must be floating point.");
+
+  std::vector<T> weights;
+  interval<> taps;
+
+  template <class K, class Shape>
+  explicit kernel_1d(const array_ref<K, Shape>& kernel)
+      : taps(kernel.x().min(), kernel.x().extent()) {
+    assert(taps.extent() > 0);
+    for (index_t i : kernel.x()) {
+      weights.push_back(kernel(i));
+    }
+  }
+};
+
+// Filter the rows `ys` of the plane `out` with the separable kernel `kx`,
+// `ky`. Each row of the input is filtered in x once, to a ring buffer of the
+// rows needed to filter the next row of the output in y.
+template <class T, class TIn, class TOut>
+void convolve_strip(const image_plane<const TIn>& in, const image_plane<TOut>& out,
+    const interval<>& ys, const kernel_1d<T>& kx, const kernel_1d<T>& ky, border_mode border) {
+  // The temporary rows of this strip reuse the memory of the previous strip
+  // computed by this thread.
+  arena_scope temps;
+  const index_t channels = out.channels;
+  const index_t width = out.x.extent() * channels;
+  const interval<> xs(out.x.min() + kx.taps.min(), out.x.extent() + kx.taps.extent() - 1);
+  std::vector<T, uninitialized_arena_allocator<T>> padded(xs.extent() * channels);
+  const index_t ring_size = ky.taps.extent();
+  std::vector<T, uninitialized_arena_allocator<T>> ring(ring_size * width);
+  std::vector<const T*, uninitialized_arena_allocator<const T*>> rows(ring_size);
+
+  const index_t first = ys.min() + ky.taps.min();
+  auto ring_row = [&](index_t y) { return &ring[((y - first) % ring_size) * width]; };
+  auto load = [&](index_t y) {
+    load_row(in, y, xs, border, padded.data());
+    filter_row(padded.data(), channels, kx.weights.data(), kx.taps.extent(), ring_row(y), width);
+  };
+  for (index_t y = first; y < first + ring_size - 1; y++) {
+    load(y);
+  }
+  for (index_t y : ys) {
+    load(y + ky.taps.max());
+    for (index_t k = 0; k < ring_size; k++) {
+      rows[k] = ring_row(y + ky.taps.min() + k);
+    }
+    filter_rows(rows.data(), ky.weights.data(), ring_size, out.row(y), width);
+  }
+}
+
+// Compute `width` values of a row filtered in x by a box of `taps` values,
+// from a row `in` of values `stride` apart, with running sums.
+template <class T>
+void box_row(const T* in, index_t stride, index_t taps, T* out, index_t width) {
+  // Split the row into segments with independent running sums, so the sums
+  // are not limited by the latency of the additions. Each segment starts with
+  // a sum of `taps` values, so the segments should be much longer than that.
+  constexpr index_t max_segments = 8;
+  const index_t segments = nda::clamp(width / (stride * taps * 4), 1, max_segments);
+  const index_t segment_width = width / (stride * segments) * stride;
+  if (segment_width <= 0) { return; }
+  for (index_t s = 0; s < segments; s++) {
+    const index_t x = s * segment_width;
+    for (index_t c = 0; c < stride; c++) {
+      T sum = 0;
+      for (index_t k = 0; k < taps; k++) {
+        sum += in[x + k * stride + c];
+      }
+      out[x + c] = sum;
+    }
+  }
+  const T* add = in + (taps - 1) * stride;
+  const T* subtract = in - stride;
+  for (index_t i = stride; i < segment_width; i++) {
+    for (index_t s = 0; s < segments; s++) {
+      const index_t x = s * segment_width + i;
+      out[x] = out[x - stride] + add[x] - subtract[x];
+    }
+  }
+  // The remainder of the last segment.
+  for (index_t x = segments * segment_width; x < width; x++) {
+    out[x] = out[x - stride] + add[x] - subtract[x];
+  }
+}
+
+// Update the running sums of the rows of a box, by adding the row `add` and
+// subtracting the row `subtract`, and store the sums multiplied by `scale` to
+// `out`.
+template <class T, class TOut>
+void box_rows(T* sums, const T* add, const T* subtract, T scale, TOut* out, index_t width) {
+  index_t i = 0;
+  for (; i + filter_block <= width; i += filter_block) {
+    T block[filter_block];
+    for (index_t j = 0; j < filter_block; j++) {
+      block[j] = sums[i + j] + add[i + j] - subtract[i + j];
+    }
+    std::copy(block, block + filter_block, sums + i);
+    TOut* out_i = out + i;
+    for (index_t j = 0; j < filter_block; j++) {
+      out_i[j] = convert_saturate<TOut>(block[j] * scale);
+    }
+  }
+  for (; i < width; i++) {
+    sums[i] += add[i] - subtract[i];
+    out[i] = convert_saturate<TOut>(sums[i] * scale);
+  }
+}
+
+// Blur the rows `ys` of the plane `out` with a box of 2 * `radius_x` + 1 by
+// 2 * `radius_y` + 1 pixels. The sums of the box in x and y are updated as the
+// box moves, so the cost per pixel is independent of the size of the box.
+template <class T, class TIn, class TOut>
+void box_blur_strip(const image_plane<const TIn>& in, const image_plane<TOut>& out,
+    const interval<>& ys, index_t radius_x, index_t radius_y, border_mode border) {
+  arena_scope temps;
+  const index_t channels = out.channels;
+  const index_t width = out.x.extent() * channels;
+  const interval<> xs(out.x.min() - radius_x, out.x.extent() + 2 * radius_x);
+  std::vector<T, uninitialized_arena_allocator<T>> padded(xs.extent() * channels);
+  // The ring holds the rows of the box, and the row that leaves the box when
+  // it moves to the next row.
+  const index_t ring_size = 2 * radius_y + 2;
+  std::vector<T, uninitialized_arena_allocator<T>> ring(ring_size * width);
+  std::vector<T, arena_allocator<T>> sums(width, 0);
+  const T scale = static_cast<T>(1) / static_cast<T>((2 * radius_x + 1) * (2 * radius_y + 1));
+
+  const index_t first = ys.min() - radius_y - 1;
+  auto ring_row = [&](index_t y) { return &ring[((y - first) % ring_size) * width]; };
+  auto load = [&](index_t y) {
+    load_row(in, y, xs, border, padded.data());
+    box_row(padded.data(), channels, 2 * radius_x + 1, ring_row(y), width);
+  };
+
+  // Start with the box of the row before the first row, with a row of zeros
+  // to subtract.
+  std::fill(ring_row(first), ring_row(first) + width, static_cast<T>(0));
+  for (index_t y = first + 1; y < ys.min() + radius_y; y++) {
+    load(y);
+    const T* row = ring_row(y);
+    for (index_t i = 0; i < width; i++) {
+      sums[i] += row[i];
+    }
+  }
+  for (index_t y : ys) {
+    load(y + radius_y);
+    box_rows(sums.data(), ring_row(y + radius_y), ring_row(y - radius_y - 1), scale, out.row(y),
+        width);
+  }
+}
+
+// The output is computed in horizontal strips of at least this many rows.
+constexpr index_t filter_strip_size = 64;
+
+// The number of rows of the strips of a filter with `taps` taps in y. Each
+// strip filters `taps` - 1 rows of the input in x that the previous strip also
+// filtered, so the strips should be much taller than the kernel.
+inline index_t strip_size(index_t taps) { return std::max(filter_strip_size, taps * 4); }
+
+// Call `fn` with the horizontal strips of `strip_size` rows of `out`.
+template <class T, class Shape, class Fn>
+void for_each_strip(const array_ref<T, Shape>& out, index_t strip_size, const Fn& fn) {
+  const interval<> ys(out.y().min(), out.y().extent());
+  for (index_t y = ys.min(); y <= ys.max(); y += strip_size) {
+    fn(interval<>(y, std::min(strip_size, ys.max() + 1 - y)));
+  }
+}
+template <class T, class Shape, class Fn>
+void for_each_strip(
+    const parallel_policy& policy, const array_ref<T, Shape>& out, index_t strip_size, const Fn& fn) {
+  const interval<> ys(out.y().min(), out.y().extent());
+  const index_t strips = (ys.extent() + strip_size - 1) / strip_size;
+  parallel_for(policy, interval<>(0, strips), [&](const interval<>& strip_range) {
+    for (index_t i : strip_range) {
+      const index_t y = ys.min() + i * strip_size;
+      fn(interval<>(y, std::min(strip_size, ys.max() + 1 - y)));
+    }
+  });
+}
+
+template <class KX, class KY>
+using convolve_type = std::common_type_t<std::remove_const_t<KX>, std::remove_const_t<KY>>;
+
+template <class TIn, class TOut>
+using box_blur_type = std::common_type_t<float, std::remove_const_t<TIn>, TOut>;
+
+// Filter the rows `ys` of each plane of `out`.
+template <class T, class TIn, class TOut, class ShapeIn, class ShapeOut>
+void convolve_strip(const array_ref<TIn, ShapeIn>& in, const array_ref<TOut, ShapeOut>& out,
+    const interval<>& ys, const kernel_1d<T>& kx, const kernel_1d<T>& ky, border_mode border) {
+  assert(!in.empty());
+  for_each_plane(in.cref(), out, [&](const auto& in_plane, const auto& out_plane) {
+    convolve_strip(in_plane, out_plane, ys, kx, ky, border);
+  });
+}
+template <class T, class TIn, class TOut, class ShapeIn, class ShapeOut>
+void box_blur_strip(const array_ref<TIn, ShapeIn>& in, const array_ref<TOut, ShapeOut>& out,
+    const interval<>& ys, index_t radius_x, index_t radius_y, border_mode border) {
+  assert(!in.empty());
+  for_each_plane(in.cref(), out, [&](const auto& in_plane, const auto& out_plane) {
+    box_blur_strip<T>(in_plane, out_plane, ys, radius_x, radius_y, border);
+  });
+}
+
+} // namespace internal
+
+/** Filter the planar or chunky image `in` with the separable kernel
+ * `kernel_x`, `kernel_y` to produce the image `out` of the same kind:
+ *
+ * `out(x, y, c) = sum(kernel_x(i) * kernel_y(j) * in(x + i, y + j, c))`
+ *
+ * where `i` and `j` are the indices of the kernels, which may be negative,
+ * e.g. a kernel with indices [-2, 2] is centered on each output pixel. The
+ * values of `in` outside of its bounds are read according to `border`. The
+ * kernels must be floating point, and the result is computed in the type of
+ * the kernels. Integer results are rounded and saturated.
+ *
+ * The output is computed in horizontal strips. Each row of the input needed by
+ * a strip is filtered in x once, to a ring buffer of the rows needed to filter
+ * the next row of the output in y, so no temporary image the size of the
+ * input is allocated. */
+template <class TIn, class TOut, class ShapeIn, class ShapeOut, class KX, class ShapeKX, class KY,
+    class ShapeKY>
+void convolve_separable(const array_ref<TIn, ShapeIn>& in, const array_ref<TOut, ShapeOut>& out,
+    const array_ref<KX, ShapeKX>& kernel_x, const array_ref<KY, ShapeKY>& kernel_y,
+    border_mode border = border_mode::clamp) {
+  using T = internal::convolve_type<KX, KY>;
+  const internal::kernel_1d<T> kx(kernel_x);
+  const internal::kernel_1d<T> ky(kernel_y);
+  const index_t strip_size = internal::strip_size(ky.taps.extent());
+  internal::for_each_strip(out, strip_size, [&](const interval<>& ys) {
+    internal::convolve_strip(in, out, ys, kx, ky, border);
+  });
+}
+
+/** Filter the image `in` to produce the image `out` as above, computing the
+ * horizontal strips of the output in parallel using `policy`. Each thread
+ * allocates the ring buffers of its strips from its own `thread_arena`. */
+template <class TIn, class TOut, class ShapeIn, class ShapeOut, class KX, class ShapeKX, class KY,
+    class ShapeKY>
+void convolve_separable(const parallel_policy& policy, const array_ref<TIn, ShapeIn>& in,
+    const array_ref<TOut, ShapeOut>& out, const array_ref<KX, ShapeKX>& kernel_x,
+    const array_ref<KY, ShapeKY>& kernel_y, border_mode border = border_mode::clamp) {
+  using T = internal::convolve_type<KX, KY>;
+  const internal::kernel_1d<T> kx(kernel_x);
+  const internal::kernel_1d<T> ky(kernel_y);
+  const index_t strip_size = internal::strip_size(ky.taps.extent());
+  internal::for_each_strip(policy, out, strip_size, [&](const interval<>& ys) {
+    internal::convolve_strip(in, out, ys, kx, ky, border);
+  });
+}
+
+/** Blur the planar or chunky image `in` to produce the image `out` of the
+ * same kind, with the mean of a box of (2 * `radius_x` + 1) x
+ * (2 * `radius_y` + 1) pixels centered on each output pixel. The values of
+ * `in` outside of its bounds are read according to `border`. The sums of the
+ * box are updated as the box moves, so the cost per pixel is independent of
+ * the radius. Integer results are rounded and saturated. */
+template <class TIn, class TOut, class ShapeIn, class ShapeOut>
+void box_blur(const array_ref<TIn, ShapeIn>& in, const array_ref<TOut, ShapeOut>& out,
+    index_t radius_x, index_t radius_y, border_mode border = border_mode::clamp) {
+  using T = internal::box_blur_type<TIn, TOut>;
+  assert(radius_x >= 0 && radius_y >= 0);
+  const index_t strip_size = internal::strip_size(2 * radius_y + 1);
+  internal::for_each_strip(out, strip_size, [&](const interval<>& ys) {
+    internal::box_blur_strip<T>(in, out, ys, radius_x, radius_y, border);
+  });
+}
+
+/** Blur the image `in` to produce the image `out` as above, computing the
+ * horizontal strips of the output in parallel using `policy`. */
+template <class TIn, class TOut, class ShapeIn, class ShapeOut>
+void box_blur(const parallel_policy& policy, const array_ref<TIn, ShapeIn>& in,
+    const array_ref<TOut, ShapeOut>& out, index_t radius_x, index_t radius_y,
+    border_mode border = border_mode::clamp) {
+  using T = internal::box_blur_type<TIn, TOut>;
+  assert(radius_x >= 0 && radius_y >= 0);
+  const index_t strip_size = internal::strip_size(2 * radius_y + 1);
+  internal::for_each_strip(policy, out, strip_size, [&](const interval<>& ys) {
+    internal::box_blur_strip<T>(in, out, ys, radius_x, radius_y, border);
+  });
+}
+
+} // namespace nda
+
+#endif // NDARRAY_CONVOLVE_H
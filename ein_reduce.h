@@ -20,11 +20,199 @@
 #define NDARRAY_EIN_REDUCE_H
 
 #include "array.h"
+#include "gemm.h"
+#include "parallel.h"
 
 namespace nda {
 
 namespace internal {
 
+// Make an index with all of its elements equal to the largest index.
+template <class Index, size_t... Is>
+Index max_index(index_sequence<Is...>) {
+  return Index((static_cast<void>(Is), std::numeric_limits<index_t>::max())...);
+}
+template <class Index>
+Index max_index() {
+  return max_index<Index>(make_index_sequence<std::tuple_size<Index>::value>());
+}
+
+} // namespace internal
+
+/** Reducers describe how `reduce_assign` and `make_ein_reduce` reduce
+ * values into a result. A reducer provides:
+ * - `result_type<T, Index>`, the type of the result when reducing values of
+ *   type `T` with reduction indices of type `Index`.
+ * - `identity<T>()`, the initial value of a result of type `T`.
+ * - `reduce(acc, x, i)`, reducing the value `x` at the reduction index `i`
+ *   into `acc`.
+ * - `combine(acc, other)`, combining two partial results of the reduction.
+ *   The reduction may be computed by combining partial results of disjoint
+ *   subsets of the reduction. */
+struct sum_reducer {
+  template <class T, class Index>
+  using result_type = T;
+  template <class T>
+  static T identity() {
+    return static_cast<T>(0);
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index&) {
+    acc += x;
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    acc += other;
+  }
+};
+
+/** Computes the product of the values. */
+struct product_reducer {
+  template <class T, class Index>
+  using result_type = T;
+  template <class T>
+  static T identity() {
+    return static_cast<T>(1);
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index&) {
+    acc *= x;
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    acc *= other;
+  }
+};
+
+/** Computes the maximum of the values. */
+struct max_reducer {
+  template <class T, class Index>
+  using result_type = T;
+  template <class T>
+  static T identity() {
+    return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                                : std::numeric_limits<T>::lowest();
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index&) {
+    acc = acc < x ? static_cast<T>(x) : acc;
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    acc = acc < other ? other : acc;
+  }
+};
+
+/** Computes the minimum of the values. */
+struct min_reducer {
+  template <class T, class Index>
+  using result_type = T;
+  template <class T>
+  static T identity() {
+    return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+                                                : std::numeric_limits<T>::max();
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index&) {
+    acc = x < acc ? static_cast<T>(x) : acc;
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    acc = other < acc ? other : acc;
+  }
+};
+
+/** Computes whether any of the values are true. */
+struct any_reducer {
+  template <class T, class Index>
+  using result_type = T;
+  template <class T>
+  static T identity() {
+    return static_cast<T>(false);
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index&) {
+    acc = acc || x;
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    acc = acc || other;
+  }
+};
+
+/** Computes whether all of the values are true. */
+struct all_reducer {
+  template <class T, class Index>
+  using result_type = T;
+  template <class T>
+  static T identity() {
+    return static_cast<T>(true);
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index&) {
+    acc = acc && x;
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    acc = acc && other;
+  }
+};
+
+/** Computes the maximum of the values, and the reduction index at which
+ * the maximum occurs. The result is a `std::pair` of the value and the
+ * index. If the maximum occurs more than once, the index is the least of
+ * the indices, comparing them as `std::tuple`s. This does not depend on the
+ * order in which the reduction is computed. */
+struct argmax_reducer {
+  template <class T, class Index>
+  using result_type = std::pair<T, Index>;
+  template <class T>
+  static T identity() {
+    return T(max_reducer::identity<typename T::first_type>(),
+        internal::max_index<typename T::second_type>());
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index& i) {
+    if (acc.first < x || (acc.first == x && i < acc.second)) {
+      acc.first = x;
+      acc.second = i;
+    }
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    if (acc.first < other.first || (acc.first == other.first && other.second < acc.second)) {
+      acc = other;
+    }
+  }
+};
+
+/** Computes the minimum of the values, and the reduction index at which
+ * the minimum occurs. See `argmax_reducer` for more details. */
+struct argmin_reducer {
+  template <class T, class Index>
+  using result_type = std::pair<T, Index>;
+  template <class T>
+  static T identity() {
+    return T(min_reducer::identity<typename T::first_type>(),
+        internal::max_index<typename T::second_type>());
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index& i) {
+    if (x < acc.first || (acc.first == x && i < acc.second)) {
+      acc.first = x;
+      acc.second = i;
+    }
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    if (other.first < acc.first || (acc.first == other.first && other.second < acc.second)) {
+      acc = other;
+    }
+  }
+};
+
+namespace internal {
+
 // TODO: Find a way to enable operations with non-op types? e.g. scalars.
 template <class T>
 using enable_if_ein_op =
@@ -197,6 +385,24 @@ NDARRAY_MAKE_EIN_BINARY_OP(ein_op_mul_assign, *=, std::true_type);
 #undef NDARRAY_MAKE_EIN_BINARY_OP
 #undef NDARRAY_MAKE_EIN_BINARY_HELPERS
 
+// An assignment that reduces the right hand side into the result with `Reducer`.
+template <class Reducer, class OpA, class OpB>
+struct ein_op_reduce_assign
+    : public ein_binary_op<OpA, OpB, ein_op_reduce_assign<Reducer, OpA, OpB>> {
+  using base = ein_binary_op<OpA, OpB, ein_op_reduce_assign>;
+  ein_op_reduce_assign(const OpA& a, const OpB& b) : base(a, b) {}
+  using is_assign = std::true_type;
+  template <class Idx>
+  NDARRAY_INLINE void operator()(const Idx& i) const {
+    Reducer::reduce(base::op_a(i), base::op_b(i), i);
+  }
+};
+
+template <class Reducer, class OpA, class OpB>
+auto make_ein_op_reduce_assign(const OpA& a, const OpB& b) {
+  return ein_op_reduce_assign<Reducer, OpA, OpB>(a, b);
+}
+
 } // namespace internal
 
 /** Cast an Einstein summation operand to a different type `Type`.
@@ -216,6 +422,28 @@ auto max(const internal::ein_op_base<OpA>& a, const internal::ein_op_base<OpB>&
   return internal::make_ein_op_max(a.derived(), b.derived());
 }
 
+/** Reduce the Einstein summation operand `x` into the result operand
+ * `result` with `Reducer`, e.g. `max_reducer`. The result of `ein_reduce`
+ * of the returned expression is `result(i) = reduce(result(i), x(i))` for
+ * each index `i` of the reduction, where `reduce` is `Reducer::reduce`.
+ * As with `+=`, the result should be initialized, typically with
+ * `Reducer::identity<T>()`. */
+template <class Reducer, class Op, size_t... Is, class OpB>
+auto reduce_assign(const internal::ein_op<Op, Is...>& result, const internal::ein_op_base<OpB>& x) {
+  return internal::make_ein_op_reduce_assign<Reducer>(result, x.derived());
+}
+
+/** Reduce the max or min of an Einstein summation operand `x` into the result
+ * operand `result`. See `reduce_assign` for more details. */
+template <class Op, size_t... Is, class OpB>
+auto max_assign(const internal::ein_op<Op, Is...>& result, const internal::ein_op_base<OpB>& x) {
+  return reduce_assign<max_reducer>(result, x);
+}
+template <class Op, size_t... Is, class OpB>
+auto min_assign(const internal::ein_op<Op, Is...>& result, const internal::ein_op_base<OpB>& x) {
+  return reduce_assign<min_reducer>(result, x);
+}
+
 namespace internal {
 
 // Let these be found via ADL too.
@@ -275,6 +503,12 @@ template <index_t NewStride, index_t Min, index_t Extent, index_t Stride>
 NDARRAY_INLINE auto with_stride(const dim<Min, Extent, Stride>& d) {
   return dim<Min, Extent, NewStride>(d.min(), d.extent());
 }
+// Intervals (the dims of shapes without strides, e.g. morton shapes) become
+// dims with the new stride.
+template <index_t NewStride, index_t Min, index_t Extent>
+NDARRAY_INLINE auto with_stride(const interval<Min, Extent>& d) {
+  return dim<Min, Extent, NewStride>(d.min(), d.extent());
+}
 template <index_t NewStride, class Dim>
 NDARRAY_INLINE auto with_stride(const std::tuple<Dim>& maybe_dim) {
   return std::make_tuple(with_stride<NewStride>(std::get<0>(maybe_dim)));
@@ -284,6 +518,22 @@ NDARRAY_INLINE std::tuple<> with_stride(std::tuple<> maybe_dim) {
   return maybe_dim;
 }
 
+// Dims of the result keep their strides. Intervals of the result become dims
+// with an unknown (but not zero) stride, because they address the result.
+template <class Dim>
+NDARRAY_INLINE const Dim& as_result_dim(const Dim& d) {
+  return d;
+}
+template <index_t Min, index_t Extent>
+NDARRAY_INLINE dim<Min, Extent> as_result_dim(const interval<Min, Extent>& d) {
+  return dim<Min, Extent>(d.min(), d.extent());
+}
+template <class Dim>
+NDARRAY_INLINE auto as_result_dim(const std::tuple<Dim>& maybe_dim) {
+  return std::make_tuple(as_result_dim(std::get<0>(maybe_dim)));
+}
+NDARRAY_INLINE std::tuple<> as_result_dim(std::tuple<> maybe_dim) { return maybe_dim; }
+
 // These types are flags that let us overload behavior based on these 3 options.
 class is_inferred_shape {};
 class is_result_shape {};
@@ -293,7 +543,7 @@ class is_operand_shape {};
 template <size_t Dim, class Dims, size_t... Is>
 NDARRAY_INLINE auto gather_dims(is_result_shape, const ein_op<Dims, Is...>& op) {
   // If this is part of the result, we want to keep its strides.
-  return get_or_empty<index_of<Dim, Is...>()>(dims_of(op.op));
+  return as_result_dim(get_or_empty<index_of<Dim, Is...>()>(dims_of(op.op)));
 }
 template <size_t Dim, class Dims, size_t... Is>
 NDARRAY_INLINE auto gather_dims(is_inferred_shape, const ein_op<Dims, Is...>& op) {
@@ -370,6 +620,489 @@ auto ein(T (&x)[N]) {
   return ein<I0>(make_array_ref(&x[0], shape<dim<0, N, 1>>()));
 }
 
+namespace internal {
+
+constexpr size_t no_index = std::numeric_limits<size_t>::max();
+
+// Find the summation index of a matrix product `C(c0, c1) += A(a0, a1) * B(b0, b1)`,
+// or `no_index` if the expression is not a matrix product. A matrix product
+// has one index shared by A and B that is not an index of C, and the other
+// index of each of A and B is a different index of C.
+constexpr size_t ein_gemm_k(size_t c0, size_t c1, size_t a0, size_t a1, size_t b0, size_t b1) {
+  if (c0 == c1 || a0 == a1 || b0 == b1) { return no_index; }
+  const size_t k = (a0 == b0 || a0 == b1) ? a0 : ((a1 == b0 || a1 == b1) ? a1 : no_index);
+  if (k == no_index || k == c0 || k == c1) { return no_index; }
+  const size_t a_other = a0 == k ? a1 : a0;
+  const size_t b_other = b0 == k ? b1 : b0;
+  const bool match = (a_other == c0 && b_other == c1) || (a_other == c1 && b_other == c0);
+  return match ? k : no_index;
+}
+
+// Find the summation index of a matrix-vector product `y(c0) += A(a0, a1) * x(b0)`.
+constexpr size_t ein_gemv_k(size_t c0, size_t a0, size_t a1, size_t b0) {
+  if (a0 == a1 || b0 == c0) { return no_index; }
+  return (a0 == c0 && a1 == b0) || (a1 == c0 && a0 == b0) ? b0 : no_index;
+}
+
+// Check if the operands of types `Ts...` can be computed with `gemm` or
+// `gemv` producing a result of type `T`.
+template <class T, class... Ts>
+constexpr bool is_blas_type() {
+  return std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+         all(std::is_same<typename std::remove_const<Ts>::type, T>::value...);
+}
+
+// `gemm` and `gemv` address their operands with one stride per dimension,
+// which is only possible for affine shapes. Other shapes (e.g. tiled or
+// morton shapes) use the loop nest.
+template <class... Shapes>
+constexpr bool is_blas_shape() {
+  return all(is_affine_shape<Shapes>::value...);
+}
+
+// The stride of the dimension of `op` addressed by the reduction index `I`.
+template <size_t I, class T, class Shape, size_t... Is>
+index_t ein_stride(const ein_op<array_ref<T, Shape>, Is...>& op) {
+  return op.op.shape().template dim<index_of<I, Is...>()>().stride();
+}
+
+// A pointer to the element of `op` at the min of the reduction shape.
+template <class T, class Shape, size_t... Is, class Mins>
+T* ein_base(const ein_op<array_ref<T, Shape>, Is...>& op, const Mins& mins) {
+  return &op.op(std::get<Is>(mins)...);
+}
+
+// Most expressions are not matrix products.
+template <class Expr, class Shape>
+bool ein_reduce_blas(const Expr&, const Shape&) {
+  return false;
+}
+
+// Compute `C(c0, c1) += A(c0, k) * B(k, c1)` with `gemm`, where the indices of
+// each operand may be in any order. The last parameter indicates whether `a`
+// provides the rows of the result, if not, the operands are swapped.
+template <size_t C0, size_t C1, size_t K, class C, class A, class B, class Shape>
+void ein_gemm(const C& c, const A& a, const B& b, const Shape& reduction_shape, std::true_type) {
+  const auto mins = reduction_shape.min();
+  gemm(reduction_shape.template dim<C0>().extent(), reduction_shape.template dim<C1>().extent(),
+      reduction_shape.template dim<K>().extent(), ein_base(a, mins), ein_stride<C0>(a),
+      ein_stride<K>(a), ein_base(b, mins), ein_stride<K>(b), ein_stride<C1>(b), ein_base(c, mins),
+      ein_stride<C0>(c), ein_stride<C1>(c), true);
+}
+template <size_t C0, size_t C1, size_t K, class C, class A, class B, class Shape>
+void ein_gemm(const C& c, const A& a, const B& b, const Shape& reduction_shape, std::false_type) {
+  ein_gemm<C0, C1, K>(c, b, a, reduction_shape, std::true_type());
+}
+
+// Matrix products `C(i, j) += A(i, k) * B(k, j)`, with any permutation of the
+// indices of each operand, are computed with `gemm`.
+template <class TC, class ShapeC, size_t C0, size_t C1, class TA, class ShapeA, size_t A0,
+    size_t A1, class TB, class ShapeB, size_t B0, size_t B1, class Shape,
+    size_t K = ein_gemm_k(C0, C1, A0, A1, B0, B1),
+    class = std::enable_if_t<K != no_index && is_blas_type<TC, TA, TB>() &&
+                             is_blas_shape<ShapeC, ShapeA, ShapeB>()>>
+bool ein_reduce_blas(const ein_op_add_assign<ein_op<array_ref<TC, ShapeC>, C0, C1>,
+                         ein_op_mul<ein_op<array_ref<TA, ShapeA>, A0, A1>,
+                             ein_op<array_ref<TB, ShapeB>, B0, B1>>>& expr,
+    const Shape& reduction_shape) {
+  const auto& c = expr.op_a;
+  if (ein_stride<C0>(c) == 0 || ein_stride<C1>(c) == 0) { return false; }
+  if (reduction_shape.empty()) { return true; }
+
+  ein_gemm<C0, C1, K>(c, expr.op_b.op_a, expr.op_b.op_b, reduction_shape,
+      std::integral_constant<bool, A0 == C0 || A1 == C0>());
+  return true;
+}
+
+// Matrix-vector products `y(i) += A(i, j) * x(j)` are computed with `gemv`.
+template <class TY, class ShapeY, size_t C0, class TA, class ShapeA, size_t A0, size_t A1,
+    class TX, class ShapeX, size_t B0, class Shape>
+bool ein_gemv(const ein_op<array_ref<TY, ShapeY>, C0>& y,
+    const ein_op<array_ref<TA, ShapeA>, A0, A1>& a, const ein_op<array_ref<TX, ShapeX>, B0>& x,
+    const Shape& reduction_shape) {
+  constexpr size_t K = ein_gemv_k(C0, A0, A1, B0);
+  if (ein_stride<C0>(y) == 0) { return false; }
+  if (reduction_shape.empty()) { return true; }
+
+  const auto mins = reduction_shape.min();
+  gemv(reduction_shape.template dim<C0>().extent(), reduction_shape.template dim<K>().extent(),
+      ein_base(a, mins), ein_stride<C0>(a), ein_stride<K>(a), ein_base(x, mins),
+      ein_stride<K>(x), ein_base(y, mins), ein_stride<C0>(y), true);
+  return true;
+}
+template <class TY, class ShapeY, size_t C0, class TA, class ShapeA, size_t A0, size_t A1,
+    class TX, class ShapeX, size_t B0, class Shape,
+    class = std::enable_if_t<ein_gemv_k(C0, A0, A1, B0) != no_index &&
+                             is_blas_type<TY, TA, TX>() && is_blas_shape<ShapeY, ShapeA, ShapeX>()>>
+bool ein_reduce_blas(const ein_op_add_assign<ein_op<array_ref<TY, ShapeY>, C0>,
+                         ein_op_mul<ein_op<array_ref<TA, ShapeA>, A0, A1>,
+                             ein_op<array_ref<TX, ShapeX>, B0>>>& expr,
+    const Shape& reduction_shape) {
+  return ein_gemv(expr.op_a, expr.op_b.op_a, expr.op_b.op_b, reduction_shape);
+}
+template <class TY, class ShapeY, size_t C0, class TA, class ShapeA, size_t A0, size_t A1,
+    class TX, class ShapeX, size_t B0, class Shape,
+    class = std::enable_if_t<ein_gemv_k(C0, A0, A1, B0) != no_index &&
+                             is_blas_type<TY, TA, TX>() && is_blas_shape<ShapeY, ShapeA, ShapeX>()>>
+bool ein_reduce_blas(const ein_op_add_assign<ein_op<array_ref<TY, ShapeY>, C0>,
+                         ein_op_mul<ein_op<array_ref<TX, ShapeX>, B0>,
+                             ein_op<array_ref<TA, ShapeA>, A0, A1>>>& expr,
+    const Shape& reduction_shape) {
+  return ein_gemv(expr.op_a, expr.op_b.op_b, expr.op_b.op_a, reduction_shape);
+}
+
+// Replace dim `D` of the tuple of dims `dims` with `new_dim`.
+template <size_t D, class Dims, class NewDim, size_t... Is>
+auto replace_dim(const Dims& dims, const NewDim& new_dim, index_sequence<Is...>) {
+  return std::make_tuple(std::get<Is == D ? 1 : 0>(std::tie(std::get<Is>(dims), new_dim))...);
+}
+
+// Intervals (the dims of shapes without strides, e.g. morton shapes) are
+// never dense.
+template <index_t Min, index_t Extent>
+constexpr bool is_dense_dim(const interval<Min, Extent>*) {
+  return false;
+}
+template <index_t Min, index_t Extent, index_t Stride>
+constexpr bool is_dense_dim(const dim<Min, Extent, Stride>*) {
+  return Stride == 1;
+}
+template <class Dim>
+constexpr bool is_dense_dim() {
+  return is_dense_dim(static_cast<const Dim*>(nullptr));
+}
+
+// The number of dimensions of an operand addressed by the reduction index `I`
+// that have (if `Dense`) or do not have (if `!Dense`) a compile-time stride of
+// 1. Operands that are not arrays do not have any dimensions.
+template <size_t I, bool Dense, class Shape, size_t... Is, size_t... Ds>
+constexpr index_t ein_count_dims(index_sequence<Is...>, index_sequence<Ds...>) {
+  using Dims = typename Shape::dims_type;
+  return sum((Is == I && is_dense_dim<std::tuple_element_t<Ds, Dims>>() == Dense ? 1 : 0)...);
+}
+// These overloads take a null pointer to the expression, so they can be
+// evaluated at compile time.
+template <size_t I, bool Dense, class Op, size_t... Is>
+constexpr index_t ein_count_dims(const ein_op<Op, Is...>*) {
+  return 0;
+}
+template <size_t I, bool Dense, class T, class Shape, size_t... Is>
+constexpr index_t ein_count_dims(const ein_op<array_ref<T, Shape>, Is...>*) {
+  return ein_count_dims<I, Dense, Shape>(
+      index_sequence<Is...>(), make_index_sequence<sizeof...(Is)>());
+}
+template <size_t I, bool Dense, class Op, class Derived>
+constexpr index_t ein_count_dims(const ein_unary_op<Op, Derived>*) {
+  return ein_count_dims<I, Dense>(static_cast<const Op*>(nullptr));
+}
+template <size_t I, bool Dense, class OpA, class OpB, class Derived>
+constexpr index_t ein_count_dims(const ein_binary_op<OpA, OpB, Derived>*) {
+  return ein_count_dims<I, Dense>(static_cast<const OpA*>(nullptr)) +
+         ein_count_dims<I, Dense>(static_cast<const OpB*>(nullptr));
+}
+
+// Find the best innermost loop of a reduction `Expr`. This is the index that
+// addresses the most dimensions with a compile-time stride of 1, counting the
+// operands twice as much as the result. Ties are broken by choosing the
+// lowest index, so the order of the indices is respected when no other
+// index is better.
+template <class Expr, size_t... Is>
+constexpr size_t ein_innermost_index(index_sequence<Is...>) {
+  using OpA = decltype(Expr::op_a);
+  using OpB = decltype(Expr::op_b);
+  // The extra element avoids an empty array for rank 0 reductions.
+  const index_t scores[] = {(ein_count_dims<Is, true>(static_cast<const OpA*>(nullptr)) +
+                             2 * ein_count_dims<Is, true>(static_cast<const OpB*>(nullptr)))...,
+      0};
+  size_t best = 0;
+  for (size_t i = 1; i < sizeof...(Is); i++) {
+    if (scores[i] > scores[best]) { best = i; }
+  }
+  return best;
+}
+
+// Check if the result `ein_op<Op, Is...>` uses the reduction index `I`.
+template <size_t I, class Op, size_t... Is>
+constexpr bool ein_uses_index(const ein_op<Op, Is...>*) {
+  return any((Is == I)...);
+}
+
+// Check if any array operand of `op` overlaps the memory of the result
+// `result`. Operands that are not arrays are assumed to not read the result.
+template <class T, class ShapeT, class Op, size_t... Is>
+bool ein_may_alias(const array_ref<T, ShapeT>&, const ein_op<Op, Is...>&) {
+  return false;
+}
+template <class T, class ShapeT, class U, class ShapeU, size_t... Is>
+bool ein_may_alias(
+    const array_ref<T, ShapeT>& result, const ein_op<array_ref<U, ShapeU>, Is...>& op) {
+  using V = typename std::remove_const<U>::type;
+  if (!std::is_same<T, V>::value || result.empty() || op.op.empty()) { return false; }
+  const T* result_begin = result.data();
+  const T* result_end = result_begin + (result.shape().flat_max() - result.shape().flat_min());
+  const V* op_begin = op.op.data();
+  const V* op_end = op_begin + (op.op.shape().flat_max() - op.op.shape().flat_min());
+  std::less_equal<const void*> le;
+  return le(result_begin, op_end) && le(op_begin, result_end);
+}
+template <class T, class ShapeT, class Op, class Derived>
+bool ein_may_alias(const array_ref<T, ShapeT>& result, const ein_unary_op<Op, Derived>& op) {
+  return ein_may_alias(result, op.op);
+}
+template <class T, class ShapeT, class OpA, class OpB, class Derived>
+bool ein_may_alias(const array_ref<T, ShapeT>& result, const ein_binary_op<OpA, OpB, Derived>& op) {
+  return ein_may_alias(result, op.op_a) || ein_may_alias(result, op.op_b);
+}
+
+// Check if the result of a reduction may alias any operand in `op`.
+template <class Result, size_t... Is, class Op>
+bool ein_result_may_alias(const ein_op<Result, Is...>&, const Op&) {
+  // We can't tell if a result that is not an array aliases the operands.
+  return true;
+}
+template <class T, class Shape, size_t... Is, class Op>
+bool ein_result_may_alias(const ein_op<array_ref<T, Shape>, Is...>& result, const Op& op) {
+  return ein_may_alias(result.op, op);
+}
+
+// Accumulate a value `x` at the reduction index `i` of the right hand side of
+// an assignment `expr` into the local accumulator `acc`.
+template <class OpA, class OpB, class T, class U, class Idx>
+NDARRAY_INLINE void ein_reduce_accumulate(
+    const ein_op_assign<OpA, OpB>&, T& acc, const U& x, const Idx&) {
+  acc = x;
+}
+template <class OpA, class OpB, class T, class U, class Idx>
+NDARRAY_INLINE void ein_reduce_accumulate(
+    const ein_op_add_assign<OpA, OpB>&, T& acc, const U& x, const Idx&) {
+  acc += x;
+}
+template <class OpA, class OpB, class T, class U, class Idx>
+NDARRAY_INLINE void ein_reduce_accumulate(
+    const ein_op_sub_assign<OpA, OpB>&, T& acc, const U& x, const Idx&) {
+  acc -= x;
+}
+template <class OpA, class OpB, class T, class U, class Idx>
+NDARRAY_INLINE void ein_reduce_accumulate(
+    const ein_op_mul_assign<OpA, OpB>&, T& acc, const U& x, const Idx&) {
+  acc *= x;
+}
+template <class Reducer, class OpA, class OpB, class T, class U, class Idx>
+NDARRAY_INLINE void ein_reduce_accumulate(
+    const ein_op_reduce_assign<Reducer, OpA, OpB>&, T& acc, const U& x, const Idx& i) {
+  Reducer::reduce(acc, x, i);
+}
+
+// `-=` accumulates the partial results by subtraction, and adds the partial
+// results to the result.
+struct difference_reducer {
+  template <class T>
+  static T identity() {
+    return static_cast<T>(0);
+  }
+  template <class T, class U, class Index>
+  NDARRAY_INLINE static void reduce(T& acc, const U& x, const Index&) {
+    acc -= x;
+  }
+  template <class T>
+  NDARRAY_INLINE static void combine(T& acc, const T& other) {
+    acc += other;
+  }
+};
+
+// The reducer of an assignment that can be computed with partial results, or
+// void if the assignment can't be computed this way.
+template <class Expr>
+struct ein_reducer {
+  using type = void;
+};
+template <class OpA, class OpB>
+struct ein_reducer<ein_op_add_assign<OpA, OpB>> {
+  using type = sum_reducer;
+};
+template <class OpA, class OpB>
+struct ein_reducer<ein_op_sub_assign<OpA, OpB>> {
+  using type = difference_reducer;
+};
+template <class OpA, class OpB>
+struct ein_reducer<ein_op_mul_assign<OpA, OpB>> {
+  using type = product_reducer;
+};
+template <class Reducer, class OpA, class OpB>
+struct ein_reducer<ein_op_reduce_assign<Reducer, OpA, OpB>> {
+  using type = Reducer;
+};
+
+// The number of iterations of the innermost loop in each chunk, when the
+// innermost loop is split into chunks.
+constexpr index_t ein_inner_chunk = 16;
+
+// Call `fn(k)` for each `k` in the innermost loop `inner`.
+template <class Dim, class Fn>
+NDARRAY_INLINE void ein_for_each_inner(const Dim& inner, const Fn& fn, std::false_type) {
+  for (index_t k : inner) {
+    fn(k);
+  }
+}
+// This version splits the loop into chunks with a constant number of
+// iterations, which compilers vectorize more readily than loops with a
+// dynamic number of iterations.
+template <class Dim, class Fn>
+NDARRAY_INLINE void ein_for_each_inner(const Dim& inner, const Fn& fn, std::true_type) {
+  const index_t end = inner.min() + inner.extent();
+  index_t k = inner.min();
+  for (; k + ein_inner_chunk <= end; k += ein_inner_chunk) {
+    for (index_t c = 0; c < ein_inner_chunk; c++) {
+      fn(k + c);
+    }
+  }
+  for (; k < end; k++) {
+    fn(k);
+  }
+}
+
+// Evaluate `expr` for each index of the innermost loop `Inner`, where `i` is
+// the index of the outer loops.
+template <size_t Inner, class Dim, class Expr, class Idx, class Chunked>
+NDARRAY_INLINE void ein_reduce_inner(const Dim& inner, const Expr& expr, Idx& i, Chunked chunked) {
+  ein_for_each_inner(inner, [&](index_t k) {
+    std::get<Inner>(i) = k;
+    expr(i);
+  }, chunked);
+}
+
+// If the result is not addressed by the innermost loop, the result is loaded
+// once into a local accumulator, instead of once per iteration.
+template <size_t Inner, class Dim, class Expr, class Idx, class Chunked>
+NDARRAY_INLINE void ein_reduce_inner_hoisted(
+    const Dim& inner, const Expr& expr, Idx& i, Chunked chunked, std::false_type) {
+  auto& result = expr.op_a(i);
+  auto acc = result;
+  ein_for_each_inner(inner, [&](index_t k) {
+    std::get<Inner>(i) = k;
+    ein_reduce_accumulate(expr, acc, expr.op_b(i), i);
+  }, chunked);
+  result = acc;
+}
+
+// If the assignment has a reducer, each iteration of a chunk accumulates to a
+// separate partial result. This breaks the dependency chain through the
+// accumulator, and the partial results of a chunk can be held in vector
+// registers when the operands are dense.
+template <size_t Inner, class Dim, class Expr, class Idx, class Chunked>
+NDARRAY_INLINE void ein_reduce_inner_hoisted(
+    const Dim& inner, const Expr& expr, Idx& i, Chunked, std::true_type) {
+  using Reducer = typename ein_reducer<Expr>::type;
+  auto& result = expr.op_a(i);
+  using T = typename std::decay<decltype(result)>::type;
+  T acc = result;
+  const index_t end = inner.min() + inner.extent();
+  index_t k = inner.min();
+  if (k + ein_inner_chunk <= end) {
+    T partials[ein_inner_chunk];
+    for (index_t c = 0; c < ein_inner_chunk; c++) {
+      partials[c] = Reducer::template identity<T>();
+    }
+    for (; k + ein_inner_chunk <= end; k += ein_inner_chunk) {
+      for (index_t c = 0; c < ein_inner_chunk; c++) {
+        std::get<Inner>(i) = k + c;
+        Reducer::reduce(partials[c], expr.op_b(i), i);
+      }
+    }
+    for (index_t c = 0; c < ein_inner_chunk; c++) {
+      Reducer::combine(acc, partials[c]);
+    }
+  }
+  for (; k < end; k++) {
+    std::get<Inner>(i) = k;
+    Reducer::reduce(acc, expr.op_b(i), i);
+  }
+  result = acc;
+}
+
+template <size_t Inner, class Shape, class Expr>
+NDARRAY_UNIQUE void ein_reduce_loops(
+    const Shape& reduction_shape, const Expr& expr, std::false_type) {
+  using index_type = typename Shape::index_type;
+  const auto& inner = reduction_shape.template dim<Inner>();
+  if (inner.extent() <= 0) { return; }
+
+  // The outer loops visit only the min of the innermost loop.
+  auto outer_shape = make_shape_from_tuple(replace_dim<Inner>(reduction_shape.dims(),
+      dim<dynamic, 1, 0>(inner.min(), 1), make_index_sequence<Shape::rank()>()));
+
+  using OpA = decltype(Expr::op_a);
+  constexpr bool hoist =
+      !ein_uses_index<Inner>(static_cast<const OpA*>(nullptr)) &&
+      std::is_lvalue_reference<decltype(expr.op_a(reduction_shape.min()))>::value;
+  // If all of the operands addressed by the innermost loop are dense in that
+  // dimension, the innermost loop is likely to be vectorizable.
+  constexpr bool chunked = ein_count_dims<Inner, true>(static_cast<const Expr*>(nullptr)) > 0 &&
+                           ein_count_dims<Inner, false>(static_cast<const Expr*>(nullptr)) == 0;
+  using Chunked = std::integral_constant<bool, chunked>;
+  using Partials = std::integral_constant<bool, !std::is_void<typename ein_reducer<Expr>::type>::value>;
+  if (hoist && !ein_result_may_alias(expr.op_a, expr.op_b)) {
+    for_each_index_in_order(outer_shape, [&](index_type i) {
+      ein_reduce_inner_hoisted<Inner>(inner, expr, i, Chunked(), Partials());
+    });
+  } else {
+    for_each_index_in_order(
+        outer_shape, [&](index_type i) { ein_reduce_inner<Inner>(inner, expr, i, Chunked()); });
+  }
+}
+template <size_t Inner, class Shape, class Expr>
+NDARRAY_UNIQUE void ein_reduce_loops(
+    const Shape& reduction_shape, const Expr& expr, std::true_type) {
+  // Rank 0 reductions have no loops.
+  for_each_index_in_order(reduction_shape, expr);
+}
+
+} // namespace internal
+
+/** Reduction traits enable customizing how the loop nest of `ein_reduce` is
+ * executed. The traits are a template parameter of `ein_reduce`, and the
+ * reduction is computed by `Traits::for_each_index(reduction_shape, expr)`,
+ * which must call `expr` for each index in `reduction_shape`. Dimensions of
+ * `reduction_shape` that do not address the result have stride 0.
+ *
+ * The default traits compute matrix products with `gemm` and matrix-vector
+ * products with `gemv`. Other reductions are computed with a loop nest in the
+ * order of the indices, except that the innermost loop is the index that
+ * addresses the most dimensions with a compile-time stride of 1, such as
+ * `dense_dim`s. If the result is not addressed by the innermost loop, it is
+ * accumulated in a local variable instead of in memory, unless an array operand
+ * overlaps the result. Operands that are not arrays must not read the result.
+ *
+ * Reductions `+=`, `-=`, `*=` and `reduce_assign` accumulated in a local
+ * variable are split into several independent partial results, which are
+ * combined at the end of the innermost loop. This reassociates the reduction,
+ * so floating point results may differ slightly from a sequential reduction.
+ * Use `ein_reduce_in_order_traits` if the exact sequential order is needed. */
+class ein_reduce_traits {
+public:
+  template <class Shape, class Expr>
+  static void for_each_index(const Shape& reduction_shape, const Expr& expr) {
+    if (internal::ein_reduce_blas(expr, reduction_shape)) { return; }
+
+    constexpr size_t inner =
+        internal::ein_innermost_index<Expr>(internal::make_index_sequence<Shape::rank()>());
+    internal::ein_reduce_loops<inner>(
+        reduction_shape, expr, std::integral_constant<bool, Shape::rank() == 0>());
+  }
+};
+
+/** Reduction traits that evaluate `expr` in exactly the order of the indices,
+ * with the lowest numbered dimension executed as the innermost loop, and each
+ * reduction accumulated sequentially. This gives a deterministic order of
+ * evaluation for floating point reductions. */
+class ein_reduce_in_order_traits {
+public:
+  template <class Shape, class Expr>
+  static void for_each_index(const Shape& reduction_shape, const Expr& expr) {
+    for_each_index_in_order(reduction_shape, expr);
+  }
+};
+
 /** Compute an Einstein reduction. This function allows one to specify
  * many kinds of array transformations and reductions using
  * <a href="https://en.wikipedia.org/wiki/Einstein_notation">Einstein notation</a>.
@@ -378,9 +1111,13 @@ auto ein(T (&x)[N]) {
  * on `ein<i, j, ...>(op)` operands. These operands describe which
  * dimensions of the reduction index should be used to address that
  * operand. The rank of the reduction operation is inferred from the
- * number of dimensions used in the expression. The reduction operation
- * is executed in the order of the indices, with the lowest numbered
- * dimension executed as the innermost loop.
+ * number of dimensions used in the expression. The loop nest of the
+ * reduction is executed by `Traits::for_each_index`. With the default
+ * `ein_reduce_traits`, the reduction is executed in the order of the
+ * indices, with the lowest numbered dimension executed as the innermost
+ * loop, unless another dimension addresses more operands with a
+ * compile-time stride of 1. Use `ein_reduce_in_order_traits` to execute
+ * the reduction exactly in the order of the indices.
  *
  * If `expr` is a reduction operator, the result must be initialized to
  * some useful value, typically the identity value for the reduction
@@ -391,14 +1128,22 @@ auto ein(T (&x)[N]) {
  * operations are performed. It evaluates the expression for each element
  * of the final result reduction. This can be efficient for expansion
  * operations, but it may be inefficient for contractions. Contractions
- * may need to be reassociated manually for efficient computation.
+ * may need to be reassociated manually for efficient computation, or
+ * computed with `ein_contract`.
  *
- * This function does not optimize the loop ordering within each operation.
- * The goal of this function is to provide a low-overhead and expressive
- * reduction that can be composed with other explicit loop transformations
- * to achieve good performance. Various optimization strategies can be
- * implemented by splitting loops appropriately and by controlling the
- * order of the loops with the reduction indices.
+ * Expressions that are matrix products `C(i, j) += A(i, k) * B(k, j)` or
+ * matrix-vector products `y(i) += A(i, j) * x(j)`, where all of the operands
+ * are arrays of the same arithmetic type, are computed by the default
+ * `ein_reduce_traits` with the blocked implementations of `multiply` in
+ * matrix.h instead of a loop nest.
+ *
+ * Other than choosing the innermost loop, this function does not optimize
+ * the loop ordering within each operation. The goal of this function is to
+ * provide a low-overhead and expressive reduction that can be composed with
+ * other explicit loop transformations to achieve good performance. Various
+ * optimization strategies can be implemented by splitting loops
+ * appropriately and by controlling the order of the loops with the
+ * reduction indices.
  *
  * Examples:
  * - `ein_reduce(ein<>(tr_A) += ein<i, i>(A))`, the trace of `A`.
@@ -413,7 +1158,8 @@ auto ein(T (&x)[N]) {
  * - `x`, `y`, `z`, `Ax` are vectors (rank 1 arrays)
  * - `tr_A`, `dot` are scalar (rank 0 arrays)
  * - `i`, `j`, `k` are unique constexpr integers. */
-template <class Expr, class = internal::enable_if_ein_assign<Expr>>
+template <class Traits = ein_reduce_traits, class Expr,
+    class = internal::enable_if_ein_assign<Expr>>
 NDARRAY_UNIQUE auto ein_reduce(const Expr& expr) {
   constexpr index_t LoopRank = Expr::MaxIndex + 1;
 
@@ -424,22 +1170,356 @@ NDARRAY_UNIQUE auto ein_reduce(const Expr& expr) {
   auto reduction_shape = internal::make_ein_reduce_shape(internal::make_index_sequence<LoopRank>(),
       internal::is_result_shape(), expr.op_a, internal::is_operand_shape(), expr.op_b);
 
-  // TODO: Try to compile-time optimize reduction_shape? :)
-  // This is maybe actually somewhat doable, simply moving the for_each_index
-  // call below into a function that could be overloaded based on the type of
-  // the shape would enable different optimizations. This function could be a
-  // member of a template parameter/parameter of this function, enabling the
-  // caller to customize the optimization. However, it's still very difficult
-  // to make useful optimizations without making some assumptions about the
-  // dimensions of the shape.
-
   // Perform the reduction.
-  for_each_index_in_order(reduction_shape, expr);
+  Traits::for_each_index(reduction_shape, expr);
 
   // Assume the expr is an assignment, and return the left-hand side.
   return expr.op_a.op;
 }
 
+namespace internal {
+
+// Execute the reduction in parallel, by splitting the outermost dimension `D`
+// of the reduction shape that addresses the result. Different values of this
+// dimension write to different elements of the result, so the tasks do not
+// need any synchronization. Dimensions that are not part of the result
+// (reduction dimensions) are executed serially within each task.
+template <class Traits, index_t D, class Shape, class Expr, std::enable_if_t<(D >= 0), int> = 0>
+void parallel_ein_reduce(const parallel_policy& policy, const Shape& reduction_shape,
+    const Expr& expr, std::integral_constant<index_t, D>) {
+  const auto& split_dim = reduction_shape.template dim<D>();
+  if (split_dim.stride() == 0 || split_dim.extent() <= 1) {
+    // This dimension is a reduction or trivial, try the next one.
+    parallel_ein_reduce<Traits>(
+        policy, reduction_shape, expr, std::integral_constant<index_t, D - 1>());
+    return;
+  }
+
+  // We need to crop this dimension, so it can't have a constant min or extent.
+  using SplitDim = dim<dynamic, dynamic, std::decay_t<decltype(split_dim)>::Stride>;
+  constexpr size_t rank = Shape::rank();
+
+  // Each task executes all of the other dimensions for its part of this one.
+  index_t task_size = 1;
+  for (size_t d = 0; d < rank; d++) {
+    if (d != D) { task_size *= reduction_shape.dim(d).extent(); }
+  }
+  const index_t min_extent =
+      std::max<index_t>(1, parallel_min_task_size / std::max<index_t>(1, task_size));
+  policy.pool().parallel_for(interval<>(split_dim.min(), split_dim.extent()), min_extent,
+      [&](const interval<>& i) {
+        auto task_shape = make_shape_from_tuple(replace_dim<D>(reduction_shape.dims(),
+            SplitDim(i.min(), i.extent(), split_dim.stride()), make_index_sequence<rank>()));
+        Traits::for_each_index(task_shape, expr);
+      });
+}
+template <class Traits, index_t D, class Shape, class Expr, std::enable_if_t<(D < 0), int> = 0>
+void parallel_ein_reduce(const parallel_policy&, const Shape& reduction_shape, const Expr& expr,
+    std::integral_constant<index_t, D>) {
+  // None of the dimensions address the result, this must be run serially.
+  Traits::for_each_index(reduction_shape, expr);
+}
+
+} // namespace internal
+
+/** Compute an Einstein reduction in parallel using `policy`. The outermost
+ * dimension of the reduction that is used to address the result is split into
+ * tasks, and the remaining dimensions are executed serially within each task
+ * using `Traits::for_each_index`. This means that the reduction does not need
+ * any synchronization, but it also means that reductions to a scalar are not
+ * parallelized.
+ *
+ * The operands of `expr` are called concurrently from multiple threads. The
+ * result operand must not alias any other operand. See `ein_reduce()` for more
+ * details. */
+template <class Traits = ein_reduce_traits, class Expr,
+    class = internal::enable_if_ein_assign<Expr>>
+NDARRAY_UNIQUE auto ein_reduce(const parallel_policy& policy, const Expr& expr) {
+  constexpr index_t LoopRank = Expr::MaxIndex + 1;
+
+  auto reduction_shape = internal::make_ein_reduce_shape(internal::make_index_sequence<LoopRank>(),
+      internal::is_result_shape(), expr.op_a, internal::is_operand_shape(), expr.op_b);
+
+  internal::parallel_ein_reduce<Traits>(
+      policy, reduction_shape, expr, std::integral_constant<index_t, LoopRank - 1>());
+
+  return expr.op_a.op;
+}
+
+namespace internal {
+
+// Flatten a tree of products into a tuple of the factors. Any operand that is
+// not a product is a single factor.
+template <class Op>
+auto ein_factors(const Op& op) {
+  return std::make_tuple(op);
+}
+template <class OpA, class OpB>
+auto ein_factors(const ein_op_mul<OpA, OpB>& op) {
+  return std::tuple_cat(ein_factors(op.op_a), ein_factors(op.op_b));
+}
+
+// Compute a bitmask of the indices used by an operand.
+template <class Op, size_t... Is>
+index_t ein_index_mask(const ein_op<Op, Is...>&) {
+  const std::array<size_t, sizeof...(Is)> is = {{Is...}};
+  index_t mask = 0;
+  for (size_t i : is) {
+    mask |= static_cast<index_t>(1) << i;
+  }
+  return mask;
+}
+template <class Op, class Derived>
+index_t ein_index_mask(const ein_unary_op<Op, Derived>& op) {
+  return ein_index_mask(op.op);
+}
+template <class OpA, class OpB, class Derived>
+index_t ein_index_mask(const ein_binary_op<OpA, OpB, Derived>& op) {
+  return ein_index_mask(op.op_a) | ein_index_mask(op.op_b);
+}
+
+inline bool has_index(index_t mask, size_t i) { return (mask >> i) & 1; }
+
+// A factor of a contraction. All factors have the same rank as the whole
+// reduction, with stride 0 in the dimensions that the factor does not use.
+template <class T, size_t Rank>
+struct ein_factor {
+  array_ref<const T, shape_of_rank<Rank>> value;
+  index_t mask;
+};
+
+template <class T, size_t Rank>
+class ein_contraction {
+  using shape_type = shape_of_rank<Rank>;
+  using factor = ein_factor<T, Rank>;
+
+  std::array<dim<>, Rank> dims_;
+  index_t result_mask_;
+  std::vector<factor> factors_;
+  // Storage for the intermediate results of the contraction.
+  std::vector<array<T, shape_type>> temps_;
+
+  // Make a shape for the loops over the indices in `mask`. The other
+  // dimensions have extent 1.
+  shape_type loop_shape(index_t mask) const {
+    std::array<dim<>, Rank> dims = dims_;
+    for (size_t i = 0; i < Rank; i++) {
+      if (!has_index(mask, i)) { dims[i] = dim<>(dims[i].min(), 1, 0); }
+    }
+    return shape_type(array_to_tuple(dims));
+  }
+
+  // Make an array for an intermediate result using the indices in `mask`. The
+  // array is only allocated for the indices in `mask`, the returned array_ref
+  // broadcasts it to the rest of the dimensions.
+  array_ref<T, shape_type> make_temp(index_t mask) {
+    std::array<dim<>, Rank> dims = dims_;
+    std::array<dim<>, Rank> broadcast_dims = dims_;
+    index_t stride = 1;
+    for (size_t i = 0; i < Rank; i++) {
+      if (has_index(mask, i)) {
+        dims[i].set_stride(stride);
+        broadcast_dims[i].set_stride(stride);
+        stride *= dims[i].extent();
+      } else {
+        dims[i] = dim<>(dims[i].min(), 1, 0);
+        broadcast_dims[i].set_stride(0);
+      }
+    }
+    temps_.emplace_back(shape_type(array_to_tuple(dims)), static_cast<T>(0));
+    return array_ref<T, shape_type>(temps_.back().base(), array_to_tuple(broadcast_dims));
+  }
+
+  // An operand that is a view of an array of the same type with an affine
+  // shape can be used directly.
+  template <class U, class Shape, size_t... Is,
+      class = std::enable_if_t<std::is_same<typename std::remove_const<U>::type, T>::value &&
+                               is_affine_shape<Shape>::value>>
+  factor make_factor(const ein_op<array_ref<U, Shape>, Is...>& op) {
+    const auto mins = shape_type(array_to_tuple(dims_)).min();
+    const auto op_dims = tuple_to_array<dim<>>(op.op.shape().dims());
+    const std::array<size_t, sizeof...(Is)> is = {{Is...}};
+    std::array<dim<>, Rank> dims = dims_;
+    for (size_t i = 0; i < Rank; i++) {
+      dims[i].set_stride(0);
+    }
+    for (size_t d = 0; d < is.size(); d++) {
+      dims[is[d]].set_stride(dims[is[d]].stride() + op_dims[d].stride());
+    }
+    const T* base = &op.op(std::get<Is>(mins)...);
+    return {array_ref<const T, shape_type>(base, shape_type(array_to_tuple(dims))),
+        ein_index_mask(op)};
+  }
+  // Other operands (including arrays with shapes that are not affine, such as
+  // tiled or morton shapes) are evaluated into a temporary array.
+  template <class Op>
+  factor make_factor(const Op& op) {
+    const index_t mask = ein_index_mask(op);
+    array_ref<T, shape_type> temp = make_temp(mask);
+    for_each_index_in_order(
+        loop_shape(mask), [&](const index_of_rank<Rank>& i) { temp(i) = static_cast<T>(op(i)); });
+    return {temp, mask};
+  }
+
+  template <class Factors, size_t... Is>
+  void make_factors(const Factors& factors, index_sequence<Is...>) {
+    factors_.reserve(sizeof...(Is));
+    // Each factor may need a temporary, and each contraction needs a temporary.
+    temps_.reserve(sizeof...(Is) * 2);
+    int unused[] = {(factors_.push_back(make_factor(std::get<Is>(factors))), 0)...};
+    (void)unused;
+  }
+
+  // The indices used by the union of the factors in `set` that are still
+  // needed by the result or the factors outside of `set`.
+  index_t output_mask(index_t set) const {
+    index_t inside = 0;
+    index_t outside = result_mask_;
+    for (size_t i = 0; i < factors_.size(); i++) {
+      if (has_index(set, i)) {
+        inside |= factors_[i].mask;
+      } else {
+        outside |= factors_[i].mask;
+      }
+    }
+    return inside & outside;
+  }
+
+  // The indices of the result of contracting the factors in `set`.
+  index_t factor_mask(index_t set) const {
+    if ((set & (set - 1)) == 0) {
+      // A single factor is used as is.
+      for (size_t i = 0; i < factors_.size(); i++) {
+        if (has_index(set, i)) { return factors_[i].mask; }
+      }
+    }
+    return output_mask(set);
+  }
+
+  double loop_size(index_t mask) const {
+    double size = 1.0;
+    for (size_t i = 0; i < Rank; i++) {
+      if (has_index(mask, i)) { size *= dims_[i].extent(); }
+    }
+    return size;
+  }
+
+  // For each subset of factors, the cost of the cheapest way to contract the
+  // subset, and one half of the best split of the subset.
+  std::vector<double> costs_;
+  std::vector<index_t> splits_;
+
+  void find_order() {
+    const index_t all = (static_cast<index_t>(1) << factors_.size()) - 1;
+    costs_.assign(all + 1, 0.0);
+    splits_.assign(all + 1, 0);
+    // Subsets are visited in increasing order, so every proper subset of a set
+    // has already been visited.
+    for (index_t set = 1; set <= all; set++) {
+      if ((set & (set - 1)) == 0) { continue; }
+      costs_[set] = std::numeric_limits<double>::infinity();
+      // Only consider splits where `a` contains the lowest factor in the set,
+      // to avoid visiting each split twice.
+      const index_t lowest = set & -set;
+      for (index_t a = (set - 1) & set; a > 0; a = (a - 1) & set) {
+        if (!(a & lowest)) { continue; }
+        const index_t b = set & ~a;
+        const double cost = costs_[a] + costs_[b] + loop_size(factor_mask(a) | factor_mask(b));
+        if (cost < costs_[set]) {
+          costs_[set] = cost;
+          splits_[set] = a;
+        }
+      }
+    }
+  }
+
+  // Contract the factors in `set`, returning the factor of the result.
+  factor contract(index_t set) {
+    if ((set & (set - 1)) == 0) {
+      for (size_t i = 0; i < factors_.size(); i++) {
+        if (has_index(set, i)) { return factors_[i]; }
+      }
+    }
+    const factor a = contract(splits_[set]);
+    const factor b = contract(set & ~splits_[set]);
+    const index_t mask = output_mask(set);
+    array_ref<T, shape_type> temp = make_temp(mask);
+    for_each_index_in_order(loop_shape(a.mask | b.mask), [&](const index_of_rank<Rank>& i) {
+      temp(i) += a.value(i) * b.value(i);
+    });
+    return {temp, mask};
+  }
+
+public:
+  template <class Shape, class Factors>
+  ein_contraction(const Shape& reduction_shape, index_t result_mask, const Factors& factors)
+      : dims_(tuple_to_array<dim<>>(reduction_shape.dims())), result_mask_(result_mask) {
+    make_factors(factors, make_index_sequence<std::tuple_size<Factors>::value>());
+    find_order();
+  }
+
+  // Contract all of the factors, and accumulate the result with `accumulate`.
+  template <class Accumulate>
+  void run(const Accumulate& accumulate) {
+    const index_t all = (static_cast<index_t>(1) << factors_.size()) - 1;
+    const factor a = contract(splits_[all]);
+    const factor b = contract(all & ~splits_[all]);
+    for_each_index_in_order(loop_shape(a.mask | b.mask | result_mask_),
+        [&](const index_of_rank<Rank>& i) { accumulate(i, a.value(i) * b.value(i)); });
+  }
+};
+
+template <class OpA, class OpB>
+auto ein_contraction_accumulator(const ein_op_add_assign<OpA, OpB>& expr) {
+  return [&](const auto& i, const auto& x) { expr.op_a(i) += x; };
+}
+template <class OpA, class OpB>
+auto ein_contraction_accumulator(const ein_op_sub_assign<OpA, OpB>& expr) {
+  return [&](const auto& i, const auto& x) { expr.op_a(i) -= x; };
+}
+
+template <class Expr, class Factors,
+    std::enable_if_t<(std::tuple_size<Factors>::value >= 3), int> = 0>
+void ein_contract(const Expr& expr, const Factors& factors) {
+  constexpr index_t LoopRank = Expr::MaxIndex + 1;
+  auto reduction_shape = make_ein_reduce_shape(make_index_sequence<LoopRank>(), is_result_shape(),
+      expr.op_a, is_operand_shape(), expr.op_b);
+  if (reduction_shape.empty()) { return; }
+
+  using T = typename std::decay<decltype(expr.op_a(reduction_shape.min()))>::type;
+  ein_contraction<T, LoopRank> contraction(
+      reduction_shape, ein_index_mask(expr.op_a), factors);
+  contraction.run(ein_contraction_accumulator(expr));
+}
+template <class Expr, class Factors,
+    std::enable_if_t<(std::tuple_size<Factors>::value < 3), int> = 0>
+void ein_contract(const Expr& expr, const Factors&) {
+  // There is no choice of order with fewer than 3 factors.
+  ein_reduce(expr);
+}
+
+} // namespace internal
+
+/** Compute an Einstein summation of a product of 3 or more factors, such as
+ * `ein_contract(ein<i, l>(D) += ein<i, j>(A) * ein<j, k>(B) * ein<k, l>(C))`.
+ * Unlike `ein_reduce`, this function chooses the order in which the factors
+ * are multiplied to minimize the number of multiplications, using the extents
+ * of the operands at runtime. Intermediate results are stored in temporary
+ * arrays, and indices are summed as soon as no remaining factor uses them. For
+ * example, the product above is computed as `(A*B)*C` or `A*(B*C)`, requiring
+ * two loop nests of rank 3 instead of one loop nest of rank 4.
+ *
+ * `expr` must be a `+=` or `-=` of a product. Factors that are not an
+ * `array_ref` of the result type (including sums or other expressions) are
+ * evaluated into a temporary array first. The result is not computed in
+ * the same order as `ein_reduce`, so floating point results may differ
+ * slightly. */
+template <class Expr, class = internal::enable_if_ein_assign<Expr>>
+auto ein_contract(const Expr& expr) {
+  internal::ein_contract(expr, internal::ein_factors(expr.op_b));
+  return expr.op_a.op;
+}
+
 /** Infer the shape of the result of `make_ein_reduce`. */
 template <size_t... ResultIs, class Expr, class = internal::enable_if_ein_op<Expr>>
 auto make_ein_reduce_shape(const Expr& expr) {
@@ -465,9 +1545,9 @@ auto make_ein_reduce_shape(const Expr& expr) {
  * - `x`, `y`, `z` are vectors (rank 1 arrays)
  * - `i`, `j`, `k` are unique constexpr integers.
  *
- * See `ein_reduce()` for more details.
+ * See `ein_reduce()` for more details, and `make_ein_reduce` for reductions
+ * other than sums.
  **/
-// TODO: It would be nice to be able to express reductions other than sums.
 // TODO: Add an overload with a default ResultIs... = 0, 1, 2, ... This requires
 // also inferring the rank of the result.
 template <class T, size_t... ResultIs, class Expr, class Alloc = std::allocator<T>,
@@ -480,6 +1560,55 @@ NDARRAY_UNIQUE auto make_ein_sum(
   return result;
 }
 
+namespace internal {
+
+// The type of the result of reducing `Expr` with `Reducer`.
+template <class Reducer, class T, class Expr, size_t... ResultIs>
+using ein_reduce_result =
+    typename Reducer::template result_type<T, index_of_rank<static_cast<size_t>(
+                                                     std::max(Expr::MaxIndex,
+                                                         variadic_max(ResultIs...)) +
+                                                     1)>>;
+
+} // namespace internal
+
+/** Compute an Einstein reduction of `expr` with `Reducer` using `ein_reduce`
+ * and return the result. The values of `expr` are reduced to a result of type
+ * `T`, and the `value_type` of the result is
+ * `Reducer::result_type<T, index_type>`, where `index_type` is the type of
+ * the index of the reduction. The result shape is inferred from the shape of
+ * the operands, and the result is initialized to `Reducer::identity()` prior
+ * to computing the reduction. The Einstein summation indices for the result
+ * operand are `ResultIs...`.
+ *
+ * Examples:
+ * - `max_A = make_ein_reduce<max_reducer, T>(ein<i, j>(A))`
+ * - `max_rows_A = make_ein_reduce<max_reducer, T, i>(ein<i, j>(A))`
+ * - `argmin_rows_A = make_ein_reduce<argmin_reducer, T, i>(ein<i, j>(A))`
+ * - `prod_x = make_ein_reduce<product_reducer, T>(ein<i>(x))`
+ * - `any_x = make_ein_reduce<any_reducer, bool>(ein<i>(x))`
+ *
+ * where:
+ * - `A` is a matrix (rank 2 array)
+ * - `x` is a vector (rank 1 array)
+ * - `i`, `j` are unique constexpr integers.
+ *
+ * The elements of the result of `argmin_rows_A` are pairs of the minimum
+ * value of each row, and the index `(i, j)` of that value.
+ *
+ * See `ein_reduce()` and `reduce_assign()` for more details. */
+template <class Reducer, class T, size_t... ResultIs, class Expr,
+    class Alloc = std::allocator<internal::ein_reduce_result<Reducer, T, Expr, ResultIs...>>,
+    class = internal::enable_if_ein_op<Expr>>
+NDARRAY_UNIQUE auto make_ein_reduce(const Expr& expr, const Alloc& alloc = Alloc()) {
+  using result_type = internal::ein_reduce_result<Reducer, T, Expr, ResultIs...>;
+  auto result_shape = make_ein_reduce_shape<ResultIs...>(expr);
+  auto result =
+      make_array<result_type>(result_shape, Reducer::template identity<result_type>(), alloc);
+  ein_reduce(reduce_assign<Reducer>(ein<ResultIs...>(result), expr));
+  return result;
+}
+
 } // namespace nda
 
 #endif // NDARRAY_EIN_REDUCE_H
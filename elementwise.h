@@ -0,0 +1,373 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** \file elementwise.h
+ * \brief Optional helper for lazily evaluated element-wise expressions of
+ * arrays.
+ */
+
+#ifndef NDARRAY_ELEMENTWISE_H
+#define NDARRAY_ELEMENTWISE_H
+
+#include "array.h"
+
+#include <cmath>
+
+namespace nda {
+
+namespace internal {
+
+// Element-wise expressions are trees of operations, where the leaves are
+// arrays or scalars. The leaves that are arrays are collected into a tuple of
+// array_refs, and the expression is evaluated with for_each_value over the
+// destination and all of these arrays at once. At each index, the expression
+// is evaluated with the values of the arrays at that index, so the shapes of
+// all of the arrays are optimized together, and no intermediate arrays are
+// needed. If any of the shapes are not affine, the indices of the destination
+// are visited with its shape_traits instead.
+//
+// Each operation provides:
+// - `leaf_count`, the number of arrays in the expression.
+// - `leaves()`, a tuple of the array_refs in the expression.
+// - `eval<I>(values)`, the value of the expression, where `values` is a tuple
+//   of the values of the leaves at the current index, and `I` is the index in
+//   `values` of the first leaf of this operation.
+
+struct elementwise_op_tag {};
+
+template <class Derived>
+struct elementwise_op_base : public elementwise_op_tag {
+  const Derived& derived() const { return *static_cast<const Derived*>(this); }
+};
+
+template <class T>
+using is_elementwise_op = std::is_base_of<elementwise_op_tag, T>;
+
+// A leaf of an expression that is a scalar value.
+template <class T>
+struct elementwise_scalar : public elementwise_op_base<elementwise_scalar<T>> {
+  T value;
+  elementwise_scalar(T value) : value(value) {}
+
+  static constexpr size_t leaf_count = 0;
+  std::tuple<> leaves() const { return std::tuple<>(); }
+
+  template <size_t I, class Values>
+  NDARRAY_INLINE T eval(const Values&) const {
+    return value;
+  }
+};
+
+template <class T, class Shape>
+class elementwise_array;
+
+// Convert the operands of an operation to element-wise expressions. Arrays and
+// array_refs become leaves reading the array, and scalars become constants.
+template <class Op>
+const Op& as_elementwise_op(const elementwise_op_base<Op>& op) {
+  return op.derived();
+}
+template <class T, class = std::enable_if_t<std::is_arithmetic<T>::value>>
+elementwise_scalar<T> as_elementwise_op(T value) {
+  return elementwise_scalar<T>(value);
+}
+template <class T, class Shape>
+elementwise_array<T, Shape> as_elementwise_op(const array_ref<T, Shape>& a) {
+  return elementwise_array<T, Shape>(a);
+}
+template <class T, class Shape, class Alloc>
+elementwise_array<const T, Shape> as_elementwise_op(const array<T, Shape, Alloc>& a) {
+  return elementwise_array<const T, Shape>(a.cref());
+}
+
+template <class T>
+using elementwise_op_type = std::decay_t<decltype(as_elementwise_op(std::declval<const T&>()))>;
+
+template <class T, class = void>
+struct is_elementwise_operand : std::false_type {};
+template <class T>
+struct is_elementwise_operand<T,
+    decltype(static_cast<void>(as_elementwise_op(std::declval<const T&>())))> : std::true_type {};
+
+template <class T>
+using enable_if_elementwise_operand = std::enable_if_t<is_elementwise_operand<T>::value>;
+
+// Operations of two operands require at least one of them to be an
+// element-wise expression, the other may be an array or a scalar.
+template <class A, class B>
+using enable_if_elementwise_operands =
+    std::enable_if_t<(is_elementwise_op<A>::value || is_elementwise_op<B>::value) &&
+                     is_elementwise_operand<A>::value && is_elementwise_operand<B>::value>;
+
+// An operation applying `Fn` to the value of one operand.
+template <class Fn, class Op>
+struct elementwise_unary_op : public elementwise_op_base<elementwise_unary_op<Fn, Op>> {
+  Op op;
+  elementwise_unary_op(const Op& op) : op(op) {}
+
+  static constexpr size_t leaf_count = Op::leaf_count;
+  auto leaves() const { return op.leaves(); }
+
+  template <size_t I, class Values>
+  NDARRAY_INLINE auto eval(const Values& values) const {
+    return Fn()(op.template eval<I>(values));
+  }
+};
+
+template <class Fn, class Op>
+auto make_elementwise_unary_op(const Op& op) {
+  return elementwise_unary_op<Fn, Op>(op);
+}
+
+// An operation applying `Fn` to the values of two operands.
+template <class Fn, class OpA, class OpB>
+struct elementwise_binary_op : public elementwise_op_base<elementwise_binary_op<Fn, OpA, OpB>> {
+  OpA op_a;
+  OpB op_b;
+  elementwise_binary_op(const OpA& a, const OpB& b) : op_a(a), op_b(b) {}
+
+  static constexpr size_t leaf_count = OpA::leaf_count + OpB::leaf_count;
+  auto leaves() const { return std::tuple_cat(op_a.leaves(), op_b.leaves()); }
+
+  template <size_t I, class Values>
+  NDARRAY_INLINE auto eval(const Values& values) const {
+    return Fn()(op_a.template eval<I>(values), op_b.template eval<I + OpA::leaf_count>(values));
+  }
+};
+
+template <class Fn, class A, class B>
+auto make_elementwise_binary_op(const A& a, const B& b) {
+  using OpA = elementwise_op_type<A>;
+  using OpB = elementwise_op_type<B>;
+  return elementwise_binary_op<Fn, OpA, OpB>(as_elementwise_op(a), as_elementwise_op(b));
+}
+
+#define NDARRAY_MAKE_ELEMENTWISE_BINARY_OP(name, op)                                               \
+  struct name {                                                                                    \
+    template <class A, class B>                                                                    \
+    NDARRAY_INLINE auto operator()(const A& a, const B& b) const {                                 \
+      return a op b;                                                                               \
+    }                                                                                              \
+  };                                                                                               \
+  template <class A, class B, class = enable_if_elementwise_operands<A, B>>                        \
+  auto operator op(const A& a, const B& b) {                                                       \
+    return make_elementwise_binary_op<name>(a, b);                                                 \
+  }
+
+NDARRAY_MAKE_ELEMENTWISE_BINARY_OP(elementwise_add, +);
+NDARRAY_MAKE_ELEMENTWISE_BINARY_OP(elementwise_sub, -);
+NDARRAY_MAKE_ELEMENTWISE_BINARY_OP(elementwise_mul, *);
+NDARRAY_MAKE_ELEMENTWISE_BINARY_OP(elementwise_div, /);
+
+#undef NDARRAY_MAKE_ELEMENTWISE_BINARY_OP
+
+struct elementwise_negate {
+  template <class T>
+  NDARRAY_INLINE auto operator()(const T& x) const {
+    return -x;
+  }
+};
+
+template <class Op>
+auto operator-(const elementwise_op_base<Op>& op) {
+  return make_elementwise_unary_op<elementwise_negate>(op.derived());
+}
+
+struct elementwise_min {
+  template <class A, class B>
+  NDARRAY_INLINE auto operator()(const A& a, const B& b) const {
+    using T = std::common_type_t<A, B>;
+    return b < a ? static_cast<T>(b) : static_cast<T>(a);
+  }
+};
+
+struct elementwise_max {
+  template <class A, class B>
+  NDARRAY_INLINE auto operator()(const A& a, const B& b) const {
+    using T = std::common_type_t<A, B>;
+    return a < b ? static_cast<T>(b) : static_cast<T>(a);
+  }
+};
+
+template <class Type>
+struct elementwise_cast {
+  template <class T>
+  NDARRAY_INLINE Type operator()(const T& x) const {
+    return static_cast<Type>(x);
+  }
+};
+
+// Math functions of an element-wise expression. These are only found by
+// argument dependent lookup, so they don't hide the standard functions.
+#define NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(name)                                                    \
+  struct elementwise_##name {                                                                      \
+    template <class T>                                                                             \
+    NDARRAY_INLINE auto operator()(const T& x) const {                                             \
+      using std::name;                                                                             \
+      return name(x);                                                                              \
+    }                                                                                              \
+  };                                                                                               \
+  template <class Op>                                                                              \
+  auto name(const elementwise_op_base<Op>& op) {                                                   \
+    return make_elementwise_unary_op<elementwise_##name>(op.derived());                            \
+  }
+
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(abs);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(sqrt);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(exp);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(log);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(sin);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(cos);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(tanh);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(floor);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(ceil);
+NDARRAY_MAKE_ELEMENTWISE_UNARY_FN(round);
+
+#undef NDARRAY_MAKE_ELEMENTWISE_UNARY_FN
+
+struct elementwise_assign {
+  template <class T, class U>
+  NDARRAY_INLINE void operator()(T& x, const U& y) const {
+    x = y;
+  }
+};
+
+#define NDARRAY_MAKE_ELEMENTWISE_ASSIGN(name, op)                                                  \
+  struct name {                                                                                    \
+    template <class T, class U>                                                                    \
+    NDARRAY_INLINE void operator()(T& x, const U& y) const {                                       \
+      x op y;                                                                                      \
+    }                                                                                              \
+  };
+
+NDARRAY_MAKE_ELEMENTWISE_ASSIGN(elementwise_add_assign, +=);
+NDARRAY_MAKE_ELEMENTWISE_ASSIGN(elementwise_sub_assign, -=);
+NDARRAY_MAKE_ELEMENTWISE_ASSIGN(elementwise_mul_assign, *=);
+NDARRAY_MAKE_ELEMENTWISE_ASSIGN(elementwise_div_assign, /=);
+
+#undef NDARRAY_MAKE_ELEMENTWISE_ASSIGN
+
+// Evaluate `assign(dst(i), op(i))` for each index `i` in `dst`.
+template <class Assign, class T, class Shape, class Op, class Leaves, size_t... Is>
+void evaluate_elementwise(const array_ref<T, Shape>& dst, const Op& op, const Leaves& leaves,
+    index_sequence<Is...> leaf_indices) {
+  for_each_value_impl(
+      [op](T& x, const auto&... values) {
+        Assign()(x, op.template eval<0>(std::forward_as_tuple(values...)));
+      },
+      leaf_indices, dst, std::get<Is>(leaves)...);
+}
+template <class Assign, class T, class Shape, class Op>
+void evaluate_elementwise(const array_ref<T, Shape>& dst, const Op& op) {
+  evaluate_elementwise<Assign>(dst, op, op.leaves(), make_index_sequence<Op::leaf_count>());
+}
+
+// A leaf of an expression that reads the values of an array. This is also the
+// destination of an assignment, which evaluates the expression.
+template <class T, class Shape>
+class elementwise_array : public elementwise_op_base<elementwise_array<T, Shape>> {
+  array_ref<T, Shape> a_;
+
+public:
+  elementwise_array(const array_ref<T, Shape>& a) : a_(a) {}
+  elementwise_array(const elementwise_array&) = default;
+
+  static constexpr size_t leaf_count = 1;
+  std::tuple<array_ref<T, Shape>> leaves() const { return std::make_tuple(a_); }
+
+  template <size_t I, class Values>
+  NDARRAY_INLINE decltype(auto) eval(const Values& values) const {
+    return std::get<I>(values);
+  }
+
+  /** Evaluate the expression `x` for each index of the array, and assign or
+   * update the values of the array with the result. */
+  elementwise_array& operator=(const elementwise_array& x) {
+    evaluate_elementwise<elementwise_assign>(a_, x);
+    return *this;
+  }
+  template <class X, class = enable_if_elementwise_operand<X>>
+  elementwise_array& operator=(const X& x) {
+    evaluate_elementwise<elementwise_assign>(a_, as_elementwise_op(x));
+    return *this;
+  }
+  template <class X, class = enable_if_elementwise_operand<X>>
+  elementwise_array& operator+=(const X& x) {
+    evaluate_elementwise<elementwise_add_assign>(a_, as_elementwise_op(x));
+    return *this;
+  }
+  template <class X, class = enable_if_elementwise_operand<X>>
+  elementwise_array& operator-=(const X& x) {
+    evaluate_elementwise<elementwise_sub_assign>(a_, as_elementwise_op(x));
+    return *this;
+  }
+  template <class X, class = enable_if_elementwise_operand<X>>
+  elementwise_array& operator*=(const X& x) {
+    evaluate_elementwise<elementwise_mul_assign>(a_, as_elementwise_op(x));
+    return *this;
+  }
+  template <class X, class = enable_if_elementwise_operand<X>>
+  elementwise_array& operator/=(const X& x) {
+    evaluate_elementwise<elementwise_div_assign>(a_, as_elementwise_op(x));
+    return *this;
+  }
+};
+
+} // namespace internal
+
+/** Make an element-wise expression operand of an array or array_ref `a`.
+ * Element-wise expressions support the operators `+ - * /`, unary `-`,
+ * `min`, `max`, `cast`, and the math functions `abs`, `sqrt`, `exp`, `log`,
+ * `sin`, `cos`, `tanh`, `floor`, `ceil`, and `round`. The other operand of a
+ * binary operation may be an array or a scalar.
+ *
+ * Expressions are evaluated lazily, by assigning them to an element-wise
+ * operand: `elementwise(c) = elementwise(a) * 2 + b` computes
+ * `c(i) = a(i) * 2 + b(i)` for each index `i` in the shape of `c`, in one pass
+ * over all of the arrays, with their shapes optimized together as in
+ * `for_each_value`. The other arrays must contain the indices of `c`. The
+ * destination may also be an operand of the expression. */
+template <class T, class Shape>
+internal::elementwise_array<T, Shape> elementwise(const array_ref<T, Shape>& a) {
+  return internal::elementwise_array<T, Shape>(a);
+}
+template <class T, class Shape, class Alloc>
+internal::elementwise_array<T, Shape> elementwise(array<T, Shape, Alloc>& a) {
+  return elementwise(a.ref());
+}
+template <class T, class Shape, class Alloc>
+internal::elementwise_array<const T, Shape> elementwise(const array<T, Shape, Alloc>& a) {
+  return elementwise(a.cref());
+}
+
+/** Cast the values of an element-wise expression to `Type` with
+ * `static_cast<Type>`. */
+template <class Type, class Op>
+auto cast(const internal::elementwise_op_base<Op>& op) {
+  return internal::make_elementwise_unary_op<internal::elementwise_cast<Type>>(op.derived());
+}
+
+/** The min or max of the values of two element-wise operands. */
+template <class A, class B, class = internal::enable_if_elementwise_operands<A, B>>
+auto min(const A& a, const B& b) {
+  return internal::make_elementwise_binary_op<internal::elementwise_min>(a, b);
+}
+template <class A, class B, class = internal::enable_if_elementwise_operands<A, B>>
+auto max(const A& a, const B& b) {
+  return internal::make_elementwise_binary_op<internal::elementwise_max>(a, b);
+}
+
+} // namespace nda
+
+#endif // NDARRAY_ELEMENTWISE_H
@@ -41,7 +41,10 @@ NOINLINE void multiply_reduce_cols(const_matrix_ref<T> A, const_matrix_ref<T> B,
 }
 
 // This implementation uses Einstein summation. This should be equivalent
-// to multiply_reduce_cols.
+// to multiply_reduce_cols. However, ein_reduce recognizes this expression
+// as a matrix product, and computes it in the same way as multiply_packed,
+// so the loop order does not matter for this and the other ein_reduce
+// implementations below.
 template <typename T>
 NOINLINE void multiply_ein_reduce_cols(
     const_matrix_ref<T> A, const_matrix_ref<T> B, matrix_ref<T> C) {
@@ -119,6 +122,16 @@ NOINLINE void multiply_ein_reduce_matrix(
   ein_reduce(ein<i, j>(C) += ein<i, k>(A) * ein<k, j>(B));
 }
 
+// This is the same as multiply_ein_reduce_matrix, but the rows of the result
+// are computed in parallel.
+template <class T>
+NOINLINE void multiply_ein_reduce_matrix_par(
+    const_matrix_ref<T> A, const_matrix_ref<T> B, matrix_ref<T> C) {
+  fill(par, C, static_cast<T>(0));
+  enum { i = 0, j = 1, k = 2 };
+  ein_reduce(par, ein<i, j>(C) += ein<i, k>(A) * ein<k, j>(B));
+}
+
 // This implementation of matrix multiplication splits the loops over
 // the output matrix into chunks, and reorders the small loops
 // innermost to form tiles. This implementation should allow the compiler
@@ -261,6 +274,13 @@ NOINLINE void multiply_ein_reduce_tiles(
   }
 }
 
+// This implementation uses the packed, register-blocked matrix multiplication
+// from matrix.h.
+template <typename T>
+NOINLINE void multiply_packed(const_matrix_ref<T> A, const_matrix_ref<T> B, matrix_ref<T> C) {
+  multiply(A, B, C);
+}
+
 float relative_error(float A, float B) { return std::abs(A - B) / std::max(A, B); }
 
 int main(int, const char**) {
@@ -294,8 +314,10 @@ int main(int, const char**) {
       {"ein_reduce_rows", multiply_ein_reduce_rows<float>},
       {"reduce_matrix", multiply_reduce_matrix<float>},
       {"ein_reduce_matrix", multiply_ein_reduce_matrix<float>},
+      {"ein_reduce_matrix_par", multiply_ein_reduce_matrix_par<float>},
       {"reduce_tiles", multiply_reduce_tiles<float>},
       {"ein_reduce_tiles", multiply_ein_reduce_tiles<float>},
+      {"packed", multiply_packed<float>},
   };
   for (auto i : versions) {
     // Compute the result using all matrix multiply methods.
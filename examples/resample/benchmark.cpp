@@ -14,6 +14,7 @@
 
 #include "benchmark.h"
 #include "image.h"
+#include "parallel.h"
 #include "rational.h"
 #include "resample.h"
 
@@ -23,16 +24,19 @@
 using namespace nda;
 
 const std::pair<const char*, continuous_kernel> benchmarks[] = {
-    {"box", box},
-    {"linear", linear},
-    {"quadratic", interpolating_quadratic},
-    {"cubic", interpolating_cubic},
-    {"lanczos3", lanczos<3>},
+    {"box", {box, 0.5f}},
+    {"linear", {linear, 1.0f}},
+    {"quadratic", {interpolating_quadratic, 1.5f}},
+    {"cubic", {interpolating_cubic, 2.0f}},
+    {"lanczos3", {lanczos<3>, 3.0f}},
 };
 
+// If `threads` is 0, the benchmarks run the serial `resample`, otherwise the
+// parallel `resample` using a pool of `threads` threads.
 template <typename Image, index_t Channels>
-void run_benchmarks(
-    index_t input_width, index_t input_height, index_t output_width, index_t output_height) {
+void run_benchmarks(const char* type_name, index_t input_width, index_t input_height,
+    index_t output_width, index_t output_height, int threads) {
+  std::cout << type_name << ":" << std::endl;
 
   Image input({input_width, input_height, Channels});
   Image output({output_width, output_height, Channels});
@@ -40,17 +44,26 @@ void run_benchmarks(
   const rational<index_t> rate_x(output.width(), input.width());
   const rational<index_t> rate_y(output.height(), input.height());
 
+  thread_pool pool(std::max(threads, 1));
+  const parallel_policy policy(pool);
+
   for (auto i : benchmarks) {
-    double resample_time =
-        benchmark([&]() { resample(input.cref(), output.ref(), rate_x, rate_y, i.second); });
-    std::cout << i.first << " time: " << resample_time * 1e3 << " ms " << std::endl;
+    double resample_time = benchmark([&]() {
+      if (threads > 0) {
+        resample(policy, input.cref(), output.ref(), rate_x, rate_y, i.second);
+      } else {
+        resample(input.cref(), output.ref(), rate_x, rate_y, i.second);
+      }
+    });
+    std::cout << "  " << i.first << " time: " << resample_time * 1e3 << " ms " << std::endl;
   }
 }
 
 int main(int argc, char* argv[]) {
   if (argc < 5) {
     std::cout << "Usage: " << argv[0]
-              << " <input width> <input height> <output_width> <output height>" << std::endl;
+              << " <input width> <input height> <output_width> <output height> [threads]"
+              << std::endl;
     return -1;
   }
 
@@ -58,8 +71,24 @@ int main(int argc, char* argv[]) {
   index_t input_height = std::atoi(argv[2]);
   index_t output_width = std::atoi(argv[3]);
   index_t output_height = std::atoi(argv[4]);
+  int threads = argc > 5 ? std::atoi(argv[5]) : 0;
+  if (threads > 0) { std::cout << threads << " threads" << std::endl; }
 
-  run_benchmarks<planar_image<float>, 4>(input_width, input_height, output_width, output_height);
+  run_benchmarks<planar_image<float>, 4>(
+      "planar float", input_width, input_height, output_width, output_height, threads);
+  // 8 and 16-bit images are resampled in fixed point.
+  run_benchmarks<planar_image<uint8_t>, 4>(
+      "planar uint8_t", input_width, input_height, output_width, output_height, threads);
+  run_benchmarks<planar_image<uint16_t>, 4>(
+      "planar uint16_t", input_width, input_height, output_width, output_height, threads);
+  run_benchmarks<chunky_image<float, 4>, 4>(
+      "chunky float x4", input_width, input_height, output_width, output_height, threads);
+  run_benchmarks<chunky_image<float, 3>, 3>(
+      "chunky float x3", input_width, input_height, output_width, output_height, threads);
+  run_benchmarks<chunky_image<uint8_t, 4>, 4>(
+      "chunky uint8_t x4", input_width, input_height, output_width, output_height, threads);
+  run_benchmarks<chunky_image<uint8_t, 3>, 3>(
+      "chunky uint8_t x3", input_width, input_height, output_width, output_height, threads);
 
   return 0;
 }
@@ -23,15 +23,15 @@ using namespace nda;
 
 continuous_kernel parse_kernel(const char* name) {
   if (strcmp(name, "box") == 0) {
-    return box;
+    return {box, 0.5f};
   } else if (strcmp(name, "linear") == 0) {
-    return linear;
+    return {linear, 1.0f};
   } else if (strcmp(name, "quadratic") == 0) {
-    return interpolating_quadratic;
+    return {interpolating_quadratic, 1.5f};
   } else if (strcmp(name, "cubic") == 0) {
-    return interpolating_cubic;
+    return {interpolating_cubic, 2.0f};
   } else if (strcmp(name, "lanczos") == 0) {
-    return lanczos<4>;
+    return {lanczos<4>, 4.0f};
   } else {
     return nullptr;
   }
@@ -54,23 +54,6 @@ chunky_image_ref<const Magick::Quantum, 4> cref(const Magick::Image& img) {
   return {base, {width, height, 4}};
 }
 
-template <class T>
-planar_image<T> magick_to_array(const Magick::Image& img) {
-  // We can tell make_compact_copy the value_type of the array we want by giving
-  // it an allocator for that type.
-  auto chunky = cref(img);
-  planar_image_shape array_shape(chunky.width(), chunky.height(), chunky.channels());
-  return make_copy(chunky, array_shape, std::allocator<T>());
-}
-
-template <class T, class Shape>
-Magick::Image array_to_magick(const array_ref<T, Shape>& img) {
-  Magick::Image result(Magick::Geometry(img.width(), img.height()), Magick::Color());
-  copy(img, ref(result));
-  result.syncPixels();
-  return result;
-}
-
 int main(int argc, char* argv[]) {
   Magick::InitializeMagick(*argv);
 
@@ -89,17 +72,17 @@ int main(int argc, char* argv[]) {
   Magick::Image image;
   image.read(input_path);
 
-  auto input = magick_to_array<float>(image);
+  Magick::Image magick_output(Magick::Geometry(new_width, new_height), Magick::Color());
 
-  planar_image<float> output({new_width, new_height, 4});
+  // Magick::Quantum is an 8 or 16-bit integer, so the pixels are resampled in
+  // fixed point, directly from and to the images' pixel caches.
+  auto input = cref(image);
+  auto output = ref(magick_output);
   const rational<index_t> rate_x(output.width(), input.width());
   const rational<index_t> rate_y(output.height(), input.height());
-  resample(input.cref(), output.ref(), rate_x, rate_y, kernel);
-
-  const float max_quantum = std::numeric_limits<Magick::Quantum>::max();
-  output.for_each_value([=](float& i) { i = std::max(std::min(i, max_quantum), 0.0f); });
+  resample(input, output, rate_x, rate_y, kernel);
 
-  Magick::Image magick_output = array_to_magick(output.cref());
+  magick_output.syncPixels();
   magick_output.write(output_path);
   return 0;
 }
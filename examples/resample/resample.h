@@ -17,20 +17,55 @@
 
 #include "array.h"
 #include "ein_reduce.h"
+#include "image.h"
+#include "parallel.h"
 #include "rational.h"
 
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
 namespace nda {
 
-/** A reconstruction kernel is a continuous function. */
-using continuous_kernel = std::function<float(float)>;
-
-/** Box kernel. */
+/** A reconstruction kernel is a continuous function `kernel(s)`, which is
+ * zero for `|s|` greater than the `support` of the kernel. */
+class continuous_kernel {
+  std::function<float(float)> fn_;
+  // If the kernel is a function pointer, the pointer, which identifies the
+  // kernel in the cache of kernel weights.
+  float (*fn_ptr_)(float) = nullptr;
+  float support_ = std::numeric_limits<float>::max();
+
+public:
+  continuous_kernel() = default;
+  /** Make a kernel from a function `fn` with the given `support`. If the
+   * support is not specified, it is unbounded, and the kernel is evaluated
+   * at every input position. */
+  continuous_kernel(float (*fn)(float), float support = std::numeric_limits<float>::max())
+      : fn_(fn), fn_ptr_(fn), support_(support) {}
+  template <class Fn, class = std::enable_if_t<!std::is_convertible<Fn, float (*)(float)>::value>>
+  continuous_kernel(Fn fn, float support = std::numeric_limits<float>::max())
+      : fn_(std::move(fn)), support_(support) {}
+
+  float operator()(float s) const { return fn_(s); }
+
+  float support() const { return support_; }
+  /** The function pointer this kernel was made from, or `nullptr` if it was
+   * made from another callable object. */
+  float (*function_pointer() const)(float) { return fn_ptr_; }
+};
+
+/** Box kernel, with support 0.5. */
 inline float box(float s) { return std::abs(s) <= 0.5f ? 1.0f : 0.0f; }
 
-/** Linear interpolation kernel. */
+/** Linear interpolation kernel, with support 1. */
 inline float linear(float s) { return std::max(0.0f, 1.0f - std::abs(s)); }
 
 // The quadratic and cubic formulas come from
@@ -61,16 +96,18 @@ inline float cubic_family(float s, float B, float C) {
   }
 }
 
-/** Interpolating quadratic kernel. */
+/** Interpolating quadratic kernel, with support 1.5. */
 inline float interpolating_quadratic(float s) { return quadratic_family(s, 1.0f); }
 
-/** Interpolating cubic, i.e. Catmull-Rom spline. */
+/** Interpolating cubic, i.e. Catmull-Rom spline, with support 2. */
 inline float interpolating_cubic(float s) { return cubic_family(s, 0.0f, 0.5f); }
 
-/** Smooth but soft quadratic B-spline approximation (not interpolating). */
+/** Smooth but soft quadratic B-spline approximation (not interpolating), with
+ * support 1.5. */
 inline float quadratic_bspline(float s) { return quadratic_family(s, 0.5f); }
 
-/** Smooth but soft cubic B-spline approximation (not interpolating). */
+/** Smooth but soft cubic B-spline approximation (not interpolating), with
+ * support 2. */
 inline float cubic_bspline(float s) { return cubic_family(s, 1.0f, 0.0f); }
 
 inline float sinc(float s) {
@@ -78,7 +115,7 @@ inline float sinc(float s) {
   return std::abs(s) > 1e-6f ? std::sin(s) / s : 1.0f;
 }
 
-/** Lanczos kernel, with `2*side_lobes + 1` lobes. */
+/** Lanczos kernel, with `2*side_lobes + 1` lobes, and support `side_lobes`. */
 inline float lanczos(float s, int side_lobes) {
   if (std::abs(s) <= side_lobes) {
     return sinc(s) * sinc(s / side_lobes);
@@ -93,44 +130,64 @@ float lanczos(float s) {
 
 namespace internal {
 
-// An array of kernels is not just a 2D array, because each kernel may
-// have different bounds.
-using kernel_allocator = auto_allocator<float, 16>;
-using kernel_array = dense_array<dense_array<float, 1, kernel_allocator>, 1>;
+// The kernels for each position in a dimension 'out' sampling from a
+// dimension 'in', padded to the same number of taps, so that
+// out(x) = sum(in(in.min() + offsets(x) + k) * weights(x, k)) for k in
+// [0, taps). The taps are in bounds of 'in'. `fixed_weights` are the
+// weights in fixed point, with `fixed_bits` fractional bits.
+struct kernel_taps {
+  static constexpr int fixed_bits = 14;
+
+  index_t taps = 0;
+  dense_array<index_t, 1> offsets;
+  dense_array<float, 2> weights;
+  dense_array<int16_t, 2> fixed_weights;
+
+  // The weights of kernel `x`, as an array indexed by the input coordinate,
+  // where `in_min` is the min of the input.
+  auto kernel(index_t x, index_t in_min) const {
+    const shape<dim<>> kernel_shape(dim<>(in_min + offsets(x), taps, weights.dim<1>().stride()));
+    return make_array_ref(&weights(x, 0), kernel_shape);
+  }
+};
 
 // Build kernels for each index in a dim 'out' to sample from a dim 'in'.
-// The kernels are guaranteed not to read out of bounds of 'in'.
-inline kernel_array build_kernels(
-    interval<> in, interval<> out, const rational<index_t>& rate, continuous_kernel kernel) {
+// The kernel is only evaluated within its support of each output.
+inline kernel_taps build_kernels(
+    interval<> in, interval<> out, const rational<index_t>& rate, const continuous_kernel& kernel) {
   // The constant 1/2 as a rational.
   const rational<index_t> half = rational<index_t>(1, 2);
 
-  // We need to compute a kernel for each output position.
-  kernel_array kernels(out);
-
-  // Define a buffer to produce each kernel in.
-  dense_array<float, 1> buffer(in);
-
   // When downsampling, stretch the kernel to perform low pass filtering.
   // TODO: Move this, so it's possible to specify kernels that include
   // low pass filtering, e.g. trapezoid kernels.
-  float kernel_scale = std::min(to_float(rate), 1.0f);
+  const float kernel_scale = std::min(to_float(rate), 1.0f);
+
+  // The distance from the center of a kernel to the inputs it may read.
+  const float radius = std::min(kernel.support(), in.extent() * kernel_scale) / kernel_scale;
 
+  // Evaluate each kernel, keeping track of the bounds of its non-zero values.
+  // TODO: This might produce incorrect results if a kernel has zeros mixed
+  // in with non-zeros before the "end" (though such kernels probably aren't
+  // very good).
+  dense_array<float, 1> buffer(in);
+  std::vector<float> values;
+  dense_array<index_t, 1> mins(out);
+  dense_array<index_t, 1> maxs(out);
+  dense_array<index_t, 1> begins(out);
+  index_t taps = 0;
   for (index_t x : out) {
     // Compute the fractional position of the input corresponding to
     // this output.
     const float in_x = to_float((x + half) / rate - half);
 
-    // Fill the buffer, while keeping track of the sum of, first, and
-    // last non-zero kernel values,
-    // TODO: This is messy, optimize it better.
-    // TODO: This might produce incorrect results if a kernel has zeros mixed
-    // in with non-zeros before the "end" (though such kernels probably aren't
-    // very good).
-    index_t min = in.max();
-    index_t max = in.min();
+    // Include one more input on each side, in case of rounding errors.
+    const index_t rx_min = std::max(in.min(), static_cast<index_t>(std::floor(in_x - radius)) - 1);
+    const index_t rx_max = std::min(in.max(), static_cast<index_t>(std::ceil(in_x + radius)) + 1);
+    index_t min = rx_max;
+    index_t max = rx_min;
     float sum = 0.0f;
-    for (index_t rx : in) {
+    for (index_t rx = rx_min; rx <= rx_max; rx++) {
       float k_rx = kernel((rx - in_x) * kernel_scale);
       buffer(rx) = k_rx;
       if (k_rx != 0.0f) {
@@ -139,30 +196,59 @@ inline kernel_array build_kernels(
         max = std::max(max, rx);
       }
     }
-
-    // Crop and normalize the kernel.
-    index_t extent = max - min + 1;
-    assert(extent > 0);
+    assert(max >= min);
     assert(sum > 0.0f);
-    dense_array<float, 1, kernel_allocator> kernel_x({{min, extent}});
-    for (index_t rx : kernel_x.x()) {
-      kernel_x(rx) = buffer(rx) / sum;
+
+    // Save the normalized non-zero part of the kernel.
+    mins(x) = min;
+    maxs(x) = max;
+    begins(x) = values.size();
+    for (index_t rx = min; rx <= max; rx++) {
+      values.push_back(buffer(rx) / sum);
     }
+    taps = std::max(taps, max - min + 1);
+  }
 
-    // Make a copy without the padding, and store it in the kernel array.
-    kernels(x) = std::move(kernel_x);
+  // Pack the kernels into one table.
+  kernel_taps result;
+  result.taps = taps;
+  result.offsets = dense_array<index_t, 1>(dense_shape<1>(out));
+  result.weights = dense_array<float, 2>({out, taps}, 0.0f);
+  for (index_t x : out) {
+    // Move kernels near the end of the input back, so the padded taps are in
+    // bounds.
+    const index_t offset = std::min(mins(x), in.max() + 1 - taps);
+    result.offsets(x) = offset - in.min();
+    for (index_t rx = mins(x); rx <= maxs(x); rx++) {
+      result.weights(x, rx - offset) = values[begins(x) + rx - mins(x)];
+    }
   }
 
-  return kernels;
+  // Quantize the weights, and add the rounding error of each kernel to its
+  // largest weight, so the fixed point kernels also sum to one.
+  const int32_t one = 1 << kernel_taps::fixed_bits;
+  result.fixed_weights = dense_array<int16_t, 2>({out, taps});
+  for (index_t x : out) {
+    int32_t sum = 0;
+    index_t largest = 0;
+    for (index_t k = 0; k < taps; k++) {
+      const float w = result.weights(x, k);
+      result.fixed_weights(x, k) = static_cast<int16_t>(std::lround(w * one));
+      sum += result.fixed_weights(x, k);
+      if (w > result.weights(x, largest)) { largest = k; }
+    }
+    result.fixed_weights(x, largest) += one - sum;
+  }
+  return result;
 }
 
 // Resize the y dimension of an input array 'in' to a destination array 'out',
-// using kernels(y) to produce out(., y, .).
+// using the kernel of y to produce out(., y, .).
 template <class TIn, class TOut>
-void resample_y(const TIn& in, const TOut& out, const kernel_array& kernels) {
+void resample_y(const TIn& in, const TOut& out, const kernel_taps& kernels) {
   enum { x = 0, ry = 1, c = 2 };
   for (index_t y : out.y()) {
-    const auto& kernel_y = kernels(y);
+    const auto kernel_y = kernels.kernel(y, in.y().min());
     fill(out(_, y, _), 0.0f);
     // TODO: Consider making reconcile_dim in ein_reduce take the intersection
     // of the dims to avoid needing the crop of in here.
@@ -171,6 +257,303 @@ void resample_y(const TIn& in, const TOut& out, const kernel_array& kernels) {
   }
 }
 
+// Kernels with at most this many taps are resampled in x directly, instead of
+// transposing the image and resampling in y.
+constexpr index_t max_direct_taps = 8;
+
+// Resize the x dimension of an input array 'in' to a destination array 'out',
+// where all of the kernels have `Taps` taps. The outputs are computed in
+// blocks of `Block` values, gathering each tap for all of the values of the
+// block, which compilers can vectorize.
+template <index_t Taps, class TIn, class TOut>
+void resample_x(const TIn& in, const TOut& out, const kernel_taps& taps) {
+  assert(taps.taps == Taps);
+  constexpr index_t Block = 16;
+  const index_t in_stride = in.x().stride();
+  const index_t* offsets = &taps.offsets(out.x().min());
+  for (index_t c : out.c()) {
+    for (index_t y : out.y()) {
+      const auto* in_row = &in(in.x().min(), y, c);
+      index_t x = out.x().min();
+      for (; x + Block <= out.x().max() + 1; x += Block) {
+        const index_t* offsets_x = offsets + (x - out.x().min());
+        float sums[Block] = {0.0f};
+        for (index_t k = 0; k < Taps; k++) {
+          const float* weights_k = &taps.weights(x, k);
+          for (index_t j = 0; j < Block; j++) {
+            sums[j] += in_row[(offsets_x[j] + k) * in_stride] * weights_k[j];
+          }
+        }
+        for (index_t j = 0; j < Block; j++) {
+          out(x + j, y, c) = sums[j];
+        }
+      }
+      for (; x <= out.x().max(); x++) {
+        const index_t offset = offsets[x - out.x().min()];
+        float sum = 0.0f;
+        for (index_t k = 0; k < Taps; k++) {
+          sum += in_row[(offset + k) * in_stride] * taps.weights(x, k);
+        }
+        out(x, y, c) = sum;
+      }
+    }
+  }
+}
+
+template <class TIn, class TOut>
+void resample_x(const TIn& in, const TOut& out, const kernel_taps& taps) {
+  switch (taps.taps) {
+  case 1: resample_x<1>(in, out, taps); return;
+  case 2: resample_x<2>(in, out, taps); return;
+  case 3: resample_x<3>(in, out, taps); return;
+  case 4: resample_x<4>(in, out, taps); return;
+  case 5: resample_x<5>(in, out, taps); return;
+  case 6: resample_x<6>(in, out, taps); return;
+  case 7: resample_x<7>(in, out, taps); return;
+  case 8: resample_x<8>(in, out, taps); return;
+  default: assert(!"unsupported number of taps");
+  }
+}
+
+// Images of these types can be resampled in fixed point. The intermediate
+// image resampled in y has `intermediate_bits` more bits of precision than
+// the input, and can represent the overshoot of kernels with negative lobes.
+template <class T>
+struct fixed_point_traits {
+  static constexpr bool enabled = false;
+};
+
+template <>
+struct fixed_point_traits<uint8_t> {
+  static constexpr bool enabled = true;
+  using intermediate = int32_t;
+  static constexpr int intermediate_bits = 6;
+};
+
+template <>
+struct fixed_point_traits<uint16_t> {
+  static constexpr bool enabled = true;
+  using intermediate = int32_t;
+  static constexpr int intermediate_bits = 0;
+};
+
+// Whether resampling `TIn` to `TOut` uses the fixed point implementation.
+template <class TIn, class TOut>
+using use_fixed_point = std::integral_constant<bool,
+    fixed_point_traits<TOut>::enabled && std::is_same<std::remove_const_t<TIn>, TOut>::value>;
+
+// Round the fixed point value `x` with `bits` fractional bits to the nearest
+// integer, saturating to the range of `T`.
+template <class T>
+NDARRAY_INLINE T round_saturate(int32_t x, int bits) {
+  x = (x + (1 << (bits - 1))) >> bits;
+  x = std::max<int32_t>(x, std::numeric_limits<T>::min());
+  x = std::min<int32_t>(x, std::numeric_limits<T>::max());
+  return static_cast<T>(x);
+}
+
+// Converts the sums of the fixed point kernels to `T`.
+template <class T>
+struct round_saturate_fn {
+  int bits;
+  NDARRAY_INLINE T operator()(int32_t x) const { return round_saturate<T>(x, bits); }
+};
+
+// Converts the sums of the floating point kernels to `T`.
+template <class T>
+struct convert_fn {
+  template <class Acc>
+  NDARRAY_INLINE T operator()(Acc x) const {
+    return static_cast<T>(x);
+  }
+};
+
+// Compute `width` values of a row resampled in y, from `taps` rows of the
+// input beginning at `in`, with the weights `weights[k * weights_stride]`.
+// The sums are accumulated in `Acc`, in blocks small enough to keep in
+// registers, and converted to the output with `store`. If `Dense` is true,
+// the input rows are contiguous.
+template <bool Dense, class Acc, class TIn, class W, class T, class Store>
+void resample_y_row(const TIn* in, index_t in_stride_x, index_t in_stride_y, const W* weights,
+    index_t weights_stride, index_t taps, T* out, index_t width, Store store) {
+  constexpr index_t Block = 64;
+  const index_t in_stride = Dense ? 1 : in_stride_x;
+  index_t x = 0;
+  for (; x + Block <= width; x += Block) {
+    const TIn* in_x = in + x * in_stride;
+    Acc sums[Block] = {0};
+    for (index_t k = 0; k < taps; k++) {
+      const TIn* in_k = in_x + k * in_stride_y;
+      const Acc w = weights[k * weights_stride];
+      for (index_t j = 0; j < Block; j++) {
+        sums[j] += in_k[j * in_stride] * w;
+      }
+    }
+    for (index_t j = 0; j < Block; j++) {
+      out[x + j] = store(sums[j]);
+    }
+  }
+  for (; x < width; x++) {
+    const TIn* in_x = in + x * in_stride;
+    Acc sum = 0;
+    for (index_t k = 0; k < taps; k++) {
+      sum += in_x[k * in_stride_y] * static_cast<Acc>(weights[k * weights_stride]);
+    }
+    out[x] = store(sum);
+  }
+}
+
+// Resize the y dimension of `in` to `out` as `resample_y` does, using the
+// fixed point weights of the kernels. `out` has `bits` more bits of
+// precision than `in`, and must be dense in x.
+template <class TIn, class TOut>
+void resample_y_fixed(const TIn& in, const TOut& out, const kernel_taps& kernels, int bits) {
+  assert(out.x().stride() == 1);
+  using T = typename TOut::value_type;
+  const round_saturate_fn<T> store{kernel_taps::fixed_bits - bits};
+  const index_t width = out.x().extent();
+  const index_t in_stride_x = in.x().stride();
+  const index_t in_stride_y = in.y().stride();
+  const index_t weights_stride = kernels.fixed_weights.dim<1>().stride();
+  for (index_t c : out.c()) {
+    for (index_t y : out.y()) {
+      const auto* in_y = &in(out.x().min(), in.y().min() + kernels.offsets(y), c);
+      const int16_t* weights = &kernels.fixed_weights(y, 0);
+      auto* out_y = &out(out.x().min(), y, c);
+      if (in_stride_x == 1) {
+        resample_y_row<true, int32_t>(in_y, in_stride_x, in_stride_y, weights, weights_stride,
+            kernels.taps, out_y, width, store);
+      } else {
+        resample_y_row<false, int32_t>(in_y, in_stride_x, in_stride_y, weights, weights_stride,
+            kernels.taps, out_y, width, store);
+      }
+    }
+  }
+}
+
+// Resize the x dimension of `in` to `out` as `resample_x` does, using the
+// fixed point weights of the kernels. `in` has `bits` more bits of precision
+// than `out`. If `Taps` is 0, the number of taps is not known at compile time.
+template <index_t Taps, class TIn, class TOut>
+void resample_x_fixed(const TIn& in, const TOut& out, const kernel_taps& kernels, int bits) {
+  assert(Taps == 0 || kernels.taps == Taps);
+  using T = typename TOut::value_type;
+  constexpr index_t Block = 16;
+  const index_t taps = Taps > 0 ? Taps : kernels.taps;
+  const int shift = kernel_taps::fixed_bits + bits;
+  const index_t width = out.x().extent();
+  const index_t in_stride = in.x().stride();
+  const index_t out_stride = out.x().stride();
+  const index_t* offsets = &kernels.offsets(out.x().min());
+  // The output may alias anything if it is 8-bit, so the weights and the
+  // output are addressed with pointers computed outside of the loops.
+  const int16_t* weights = &kernels.fixed_weights(out.x().min(), 0);
+  const index_t weights_stride = kernels.fixed_weights.dim<1>().stride();
+  for (index_t c : out.c()) {
+    for (index_t y : out.y()) {
+      const auto* in_row = &in(in.x().min(), y, c);
+      T* out_row = &out(out.x().min(), y, c);
+      index_t x = 0;
+      for (; x + Block <= width; x += Block) {
+        int32_t sums[Block] = {0};
+        for (index_t k = 0; k < taps; k++) {
+          const int16_t* weights_k = weights + k * weights_stride + x;
+          for (index_t j = 0; j < Block; j++) {
+            sums[j] += in_row[(offsets[x + j] + k) * in_stride] * weights_k[j];
+          }
+        }
+        for (index_t j = 0; j < Block; j++) {
+          out_row[(x + j) * out_stride] = round_saturate<T>(sums[j], shift);
+        }
+      }
+      for (; x < width; x++) {
+        int32_t sum = 0;
+        for (index_t k = 0; k < taps; k++) {
+          sum += in_row[(offsets[x] + k) * in_stride] * weights[k * weights_stride + x];
+        }
+        out_row[x * out_stride] = round_saturate<T>(sum, shift);
+      }
+    }
+  }
+}
+
+template <class TIn, class TOut>
+void resample_x_fixed(const TIn& in, const TOut& out, const kernel_taps& kernels, int bits) {
+  switch (kernels.taps) {
+  case 1: resample_x_fixed<1>(in, out, kernels, bits); return;
+  case 2: resample_x_fixed<2>(in, out, kernels, bits); return;
+  case 3: resample_x_fixed<3>(in, out, kernels, bits); return;
+  case 4: resample_x_fixed<4>(in, out, kernels, bits); return;
+  case 5: resample_x_fixed<5>(in, out, kernels, bits); return;
+  case 6: resample_x_fixed<6>(in, out, kernels, bits); return;
+  case 7: resample_x_fixed<7>(in, out, kernels, bits); return;
+  case 8: resample_x_fixed<8>(in, out, kernels, bits); return;
+  default: resample_x_fixed<0>(in, out, kernels, bits); return;
+  }
+}
+
+// The number of values of a pixel of a chunky image with `Channels`
+// channels computed together. Pixels with 3 channels are computed as vectors
+// of 4 values, where the last value is discarded.
+template <index_t Channels>
+constexpr index_t chunky_lanes() {
+  return Channels == 3 ? 4 : Channels;
+}
+
+// Resize a row of a chunky image with `Channels` channels in x, from `in`
+// to `width` pixels of `out`, where each kernel has `Taps` taps, or
+// `taps` taps if `Taps` is 0. All of the channels of a pixel are computed
+// together, so each tap is one vector of `chunky_lanes<Channels>()` values.
+// This may read up to one pixel past the end of `in`.
+template <index_t Channels, index_t Taps, class Acc, class TIn, class W, class T, class Store>
+void resample_x_chunky_row(const TIn* in, const index_t* offsets, const W* weights,
+    index_t weights_stride, index_t taps, T* out, index_t width, Store store) {
+  constexpr index_t Lanes = chunky_lanes<Channels>();
+  const index_t n = Taps > 0 ? Taps : taps;
+  for (index_t x = 0; x < width; x++) {
+    const TIn* in_x = in + offsets[x] * Channels;
+    const W* weights_x = weights + x;
+    Acc sums[Lanes] = {0};
+    for (index_t k = 0; k < n; k++) {
+      const Acc w = weights_x[k * weights_stride];
+      const TIn* in_k = in_x + k * Channels;
+      for (index_t c = 0; c < Lanes; c++) {
+        sums[c] += in_k[c] * w;
+      }
+    }
+    T results[Lanes];
+    unroll<Lanes>([&](auto c) { results[c] = store(sums[c]); });
+    // The extra lanes of a pixel can be written to the next pixel, which is
+    // overwritten afterwards.
+    T* out_x = out + x * Channels;
+    if (x + 1 < width) {
+      std::memcpy(out_x, results, sizeof(T) * Lanes);
+    } else {
+      std::memcpy(out_x, results, sizeof(T) * Channels);
+    }
+  }
+}
+
+template <index_t Channels, class Acc, class TIn, class W, class T, class Store>
+void resample_x_chunky_row(const TIn* in, const index_t* offsets, const W* weights,
+    index_t weights_stride, index_t taps, T* out, index_t width, Store store) {
+  const auto row = [&](auto taps_constant) {
+    resample_x_chunky_row<Channels, decltype(taps_constant)::value, Acc>(
+        in, offsets, weights, weights_stride, taps, out, width, store);
+  };
+  switch (taps) {
+  case 1: row(std::integral_constant<index_t, 1>()); return;
+  case 2: row(std::integral_constant<index_t, 2>()); return;
+  case 3: row(std::integral_constant<index_t, 3>()); return;
+  case 4: row(std::integral_constant<index_t, 4>()); return;
+  case 5: row(std::integral_constant<index_t, 5>()); return;
+  case 6: row(std::integral_constant<index_t, 6>()); return;
+  case 7: row(std::integral_constant<index_t, 7>()); return;
+  case 8: row(std::integral_constant<index_t, 8>()); return;
+  default: row(std::integral_constant<index_t, 0>()); return;
+  }
+}
+
 // TODO: Get rid of these ugly helpers. Shapes shouldn't preserve strides in some usages.
 template <index_t Min, index_t Extent, index_t Stride>
 dim<Min, Extent> without_stride(const dim<Min, Extent, Stride>& d) {
@@ -182,47 +565,248 @@ auto make_temp_image_shape(X x, Y y, C c) {
   return make_shape(with_stride<1>(x), without_stride(y), without_stride(c));
 }
 
+// Temporary images are allocated from the arena of the calling thread, and
+// must be destroyed before the enclosing `arena_scope` ends.
 template <class T, class X, class Y, class C>
 auto make_temp_image(X x, Y y, C c) {
-  return make_array<T>(make_temp_image_shape(x, y, c));
+  return make_array<T>(make_temp_image_shape(x, y, c), arena_allocator<T>());
+}
+
+// The output is computed in horizontal strips of this many rows.
+constexpr index_t resample_strip_size = 64;
+
+// A cache of the kernels built by `build_kernels`, so resampling many images
+// of the same size, e.g. the frames of a video, does not rebuild the kernels.
+// Only kernels made from function pointers can be cached.
+class kernel_cache {
+  using key = std::tuple<index_t, index_t, index_t, index_t, index_t, index_t, float (*)(float),
+      float>;
+
+  std::mutex mutex_;
+  std::map<key, std::shared_ptr<const kernel_taps>> entries_;
+
+public:
+  // The cache is cleared when it reaches this many entries.
+  static constexpr size_t max_size = 16;
+
+  std::shared_ptr<const kernel_taps> get(interval<> in, interval<> out,
+      const rational<index_t>& rate, const continuous_kernel& kernel) {
+    if (!kernel.function_pointer()) {
+      return std::make_shared<const kernel_taps>(build_kernels(in, out, rate, kernel));
+    }
+    const key k(in.min(), in.extent(), out.min(), out.extent(), rate.numerator(),
+        rate.denominator(), kernel.function_pointer(), kernel.support());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto i = entries_.find(k);
+      if (i != entries_.end()) { return i->second; }
+    }
+    // Build the kernels without holding the lock. If another thread builds
+    // the same kernels concurrently, the last one wins.
+    auto result = std::make_shared<const kernel_taps>(build_kernels(in, out, rate, kernel));
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.size() >= max_size) { entries_.clear(); }
+    entries_[k] = result;
+    return result;
+  }
+
+  static kernel_cache& global() {
+    static kernel_cache cache;
+    return cache;
+  }
+};
+
+// The kernels used to resample an image.
+struct resample_kernels {
+  std::shared_ptr<const kernel_taps> x;
+  std::shared_ptr<const kernel_taps> y;
+};
+
+template <class ShapeIn, class ShapeOut>
+resample_kernels build_resample_kernels(const ShapeIn& in, const ShapeOut& out,
+    const rational<index_t>& rate_x, const rational<index_t>& rate_y,
+    const continuous_kernel& kernel) {
+  kernel_cache& cache = kernel_cache::global();
+  resample_kernels result;
+  result.x = cache.get(
+      {in.x().min(), in.x().extent()}, {out.x().min(), out.x().extent()}, rate_x, kernel);
+  result.y = cache.get(
+      {in.y().min(), in.y().extent()}, {out.y().min(), out.y().extent()}, rate_y, kernel);
+  return result;
+}
+
+// Resample the strip of rows `ys` of the output.
+template <class TIn, class TOut, class ShapeIn, class ShapeOut>
+void resample_strip(const array_ref<TIn, ShapeIn>& in, const array_ref<TOut, ShapeOut>& out,
+    const interval<>& ys, const resample_kernels& kernels, std::false_type /*fixed_point*/) {
+  auto out_y = out(out.x(), ys, out.c());
+
+  // The temporary images of this strip reuse the memory of the previous
+  // strip computed by this thread.
+  arena_scope temps;
+
+  // Resample the input in y, to an intermediate buffer.
+  auto strip = make_temp_image<TOut>(in.x(), out_y.y(), out_y.c());
+  resample_y(in, strip.ref(), *kernels.y);
+
+  if (kernels.x->taps <= max_direct_taps) {
+    // Resample the intermediate in x directly to the output.
+    resample_x(strip.cref(), out_y, *kernels.x);
+    return;
+  }
+
+  // Transpose the intermediate.
+  auto strip_tr = make_temp_image<TOut>(out_y.y(), in.x(), out_y.c());
+  copy(transpose<1, 0, 2>(strip.cref()), strip_tr);
+
+  // Resample the intermediate in x.
+  auto out_tr = make_temp_image<TOut>(out_y.y(), out_y.x(), out_y.c());
+  resample_y(strip_tr.cref(), out_tr.ref(), *kernels.x);
+
+  // Transpose the intermediate to the output.
+  copy(transpose<1, 0, 2>(out_tr.cref()), out_y);
+}
+
+// Resample the strip of rows `ys` of an integer image in fixed point.
+template <class TIn, class TOut, class ShapeIn, class ShapeOut>
+void resample_strip(const array_ref<TIn, ShapeIn>& in, const array_ref<TOut, ShapeOut>& out,
+    const interval<>& ys, const resample_kernels& kernels, std::true_type /*fixed_point*/) {
+  using traits = fixed_point_traits<TOut>;
+  auto out_y = out(out.x(), ys, out.c());
+
+  arena_scope temps;
+
+  // The intermediate is always resampled in x directly. It is 32-bit, so the
+  // compiler can vectorize the gathers of its values.
+  auto strip = make_temp_image<typename traits::intermediate>(in.x(), out_y.y(), out_y.c());
+  resample_y_fixed(in, strip.ref(), *kernels.y, traits::intermediate_bits);
+  resample_x_fixed(strip.cref(), out_y, *kernels.x, traits::intermediate_bits);
+}
+
+template <class TIn, class TOut, class ShapeIn, class ShapeOut>
+void resample_strip(const array_ref<TIn, ShapeIn>& in, const array_ref<TOut, ShapeOut>& out,
+    const interval<>& ys, const resample_kernels& kernels) {
+  resample_strip(in, out, ys, kernels, use_fixed_point<TIn, TOut>());
+}
+
+// Resample the strip of rows `ys` of a chunky image with `Channels` channels,
+// accumulating the sums in `Acc` with the weights `W`, via a row of an
+// intermediate chunky image of `Intermediate`. The rows of chunky images are
+// contiguous, so the y pass treats a row as one dimension of
+// `width * Channels` values. `in` and `out` point to the first pixel of the
+// first row of the input and output.
+template <index_t Channels, class Acc, class Intermediate, class TIn, class TOut, class W,
+    class StoreY, class StoreX>
+void resample_chunky_rows(const TIn* in, index_t in_width, index_t in_stride_y, TOut* out,
+    index_t out_min_y, index_t out_stride_y, const interval<>& xs, const interval<>& ys,
+    const kernel_taps& kernels_x, const dense_array<W, 2>& weights_x,
+    const kernel_taps& kernels_y, const dense_array<W, 2>& weights_y, StoreY store_y,
+    StoreX store_x) {
+  arena_scope temps;
+
+  const index_t row_size = in_width * Channels;
+  // The x pass may read one pixel past the end of the row.
+  std::vector<Intermediate, arena_allocator<Intermediate>> row(row_size + Channels, 0);
+  const index_t* offsets_x = &kernels_x.offsets(xs.min());
+  const index_t weights_x_stride = weights_x.template dim<1>().stride();
+  const index_t weights_y_stride = weights_y.template dim<1>().stride();
+  for (index_t y : ys) {
+    resample_y_row<true, Acc>(in + kernels_y.offsets(y) * in_stride_y, 1, in_stride_y,
+        &weights_y(y, 0), weights_y_stride, kernels_y.taps, row.data(), row_size, store_y);
+    resample_x_chunky_row<Channels, Acc>(row.data(), offsets_x, &weights_x(xs.min(), 0),
+        weights_x_stride, kernels_x.taps, out + (y - out_min_y) * out_stride_y, xs.extent(),
+        store_x);
+  }
+}
+
+// Resample the strip of rows `ys` of a chunky image, where the pixels are
+// dense, so all of the channels of a pixel can be computed together.
+template <class TIn, class TOut, index_t Channels>
+void resample_chunky_strip(const array_ref<TIn, chunky_image_shape<Channels>>& in,
+    const array_ref<TOut, chunky_image_shape<Channels>>& out, const interval<>& ys,
+    const resample_kernels& kernels, std::false_type /*fixed_point*/) {
+  resample_chunky_rows<Channels, float, TOut>(&in(in.x().min(), in.y().min(), 0),
+      in.x().extent(), in.y().stride(), &out(out.x().min(), out.y().min(), 0), out.y().min(),
+      out.y().stride(), interval<>(out.x().min(), out.x().extent()), ys, *kernels.x,
+      kernels.x->weights, *kernels.y, kernels.y->weights, convert_fn<TOut>(),
+      convert_fn<TOut>());
+}
+
+template <class TIn, class TOut, index_t Channels>
+void resample_chunky_strip(const array_ref<TIn, chunky_image_shape<Channels>>& in,
+    const array_ref<TOut, chunky_image_shape<Channels>>& out, const interval<>& ys,
+    const resample_kernels& kernels, std::true_type /*fixed_point*/) {
+  using traits = fixed_point_traits<TOut>;
+  using intermediate = typename traits::intermediate;
+  resample_chunky_rows<Channels, int32_t, intermediate>(&in(in.x().min(), in.y().min(), 0),
+      in.x().extent(), in.y().stride(), &out(out.x().min(), out.y().min(), 0), out.y().min(),
+      out.y().stride(), interval<>(out.x().min(), out.x().extent()), ys, *kernels.x,
+      kernels.x->fixed_weights, *kernels.y, kernels.y->fixed_weights,
+      round_saturate_fn<intermediate>{kernel_taps::fixed_bits - traits::intermediate_bits},
+      round_saturate_fn<TOut>{kernel_taps::fixed_bits + traits::intermediate_bits});
+}
+
+template <class TIn, class TOut, index_t Channels, class = std::enable_if_t<(Channels > 0)>>
+void resample_strip(const array_ref<TIn, chunky_image_shape<Channels>>& in,
+    const array_ref<TOut, chunky_image_shape<Channels>>& out, const interval<>& ys,
+    const resample_kernels& kernels) {
+  resample_chunky_strip(in, out, ys, kernels, use_fixed_point<TIn, TOut>());
+}
+
+// The strip `i` of the rows `ys`.
+inline interval<> resample_strip_rows(const interval<>& ys, index_t i) {
+  const index_t min = ys.min() + i * resample_strip_size;
+  return interval<>(min, std::min(resample_strip_size, ys.max() + 1 - min));
 }
 
 } // namespace internal
 
 /** Resample an array `in` to produce an array `out`, using an interpolation `kernel`.
- * Input coordinates (x, y) map to output coordinates (x * rate_x, y * rate_y). */
+ * Input coordinates (x, y) map to output coordinates (x * rate_x, y * rate_y).
+ *
+ * If `in` and `out` are both `uint8_t` or both `uint16_t` images, the
+ * resampling is computed in fixed point, with 14-bit weights and 32-bit
+ * accumulators, and the results are rounded and saturated to the range of
+ * the type. 8-bit results are within 1 of the rounded result of resampling
+ * in floating point. The precision of 16-bit results is limited by the
+ * weights, each tap of the kernels adds up to about 2 to the error. */
 template <class TIn, class TOut, class ShapeIn, class ShapeOut>
 void resample(array_ref<TIn, ShapeIn> in, array_ref<TOut, ShapeOut> out, rational<index_t> rate_x,
     rational<index_t> rate_y, continuous_kernel kernel) {
   // Make the kernels we need at each output x and y coordinate in the output.
-  internal::kernel_array kernels_x = internal::build_kernels(
-      {in.x().min(), in.x().extent()}, {out.x().min(), out.x().extent()}, rate_x, kernel);
-  internal::kernel_array kernels_y = internal::build_kernels(
-      {in.y().min(), in.y().extent()}, {out.y().min(), out.y().extent()}, rate_y, kernel);
+  const internal::resample_kernels kernels =
+      internal::build_resample_kernels(in.shape(), out.shape(), rate_x, rate_y, kernel);
 
   // Split the image into horizontal strips.
-  constexpr index_t StripSize = 64;
-  for (auto yo : split<StripSize>(out.y())) {
-    auto out_y = out(out.x(), yo, out.c());
-
-    // Resample the input in y, to an intermediate buffer.
-    auto strip = internal::make_temp_image<TOut>(in.x(), out_y.y(), out_y.c());
-    internal::resample_y(in, strip.ref(), kernels_y);
-
-    // Transpose the intermediate.
-    enum { x = 0, y = 1, c = 2 };
-    auto strip_tr = internal::make_temp_image<TOut>(out_y.y(), in.x(), out_y.c());
-    ein_reduce(ein<x, y, c>(strip_tr) = ein<y, x, c>(strip));
-
-    // Resample the intermediate in x.
-    auto out_tr = internal::make_temp_image<TOut>(out_y.y(), out_y.x(), out_y.c());
-    internal::resample_y(strip_tr.cref(), out_tr.ref(), kernels_x);
-
-    // Transpose the intermediate to the output.
-    ein_reduce(ein<x, y, c>(out_y) = ein<y, x, c>(out_tr));
+  const interval<> ys(out.y().min(), out.y().extent());
+  const index_t strips =
+      (ys.extent() + internal::resample_strip_size - 1) / internal::resample_strip_size;
+  for (index_t i = 0; i < strips; i++) {
+    internal::resample_strip(in, out, internal::resample_strip_rows(ys, i), kernels);
   }
 }
 
+/** Resample an array `in` to produce an array `out` as above, computing the
+ * horizontal strips of the output in parallel using `policy`. Each thread
+ * allocates the temporary images of its strips from its own `thread_arena`,
+ * so the memory is reused across strips without synchronization. */
+template <class TIn, class TOut, class ShapeIn, class ShapeOut>
+void resample(const parallel_policy& policy, array_ref<TIn, ShapeIn> in,
+    array_ref<TOut, ShapeOut> out, rational<index_t> rate_x, rational<index_t> rate_y,
+    continuous_kernel kernel) {
+  const internal::resample_kernels kernels =
+      internal::build_resample_kernels(in.shape(), out.shape(), rate_x, rate_y, kernel);
+
+  const interval<> ys(out.y().min(), out.y().extent());
+  const index_t strips =
+      (ys.extent() + internal::resample_strip_size - 1) / internal::resample_strip_size;
+  parallel_for(policy, interval<>(0, strips), [&](const interval<>& strip_range) {
+    for (index_t i : strip_range) {
+      internal::resample_strip(in, out, internal::resample_strip_rows(ys, i), kernels);
+    }
+  });
+}
+
 } // namespace nda
 
 #endif // NDARRAY_RESAMPLE_H
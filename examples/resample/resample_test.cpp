@@ -0,0 +1,133 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks that the specialized implementations of resampling, in fixed point
+// for 8 and 16-bit images, and for chunky images, match resampling planar
+// images in floating point.
+
+#include "resample.h"
+#include "image.h"
+
+#include <cstdlib>
+#include <type_traits>
+#include <iostream>
+#include <random>
+#include <utility>
+
+using namespace nda;
+
+const std::pair<const char*, continuous_kernel> kernels[] = {
+    {"box", {box, 0.5f}},
+    {"linear", {linear, 1.0f}},
+    {"quadratic", {interpolating_quadratic, 1.5f}},
+    {"cubic", {interpolating_cubic, 2.0f}},
+    {"lanczos3", {lanczos<3>, 3.0f}},
+    {"lanczos4", {lanczos<4>, 4.0f}},
+};
+
+// The largest value of the test images of `T`.
+template <class T>
+double max_value() {
+  return std::is_integral<T>::value ? std::numeric_limits<T>::max() : 1.0;
+}
+
+// The expected value of a `T` resampled in floating point to `x`.
+template <class T>
+double expected_value(float x) {
+  if (!std::is_integral<T>::value) { return x; }
+  return std::min(std::max(std::round(x), 0.0f), static_cast<float>(max_value<T>()));
+}
+
+// The largest difference between resampling `input` and resampling a planar
+// floating point copy of it.
+template <class T, class Shape>
+double max_error(const array<T, Shape>& input, index_t width, index_t height,
+    const continuous_kernel& kernel) {
+  const rational<index_t> rate_x(width, input.width());
+  const rational<index_t> rate_y(height, input.height());
+
+  array<T, Shape> output({width, height, input.channels()});
+  resample(input.cref(), output.ref(), rate_x, rate_y, kernel);
+
+  planar_image<float> input_float({input.width(), input.height(), input.channels()});
+  copy(input, input_float);
+  planar_image<float> output_float({width, height, input.channels()});
+  resample(input_float.cref(), output_float.ref(), rate_x, rate_y, kernel);
+
+  double error = 0;
+  for_all_indices(output.shape(), [&](index_t x, index_t y, index_t c) {
+    const double expected = expected_value<T>(output_float(x, y, c));
+    error = std::max(error, std::abs(output(x, y, c) - expected));
+  });
+  return error;
+}
+
+// Make a random image, with some blocks of the extreme values, where the
+// kernels with negative lobes overshoot.
+template <class Image>
+Image make_input(index_t width, index_t height, index_t channels) {
+  using T = typename Image::value_type;
+  std::mt19937 rng;
+  std::uniform_real_distribution<double> random_value(0, max_value<T>());
+  Image input({width, height, channels});
+  for_all_indices(input.shape(), [&](index_t x, index_t y, index_t c) {
+    if ((x / 7 + y / 5) % 3 == 0) {
+      input(x, y, c) = (x / 7) % 2 ? max_value<T>() : 0;
+    } else {
+      input(x, y, c) = random_value(rng);
+    }
+  });
+  return input;
+}
+
+template <class Image>
+bool test(const char* type_name, index_t channels, double tolerance) {
+  bool success = true;
+  const index_t sizes[][4] = {
+      {97, 53, 300, 200},
+      {300, 200, 97, 53},
+      {200, 150, 411, 60},
+  };
+  for (const auto& size : sizes) {
+    const Image input = make_input<Image>(size[0], size[1], channels);
+    for (const auto& kernel : kernels) {
+      const double error = max_error(input, size[2], size[3], kernel.second);
+      std::cout << type_name << " " << size[0] << "x" << size[1] << " -> " << size[2] << "x"
+                << size[3] << " " << kernel.first << " max error: " << error << std::endl;
+      if (error > tolerance) {
+        std::cout << "error exceeds tolerance " << tolerance << std::endl;
+        success = false;
+      }
+    }
+  }
+  return success;
+}
+
+int main() {
+  bool success = true;
+  success = test<chunky_image<float, 3>>("chunky float x3", 3, 1e-5) && success;
+  success = test<chunky_image<float, 4>>("chunky float x4", 4, 1e-5) && success;
+  success = test<planar_image<uint8_t>>("planar uint8_t", 3, 1) && success;
+  success = test<chunky_image<uint8_t, 3>>("chunky uint8_t x3", 3, 1) && success;
+  success = test<chunky_image<uint8_t, 4>>("chunky uint8_t x4", 4, 1) && success;
+  // The 14-bit weights limit the precision of 16-bit results, each tap can
+  // contribute about 2 to the error.
+  success = test<planar_image<uint16_t>>("planar uint16_t", 3, 16) && success;
+  success = test<chunky_image<uint16_t, 3>>("chunky uint16_t x3", 3, 16) && success;
+  success = test<chunky_image<uint16_t, 4>>("chunky uint16_t x4", 4, 16) && success;
+  // Chunky images with a dynamic number of channels use the generic
+  // implementation.
+  success = test<chunky_image<uint8_t>>("chunky uint8_t", 3, 1) && success;
+  return success ? 0 : 1;
+}
@@ -0,0 +1,359 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** \file gemm.h
+ * \brief Blocked matrix multiplication kernels, used by `multiply` in matrix.h
+ * and by `ein_reduce`. These kernels operate on pointers and strides, so they
+ * do not depend on any particular array type.
+ */
+#ifndef NDARRAY_GEMM_H
+#define NDARRAY_GEMM_H
+
+#include "array.h"
+
+#include <cstring>
+#include <vector>
+
+namespace nda {
+
+namespace internal {
+
+// The number of rows of the register tile of the result. The tile has two
+// vectors of columns, so these are chosen to use most of the vector registers
+// for accumulators.
+#if defined(__AVX512F__)
+// 32 registers: 24 accumulators.
+constexpr index_t gemm_tile_rows = 12;
+#elif defined(__AVX__)
+// 16 registers: 12 accumulators.
+constexpr index_t gemm_tile_rows = 6;
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+// 32 registers: 16 accumulators.
+constexpr index_t gemm_tile_rows = 8;
+#else
+// 16 registers: 8 accumulators.
+constexpr index_t gemm_tile_rows = 4;
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+template <class T>
+using enable_if_vectorizable =
+    std::enable_if_t<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>;
+#else
+template <class T>
+using enable_if_vectorizable = std::enable_if_t<false && sizeof(T) != 0>;
+#endif
+
+// The register tile sizes and the micro-kernel for types that map to vector
+// registers.
+template <class T, class = void>
+struct gemm_kernel {
+  static constexpr index_t rows = 4;
+  static constexpr index_t cols = 4;
+
+  // Compute the `rows` x `cols` tile of the product of a packed panel of A and
+  // a packed panel of B of depth `k`, and store or accumulate it to the tile
+  // `c` with dense columns.
+  static void run(index_t k, const T* NDARRAY_RESTRICT a, const T* NDARRAY_RESTRICT b, T* c,
+      index_t c_row_stride, bool accumulate) {
+    T acc[rows][cols] = {};
+    for (index_t kk = 0; kk < k; kk++) {
+      unroll<rows>([&](auto i) { unroll<cols>([&](auto j) { acc[i][j] += a[i] * b[j]; }); });
+      a += rows;
+      b += cols;
+    }
+    for (index_t i = 0; i < rows; i++) {
+      for (index_t j = 0; j < cols; j++) {
+        c[i * c_row_stride + j] = accumulate ? c[i * c_row_stride + j] + acc[i][j] : acc[i][j];
+      }
+    }
+  }
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+template <class T>
+struct gemm_kernel<T, enable_if_vectorizable<T>> {
+  typedef T vector_type __attribute__((vector_size(vector_bytes)));
+  static constexpr index_t lanes = vector_bytes / sizeof(T);
+  static constexpr index_t vectors = 2;
+  static constexpr index_t rows = gemm_tile_rows;
+  static constexpr index_t cols = lanes * vectors;
+
+  static void run(index_t k, const T* NDARRAY_RESTRICT a, const T* NDARRAY_RESTRICT b, T* c,
+      index_t c_row_stride, bool accumulate) {
+    vector_type acc[rows][vectors] = {};
+    for (index_t kk = 0; kk < k; kk++) {
+      vector_type b_k[vectors];
+      unroll<vectors>([&](auto j) { std::memcpy(&b_k[j], b + j * lanes, sizeof(vector_type)); });
+      unroll<rows>([&](auto i) {
+        // Broadcast a(i, kk) to all the lanes of a vector.
+        const vector_type a_ik = a[i] - vector_type{};
+        unroll<vectors>([&](auto j) { acc[i][j] += a_ik * b_k[j]; });
+      });
+      a += rows;
+      b += cols;
+    }
+    unroll<rows>([&](auto i) {
+      unroll<vectors>([&](auto j) {
+        T* c_ij = c + i * c_row_stride + j * lanes;
+        if (accumulate) {
+          vector_type c_ij_v;
+          std::memcpy(&c_ij_v, c_ij, sizeof(vector_type));
+          acc[i][j] += c_ij_v;
+        }
+        std::memcpy(c_ij, &acc[i][j], sizeof(vector_type));
+      });
+    });
+  }
+};
+#endif
+
+// Cache blocking parameters, in elements. The panels of B with depth
+// `gemm_depth` should fit in L1, the blocks of A should fit in L2, and the
+// blocks of B should fit in L3.
+template <class T>
+constexpr index_t gemm_depth() {
+  return 1024 / sizeof(T);
+}
+template <class T>
+constexpr index_t gemm_block_rows() {
+  return std::max<index_t>(1, (256 * 1024) / (gemm_depth<T>() * sizeof(T)) /
+                                  gemm_kernel<T>::rows) *
+         gemm_kernel<T>::rows;
+}
+template <class T>
+constexpr index_t gemm_block_cols() {
+  return std::max<index_t>(1, (4 * 1024 * 1024) / (gemm_depth<T>() * sizeof(T)) /
+                                  gemm_kernel<T>::cols) *
+         gemm_kernel<T>::cols;
+}
+
+// Scratch memory aligned to the vector size.
+template <class T>
+class gemm_buffer {
+  std::vector<T, aligned_allocator<T, vector_bytes>> buffer_;
+
+public:
+  explicit gemm_buffer(index_t size) : buffer_(size) {}
+  T* data() { return assume_aligned<vector_bytes>(buffer_.data()); }
+};
+
+// Pack an `m` x `k` block of the matrix `x` into panels of `Rows` rows, where
+// each column of the panel is contiguous. Rows past `m` are filled with zero.
+template <index_t Rows, class T>
+void gemm_pack(index_t m, index_t k, const T* x, index_t row_stride, index_t col_stride, T* dst) {
+  for (index_t io = 0; io < m; io += Rows) {
+    const index_t rows = std::min(Rows, m - io);
+    const T* x_io = x + io * row_stride;
+    if (rows == Rows && row_stride == 1) {
+      // The columns of the panel are contiguous in x.
+      for (index_t kk = 0; kk < k; kk++) {
+        std::copy(x_io + kk * col_stride, x_io + kk * col_stride + Rows, dst + kk * Rows);
+      }
+    } else if (rows == Rows && col_stride == 1) {
+      // The rows of the panel are contiguous in x. Read the rows in order.
+      unroll<Rows>([&](auto i) {
+        const T* x_i = x_io + i * row_stride;
+        for (index_t kk = 0; kk < k; kk++) {
+          dst[kk * Rows + i] = x_i[kk];
+        }
+      });
+    } else {
+      for (index_t kk = 0; kk < k; kk++) {
+        const T* x_k = x_io + kk * col_stride;
+        index_t i = 0;
+        for (; i < rows; i++) {
+          dst[kk * Rows + i] = x_k[i * row_stride];
+        }
+        for (; i < Rows; i++) {
+          dst[kk * Rows + i] = T(0);
+        }
+      }
+    }
+    dst += k * Rows;
+  }
+}
+
+// Compute the matrix product C = A*B, or C += A*B if `accumulate` is true,
+// where A is `m` x `k`, B is `k` x `n`, and C is `m` x `n`. The matrices are
+// described by pointers to their first element and strides between rows and
+// columns. This implements the blocking scheme of "Anatomy of high-performance
+// matrix multiplication" by Goto and van de Geijn: blocks of A and B are
+// packed into contiguous panels, and a micro-kernel computes a tile of C held
+// in registers.
+template <class T>
+void gemm(index_t m, index_t n, index_t k, const T* a, index_t a_row_stride,
+    index_t a_col_stride, const T* b, index_t b_row_stride, index_t b_col_stride, T* c,
+    index_t c_row_stride, index_t c_col_stride, bool accumulate) {
+  using kernel = gemm_kernel<T>;
+  constexpr index_t tile_rows = kernel::rows;
+  constexpr index_t tile_cols = kernel::cols;
+  constexpr index_t depth = gemm_depth<T>();
+  constexpr index_t block_rows = gemm_block_rows<T>();
+  constexpr index_t block_cols = gemm_block_cols<T>();
+
+  if (m <= 0 || n <= 0) { return; }
+  if (k <= 0) {
+    if (!accumulate) {
+      for (index_t i = 0; i < m; i++) {
+        for (index_t j = 0; j < n; j++) {
+          c[i * c_row_stride + j * c_col_stride] = T(0);
+        }
+      }
+    }
+    return;
+  }
+
+  auto round_up = [](index_t x, index_t n) { return (x + n - 1) / n * n; };
+  const index_t max_depth = std::min(depth, k);
+  gemm_buffer<T> packed_a(round_up(std::min(block_rows, m), tile_rows) * max_depth);
+  gemm_buffer<T> packed_b(round_up(std::min(block_cols, n), tile_cols) * max_depth);
+  T tile[tile_rows * tile_cols];
+
+  for (index_t jb = 0; jb < n; jb += block_cols) {
+    const index_t nb = std::min(block_cols, n - jb);
+    for (index_t kb = 0; kb < k; kb += depth) {
+      const index_t kc = std::min(depth, k - kb);
+      // After the first block of k, accumulate the partial sums.
+      const bool accumulate_kb = accumulate || kb > 0;
+      // B is packed transposed, so the columns of B are the "rows" of the
+      // panels.
+      gemm_pack<tile_cols>(nb, kc, b + kb * b_row_stride + jb * b_col_stride, b_col_stride,
+          b_row_stride, packed_b.data());
+      for (index_t ib = 0; ib < m; ib += block_rows) {
+        const index_t mb = std::min(block_rows, m - ib);
+        gemm_pack<tile_rows>(mb, kc, a + ib * a_row_stride + kb * a_col_stride, a_row_stride,
+            a_col_stride, packed_a.data());
+        for (index_t jt = 0; jt < nb; jt += tile_cols) {
+          const index_t nt = std::min(tile_cols, nb - jt);
+          const T* b_panel = packed_b.data() + jt * kc;
+          for (index_t it = 0; it < mb; it += tile_rows) {
+            const index_t mt = std::min(tile_rows, mb - it);
+            const T* a_panel = packed_a.data() + it * kc;
+            T* c_tile = c + (ib + it) * c_row_stride + (jb + jt) * c_col_stride;
+            if (mt == tile_rows && nt == tile_cols && c_col_stride == 1) {
+              // Write the result directly to C.
+              kernel::run(kc, a_panel, b_panel, c_tile, c_row_stride, accumulate_kb);
+              continue;
+            }
+
+            // This is a partial tile, compute it in a temporary buffer.
+            kernel::run(kc, a_panel, b_panel, tile, tile_cols, false);
+            for (index_t i = 0; i < mt; i++) {
+              T* c_i = c_tile + i * c_row_stride;
+              const T* tile_i = tile + i * tile_cols;
+              if (accumulate_kb) {
+                for (index_t j = 0; j < nt; j++) {
+                  c_i[j * c_col_stride] += tile_i[j];
+                }
+              } else {
+                for (index_t j = 0; j < nt; j++) {
+                  c_i[j * c_col_stride] = tile_i[j];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Compute the dot product of `n` elements of the dense vectors `a` and `b`,
+// using several accumulators to avoid serializing the additions.
+template <class T, class = void>
+struct gemv_kernel {
+  static T dot(index_t n, const T* NDARRAY_RESTRICT a, const T* NDARRAY_RESTRICT b) {
+    constexpr index_t accumulators = 4;
+    T acc[accumulators] = {};
+    index_t i = 0;
+    for (; i + accumulators <= n; i += accumulators) {
+      unroll<accumulators>([&](auto j) { acc[j] += a[i + j] * b[i + j]; });
+    }
+    for (; i < n; i++) {
+      acc[0] += a[i] * b[i];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+  }
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+template <class T>
+struct gemv_kernel<T, enable_if_vectorizable<T>> {
+  using vector_type = typename gemm_kernel<T>::vector_type;
+  static constexpr index_t lanes = gemm_kernel<T>::lanes;
+
+  static T dot(index_t n, const T* NDARRAY_RESTRICT a, const T* NDARRAY_RESTRICT b) {
+    constexpr index_t accumulators = 4;
+    vector_type acc[accumulators] = {};
+    index_t i = 0;
+    for (; i + accumulators * lanes <= n; i += accumulators * lanes) {
+      unroll<accumulators>([&](auto j) {
+        vector_type a_j, b_j;
+        std::memcpy(&a_j, a + i + j * lanes, sizeof(vector_type));
+        std::memcpy(&b_j, b + i + j * lanes, sizeof(vector_type));
+        acc[j] += a_j * b_j;
+      });
+    }
+    acc[0] = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    T result = 0;
+    for (index_t j = 0; j < lanes; j++) {
+      result += acc[0][j];
+    }
+    for (; i < n; i++) {
+      result += a[i] * b[i];
+    }
+    return result;
+  }
+};
+#endif
+
+// Compute the matrix-vector product y = A*x, or y += A*x if `accumulate` is
+// true, where A is `m` x `k`.
+template <class T>
+void gemv(index_t m, index_t k, const T* a, index_t a_row_stride, index_t a_col_stride,
+    const T* x, index_t x_stride, T* y, index_t y_stride, bool accumulate) {
+  if (a_col_stride == 1 && x_stride == 1) {
+    // The rows of A are dense, compute a dot product for each row.
+    for (index_t i = 0; i < m; i++) {
+      const T y_i = gemv_kernel<T>::dot(k, a + i * a_row_stride, x);
+      y[i * y_stride] = accumulate ? y[i * y_stride] + y_i : y_i;
+    }
+  } else if (a_row_stride == 1 && y_stride == 1) {
+    // The columns of A are dense, accumulate each column scaled by x.
+    if (!accumulate) { std::fill(y, y + m, T(0)); }
+    for (index_t j = 0; j < k; j++) {
+      const T x_j = x[j * x_stride];
+      const T* NDARRAY_RESTRICT a_j = a + j * a_col_stride;
+      T* NDARRAY_RESTRICT y_r = y;
+      for (index_t i = 0; i < m; i++) {
+        y_r[i] += a_j[i] * x_j;
+      }
+    }
+  } else {
+    for (index_t i = 0; i < m; i++) {
+      T y_i = 0;
+      for (index_t j = 0; j < k; j++) {
+        y_i += a[i * a_row_stride + j * a_col_stride] * x[j * x_stride];
+      }
+      y[i * y_stride] = accumulate ? y[i * y_stride] + y_i : y_i;
+    }
+  }
+}
+
+} // namespace internal
+
+} // namespace nda
+
+#endif // NDARRAY_GEMM_H
@@ -118,6 +118,219 @@ using planar_image_ref = array_ref<T, planar_image_shape>;
 template <class T>
 using const_planar_image_ref = planar_image_ref<const T>;
 
+namespace internal {
+
+// Deinterleaves and interleaves blocks of `lanes` pixels of `Channels`
+// channels in vector registers. The default has no kernel.
+template <class T, index_t Channels, class = void>
+struct interleave_kernel {
+  static constexpr index_t lanes = 0;
+
+  static void deinterleave(const T*, T*, index_t) {}
+  static void interleave(const T*, index_t, T*) {}
+};
+
+// On targets without AVX2 or NEON, the shuffles are generally slower than the
+// scalar loops.
+#if !defined(__CUDA__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)) && \
+    (defined(__AVX2__) || defined(__ARM_NEON))
+template <class T, index_t Channels>
+struct interleave_kernel<T, Channels,
+    std::enable_if_t<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+                     sizeof(T) <= 4 && 2 <= Channels && Channels <= 4>> {
+  // The channels of a block are concatenated into one vector of `planes`
+  // channels, which should fit in a register. 3 channels are padded to 4.
+  static constexpr index_t planes = Channels == 2 ? 2 : 4;
+  static constexpr index_t lanes = vector_bytes / (planes * sizeof(T));
+  typedef T vector_type __attribute__((vector_size(lanes * sizeof(T))));
+  typedef T vector2_type __attribute__((vector_size(2 * lanes * sizeof(T))));
+  typedef T planes_type __attribute__((vector_size(planes * lanes * sizeof(T))));
+
+  template <size_t... Is>
+  static NDARRAY_INLINE vector2_type concat2(
+      const vector_type& a, const vector_type& b, index_sequence<Is...>) {
+    return __builtin_shufflevector(a, b, Is...);
+  }
+  template <size_t... Is>
+  static NDARRAY_INLINE planes_type concat4(
+      const vector2_type& a, const vector2_type& b, index_sequence<Is...>) {
+    return __builtin_shufflevector(a, b, Is...);
+  }
+  static NDARRAY_INLINE planes_type concat(const vector_type* v, std::false_type) {
+    return concat2(v[0], v[1], make_index_sequence<2 * lanes>());
+  }
+  static NDARRAY_INLINE planes_type concat(const vector_type* v, std::true_type) {
+    return concat4(concat2(v[0], v[1], make_index_sequence<2 * lanes>()),
+        concat2(v[2], v[Channels - 1], make_index_sequence<2 * lanes>()),
+        make_index_sequence<4 * lanes>());
+  }
+  // Concatenate the `Channels` vectors `v`.
+  static NDARRAY_INLINE planes_type concat(const vector_type* v) {
+    return concat(v, std::integral_constant<bool, (planes == 4)>());
+  }
+
+  // Lane `i` of channel `c` is element `i * Channels + c` of a block of
+  // pixels, and element `j` of a block of pixels is lane `j / Channels` of
+  // channel `j % Channels`.
+  static constexpr int deinterleave_index(index_t c, index_t i) {
+    return static_cast<int>(i * Channels + c);
+  }
+  static constexpr int interleave_index(index_t j) {
+    return static_cast<int>((j % Channels) * lanes + j / Channels);
+  }
+  template <index_t C, size_t... Is>
+  static NDARRAY_INLINE vector_type deinterleave(const planes_type& v, index_sequence<Is...>) {
+    return __builtin_shufflevector(v, v, deinterleave_index(C, Is)...);
+  }
+  template <index_t J, size_t... Is>
+  static NDARRAY_INLINE vector_type interleave(const planes_type& v, index_sequence<Is...>) {
+    return __builtin_shufflevector(v, v, interleave_index(J * lanes + Is)...);
+  }
+
+  // Copy `lanes` pixels from `src` to the channels of `dst`, which are
+  // `dst_stride_c` apart.
+  static NDARRAY_INLINE void deinterleave(const T* src, T* dst, index_t dst_stride_c) {
+    vector_type v[Channels];
+    unroll<Channels>([&](auto i) { std::memcpy(&v[i], src + i * lanes, sizeof(vector_type)); });
+    const planes_type pixels = concat(v);
+    unroll<Channels>([&](auto c) {
+      const vector_type v_c = deinterleave<decltype(c)::value>(pixels, make_index_sequence<lanes>());
+      std::memcpy(dst + c * dst_stride_c, &v_c, sizeof(vector_type));
+    });
+  }
+
+  // Copy `lanes` pixels from the channels of `src`, which are `src_stride_c`
+  // apart, to `dst`.
+  static NDARRAY_INLINE void interleave(const T* src, index_t src_stride_c, T* dst) {
+    vector_type v[Channels];
+    unroll<Channels>(
+        [&](auto c) { std::memcpy(&v[c], src + c * src_stride_c, sizeof(vector_type)); });
+    const planes_type channels = concat(v);
+    unroll<Channels>([&](auto i) {
+      const vector_type v_i = interleave<decltype(i)::value>(channels, make_index_sequence<lanes>());
+      std::memcpy(dst + i * lanes, &v_i, sizeof(vector_type));
+    });
+  }
+};
+#endif
+
+// Copy `width` pixels from the chunky row `src` to the planar rows of `dst`,
+// which are `dst_stride_c` apart.
+template <index_t Channels, class T>
+void deinterleave_row(const T* src, T* dst, index_t dst_stride_c, index_t width) {
+  using kernel = interleave_kernel<T, Channels>;
+  constexpr index_t lanes = kernel::lanes;
+  index_t x = 0;
+  for (; x + lanes <= width; x += lanes) {
+    kernel::deinterleave(src + x * Channels, dst + x, dst_stride_c);
+  }
+  for (; x < width; x++) {
+    for (index_t c = 0; c < Channels; c++) {
+      dst[c * dst_stride_c + x] = src[x * Channels + c];
+    }
+  }
+}
+
+// Copy `width` pixels from the planar rows of `src`, which are `src_stride_c`
+// apart, to the chunky row `dst`.
+template <index_t Channels, class T>
+void interleave_row(const T* src, index_t src_stride_c, T* dst, index_t width) {
+  using kernel = interleave_kernel<T, Channels>;
+  constexpr index_t lanes = kernel::lanes;
+  index_t x = 0;
+  for (; x + lanes <= width; x += lanes) {
+    kernel::interleave(src + x, src_stride_c, dst + x * Channels);
+  }
+  for (; x < width; x++) {
+    for (index_t c = 0; c < Channels; c++) {
+      dst[x * Channels + c] = src[c * src_stride_c + x];
+    }
+  }
+}
+
+// Whether copies of chunky images of `Channels` channels with the callable
+// `Fn` can use an `interleave_kernel`.
+template <index_t Channels, class Fn>
+using can_interleave = std::integral_constant<bool,
+    (interleave_kernel<typename transpose_value_type<std::decay_t<Fn>>::type, Channels>::lanes >
+        0)>;
+
+template <index_t Channels, class TSrc, class TDst>
+bool deinterleave(const chunky_image_shape<Channels>&, TSrc, const planar_image_shape&, TDst,
+    std::false_type) {
+  return false;
+}
+template <index_t Channels, class T>
+bool deinterleave(const chunky_image_shape<Channels>& shape_src, const T* src,
+    const planar_image_shape& shape_dst, T* dst, std::true_type) {
+  // We can only deinterleave all of the channels.
+  if (shape_dst.c().extent() != Channels) { return false; }
+  if (shape_dst.empty()) { return true; }
+  const index_t x = shape_dst.x().min();
+  for (index_t y : shape_dst.y()) {
+    deinterleave_row<Channels>(src + shape_src(x, y, 0), dst + shape_dst(x, y, 0),
+        shape_dst.c().stride(), shape_dst.x().extent());
+  }
+  return true;
+}
+
+template <index_t Channels, class TSrc, class TDst>
+bool interleave(const planar_image_shape&, TSrc, const chunky_image_shape<Channels>&, TDst,
+    std::false_type) {
+  return false;
+}
+template <index_t Channels, class T>
+bool interleave(const planar_image_shape& shape_src, const T* src,
+    const chunky_image_shape<Channels>& shape_dst, T* dst, std::true_type) {
+  if (shape_dst.empty()) { return true; }
+  const index_t x = shape_dst.x().min();
+  for (index_t y : shape_dst.y()) {
+    interleave_row<Channels>(src + shape_src(x, y, 0), shape_src.c().stride(),
+        dst + shape_dst(x, y, 0), shape_dst.x().extent());
+  }
+  return true;
+}
+
+} // namespace internal
+
+/** Copies from chunky to planar images ("deinterleaving") of 2, 3, or 4
+ * channels of 8, 16, or 32-bit values are done a block of pixels at a time with
+ * vector shuffles, when the target supports them. */
+template <index_t Channels>
+class copy_shape_traits<chunky_image_shape<Channels>, planar_image_shape> {
+public:
+  using src_shape_type = chunky_image_shape<Channels>;
+  using dst_shape_type = planar_image_shape;
+
+  template <class Fn, class TSrc, class TDst>
+  static void for_each_value(const src_shape_type& shape_src, TSrc src,
+      const dst_shape_type& shape_dst, TDst dst, Fn&& fn) {
+    if (!internal::deinterleave(
+            shape_src, src, shape_dst, dst, internal::can_interleave<Channels, Fn>())) {
+      internal::for_each_copy_value(shape_src, src, shape_dst, dst, fn);
+    }
+  }
+};
+
+/** Copies from planar to chunky images ("interleaving") of 2, 3, or 4 channels
+ * of 8, 16, or 32-bit values are done a block of pixels at a time with vector
+ * shuffles, when the target supports them. */
+template <index_t Channels>
+class copy_shape_traits<planar_image_shape, chunky_image_shape<Channels>> {
+public:
+  using src_shape_type = planar_image_shape;
+  using dst_shape_type = chunky_image_shape<Channels>;
+
+  template <class Fn, class TSrc, class TDst>
+  static void for_each_value(const src_shape_type& shape_src, TSrc src,
+      const dst_shape_type& shape_dst, TDst dst, Fn&& fn) {
+    if (!internal::interleave(
+            shape_src, src, shape_dst, dst, internal::can_interleave<Channels, Fn>())) {
+      internal::for_each_copy_value(shape_src, src, shape_dst, dst, fn);
+    }
+  }
+};
+
 enum class crop_origin {
   /** The result of the crop has min 0, 0. */
   zero,
@@ -19,6 +19,7 @@
 #define NDARRAY_MATRIX_H
 
 #include "array.h"
+#include "gemm.h"
 
 namespace nda {
 
@@ -84,6 +85,34 @@ public:
   }
 };
 
+/** Compute the matrix product `C = A*B`. `A` must have the same number of
+ * rows as `C`, `B` must have the same number of columns as `C`, and the number
+ * of columns of `A` must be equal to the number of rows of `B`. `C` must not
+ * alias `A` or `B`.
+ *
+ * The product is computed by packing blocks of `A` and `B` into scratch memory
+ * and computing tiles of `C` held in registers. The tile sizes are selected for
+ * AVX-512, AVX, NEON, or SSE at compile time. */
+template <class T>
+void multiply(const_matrix_ref<T> A, const_matrix_ref<T> B, matrix_ref<T> C) {
+  assert(A.rows() == C.rows());
+  assert(B.columns() == C.columns());
+  assert(A.columns() == B.rows());
+  internal::gemm(C.rows(), C.columns(), A.columns(), A.base(), A.i().stride(), A.j().stride(),
+      B.base(), B.i().stride(), B.j().stride(), C.base(), C.i().stride(), C.j().stride(), false);
+}
+
+/** Compute the matrix-vector product `y = A*x`. `A` must have the same number
+ * of rows as `y`, and the same number of columns as `x`. `y` must not alias `A`
+ * or `x`. */
+template <class T>
+void multiply(const_matrix_ref<T> A, const_vector_ref<T> x, vector_ref<T> y) {
+  assert(A.rows() == y.i().extent());
+  assert(A.columns() == x.i().extent());
+  internal::gemv(A.rows(), A.columns(), A.base(), A.i().stride(), A.j().stride(), x.base(),
+      x.i().stride(), y.base(), y.i().stride(), false);
+}
+
 } // namespace nda
 
-#endif // NDARRAY_MATRIX_H
\ No newline at end of file
+#endif // NDARRAY_MATRIX_H
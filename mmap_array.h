@@ -0,0 +1,376 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** \file mmap_array.h
+ * \brief Optional helpers for arrays stored in memory mapped files. This
+ * requires POSIX `mmap`.
+ *
+ * A file of an `mmap_array` begins with a small header:
+ * - 8 bytes, the magic string `"ndarray"`, including the null terminator.
+ * - A `uint32_t` version, currently 1, and a `uint32_t` rank.
+ * - A `uint64_t` size of the elements in bytes, and a `uint64_t` offset of the
+ *   data from the beginning of the file.
+ * - For each dimension, the `int64_t` min, extent, and stride.
+ *
+ * The data begins at the first page boundary after the header, and contains
+ * the elements from the flat min to the flat max of the shape. The header and
+ * the data use the byte order of the machine that wrote the file.
+ */
+#ifndef NDARRAY_MMAP_ARRAY_H
+#define NDARRAY_MMAP_ARRAY_H
+
+#include "array.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nda {
+
+/** How the file of an `mmap_array` is mapped into memory. */
+enum class mmap_mode {
+  /** The array can only be read. Only arrays of const elements can be mapped
+   * with this mode. */
+  read_only,
+  /** The array can be written, but the writes are private to this mapping,
+   * and are not written to the file. */
+  copy_on_write,
+  /** The array can be written, and writes are written to the file. */
+  shared,
+};
+
+/** The default mode of a mapping of an array of `T`: `mmap_mode::read_only`
+ * if `T` is const, and `mmap_mode::copy_on_write` otherwise. */
+template <class T>
+constexpr mmap_mode default_mmap_mode() {
+  return std::is_const<T>::value ? mmap_mode::read_only : mmap_mode::copy_on_write;
+}
+
+/** Hints about how the memory of an `mmap_array` will be accessed, passed to
+ * `madvise`. */
+enum class mmap_advice {
+  normal,
+  sequential,
+  random,
+  will_need,
+  dont_need,
+};
+
+namespace internal {
+
+struct mmap_array_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t rank;
+  uint64_t elem_size;
+  uint64_t data_offset;
+};
+
+struct mmap_array_dim {
+  int64_t min;
+  int64_t extent;
+  int64_t stride;
+};
+
+constexpr char mmap_array_magic[8] = "ndarray";
+constexpr uint32_t mmap_array_version = 1;
+
+inline size_t page_size() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+
+inline size_t mmap_array_data_offset(size_t rank) {
+  size_t header_size = sizeof(mmap_array_header) + rank * sizeof(mmap_array_dim);
+  return (header_size + page_size() - 1) / page_size() * page_size();
+}
+
+template <class Dims, size_t... Is>
+void write_mmap_array_dims(const Dims& dims, mmap_array_dim* to, index_sequence<Is...>) {
+  int unused[] = {(to[Is] = {std::get<Is>(dims).min(), std::get<Is>(dims).extent(),
+                       std::get<Is>(dims).stride()},
+      0)...};
+  (void)unused;
+}
+
+template <size_t Rank, size_t... Is>
+shape_of_rank<Rank> read_mmap_array_dims(const mmap_array_dim* from, index_sequence<Is...>) {
+  return shape_of_rank<Rank>(dim<>(from[Is].min, from[Is].extent, from[Is].stride)...);
+}
+
+inline int mmap_advice_to_madvise(mmap_advice advice) {
+  switch (advice) {
+  case mmap_advice::sequential: return MADV_SEQUENTIAL;
+  case mmap_advice::random: return MADV_RANDOM;
+  case mmap_advice::will_need: return MADV_WILLNEED;
+  case mmap_advice::dont_need: return MADV_DONTNEED;
+  default: return MADV_NORMAL;
+  }
+}
+
+} // namespace internal
+
+/** Find the access pattern of `for_each_value` with the default
+ * `shape_traits`, for an array of shape `s` with elements of size
+ * `elem_size`. `for_each_value` visits the dimensions in order of increasing
+ * stride, after fusing contiguous dimensions. If the values are dense, this
+ * reads memory sequentially. If the contiguous runs of values are separated by
+ * more than a page, readahead would read pages that are not needed. */
+template <class Shape>
+mmap_advice for_each_value_advice(const Shape& s, size_t elem_size) {
+  if (s.empty()) { return mmap_advice::normal; }
+  auto opt_s = internal::optimize_shape(s);
+  const auto& inner = opt_s.template dim<0>();
+  index_t run = internal::abs(inner.stride()) == 1 ? inner.extent() : 1;
+  if (run >= static_cast<index_t>(s.flat_extent())) {
+    // The values are one contiguous run.
+    return mmap_advice::sequential;
+  }
+  // Find the smallest stride between runs.
+  index_t gap = internal::abs(inner.stride()) == 1 ? std::numeric_limits<index_t>::max()
+                                                   : internal::abs(inner.stride());
+  for (const dim<>& d : internal::tuple_to_array<dim<>>(opt_s.dims())) {
+    if (d.extent() > 1 && internal::abs(d.stride()) > run) {
+      gap = std::min(gap, internal::abs(d.stride()));
+    }
+  }
+  if (static_cast<size_t>(gap - run) * elem_size >= internal::page_size()) {
+    return mmap_advice::random;
+  }
+  return mmap_advice::sequential;
+}
+
+/** An array stored in a memory mapped file. The file begins with a header
+ * describing the shape of the array, see mmap_array.h. The array is unmapped
+ * when this object is destroyed. This object owns the mapping, and provides
+ * `array_ref`s to access it. If the file could not be opened or mapped, or the
+ * header is not compatible with `T` and `Shape`, `is_open` returns `false`.
+ *
+ * A read-only mapping is an `mmap_array<const T, Shape>`, which only provides
+ * `array_ref`s of const elements. Arrays of non-const `T` can't be mapped
+ * with `mmap_mode::read_only`. */
+template <class T, class Shape>
+class mmap_array {
+  void* mapping_;
+  size_t size_;
+  mmap_mode mode_;
+  array_ref<T, Shape> ref_;
+
+public:
+  using value_type = T;
+  using shape_type = Shape;
+
+  /** Construct an `mmap_array` that is not open. */
+  mmap_array() : mapping_(nullptr), size_(0), mode_(default_mmap_mode<T>()) {}
+
+  /** Map the file at `path` using the mode `mode`. */
+  explicit mmap_array(const char* path, mmap_mode mode = default_mmap_mode<T>()) : mmap_array() {
+    open(path, mode);
+  }
+
+  mmap_array(const mmap_array&) = delete;
+  mmap_array& operator=(const mmap_array&) = delete;
+
+  mmap_array(mmap_array&& other) : mmap_array() { swap(other); }
+  mmap_array& operator=(mmap_array&& other) {
+    close();
+    swap(other);
+    return *this;
+  }
+
+  ~mmap_array() { close(); }
+
+  /** Map the file at `path` using the mode `mode`. Returns `false` if the
+   * file could not be mapped. */
+  bool open(const char* path, mmap_mode mode = default_mmap_mode<T>()) {
+    if (!map_file(path, mode)) { return false; }
+    if (!parse_header()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  /** Map the file at `path` using the mode `mode`, without reading a header.
+   * The data of an array with shape `shape` begins at `offset` bytes from the
+   * beginning of the file, which must be a multiple of `alignof(T)`. Returns
+   * `false` if the file could not be mapped, or is too small. */
+  template <class ShapeSrc>
+  bool open(const char* path, size_t offset, const ShapeSrc& shape,
+      mmap_mode mode = default_mmap_mode<T>()) {
+    if (!map_file(path, mode)) { return false; }
+    if (!map_data(offset, shape)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  /** Unmap the file. */
+  void close() {
+    if (mapping_) { munmap(mapping_, size_); }
+    mapping_ = nullptr;
+    size_ = 0;
+    ref_ = array_ref<T, Shape>();
+  }
+
+  /** Returns `true` if a file is mapped. */
+  bool is_open() const { return mapping_ != nullptr; }
+
+  /** The mode the file was mapped with. */
+  mmap_mode mode() const { return mode_; }
+
+  /** Access the mapped array. If `T` is const, this is a `const_array_ref`. */
+  array_ref<T, Shape> ref() { return ref_; }
+  const_array_ref<T, Shape> cref() const { return ref_.cref(); }
+  const_array_ref<T, Shape> ref() const { return cref(); }
+  operator array_ref<T, Shape>() { return ref(); }
+  operator const_array_ref<T, Shape>() const { return cref(); }
+
+  /** Shape of the mapped array. */
+  const Shape& shape() const { return ref_.shape(); }
+
+  /** Pass `advice` about the memory of the array to `madvise`. */
+  void advise(mmap_advice advice) {
+    if (!is_open()) { return; }
+    // madvise requires a page aligned address. The data is page aligned if
+    // the file was written on a machine with the same page size.
+    char* begin = static_cast<char*>(mapping_);
+    size_t offset = reinterpret_cast<const char*>(ref_.data()) - begin;
+    offset -= offset % internal::page_size();
+    madvise(begin + offset, size_ - offset, internal::mmap_advice_to_madvise(advice));
+  }
+
+  /** Advise that the array will be traversed with `for_each_value` or `copy`,
+   * using `for_each_value_advice`. */
+  void advise_for_each_value() { advise(for_each_value_advice(shape(), sizeof(T))); }
+
+  /** Write the changes to an array mapped with `mmap_mode::shared` to the
+   * file. */
+  void flush() {
+    if (is_open() && mode_ == mmap_mode::shared) { msync(mapping_, size_, MS_SYNC); }
+  }
+
+  void swap(mmap_array& other) {
+    std::swap(mapping_, other.mapping_);
+    std::swap(size_, other.size_);
+    std::swap(mode_, other.mode_);
+    std::swap(ref_, other.ref_);
+  }
+
+private:
+  bool map_file(const char* path, mmap_mode mode) {
+    close();
+    // A read-only mapping must not be accessible via an array_ref of non-const
+    // elements.
+    if (!std::is_const<T>::value && mode == mmap_mode::read_only) { return false; }
+    int fd = ::open(path, mode == mmap_mode::shared ? O_RDWR : O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      int prot = mode == mmap_mode::read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+      int flags = mode == mmap_mode::copy_on_write ? MAP_PRIVATE : MAP_SHARED;
+      mapping = mmap(nullptr, static_cast<size_t>(st.st_size), prot, flags, fd, 0);
+    }
+    // The mapping remains valid after closing the file.
+    ::close(fd);
+    if (mapping == MAP_FAILED) { return false; }
+    mapping_ = mapping;
+    size_ = static_cast<size_t>(st.st_size);
+    mode_ = mode;
+    return true;
+  }
+
+  template <class ShapeSrc>
+  bool map_data(size_t offset, ShapeSrc s) {
+    s.resolve();
+    if (!is_compatible<Shape>(s) || offset % alignof(T) != 0 || offset > size_) { return false; }
+    size_t data_size = static_cast<size_t>(s.flat_extent()) * sizeof(T);
+    if (!s.empty() && data_size > size_ - offset) { return false; }
+
+    T* data = reinterpret_cast<T*>(static_cast<char*>(mapping_) + offset);
+    ref_ = array_ref<T, Shape>(data - s.flat_min(), convert_shape<Shape>(s));
+    return true;
+  }
+
+  bool parse_header() {
+    constexpr size_t rank = Shape::rank();
+    if (size_ < sizeof(internal::mmap_array_header)) { return false; }
+    const char* begin = static_cast<const char*>(mapping_);
+    internal::mmap_array_header header;
+    std::memcpy(&header, begin, sizeof(header));
+    if (std::memcmp(header.magic, internal::mmap_array_magic, sizeof(header.magic)) != 0 ||
+        header.version != internal::mmap_array_version || header.rank != rank ||
+        header.elem_size != sizeof(T) ||
+        sizeof(header) + rank * sizeof(internal::mmap_array_dim) > header.data_offset) {
+      return false;
+    }
+    std::array<internal::mmap_array_dim, rank> dims;
+    std::memcpy(dims.data(), begin + sizeof(header), sizeof(dims));
+    auto s =
+        internal::read_mmap_array_dims<rank>(dims.data(), internal::make_index_sequence<rank>());
+    return map_data(header.data_offset, s);
+  }
+};
+
+/** Create a file at `path` for an array of shape `shape`, and map it with
+ * `mmap_mode::shared`. The elements of the array are initially zero. If the
+ * file already exists, it is replaced. If the file could not be created, the
+ * resulting array is not open. */
+template <class T, class Shape>
+mmap_array<T, Shape> make_mmap_array(const char* path, Shape shape) {
+  constexpr size_t rank = Shape::rank();
+  shape.resolve();
+  internal::mmap_array_header header;
+  std::memcpy(header.magic, internal::mmap_array_magic, sizeof(header.magic));
+  header.version = internal::mmap_array_version;
+  header.rank = rank;
+  header.elem_size = sizeof(T);
+  header.data_offset = internal::mmap_array_data_offset(rank);
+  std::array<internal::mmap_array_dim, rank> dims;
+  internal::write_mmap_array_dims(shape.dims(), dims.data(), internal::make_index_sequence<rank>());
+  size_t size = header.data_offset + static_cast<size_t>(shape.flat_extent()) * sizeof(T);
+
+  int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) { return mmap_array<T, Shape>(); }
+  bool ok = ftruncate(fd, static_cast<off_t>(size)) == 0 &&
+            pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+            pwrite(fd, dims.data(), sizeof(dims), sizeof(header)) ==
+                static_cast<ssize_t>(sizeof(dims));
+  ::close(fd);
+  if (!ok) { return mmap_array<T, Shape>(); }
+  return mmap_array<T, Shape>(path, mmap_mode::shared);
+}
+
+/** Create a file at `path` containing a copy of the array `a`, and map it
+ * with `mmap_mode::shared`. The strides of the copy are compact, like
+ * `make_compact(a.shape())`. */
+template <class T, class Shape>
+mmap_array<typename std::remove_const<T>::type, Shape> make_mmap_copy(
+    const char* path, const array_ref<T, Shape>& a) {
+  auto result = make_mmap_array<typename std::remove_const<T>::type>(
+      path, convert_shape<Shape>(make_compact(a.shape())));
+  if (result.is_open()) { copy(a, result.ref()); }
+  return result;
+}
+template <class T, class Shape, class Alloc>
+mmap_array<T, Shape> make_mmap_copy(const char* path, const array<T, Shape, Alloc>& a) {
+  return make_mmap_copy(path, a.cref());
+}
+
+} // namespace nda
+
+#endif // NDARRAY_MMAP_ARRAY_H
@@ -0,0 +1,562 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** \file morton_shape.h
+ * \brief Optional shape type for arrays stored in Morton (Z-order) order.
+ *
+ * Flat offsets are computed with the BMI2 `pdep` instruction when the
+ * compiler targets it (`__BMI2__`, e.g. `-mbmi2` or `-march=native` on
+ * Haswell or later), and with a much slower loop otherwise.
+ */
+#ifndef NDARRAY_MORTON_SHAPE_H
+#define NDARRAY_MORTON_SHAPE_H
+
+#include "array.h"
+
+#include <array>
+#include <cstdint>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace nda {
+
+namespace internal {
+
+// Scatter the low bits of `x` to the set bits of `mask`.
+NDARRAY_INLINE NDARRAY_HOST_DEVICE uint64_t deposit_bits(uint64_t x, uint64_t mask) {
+#if defined(__BMI2__)
+  return _pdep_u64(x, mask);
+#else
+  uint64_t result = 0;
+  for (uint64_t bit = 1; mask != 0; bit += bit) {
+    if (x & bit) { result |= mask & (~mask + 1); }
+    mask &= mask - 1;
+  }
+  return result;
+#endif
+}
+
+// Gather the bits of `x` at the set bits of `mask` to the low bits.
+NDARRAY_INLINE NDARRAY_HOST_DEVICE uint64_t extract_bits(uint64_t x, uint64_t mask) {
+#if defined(__BMI2__)
+  return _pext_u64(x, mask);
+#else
+  uint64_t result = 0;
+  for (uint64_t bit = 1; mask != 0; bit += bit) {
+    if (x & mask & (~mask + 1)) { result |= bit; }
+    mask &= mask - 1;
+  }
+  return result;
+#endif
+}
+
+// Increment the bits of `x` at the set bits of `mask`.
+NDARRAY_INLINE NDARRAY_HOST_DEVICE uint64_t increment_bits(uint64_t x, uint64_t mask) {
+  return ((x | ~mask) + 1) & mask;
+}
+
+template <size_t Rank, class Fn>
+NDARRAY_INLINE NDARRAY_HOST_DEVICE void for_each_morton_offset(std::integral_constant<size_t, 0>,
+    const std::array<index_t, Rank>& extents, const std::array<uint64_t, Rank>& masks,
+    const std::array<uint64_t, Rank>& bits, const std::array<index_t, Rank>& strides,
+    uint64_t offset, index_t other_offset, Fn&& fn) {
+  uint64_t bits_0 = bits[0];
+  for (index_t i = 0; i < extents[0]; i++) {
+    fn(static_cast<index_t>(offset | bits_0), other_offset);
+    bits_0 = increment_bits(bits_0, masks[0]);
+    other_offset += strides[0];
+  }
+}
+template <size_t D, size_t Rank, class Fn>
+NDARRAY_INLINE NDARRAY_HOST_DEVICE void for_each_morton_offset(std::integral_constant<size_t, D>,
+    const std::array<index_t, Rank>& extents, const std::array<uint64_t, Rank>& masks,
+    const std::array<uint64_t, Rank>& bits, const std::array<index_t, Rank>& strides,
+    uint64_t offset, index_t other_offset, Fn&& fn) {
+  uint64_t bits_d = bits[D];
+  for (index_t i = 0; i < extents[D]; i++) {
+    for_each_morton_offset(std::integral_constant<size_t, D - 1>(), extents, masks, bits, strides,
+        offset | bits_d, other_offset, fn);
+    bits_d = increment_bits(bits_d, masks[D]);
+    other_offset += strides[D];
+  }
+}
+
+} // namespace internal
+
+/** A shape that stores an array in Morton (Z-order) order: the bits of the
+ * flat offset of an index are the interleaved bits of the index in each
+ * dimension, relative to the `origin` of the shape. Dimensions with a smaller
+ * extent use fewer bits, which stop being interleaved when they run out.
+ *
+ * Neighbors in every dimension are usually close in memory, which makes this
+ * layout useful for arrays accessed without a dominant direction, such as
+ * stencils and ray marching. The flat extent of a Morton shape is rounded up
+ * to a power of two in each dimension.
+ *
+ * The dims of a Morton shape are intervals, they do not have strides. The
+ * origin of the shape is the min of the dims, unless the shape is a `crop` of
+ * another shape. */
+template <size_t Rank>
+class morton_shape {
+public:
+  /** Number of dims in this shape. */
+  static constexpr size_t rank() { return Rank; }
+  static_assert(Rank > 0, "A morton_shape must have at least one dimension.");
+
+  static constexpr bool is_scalar() { return false; }
+
+  /** The type of an index for this shape. */
+  using index_type = index_of_rank<rank()>;
+
+  using size_type = size_t;
+
+  /** The type of the dims tuple of this shape. */
+  using dims_type = internal::tuple_of_n<interval<>, rank()>;
+
+  /** The type of the masks of the bits of the flat offsets used by each
+   * dimension. */
+  using masks_type = std::array<uint64_t, Rank>;
+
+  using dim_indices = decltype(internal::make_index_sequence<rank()>());
+
+private:
+  dims_type dims_;
+  index_type origin_;
+  masks_type masks_;
+
+  template <class... Args>
+  using enable_if_same_rank = std::enable_if_t<(sizeof...(Args) == rank())>;
+
+  template <class... Args>
+  using enable_if_indices = std::enable_if_t<internal::all_of_type<index_t, Args...>::value>;
+
+  template <size_t Dim>
+  using enable_if_dim = std::enable_if_t<(Dim < rank())>;
+
+  template <size_t R, size_t Required>
+  using enable_if_rank = std::enable_if_t<(R == Required)>;
+
+  static NDARRAY_HOST_DEVICE interval<> to_interval(const nda::dim<>& d) {
+    return interval<>(d.min(), d.extent());
+  }
+
+  template <size_t... Is>
+  static NDARRAY_HOST_DEVICE dims_type empty_dims(internal::index_sequence<Is...>) {
+    return std::make_tuple((static_cast<void>(Is), interval<>(0, 0))...);
+  }
+
+  // The bits of the flat offset of `at` in dimension `D`. Indices less than
+  // the origin do not have a flat offset.
+  template <size_t D>
+  NDARRAY_INLINE NDARRAY_HOST_DEVICE uint64_t offset_bits(index_t at) const {
+    return internal::deposit_bits(static_cast<uint64_t>(at - std::get<D>(origin_)), masks_[D]);
+  }
+
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE index_t flat_offset(
+      const index_type& indices, internal::index_sequence<Is...>) const {
+    uint64_t result = 0;
+    (void)std::initializer_list<int>{(result |= offset_bits<Is>(std::get<Is>(indices)), 0)...};
+    return static_cast<index_t>(result);
+  }
+
+  // The index of the flat offset `offset`, which may be out of range.
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE index_type index_of(
+      uint64_t offset, internal::index_sequence<Is...>) const {
+    return std::make_tuple(static_cast<index_t>(internal::extract_bits(offset, masks_[Is])) +
+                           std::get<Is>(origin_)...);
+  }
+
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE bool is_in_range(
+      const index_type& min, const index_type& max, internal::index_sequence<Is...>) const {
+    return internal::all((std::get<Is>(dims_).min() <= std::get<Is>(min) &&
+                          std::get<Is>(max) <= std::get<Is>(dims_).max())...);
+  }
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE bool intersects(
+      const index_type& min, const index_type& max, internal::index_sequence<Is...>) const {
+    return internal::all((std::get<Is>(dims_).min() <= std::get<Is>(max) &&
+                          std::get<Is>(min) <= std::get<Is>(dims_).max())...);
+  }
+
+  // Find the runs of flat offsets of indices in the shape in the aligned block
+  // of `2^bits` flat offsets beginning at `begin`. The indices of such a block
+  // are a box with corners at the first and last offset of the block.
+  template <class Fn>
+  NDARRAY_HOST_DEVICE void for_each_run(
+      uint64_t begin, int bits, uint64_t& run_begin, uint64_t& run_end, Fn& fn) const {
+    const uint64_t end = begin + (uint64_t(1) << bits);
+    const index_type min = index_of(begin, dim_indices());
+    const index_type max = index_of(end - 1, dim_indices());
+    if (is_in_range(min, max, dim_indices())) {
+      if (begin != run_end) {
+        if (run_end != run_begin) { fn(static_cast<index_t>(run_begin), run_end - run_begin); }
+        run_begin = begin;
+      }
+      run_end = end;
+    } else if (bits > 0 && intersects(min, max, dim_indices())) {
+      for_each_run(begin, bits - 1, run_begin, run_end, fn);
+      for_each_run(begin + (uint64_t(1) << (bits - 1)), bits - 1, run_begin, run_end, fn);
+    }
+  }
+
+  template <class Intervals, size_t... Is>
+  NDARRAY_HOST_DEVICE dims_type crop_dims(
+      const Intervals& intervals, internal::index_sequence<Is...>) const {
+    return std::make_tuple(
+        interval<>(std::max(std::get<Is>(dims_).min(), std::get<Is>(intervals).min()),
+            std::min(std::get<Is>(dims_).max(), std::get<Is>(intervals).max()) -
+                std::max(std::get<Is>(dims_).min(), std::get<Is>(intervals).min()) + 1)...);
+  }
+
+public:
+  /** Construct a Morton shape from a list of dims. Only the min and extent of
+   * the dims are used. */
+  NDARRAY_HOST_DEVICE morton_shape() : dims_(empty_dims(dim_indices())), origin_(min()), masks_() {}
+  template <size_t R = Rank, class = enable_if_rank<R, 1>>
+  NDARRAY_HOST_DEVICE morton_shape(const nda::dim<>& x)
+      : dims_(to_interval(x)), origin_(min()), masks_() {}
+  template <size_t R = Rank, class = enable_if_rank<R, 2>>
+  NDARRAY_HOST_DEVICE morton_shape(const nda::dim<>& x, const nda::dim<>& y)
+      : dims_(to_interval(x), to_interval(y)), origin_(min()), masks_() {}
+  template <size_t R = Rank, class = enable_if_rank<R, 3>>
+  NDARRAY_HOST_DEVICE morton_shape(const nda::dim<>& x, const nda::dim<>& y, const nda::dim<>& z)
+      : dims_(to_interval(x), to_interval(y), to_interval(z)), origin_(min()), masks_() {}
+  template <size_t R = Rank, class = enable_if_rank<R, 4>>
+  NDARRAY_HOST_DEVICE morton_shape(
+      const nda::dim<>& x, const nda::dim<>& y, const nda::dim<>& z, const nda::dim<>& w)
+      : dims_(to_interval(x), to_interval(y), to_interval(z), to_interval(w)), origin_(min()),
+        masks_() {}
+  NDARRAY_HOST_DEVICE morton_shape(const morton_shape&) = default;
+  NDARRAY_HOST_DEVICE morton_shape(morton_shape&&) = default;
+  NDARRAY_HOST_DEVICE morton_shape& operator=(const morton_shape&) = default;
+  NDARRAY_HOST_DEVICE morton_shape& operator=(morton_shape&&) = default;
+
+  /** Compute the masks of the bits used by each dimension from the extents of
+   * the dims, if they are not already known. */
+  NDARRAY_HOST_DEVICE void resolve() {
+    if (is_resolved()) { return; }
+    const auto extents = internal::tuple_to_array<index_t>(extent());
+    std::array<int, Rank> bits;
+    int max_bits = 0;
+    for (size_t d = 0; d < Rank; d++) {
+      bits[d] = 0;
+      while ((index_t(1) << bits[d]) < extents[d]) {
+        bits[d]++;
+      }
+      max_bits = std::max(max_bits, bits[d]);
+    }
+    int next = 0;
+    for (int level = 0; level < max_bits; level++) {
+      for (size_t d = 0; d < Rank; d++) {
+        if (level < bits[d]) { masks_[d] |= uint64_t(1) << next++; }
+      }
+    }
+    // The flat offsets must fit in an index_t.
+    assert(next < 64);
+  }
+
+  /** Check if the masks of the shape are known. */
+  NDARRAY_HOST_DEVICE bool is_resolved() const {
+    for (size_t d = 0; d < Rank; d++) {
+      if (masks_[d] != 0) { return true; }
+    }
+    // If all masks are 0, the shape must have at most one index.
+    return size() <= 1;
+  }
+
+  /** Returns `true` if the indices or intervals `args` are in interval of this shape. */
+  template <class... Args, class = enable_if_same_rank<Args...>>
+  NDARRAY_HOST_DEVICE bool is_in_range(const std::tuple<Args...>& args) const {
+    return internal::is_in_range(dims_, args, dim_indices());
+  }
+  template <class... Args, class = enable_if_same_rank<Args...>>
+  NDARRAY_HOST_DEVICE bool is_in_range(Args... args) const {
+    return internal::is_in_range(dims_, std::make_tuple(args...), dim_indices());
+  }
+
+  /** Compute the flat offset of the index `indices`. */
+  NDARRAY_HOST_DEVICE index_t operator()(const index_type& indices) const {
+    return flat_offset(indices, dim_indices());
+  }
+  NDARRAY_HOST_DEVICE index_t operator[](const index_type& indices) const {
+    return flat_offset(indices, dim_indices());
+  }
+  template <class... Args, class = enable_if_same_rank<Args...>, class = enable_if_indices<Args...>>
+  NDARRAY_HOST_DEVICE index_t operator()(Args... indices) const {
+    return flat_offset(std::make_tuple(indices...), dim_indices());
+  }
+
+  /** Make a shape with the same layout as this shape, with the dims clamped to
+   * `intervals`. The cropped shape maps indices to the same flat offsets as
+   * this shape, so it can be used with the same base pointer. */
+  template <class... Intervals, class = enable_if_same_rank<Intervals...>>
+  NDARRAY_HOST_DEVICE morton_shape crop(const std::tuple<Intervals...>& intervals) const {
+    assert(is_resolved());
+    morton_shape result;
+    result.dims_ = crop_dims(intervals, dim_indices());
+    result.origin_ = origin_;
+    result.masks_ = masks_;
+    return result;
+  }
+  template <class... Intervals, class = enable_if_same_rank<Intervals...>>
+  NDARRAY_HOST_DEVICE morton_shape crop(const Intervals&... intervals) const {
+    return crop(std::make_tuple(intervals...));
+  }
+
+  /** Get a specific dim `D` of this shape. */
+  template <size_t D, class = enable_if_dim<D>>
+  NDARRAY_HOST_DEVICE auto& dim() {
+    return std::get<D>(dims_);
+  }
+  template <size_t D, class = enable_if_dim<D>>
+  NDARRAY_HOST_DEVICE const auto& dim() const {
+    return std::get<D>(dims_);
+  }
+
+  /** Get a tuple of all of the dims of this shape. */
+  NDARRAY_HOST_DEVICE dims_type& dims() { return dims_; }
+  NDARRAY_HOST_DEVICE const dims_type& dims() const { return dims_; }
+
+  /** The index with flat offset 0. */
+  NDARRAY_HOST_DEVICE const index_type& origin() const { return origin_; }
+
+  /** The bits of the flat offsets used by each dimension. */
+  NDARRAY_HOST_DEVICE const masks_type& masks() const { return masks_; }
+
+  NDARRAY_HOST_DEVICE index_type min() const { return internal::mins(dims(), dim_indices()); }
+  NDARRAY_HOST_DEVICE index_type max() const { return internal::maxs(dims(), dim_indices()); }
+  NDARRAY_HOST_DEVICE index_type extent() const { return internal::extents(dims(), dim_indices()); }
+
+  /** Compute the min, max, or extent of the flat offsets of this shape. The
+   * min and max are the flat offsets of the min and max of the shape. */
+  NDARRAY_HOST_DEVICE index_t flat_min() const { return empty() ? 0 : (*this)(min()); }
+  NDARRAY_HOST_DEVICE index_t flat_max() const { return empty() ? -1 : (*this)(max()); }
+  NDARRAY_HOST_DEVICE size_type flat_extent() const {
+    index_t e = flat_max() - flat_min() + 1;
+    return e < 0 ? 0 : static_cast<size_type>(e);
+  }
+
+  /** Compute the total number of indices in this shape. */
+  NDARRAY_HOST_DEVICE size_type size() const {
+    index_t s = internal::product(extent(), dim_indices());
+    return s < 0 ? 0 : static_cast<size_type>(s);
+  }
+
+  /** A shape is empty if its size is 0. */
+  NDARRAY_HOST_DEVICE bool empty() const { return size() == 0; }
+
+  /** Returns `true` if there are no unaddressable flat indices between the
+   * first and last addressable flat elements. This is only true if the
+   * extents are powers of two. */
+  NDARRAY_HOST_DEVICE bool is_compact() const { return flat_extent() <= size(); }
+
+  /** Returns `true` if this shape projects to a set of flat indices that is a
+   * subset of the other shape's projection to flat indices, with an offset
+   * `offset`. */
+  template <typename OtherShape>
+  NDARRAY_HOST_DEVICE bool is_subset_of(const OtherShape& other, index_t offset) const {
+    return flat_min() >= other.flat_min() + offset && flat_max() <= other.flat_max() + offset;
+  }
+
+  /** Call `fn(begin, count)` for each run of consecutive flat offsets
+   * `[begin, begin + count)` of the indices in this shape, in increasing
+   * order. */
+  template <class Fn>
+  NDARRAY_HOST_DEVICE void for_each_run(Fn&& fn) const {
+    if (empty()) { return; }
+    int bits = 0;
+    while (bits < 63 && (uint64_t(1) << bits) <= static_cast<uint64_t>(flat_max())) {
+      bits++;
+    }
+    uint64_t run_begin = 0;
+    uint64_t run_end = 0;
+    for_each_run(0, bits, run_begin, run_end, fn);
+    if (run_end != run_begin) { fn(static_cast<index_t>(run_begin), run_end - run_begin); }
+  }
+
+  /** Provide some aliases for common interpretations of dimensions
+   * `i`, `j`, `k` as dimensions 0, 1, 2, respectively. */
+  NDARRAY_HOST_DEVICE auto& i() { return dim<0>(); }
+  NDARRAY_HOST_DEVICE const auto& i() const { return dim<0>(); }
+  NDARRAY_HOST_DEVICE auto& j() { return dim<1>(); }
+  NDARRAY_HOST_DEVICE const auto& j() const { return dim<1>(); }
+  NDARRAY_HOST_DEVICE auto& k() { return dim<2>(); }
+  NDARRAY_HOST_DEVICE const auto& k() const { return dim<2>(); }
+
+  /** Provide some aliases for common interpretations of dimensions
+   * `x`, `y`, `z` or `c`, `w` as dimensions 0, 1, 2, 3 respectively. */
+  NDARRAY_HOST_DEVICE auto& x() { return dim<0>(); }
+  NDARRAY_HOST_DEVICE const auto& x() const { return dim<0>(); }
+  NDARRAY_HOST_DEVICE auto& y() { return dim<1>(); }
+  NDARRAY_HOST_DEVICE const auto& y() const { return dim<1>(); }
+  NDARRAY_HOST_DEVICE auto& z() { return dim<2>(); }
+  NDARRAY_HOST_DEVICE const auto& z() const { return dim<2>(); }
+  NDARRAY_HOST_DEVICE auto& c() { return dim<2>(); }
+  NDARRAY_HOST_DEVICE const auto& c() const { return dim<2>(); }
+  NDARRAY_HOST_DEVICE auto& w() { return dim<3>(); }
+  NDARRAY_HOST_DEVICE const auto& w() const { return dim<3>(); }
+
+  /** Assuming this array represents an image with dimensions {width,
+   * height, channels}, get the extent of those dimensions. */
+  NDARRAY_HOST_DEVICE index_t width() const { return x().extent(); }
+  NDARRAY_HOST_DEVICE index_t height() const { return y().extent(); }
+  NDARRAY_HOST_DEVICE index_t channels() const { return c().extent(); }
+
+  /** Assuming this array represents a matrix with dimensions {rows,
+   * cols}, get the extent of those dimensions. */
+  NDARRAY_HOST_DEVICE index_t rows() const { return i().extent(); }
+  NDARRAY_HOST_DEVICE index_t columns() const { return j().extent(); }
+
+  /** A Morton shape is equal to another Morton shape if the dims, origins, and
+   * masks of both shapes are equal. */
+  NDARRAY_HOST_DEVICE bool operator==(const morton_shape& other) const {
+    return dims_ == other.dims_ && origin_ == other.origin_ && masks_ == other.masks_;
+  }
+  NDARRAY_HOST_DEVICE bool operator!=(const morton_shape& other) const {
+    return !operator==(other);
+  }
+};
+
+/** Arrays stored in Morton order. */
+template <class T, size_t Rank, class Alloc = std::allocator<T>>
+using morton_array = array<T, morton_shape<Rank>, Alloc>;
+template <class T, size_t Rank>
+using morton_array_ref = array_ref<T, morton_shape<Rank>>;
+template <class T, size_t Rank>
+using const_morton_array_ref = morton_array_ref<const T, Rank>;
+
+/** Make an `array_ref` of the part of `a` in `intervals`, with the same layout. */
+template <class T, size_t Rank, class... Intervals>
+array_ref<T, morton_shape<Rank>> crop(
+    const array_ref<T, morton_shape<Rank>>& a, const Intervals&... intervals) {
+  return make_array_ref(a.base(), a.shape().crop(intervals...));
+}
+template <class T, size_t Rank, class Alloc, class... Intervals>
+array_ref<T, morton_shape<Rank>> crop(
+    array<T, morton_shape<Rank>, Alloc>& a, const Intervals&... intervals) {
+  return crop(a.ref(), intervals...);
+}
+template <class T, size_t Rank, class Alloc, class... Intervals>
+array_ref<const T, morton_shape<Rank>> crop(
+    const array<T, morton_shape<Rank>, Alloc>& a, const Intervals&... intervals) {
+  return crop(a.cref(), intervals...);
+}
+
+namespace internal {
+
+// Call `fn(offset, other_offset)` for each index in the box [`min`, `min` +
+// `extent`), in order with dimension 0 innermost. `offset` is the flat offset
+// of the index in `shape`, and `other_offset` is the flat offset relative to
+// `min` in a shape with strides `other_stride`.
+template <size_t Rank, class Strides, class Fn>
+void for_each_morton_offset(const morton_shape<Rank>& shape,
+    const index_of_rank<Rank>& min, const index_of_rank<Rank>& extent,
+    const Strides& other_stride, Fn&& fn) {
+  const auto mins = tuple_to_array<index_t>(min);
+  const auto origin = tuple_to_array<index_t>(shape.origin());
+  std::array<uint64_t, Rank> bits;
+  for (size_t d = 0; d < Rank; d++) {
+    bits[d] = deposit_bits(static_cast<uint64_t>(mins[d] - origin[d]), shape.masks()[d]);
+  }
+  for_each_morton_offset(std::integral_constant<size_t, Rank - 1>(),
+      tuple_to_array<index_t>(extent), shape.masks(), bits,
+      tuple_to_array<index_t>(other_stride), 0, 0, fn);
+}
+
+} // namespace internal
+
+/** Morton shapes iterate over values in the order they are stored in memory. */
+template <size_t Rank>
+class shape_traits<morton_shape<Rank>> {
+public:
+  using shape_type = morton_shape<Rank>;
+
+  template <class Fn>
+  static void for_each_index(const shape_type& s, Fn&& fn) {
+    for_each_index_in_order(s, fn);
+  }
+
+  template <class Ptr, class Fn>
+  static void for_each_value(const shape_type& s, Ptr base, Fn&& fn) {
+    s.for_each_run([&](index_t begin, size_t count) {
+      for_each_value_in_order(dense_shape<1>(static_cast<index_t>(count)), base + begin, fn);
+    });
+  }
+};
+
+/** Copies between Morton shapes and other shapes visit the indices in order,
+ * with dimension 0 innermost, and step the flat offsets of the Morton shape
+ * from one index to the next with a few bit operations. */
+template <size_t Rank, class ShapeDst>
+class copy_shape_traits<morton_shape<Rank>, ShapeDst> {
+public:
+  using src_shape_type = morton_shape<Rank>;
+  using dst_shape_type = ShapeDst;
+
+  template <class Fn, class TSrc, class TDst>
+  static void for_each_value(
+      const src_shape_type& shape_src, TSrc src, const ShapeDst& shape_dst, TDst dst, Fn&& fn) {
+    internal::for_each_morton_offset(shape_src, shape_dst.min(), shape_dst.extent(),
+        shape_dst.stride(),
+        [&](index_t src_offset, index_t dst_offset) { fn(src[src_offset], dst[dst_offset]); });
+  }
+};
+
+template <class ShapeSrc, size_t Rank>
+class copy_shape_traits<ShapeSrc, morton_shape<Rank>> {
+public:
+  using src_shape_type = ShapeSrc;
+  using dst_shape_type = morton_shape<Rank>;
+
+  template <class Fn, class TSrc, class TDst>
+  static void for_each_value(
+      const ShapeSrc& shape_src, TSrc src, const dst_shape_type& shape_dst, TDst dst, Fn&& fn) {
+    src += shape_src(shape_dst.min());
+    internal::for_each_morton_offset(shape_dst, shape_dst.min(), shape_dst.extent(),
+        shape_src.stride(),
+        [&](index_t dst_offset, index_t src_offset) { fn(src[src_offset], dst[dst_offset]); });
+  }
+};
+
+template <size_t Rank>
+class copy_shape_traits<morton_shape<Rank>, morton_shape<Rank>> {
+public:
+  using src_shape_type = morton_shape<Rank>;
+  using dst_shape_type = morton_shape<Rank>;
+
+  template <class Fn, class TSrc, class TDst>
+  static void for_each_value(const src_shape_type& shape_src, TSrc src,
+      const dst_shape_type& shape_dst, TDst dst, Fn&& fn) {
+    if (shape_src.origin() == shape_dst.origin() && shape_src.masks() == shape_dst.masks()) {
+      // The flat offsets of both shapes are the same.
+      shape_dst.for_each_run([&](index_t begin, size_t count) {
+        dense_shape<1> run(static_cast<index_t>(count));
+        for_each_value_in_order(run, run, src + begin, run, dst + begin, fn);
+      });
+    } else {
+      for_each_index_in_order(shape_dst, [&](const typename dst_shape_type::index_type& i) {
+        fn(src[shape_src(i)], dst[shape_dst(i)]);
+      });
+    }
+  }
+};
+
+} // namespace nda
+
+#endif // NDARRAY_MORTON_SHAPE_H
@@ -0,0 +1,768 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** \file npy.h
+ * \brief Optional helpers for reading and writing NumPy .npy and .npz files.
+ * This requires POSIX `mmap`, see mmap_array.h.
+ *
+ * The dimensions of arrays are the axes of NumPy arrays in reverse order:
+ * dimension 0 of an array of rank N is axis N - 1 of the NumPy array. This
+ * makes C order NumPy arrays dense in dimension 0, e.g. a C order NumPy array
+ * of shape `(h, w)` is loaded as an array with a `dense_dim` of extent `w` and
+ * a dimension of extent `h`. NumPy arrays do not have mins, so arrays are
+ * loaded with mins of 0, and the mins of saved arrays are not saved.
+ */
+#ifndef NDARRAY_NPY_H
+#define NDARRAY_NPY_H
+
+#include "array.h"
+#include "mmap_array.h"
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace nda {
+
+namespace internal {
+
+inline bool is_little_endian() {
+  const uint16_t one = 1;
+  uint8_t first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+// The kind character of a NumPy dtype for the type T.
+template <class T>
+struct npy_kind {
+  static_assert(std::is_arithmetic<T>::value, "NumPy arrays must have an arithmetic type.");
+  static constexpr char value = std::is_same<T, bool>::value
+                                    ? 'b'
+                                    : std::is_floating_point<T>::value
+                                          ? 'f'
+                                          : std::is_signed<T>::value ? 'i' : 'u';
+};
+template <class T>
+struct npy_kind<std::complex<T>> {
+  static constexpr char value = 'c';
+};
+
+// The NumPy dtype of T, in the byte order of this machine.
+template <class T>
+std::string npy_descr() {
+  char order = sizeof(T) == 1 ? '|' : (is_little_endian() ? '<' : '>');
+  return std::string(1, order) + npy_kind<T>::value + std::to_string(sizeof(T));
+}
+
+// Check if `descr` is the dtype of T, in any byte order. `swap` is set to true
+// if the byte order is not the byte order of this machine.
+template <class T>
+bool npy_descr_matches(const std::string& descr, bool& swap) {
+  if (descr.size() < 3) { return false; }
+  char order = descr[0];
+  if (descr.substr(1) != npy_descr<T>().substr(1)) { return false; }
+  if (order == '<') {
+    swap = sizeof(T) > 1 && !is_little_endian();
+  } else if (order == '>') {
+    swap = sizeof(T) > 1 && is_little_endian();
+  } else if (order == '|' || order == '=') {
+    swap = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+template <class T>
+void byte_swap(T& x) {
+  char* bytes = reinterpret_cast<char*>(&x);
+  std::reverse(bytes, bytes + sizeof(T));
+}
+template <class T>
+void byte_swap(std::complex<T>& x) {
+  T re = x.real();
+  T im = x.imag();
+  byte_swap(re);
+  byte_swap(im);
+  x = std::complex<T>(re, im);
+}
+
+// The CRC-32 checksum used by zip files.
+inline uint32_t crc32(uint32_t crc, const void* data, size_t size) {
+  static const std::array<uint32_t, 256> table = []() {
+    std::array<uint32_t, 256> result;
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      result[i] = c;
+    }
+    return result;
+  }();
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Little endian encoding of integers for headers.
+template <class T>
+void put_le(std::string& to, T x) {
+  for (size_t i = 0; i < sizeof(T); i++) {
+    to.push_back(static_cast<char>((x >> (i * 8)) & 0xff));
+  }
+}
+template <class T>
+T get_le(const uint8_t* from) {
+  T result = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    result |= static_cast<T>(from[i]) << (i * 8);
+  }
+  return result;
+}
+
+// Writes to a file, and computes the size and checksum of what was written.
+class npy_writer {
+  FILE* f_;
+  uint32_t crc_;
+  uint64_t size_;
+  bool ok_;
+
+public:
+  explicit npy_writer(FILE* f) : f_(f), crc_(0), size_(0), ok_(f != nullptr) {}
+
+  bool write(const void* data, size_t size) {
+    ok_ = ok_ && std::fwrite(data, 1, size, f_) == size;
+    crc_ = crc32(crc_, data, size);
+    size_ += size;
+    return ok_;
+  }
+
+  uint32_t crc() const { return crc_; }
+  uint64_t size() const { return size_; }
+  bool ok() const { return ok_; }
+};
+
+// The header of a .npy file.
+struct npy_header {
+  std::string descr;
+  bool fortran_order;
+  std::vector<index_t> shape;
+  // The size of the header, the data begins at this offset.
+  size_t size;
+};
+
+inline std::string make_npy_header(const std::string& descr, const std::vector<index_t>& shape) {
+  std::string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (";
+  for (size_t i = 0; i < shape.size(); i++) {
+    dict += (i > 0 ? ", " : "") + std::to_string(shape[i]);
+  }
+  // Tuples of one element need a trailing comma.
+  dict += shape.size() == 1 ? ",), }" : "), }";
+
+  // Pad the header with spaces and a newline, so the data is aligned to 64
+  // bytes. Use version 2.0 if the header is too big for version 1.0.
+  size_t preamble = 10;
+  if (dict.size() + 1 + 64 > 65535) { preamble = 12; }
+  size_t size = (preamble + dict.size() + 1 + 63) / 64 * 64;
+  dict.resize(size - preamble - 1, ' ');
+  dict += '\n';
+
+  std::string result = "\x93NUMPY";
+  if (preamble == 10) {
+    result += '\x01';
+    result += '\x00';
+    put_le<uint16_t>(result, static_cast<uint16_t>(dict.size()));
+  } else {
+    result += '\x02';
+    result += '\x00';
+    put_le<uint32_t>(result, static_cast<uint32_t>(dict.size()));
+  }
+  return result + dict;
+}
+
+// Find the value of `key` in the header dictionary `dict`.
+inline size_t find_npy_value(const std::string& dict, const char* key) {
+  size_t at = dict.find(std::string("'") + key + "'");
+  if (at == std::string::npos) { return at; }
+  at = dict.find(':', at);
+  if (at == std::string::npos) { return at; }
+  return dict.find_first_not_of(' ', at + 1);
+}
+
+// Read the header of a .npy file, beginning at `offset` in `f`.
+inline bool read_npy_header(FILE* f, size_t offset, npy_header& header) {
+  uint8_t preamble[12];
+  if (fseeko(f, static_cast<off_t>(offset), SEEK_SET) != 0 ||
+      std::fread(preamble, 1, 10, f) != 10 || std::memcmp(preamble, "\x93NUMPY", 6) != 0) {
+    return false;
+  }
+  size_t dict_size;
+  size_t preamble_size;
+  if (preamble[6] == 1) {
+    dict_size = get_le<uint16_t>(preamble + 8);
+    preamble_size = 10;
+  } else if (preamble[6] == 2 || preamble[6] == 3) {
+    if (std::fread(preamble + 10, 1, 2, f) != 2) { return false; }
+    dict_size = get_le<uint32_t>(preamble + 8);
+    preamble_size = 12;
+  } else {
+    return false;
+  }
+  std::string dict(dict_size, ' ');
+  if (std::fread(&dict[0], 1, dict_size, f) != dict_size) { return false; }
+  header.size = preamble_size + dict_size;
+
+  size_t descr = find_npy_value(dict, "descr");
+  if (descr == std::string::npos || dict[descr] != '\'') { return false; }
+  size_t descr_end = dict.find('\'', descr + 1);
+  if (descr_end == std::string::npos) { return false; }
+  header.descr = dict.substr(descr + 1, descr_end - descr - 1);
+
+  size_t fortran_order = find_npy_value(dict, "fortran_order");
+  if (fortran_order == std::string::npos) { return false; }
+  header.fortran_order = dict.compare(fortran_order, 4, "True") == 0;
+
+  size_t shape = find_npy_value(dict, "shape");
+  if (shape == std::string::npos || dict[shape] != '(') { return false; }
+  size_t shape_end = dict.find(')', shape);
+  if (shape_end == std::string::npos) { return false; }
+  header.shape.clear();
+  const char* s = dict.c_str() + shape + 1;
+  const char* end = dict.c_str() + shape_end;
+  while (s < end) {
+    char* next;
+    long long extent = std::strtoll(s, &next, 10);
+    if (next == s) {
+      // Skip separators.
+      s++;
+    } else {
+      header.shape.push_back(static_cast<index_t>(extent));
+      s = next;
+    }
+  }
+  return true;
+}
+
+// Make the shape of the data of a .npy file, reversing the axes.
+template <size_t Rank>
+shape_of_rank<Rank> make_npy_shape(const npy_header& header) {
+  std::array<dim<>, Rank> dims;
+  index_t stride = 1;
+  for (size_t i = 0; i < Rank; i++) {
+    // In C order, the last axis is dense, which is dimension 0. In Fortran
+    // order, the first axis is dense, which is dimension Rank - 1.
+    size_t d = header.fortran_order ? Rank - 1 - i : i;
+    index_t extent = header.shape[Rank - 1 - d];
+    dims[d] = dim<>(0, extent, stride);
+    stride *= extent;
+  }
+  return shape_of_rank<Rank>(array_to_tuple(dims));
+}
+
+// Returns true if the mins and extents of `s` are compatible with `Shape`,
+// ignoring the strides.
+template <class Shape, class ShapeSrc, size_t... Is>
+bool are_bounds_compatible(const ShapeSrc& s, index_sequence<Is...>) {
+  return all(is_dim_compatible(
+      dim<std::tuple_element<Is, typename Shape::dims_type>::type::Min,
+          std::tuple_element<Is, typename Shape::dims_type>::type::Extent>(),
+      s.template dim<Is>())...);
+}
+
+// Make a shape of type `Shape` with the mins and extents of `s`, and strides
+// resolved for `Shape`.
+template <class Shape, class ShapeSrc, size_t... Is>
+Shape make_shape_with_bounds(const ShapeSrc& s, index_sequence<Is...>) {
+  Shape result(std::make_tuple(typename std::tuple_element<Is, typename Shape::dims_type>::type(
+      s.template dim<Is>().min(), s.template dim<Is>().extent())...));
+  result.resolve();
+  return result;
+}
+
+// Returns true if the strides of `s` are the strides of a dense array with
+// dimension 0 innermost.
+template <class Shape>
+bool is_npy_order(const Shape& s) {
+  index_t stride = 1;
+  for (const dim<>& d : tuple_to_array<dim<>>(s.dims())) {
+    if (d.extent() > 1 && d.stride() != stride) { return false; }
+    stride *= d.extent();
+  }
+  return true;
+}
+
+template <class T, class Shape>
+bool write_npy(npy_writer& w, const array_ref<T, Shape>& a) {
+  std::vector<index_t> shape;
+  for (const dim<>& d : tuple_to_array<dim<>>(a.shape().dims())) {
+    shape.insert(shape.begin(), d.extent());
+  }
+  std::string header = make_npy_header(npy_descr<typename std::remove_const<T>::type>(), shape);
+  if (!w.write(header.data(), header.size())) { return false; }
+
+  if (is_npy_order(a.shape())) {
+    // The array is already in the order of the file.
+    w.write(a.data(), static_cast<size_t>(a.size()) * sizeof(T));
+  } else {
+    // Write the values in order through a buffer.
+    std::vector<typename std::remove_const<T>::type> buffer;
+    const size_t buffer_size = 64 * 1024;
+    buffer.reserve(buffer_size);
+    for_each_index_in_order(a.shape(), [&](const typename Shape::index_type& i) {
+      buffer.push_back(a[i]);
+      if (buffer.size() == buffer_size) {
+        w.write(buffer.data(), buffer.size() * sizeof(T));
+        buffer.clear();
+      }
+    });
+    w.write(buffer.data(), buffer.size() * sizeof(T));
+  }
+  return w.ok();
+}
+
+} // namespace internal
+
+/** An array loaded from a .npy file. If the layout of the file is compatible
+ * with `Shape`, the array is a memory mapping of the file. Otherwise, the
+ * array is a copy of the file. If the file could not be loaded, `is_open`
+ * returns `false`. An `npy_array<const T, Shape>` is mapped read-only, and
+ * only provides `const_array_ref`s. */
+template <class T, class Shape>
+class npy_array {
+  using U = typename std::remove_const<T>::type;
+
+  mmap_array<T, Shape> mapped_;
+  array<U, Shape> copy_;
+  bool copied_;
+
+  // Copy the data of shape `s` at `offset` in the file `path`, swapping the
+  // bytes of each value if necessary.
+  template <class ShapeSrc>
+  bool copy_from_file(const char* path, size_t offset, const ShapeSrc& s, bool swap) {
+    if (!internal::are_bounds_compatible<Shape>(s, typename Shape::dim_indices())) {
+      return false;
+    }
+    copy_ = array<U, Shape>(
+        internal::make_shape_with_bounds<Shape>(s, typename Shape::dim_indices()));
+    mmap_array<const U, ShapeSrc> file;
+    if (file.open(path, offset, s)) {
+      // Copy the values directly from a mapping of the file.
+      copy(file.cref(), copy_.ref());
+    } else {
+      // The data in the file is not aligned, read it into a buffer first.
+      FILE* f = std::fopen(path, "rb");
+      if (!f) { return false; }
+      array<U, ShapeSrc> buffer(s);
+      size_t size = static_cast<size_t>(buffer.size());
+      bool ok = fseeko(f, static_cast<off_t>(offset), SEEK_SET) == 0 &&
+                std::fread(buffer.data(), sizeof(T), size, f) == size;
+      std::fclose(f);
+      if (!ok) { return false; }
+      copy(buffer.cref(), copy_.ref());
+    }
+    if (swap) {
+      copy_.for_each_value([](U& x) { internal::byte_swap(x); });
+    }
+    copied_ = true;
+    return true;
+  }
+
+public:
+  using value_type = T;
+  using shape_type = Shape;
+
+  npy_array() : copied_(false) {}
+
+  /** Load the .npy data beginning at `offset` bytes in the file at `path`. If
+   * the file is mapped, it is mapped with `mode`. Arrays of non-const `T`
+   * can't be mapped with `mmap_mode::read_only`, so they are copied. */
+  bool open(const char* path, size_t offset = 0, mmap_mode mode = default_mmap_mode<T>()) {
+    constexpr size_t rank = Shape::rank();
+    close();
+    FILE* f = std::fopen(path, "rb");
+    if (!f) { return false; }
+    internal::npy_header header;
+    bool ok = internal::read_npy_header(f, offset, header);
+    std::fclose(f);
+    bool swap = false;
+    if (!ok || header.shape.size() != rank || !internal::npy_descr_matches<U>(header.descr, swap)) {
+      return false;
+    }
+    auto s = internal::make_npy_shape<rank>(header);
+    size_t data_offset = offset + header.size;
+    if (!swap && is_compatible<Shape>(s) && mapped_.open(path, data_offset, s, mode)) {
+      return true;
+    }
+    return copy_from_file(path, data_offset, s, swap);
+  }
+
+  /** Release the array. */
+  void close() {
+    mapped_.close();
+    copy_.clear();
+    copied_ = false;
+  }
+
+  /** Returns `true` if the array was loaded. */
+  bool is_open() const { return mapped_.is_open() || copied_; }
+  /** Returns `true` if the array is a memory mapping of the file. */
+  bool is_mapped() const { return mapped_.is_open(); }
+
+  /** Access the loaded array. If `T` is const, this is a `const_array_ref`.
+   * Otherwise, writes are private to this array, unless the file is mapped
+   * with `mmap_mode::shared`. */
+  array_ref<T, Shape> ref() {
+    return mapped_.is_open() ? mapped_.ref() : array_ref<T, Shape>(copy_.ref());
+  }
+  const_array_ref<T, Shape> cref() const {
+    return mapped_.is_open() ? mapped_.cref() : copy_.cref();
+  }
+  const_array_ref<T, Shape> ref() const { return cref(); }
+
+  /** Shape of the loaded array. */
+  const Shape& shape() const { return mapped_.is_open() ? mapped_.shape() : copy_.shape(); }
+};
+
+/** Load an array from the .npy file at `path`. The NumPy dtype must be the
+ * same as `T`, and the rank must be the same as `Shape`. If the layout of the
+ * file is compatible with `Shape`, the file is memory mapped with `mode`,
+ * without copying. Otherwise, the data is copied to an array with shape
+ * `Shape`. */
+template <class T, class Shape>
+npy_array<T, Shape> load_npy(const char* path, mmap_mode mode = default_mmap_mode<T>()) {
+  npy_array<T, Shape> result;
+  result.open(path, 0, mode);
+  return result;
+}
+
+/** Save the array `a` to a .npy file at `path`. The file is a C order NumPy
+ * array with the axes in the reverse order of the dimensions of `a`. Returns
+ * `false` if the file could not be written. */
+template <class T, class Shape>
+bool save_npy(const char* path, const array_ref<T, Shape>& a) {
+  FILE* f = std::fopen(path, "wb");
+  internal::npy_writer w(f);
+  bool ok = f && internal::write_npy(w, a);
+  if (f) { ok = std::fclose(f) == 0 && ok; }
+  return ok;
+}
+template <class T, class Shape, class Alloc>
+bool save_npy(const char* path, const array<T, Shape, Alloc>& a) {
+  return save_npy(path, a.cref());
+}
+
+/** Writes arrays to a .npz file, a zip file of .npy files. The entries are not
+ * compressed, like `numpy.savez`. The entries are aligned so they can be
+ * loaded without copying by `npz_reader`. The zip64 format is not supported,
+ * so the file must be smaller than 4 GB. */
+class npz_writer {
+  struct entry {
+    std::string name;
+    uint32_t crc;
+    uint32_t size;
+    uint32_t offset;
+  };
+  FILE* f_;
+  std::vector<entry> entries_;
+  bool ok_;
+
+  static std::string local_header(const entry& e, uint16_t padding) {
+    std::string result;
+    internal::put_le<uint32_t>(result, 0x04034b50);
+    // Version needed, flags, compression method, time, and date.
+    internal::put_le<uint16_t>(result, 20);
+    internal::put_le<uint16_t>(result, 0);
+    internal::put_le<uint16_t>(result, 0);
+    internal::put_le<uint16_t>(result, 0);
+    internal::put_le<uint16_t>(result, 0x21);
+    internal::put_le<uint32_t>(result, e.crc);
+    internal::put_le<uint32_t>(result, e.size);
+    internal::put_le<uint32_t>(result, e.size);
+    internal::put_le<uint16_t>(result, static_cast<uint16_t>(e.name.size()));
+    internal::put_le<uint16_t>(result, padding);
+    result += e.name;
+    if (padding > 0) {
+      // An extra field with an unused ID, to align the data.
+      internal::put_le<uint16_t>(result, 0x6e64);
+      internal::put_le<uint16_t>(result, static_cast<uint16_t>(padding - 4));
+      result.append(padding - 4, '\0');
+    }
+    return result;
+  }
+
+public:
+  /** Create a .npz file at `path`. */
+  explicit npz_writer(const char* path) : f_(std::fopen(path, "wb")), ok_(f_ != nullptr) {}
+  ~npz_writer() { close(); }
+
+  npz_writer(const npz_writer&) = delete;
+  npz_writer& operator=(const npz_writer&) = delete;
+
+  /** Returns `true` if the file was created, and all writes succeeded. */
+  bool is_open() const { return f_ && ok_; }
+
+  /** Add the array `a` to the file, with name `name`. */
+  template <class T, class Shape>
+  bool add(const std::string& name, const array_ref<T, Shape>& a) {
+    if (!is_open()) { return false; }
+    off_t offset = ftello(f_);
+    entry e{name + ".npy", 0, 0, static_cast<uint32_t>(offset)};
+    // Align the data to 64 bytes. The extra field must be at least 4 bytes.
+    const size_t header_size = 30 + e.name.size();
+    uint16_t padding = static_cast<uint16_t>((64 - (offset + header_size) % 64) % 64);
+    if (padding > 0 && padding < 4) { padding += 64; }
+    std::string header = local_header(e, padding);
+    ok_ = std::fwrite(header.data(), 1, header.size(), f_) == header.size();
+
+    internal::npy_writer w(f_);
+    ok_ = ok_ && internal::write_npy(w, a);
+    if (!ok_ || offset + header.size() + w.size() > 0xffffffff) {
+      ok_ = false;
+      return false;
+    }
+    e.crc = w.crc();
+    e.size = static_cast<uint32_t>(w.size());
+
+    // Rewrite the header with the checksum and size.
+    off_t end = ftello(f_);
+    header = local_header(e, padding);
+    ok_ = fseeko(f_, offset, SEEK_SET) == 0 &&
+          std::fwrite(header.data(), 1, header.size(), f_) == header.size() &&
+          fseeko(f_, end, SEEK_SET) == 0;
+    entries_.push_back(e);
+    return ok_;
+  }
+  template <class T, class Shape, class Alloc>
+  bool add(const std::string& name, const array<T, Shape, Alloc>& a) {
+    return add(name, a.cref());
+  }
+
+  /** Write the directory of the zip file, and close it. Returns `false` if
+   * any write failed. */
+  bool close() {
+    if (!f_) { return ok_; }
+    std::string directory;
+    for (const entry& e : entries_) {
+      internal::put_le<uint32_t>(directory, 0x02014b50);
+      // Version made by, version needed, flags, compression method, time,
+      // and date.
+      internal::put_le<uint16_t>(directory, 20);
+      internal::put_le<uint16_t>(directory, 20);
+      internal::put_le<uint16_t>(directory, 0);
+      internal::put_le<uint16_t>(directory, 0);
+      internal::put_le<uint16_t>(directory, 0);
+      internal::put_le<uint16_t>(directory, 0x21);
+      internal::put_le<uint32_t>(directory, e.crc);
+      internal::put_le<uint32_t>(directory, e.size);
+      internal::put_le<uint32_t>(directory, e.size);
+      internal::put_le<uint16_t>(directory, static_cast<uint16_t>(e.name.size()));
+      // Extra field length, comment length, disk number, and attributes.
+      internal::put_le<uint16_t>(directory, 0);
+      internal::put_le<uint16_t>(directory, 0);
+      internal::put_le<uint16_t>(directory, 0);
+      internal::put_le<uint16_t>(directory, 0);
+      internal::put_le<uint32_t>(directory, 0);
+      internal::put_le<uint32_t>(directory, e.offset);
+      directory += e.name;
+    }
+    off_t offset = ftello(f_);
+    const size_t directory_size = directory.size();
+    internal::put_le<uint32_t>(directory, 0x06054b50);
+    internal::put_le<uint16_t>(directory, 0);
+    internal::put_le<uint16_t>(directory, 0);
+    internal::put_le<uint16_t>(directory, static_cast<uint16_t>(entries_.size()));
+    internal::put_le<uint16_t>(directory, static_cast<uint16_t>(entries_.size()));
+    internal::put_le<uint32_t>(directory, static_cast<uint32_t>(directory_size));
+    internal::put_le<uint32_t>(directory, static_cast<uint32_t>(offset));
+    internal::put_le<uint16_t>(directory, 0);
+    ok_ = ok_ && offset + directory.size() <= 0xffffffff &&
+          std::fwrite(directory.data(), 1, directory.size(), f_) == directory.size();
+    ok_ = std::fclose(f_) == 0 && ok_;
+    f_ = nullptr;
+    return ok_;
+  }
+};
+
+/** Reads arrays from a .npz file, a zip file of .npy files. Only entries that
+ * are not compressed can be loaded, i.e. files written by `numpy.savez`, but
+ * not `numpy.savez_compressed`. The checksums of the entries are not
+ * verified. */
+class npz_reader {
+  struct entry {
+    std::string name;
+    uint16_t compression;
+    uint64_t offset;
+  };
+  std::string path_;
+  std::vector<entry> entries_;
+  bool ok_;
+
+  // Read the zip64 extra field `extra`, to find the offset if it is
+  // 0xffffffff in the directory. The extra field contains the values that are
+  // 0xffffffff in the directory, in order.
+  static void read_zip64_extra(
+      const std::string& extra, uint64_t size, uint64_t compressed_size, uint64_t& offset) {
+    for (size_t i = 0; i + 4 <= extra.size();) {
+      const uint8_t* field = reinterpret_cast<const uint8_t*>(extra.data() + i);
+      uint16_t id = internal::get_le<uint16_t>(field);
+      uint16_t field_size = internal::get_le<uint16_t>(field + 2);
+      if (id == 0x0001) {
+        const uint8_t* value = field + 4;
+        if (size == 0xffffffff) { value += 8; }
+        if (compressed_size == 0xffffffff) { value += 8; }
+        if (offset == 0xffffffff) { offset = internal::get_le<uint64_t>(value); }
+        return;
+      }
+      i += 4 + field_size;
+    }
+  }
+
+  bool read_directory(FILE* f) {
+    if (fseeko(f, 0, SEEK_END) != 0) { return false; }
+    off_t file_size = ftello(f);
+    // Find the end of central directory record, which is followed by a
+    // comment of up to 64 KB.
+    off_t search_size = std::min<off_t>(file_size, 65535 + 22);
+    std::vector<uint8_t> tail(static_cast<size_t>(search_size));
+    if (fseeko(f, file_size - search_size, SEEK_SET) != 0 ||
+        std::fread(tail.data(), 1, tail.size(), f) != tail.size()) {
+      return false;
+    }
+    off_t eocd = -1;
+    for (off_t i = search_size - 22; i >= 0; i--) {
+      if (internal::get_le<uint32_t>(&tail[i]) == 0x06054b50) {
+        eocd = i;
+        break;
+      }
+    }
+    if (eocd < 0) { return false; }
+    uint64_t count = internal::get_le<uint16_t>(&tail[eocd + 10]);
+    uint64_t directory_offset = internal::get_le<uint32_t>(&tail[eocd + 16]);
+    if (directory_offset == 0xffffffff || count == 0xffff) {
+      // This is a zip64 file, find the zip64 end of central directory record
+      // with the locator before the end of central directory record.
+      if (eocd < 20 || internal::get_le<uint32_t>(&tail[eocd - 20]) != 0x07064b50) {
+        return false;
+      }
+      uint64_t zip64_eocd = internal::get_le<uint64_t>(&tail[eocd - 12]);
+      uint8_t record[56];
+      if (fseeko(f, static_cast<off_t>(zip64_eocd), SEEK_SET) != 0 ||
+          std::fread(record, 1, 56, f) != 56 ||
+          internal::get_le<uint32_t>(record) != 0x06064b50) {
+        return false;
+      }
+      count = internal::get_le<uint64_t>(record + 32);
+      directory_offset = internal::get_le<uint64_t>(record + 48);
+    }
+
+    if (fseeko(f, static_cast<off_t>(directory_offset), SEEK_SET) != 0) { return false; }
+    std::vector<entry> entries;
+    for (uint64_t i = 0; i < count; i++) {
+      uint8_t header[46];
+      if (std::fread(header, 1, 46, f) != 46 ||
+          internal::get_le<uint32_t>(header) != 0x02014b50) {
+        return false;
+      }
+      entry e;
+      e.compression = internal::get_le<uint16_t>(header + 10);
+      uint64_t compressed_size = internal::get_le<uint32_t>(header + 20);
+      uint64_t size = internal::get_le<uint32_t>(header + 24);
+      uint16_t name_size = internal::get_le<uint16_t>(header + 28);
+      uint16_t extra_size = internal::get_le<uint16_t>(header + 30);
+      uint16_t comment_size = internal::get_le<uint16_t>(header + 32);
+      e.offset = internal::get_le<uint32_t>(header + 42);
+      e.name.resize(name_size);
+      std::string extra(extra_size, '\0');
+      if ((name_size > 0 && std::fread(&e.name[0], 1, name_size, f) != name_size) ||
+          (extra_size > 0 && std::fread(&extra[0], 1, extra_size, f) != extra_size) ||
+          fseeko(f, comment_size, SEEK_CUR) != 0) {
+        return false;
+      }
+      read_zip64_extra(extra, size, compressed_size, e.offset);
+      entries.push_back(e);
+    }
+
+    // Find the offset of the data of each entry, after the local header.
+    for (entry& e : entries) {
+      uint8_t header[30];
+      if (fseeko(f, static_cast<off_t>(e.offset), SEEK_SET) != 0 ||
+          std::fread(header, 1, 30, f) != 30 ||
+          internal::get_le<uint32_t>(header) != 0x04034b50) {
+        return false;
+      }
+      e.offset += 30 + internal::get_le<uint16_t>(header + 26) +
+                  internal::get_le<uint16_t>(header + 28);
+      // NumPy names the entries with a .npy suffix.
+      const std::string suffix = ".npy";
+      if (e.name.size() > suffix.size() &&
+          e.name.compare(e.name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        e.name.resize(e.name.size() - suffix.size());
+      }
+    }
+    entries_ = std::move(entries);
+    return true;
+  }
+
+public:
+  /** Open the .npz file at `path`. */
+  explicit npz_reader(const char* path) : path_(path), ok_(false) {
+    FILE* f = std::fopen(path, "rb");
+    if (f) {
+      ok_ = read_directory(f);
+      std::fclose(f);
+    }
+  }
+
+  /** Returns `true` if the directory of the file was read. */
+  bool is_open() const { return ok_; }
+
+  /** The names of the arrays in the file. */
+  std::vector<std::string> names() const {
+    std::vector<std::string> result;
+    for (const entry& e : entries_) {
+      result.push_back(e.name);
+    }
+    return result;
+  }
+
+  /** Load the array with name `name`, like `load_npy`. Arrays can't be
+   * mapped with `mmap_mode::shared`, because writing to them would make the
+   * checksums of the zip file incorrect. */
+  template <class T, class Shape>
+  npy_array<T, Shape> load(
+      const std::string& name, mmap_mode mode = default_mmap_mode<T>()) const {
+    npy_array<T, Shape> result;
+    if (mode == mmap_mode::shared) { return result; }
+    for (const entry& e : entries_) {
+      if (e.name == name && e.compression == 0) {
+        result.open(path_.c_str(), e.offset, mode);
+        break;
+      }
+    }
+    return result;
+  }
+};
+
+} // namespace nda
+
+#endif // NDARRAY_NPY_H
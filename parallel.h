@@ -0,0 +1,467 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** \file parallel.h
+ * \brief Optional helpers for executing array operations on multiple threads.
+ */
+#ifndef NDARRAY_PARALLEL_H
+#define NDARRAY_PARALLEL_H
+
+#include "array.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nda {
+
+/** A pool of worker threads for executing tasks. Each worker owns a queue of
+ * tasks. Workers execute tasks from the back of their own queue, and when it is
+ * empty, steal tasks from the front of the other workers' queues.
+ *
+ * The thread waiting for work submitted to the pool (e.g. via `parallel_for`)
+ * also executes tasks while it waits. This means a pool with `thread_count`
+ * of 1 executes all work on the calling thread, and that `parallel_for` can
+ * be called from within a task without deadlocking. */
+class thread_pool {
+public:
+  using task = std::function<void()>;
+
+private:
+  struct task_queue {
+    std::mutex mutex;
+    std::deque<task> tasks;
+  };
+
+  std::vector<std::unique_ptr<task_queue>> queues_;
+  std::vector<std::thread> workers_;
+
+  // Protects stop_, and is used with cv_ to wake up idle workers.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<index_t> queued_;
+  std::atomic<size_t> next_queue_;
+  bool stop_;
+
+  // The pool and queue index of the worker running on the current thread, if
+  // the current thread is a worker.
+  static const thread_pool*& current_pool() {
+    static thread_local const thread_pool* pool = nullptr;
+    return pool;
+  }
+  static size_t& current_queue() {
+    static thread_local size_t queue = 0;
+    return queue;
+  }
+  bool is_worker() const { return current_pool() == this; }
+
+  // Pop a task from the back of queue `q` or steal from the front of another
+  // queue. If `q` is not a valid queue index, only steals.
+  bool pop(size_t q, task& t) {
+    const size_t n = queues_.size();
+    if (q < n) {
+      task_queue& own = *queues_[q];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        t = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        queued_--;
+        return true;
+      }
+    }
+    for (size_t i = 1; i <= n; i++) {
+      task_queue& victim = *queues_[(q + i) % n];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        t = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        queued_--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void worker(size_t q) {
+    current_pool() = this;
+    current_queue() = q;
+    task t;
+    while (true) {
+      if (pop(q, t)) {
+        t();
+        t = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+      if (stop_) { return; }
+    }
+  }
+
+public:
+  /** Construct a thread pool providing `thread_count` threads of parallelism.
+   * The pool creates `thread_count - 1` worker threads, the remaining thread is
+   * the thread waiting for the work to complete. */
+  explicit thread_pool(int thread_count = std::thread::hardware_concurrency())
+      : queued_(0), next_queue_(0), stop_(false) {
+    const size_t worker_count = static_cast<size_t>(std::max(thread_count, 1) - 1);
+    for (size_t i = 0; i < worker_count; i++) {
+      queues_.emplace_back(new task_queue());
+    }
+    for (size_t i = 0; i < worker_count; i++) {
+      workers_.emplace_back([this, i]() { worker(i); });
+    }
+  }
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& i : workers_) {
+      i.join();
+    }
+  }
+
+  /** The number of threads of parallelism provided by this pool, including the
+   * waiting thread. */
+  int thread_count() const { return static_cast<int>(workers_.size()) + 1; }
+
+  /** Add a task to the pool. If the calling thread is a worker of this pool, the
+   * task is added to that worker's queue, otherwise the tasks are distributed
+   * among the workers' queues. Tasks enqueued in a pool without any workers are
+   * only executed by `run_one`. */
+  void enqueue(task t) {
+    if (queues_.empty()) {
+      // There are no workers, just run the task now.
+      t();
+      return;
+    }
+    const size_t q = is_worker() ? current_queue() : next_queue_++ % queues_.size();
+    {
+      std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+      queues_[q]->tasks.push_back(std::move(t));
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queued_++;
+    }
+    cv_.notify_one();
+  }
+
+  /** Execute one task from the pool on the calling thread. Returns `false` if
+   * there were no tasks available. */
+  bool run_one() {
+    task t;
+    if (!pop(is_worker() ? current_queue() : queues_.size(), t)) { return false; }
+    t();
+    return true;
+  }
+
+  /** Call `body` with intervals that partition `range`, distributing the calls
+   * among the threads of this pool. Each interval has an extent of at least
+   * `min_extent`, except possibly the last. This function returns when all of
+   * the calls to `body` have completed. */
+  template <class Fn>
+  void parallel_for(const interval<>& range, index_t min_extent, const Fn& body) {
+    if (range.extent() <= 0) { return; }
+    // Make several tasks per thread, so idle threads can steal work from
+    // threads that were given expensive chunks.
+    const index_t max_tasks = thread_count() == 1 ? 1 : thread_count() * 4;
+    const index_t task_extent = std::max(
+        std::max<index_t>(min_extent, 1), (range.extent() + max_tasks - 1) / max_tasks);
+    if (task_extent >= range.extent()) {
+      body(range);
+      return;
+    }
+
+    std::atomic<index_t> remaining(0);
+    const interval<> first(range.min(), task_extent);
+    const interval<> rest(first.max() + 1, range.extent() - task_extent);
+    for (interval<> i : split(rest, task_extent)) {
+      remaining++;
+      enqueue([&body, &remaining, i]() {
+        body(i);
+        remaining--;
+      });
+    }
+    body(first);
+    // Help with the remaining work while we wait for it to complete.
+    while (remaining > 0) {
+      if (!run_one()) { std::this_thread::yield(); }
+    }
+  }
+
+  /** A thread pool shared by the whole program, with one thread per hardware
+   * thread. */
+  static thread_pool& global() {
+    static thread_pool pool;
+    return pool;
+  }
+};
+
+/** Execution policy indicating that an operation may be split into tasks
+ * executed on multiple threads of a `thread_pool`. Operations given a parallel
+ * policy may call user functions from multiple threads concurrently, and in an
+ * unspecified order. */
+class parallel_policy {
+  thread_pool* pool_;
+
+public:
+  /** Execute operations on the global thread pool `thread_pool::global()`. */
+  parallel_policy() : pool_(nullptr) {}
+  /** Execute operations on the thread pool `pool`. */
+  explicit parallel_policy(thread_pool& pool) : pool_(&pool) {}
+
+  thread_pool& pool() const { return pool_ ? *pool_ : thread_pool::global(); }
+};
+
+/** Parallel policy using the global thread pool, e.g. `copy(par, src, dst)`. */
+const parallel_policy par;
+
+/** Call `body` with intervals that partition `range`, executed in parallel
+ * using `policy`. */
+template <class Fn>
+void parallel_for(const parallel_policy& policy, const interval<>& range, const Fn& body) {
+  policy.pool().parallel_for(range, 1, body);
+}
+
+namespace internal {
+
+// The minimum number of elements to process in one task. Smaller tasks don't
+// amortize the overhead of scheduling them.
+constexpr index_t parallel_min_task_size = 1 << 14;
+
+// Dims of affine shapes with a constant min or extent can't be split.
+template <class Dim>
+constexpr bool is_splittable_dim() {
+  return is_dynamic(Dim::Min) && is_dynamic(Dim::Extent);
+}
+
+// The priority of splitting each dim of a shape into tasks, or -1 if the dim
+// can't be split. Affine shapes prefer to split the dims with the largest
+// strides. Other shapes prefer to split outer dims.
+template <class... Dims, size_t... Is>
+std::array<index_t, sizeof...(Dims)> split_priorities(
+    const shape<Dims...>& s, index_sequence<Is...>) {
+  return {{(is_splittable_dim<Dims>() ? std::abs(std::get<Is>(s.dims()).stride()) : -1)...}};
+}
+template <class Shape, size_t... Is>
+std::array<index_t, Shape::rank()> split_priorities(const Shape&, index_sequence<Is...>) {
+  return {{static_cast<index_t>(Is)...}};
+}
+
+// Choose the dim of `s` to split into tasks: the splittable dim with the
+// highest priority with an extent of at least `tasks`, or if there is no such
+// dim, the splittable dim with the largest extent. Returns `Shape::rank()` if
+// there is no dim to split.
+template <class Shape>
+size_t choose_split_dim(const Shape& s, index_t tasks) {
+  constexpr size_t rank = Shape::rank();
+  const auto priorities = split_priorities(s, make_index_sequence<rank>());
+  const auto extents = tuple_to_array<index_t>(s.extent());
+  size_t best = rank;
+  size_t largest = rank;
+  for (size_t d = 0; d < rank; d++) {
+    if (priorities[d] < 0 || extents[d] <= 1) { continue; }
+    if (extents[d] >= tasks && (best == rank || priorities[d] > priorities[best])) { best = d; }
+    if (largest == rank || extents[d] >= extents[largest]) { largest = d; }
+  }
+  return best < rank ? best : largest;
+}
+
+template <class Dim>
+index_t set_interval(Dim& dim, const interval<>& i, std::true_type) {
+  const index_t offset = dim.flat_offset(i.min());
+  dim.set_min(i.min());
+  dim.set_extent(i.extent());
+  return offset;
+}
+template <class Dim>
+index_t set_interval(Dim&, const interval<>&, std::false_type) {
+  assert(!"dim cannot be split");
+  return 0;
+}
+
+// Crop dim `d` of the shape `s` to `i`, returning the cropped shape of the
+// same type, and the flat offset in `s` of the base of the cropped shape.
+// Shapes that are not affine must provide `crop`, which maps indices to the
+// same flat offsets as the shape, like `tiled_shape` and `morton_shape`.
+template <class... Dims, size_t... Is>
+std::pair<shape<Dims...>, index_t> crop_dim(
+    const shape<Dims...>& s, size_t d, const interval<>& i, index_sequence<Is...>) {
+  std::pair<shape<Dims...>, index_t> result(s, 0);
+  (void)std::initializer_list<int>{
+      (Is == d ? (result.second = set_interval(std::get<Is>(result.first.dims()), i,
+                      std::integral_constant<bool, is_splittable_dim<Dims>()>()),
+                     0)
+               : 0)...};
+  return result;
+}
+template <class Shape, size_t... Is>
+std::pair<Shape, index_t> crop_dim(
+    const Shape& s, size_t d, const interval<>& i, index_sequence<Is...>) {
+  const auto mins = tuple_to_array<index_t>(s.min());
+  const auto extents = tuple_to_array<index_t>(s.extent());
+  return std::make_pair(
+      s.crop(std::make_tuple((Is == d ? i : interval<>(mins[Is], extents[Is]))...)), 0);
+}
+
+// Split a dim of `shape` into chunks with `choose_split_dim`, and call
+// `body(chunk, offset)` on each of them in parallel, where `offset` is the
+// flat offset in `shape` of the base of `chunk`.
+template <class Shape, class Body>
+void parallel_for_each_chunk(const parallel_policy& policy, const Shape& shape, const Body& body) {
+  constexpr size_t rank = Shape::rank();
+  const size_t d = choose_split_dim(shape, policy.pool().thread_count());
+  if (d >= rank) {
+    body(shape, 0);
+    return;
+  }
+  const auto mins = tuple_to_array<index_t>(shape.min());
+  const auto extents = tuple_to_array<index_t>(shape.extent());
+  const index_t chunk_size = static_cast<index_t>(shape.size()) / extents[d];
+  const index_t min_extent =
+      std::max<index_t>(1, parallel_min_task_size / std::max<index_t>(1, chunk_size));
+  policy.pool().parallel_for(interval<>(mins[d], extents[d]), min_extent,
+      [&](const interval<>& i) {
+        const auto chunk = crop_dim(shape, d, i, make_index_sequence<rank>());
+        body(chunk.first, chunk.second);
+      });
+}
+
+// Split `shape` into chunks, and call shape_traits::for_each_value on each of
+// them in parallel.
+template <class Shape, class Ptr, class Fn, std::enable_if_t<(Shape::rank() > 0), int> = 0>
+void parallel_for_each_value(
+    const parallel_policy& policy, const Shape& shape, Ptr base, const Fn& fn) {
+  parallel_for_each_chunk(policy, shape, [&](const Shape& chunk, index_t offset) {
+    shape_traits<Shape>::for_each_value(chunk, base + offset, fn);
+  });
+}
+template <class Shape, class Ptr, class Fn, std::enable_if_t<(Shape::rank() == 0), int> = 0>
+void parallel_for_each_value(const parallel_policy&, const Shape&, Ptr base, const Fn& fn) {
+  fn(*base);
+}
+
+// Similar to the above, splitting `shape_dst` into chunks, and calling
+// copy_shape_traits::for_each_value on each of them.
+template <class ShapeSrc, class PtrSrc, class ShapeDst, class PtrDst, class Fn,
+    std::enable_if_t<(ShapeSrc::rank() > 0), int> = 0>
+void parallel_for_each_value(const parallel_policy& policy, const ShapeSrc& shape_src, PtrSrc src,
+    const ShapeDst& shape_dst, PtrDst dst, const Fn& fn) {
+  parallel_for_each_chunk(policy, shape_dst, [&](const ShapeDst& chunk, index_t offset) {
+    copy_shape_traits<ShapeSrc, ShapeDst>::for_each_value(shape_src, src, chunk, dst + offset, fn);
+  });
+}
+template <class ShapeSrc, class PtrSrc, class ShapeDst, class PtrDst, class Fn,
+    std::enable_if_t<(ShapeSrc::rank() == 0), int> = 0>
+void parallel_for_each_value(const parallel_policy&, const ShapeSrc&, PtrSrc src, const ShapeDst&,
+    PtrDst dst, const Fn& fn) {
+  fn(*src, *dst);
+}
+
+} // namespace internal
+
+/** Call a function with a reference to each value in the array or array_ref
+ * `a`, in parallel using `policy`. One dimension of `a` is split into tasks,
+ * and each task visits its part of `a` with `shape_traits<Shape>`, so shapes
+ * that are not affine, such as `tiled_shape`, are supported. `fn` is called
+ * concurrently from multiple threads. */
+template <class T, class Shape, class Fn, class = internal::enable_if_callable<Fn, T&>>
+void for_each_value(const parallel_policy& policy, const array_ref<T, Shape>& a, const Fn& fn) {
+  internal::parallel_for_each_value(policy, a.shape(), a.base(), fn);
+}
+template <class T, class Shape, class Alloc, class Fn,
+    class = internal::enable_if_callable<Fn, T&>>
+void for_each_value(const parallel_policy& policy, array<T, Shape, Alloc>& a, const Fn& fn) {
+  for_each_value(policy, a.ref(), fn);
+}
+template <class T, class Shape, class Alloc, class Fn,
+    class = internal::enable_if_callable<Fn, const T&>>
+void for_each_value(const parallel_policy& policy, const array<T, Shape, Alloc>& a, const Fn& fn) {
+  for_each_value(policy, a.cref(), fn);
+}
+
+/** Copy the contents of the `src` array or array_ref to the `dst` array or
+ * array_ref, in parallel using `policy`. One dimension of `dst` is split into
+ * tasks, and each task copies its part of `dst` with
+ * `copy_shape_traits<ShapeSrc, ShapeDst>`. See `copy` for more details. */
+template <class TSrc, class TDst, class ShapeSrc, class ShapeDst,
+    class = internal::enable_if_shapes_copy_compatible<ShapeDst, ShapeSrc>>
+void copy(const parallel_policy& policy, const array_ref<TSrc, ShapeSrc>& src,
+    const array_ref<TDst, ShapeDst>& dst) {
+  if (dst.shape().empty()) { return; }
+
+  assert(src.shape().is_in_range(dst.shape().min()) && src.shape().is_in_range(dst.shape().max()));
+
+  internal::parallel_for_each_value(policy, src.shape(), src.base(), dst.shape(), dst.base(),
+      internal::copy_assign<TSrc, TDst>());
+}
+template <class TSrc, class TDst, class ShapeSrc, class ShapeDst, class AllocDst,
+    class = internal::enable_if_shapes_copy_compatible<ShapeDst, ShapeSrc>>
+void copy(const parallel_policy& policy, const array_ref<TSrc, ShapeSrc>& src,
+    array<TDst, ShapeDst, AllocDst>& dst) {
+  copy(policy, src, dst.ref());
+}
+template <class TSrc, class TDst, class ShapeSrc, class ShapeDst, class AllocSrc,
+    class = internal::enable_if_shapes_copy_compatible<ShapeDst, ShapeSrc>>
+void copy(const parallel_policy& policy, const array<TSrc, ShapeSrc, AllocSrc>& src,
+    const array_ref<TDst, ShapeDst>& dst) {
+  copy(policy, src.cref(), dst);
+}
+template <class TSrc, class TDst, class ShapeSrc, class ShapeDst, class AllocSrc, class AllocDst,
+    class = internal::enable_if_shapes_copy_compatible<ShapeDst, ShapeSrc>>
+void copy(const parallel_policy& policy, const array<TSrc, ShapeSrc, AllocSrc>& src,
+    array<TDst, ShapeDst, AllocDst>& dst) {
+  copy(policy, src.cref(), dst.ref());
+}
+
+/** Fill the `dst` array or array_ref by copy-assigning `value`, in parallel
+ * using `policy`. */
+template <class T, class Shape>
+void fill(const parallel_policy& policy, const array_ref<T, Shape>& dst, const T& value) {
+  for_each_value(policy, dst, [value](T& i) { i = value; });
+}
+template <class T, class Shape, class Alloc>
+void fill(const parallel_policy& policy, array<T, Shape, Alloc>& dst, const T& value) {
+  fill(policy, dst.ref(), value);
+}
+
+/** Fill the `dst` array or array_ref with the result of calling a generator
+ * function `g`, in parallel using `policy`. `g` is called concurrently from
+ * multiple threads, in an unspecified order. */
+template <class T, class Shape, class Generator, class = internal::enable_if_callable<Generator>>
+void generate(const parallel_policy& policy, const array_ref<T, Shape>& dst, const Generator& g) {
+  for_each_value(policy, dst, [&g](T& i) { i = g(); });
+}
+template <class T, class Shape, class Alloc, class Generator,
+    class = internal::enable_if_callable<Generator>>
+void generate(const parallel_policy& policy, array<T, Shape, Alloc>& dst, const Generator& g) {
+  generate(policy, dst.ref(), g);
+}
+
+} // namespace nda
+
+#endif // NDARRAY_PARALLEL_H
@@ -0,0 +1,79 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "array.h"
+#include "test.h"
+
+#include <vector>
+
+namespace nda {
+
+TEST(aligned_allocator) {
+  for (index_t n : {1, 3, 100, 1000}) {
+    dense_array<char, 1, aligned_allocator<char, 64>> x(dense_shape<1>(n), 1);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(x.data()) % 64, 0);
+    x.for_each_value([](char i) { ASSERT_EQ(i, 1); });
+
+    std::vector<double, aligned_allocator<double, 256>> y(n, 2.0);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(y.data()) % 256, 0);
+  }
+
+  using array_type = dense_array<int, 2, aligned_allocator<int>>;
+  array_type a({10, 5}, 3);
+  array_type copy_array(a);
+  ASSERT(copy_array == a);
+  const int* a_data = a.data();
+  array_type move_array(std::move(a));
+  ASSERT_EQ(move_array.data(), a_data);
+}
+
+TEST(allocator_alignment) {
+  ASSERT_EQ(allocator_alignment<std::allocator<int>>::value, alignof(int));
+  ASSERT_EQ((allocator_alignment<aligned_allocator<float, 32>>::value), 32);
+  ASSERT_EQ((allocator_alignment<uninitialized_aligned_allocator<float, 128>>::value), 128);
+  ASSERT_EQ((allocator_alignment<arena_allocator<double, 64>>::value), 64);
+  ASSERT_EQ((allocator_alignment<auto_allocator<int, 4, 16>>::value), alignof(int));
+}
+
+TEST(make_row_aligned) {
+  auto s = make_row_aligned<float>(dense_shape<3>(10, 5, 3));
+  ASSERT_EQ(s.dim<0>().stride(), 1);
+  ASSERT_EQ(s.dim<1>().stride(), 16);
+  ASSERT_EQ(s.dim<2>().stride(), 80);
+
+  // A row that is already a multiple of the alignment is not padded.
+  auto s32 = make_row_aligned<float, 32>(shape_of_rank<2>(16, 7));
+  ASSERT_EQ(s32.dim<0>().stride(), 1);
+  ASSERT_EQ(s32.dim<1>().stride(), 16);
+
+  // Known strides are not modified.
+  auto s_strided = make_row_aligned<int>(shape_of_rank<2>(dim<>(0, 10, 2), dim<>(0, 3)));
+  ASSERT_EQ(s_strided.dim<0>().stride(), 2);
+  ASSERT_EQ(s_strided.dim<1>().stride(), 32);
+
+  dense_array<float, 2, aligned_allocator<float>> a(
+      make_row_aligned<float>(dense_shape<2>(30, 20)));
+  ASSERT(is_aligned<64>(a));
+  for (index_t y : a.y()) {
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(&a(0, y)) % 64, 0);
+  }
+  // Cropping the rows makes the array unaligned.
+  ASSERT(!is_aligned<64>(a(r(1, 30), _)));
+  ASSERT(is_aligned<64>(a(r(0, 10), r(2, 10))));
+
+  dense_array<float, 2, aligned_allocator<float>> b({30, 20});
+  ASSERT(is_aligned<64>(b.cref()(_, 0)));
+  ASSERT(!is_aligned<64>(b));
+}
+
+} // namespace nda
@@ -0,0 +1,118 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "array.h"
+#include "test.h"
+
+#include <thread>
+
+namespace nda {
+
+typedef dense_array<int, 3, arena_allocator<int>> dense3d_int_arena_array;
+
+TEST(arena_allocator) {
+  arena a;
+  arena_allocator<int> alloc(a);
+  const int* first_data;
+  {
+    arena_scope scope(a);
+    dense3d_int_arena_array x({4, 3, 2}, 0, alloc);
+    dense3d_int_arena_array y({4, 3, 2}, 0, alloc);
+    for_all_indices(x.shape(), [&](int i, int j, int k) { x(i, j, k) = i; });
+    ASSERT(x.data() != y.data());
+    ASSERT(x.data() + x.size() <= y.data());
+    first_data = x.data();
+
+    dense3d_int_arena_array copy_array(x);
+    ASSERT(copy_array.get_allocator() == alloc);
+    ASSERT(copy_array == x);
+
+    // Move construction uses a default constructed allocator, which uses a
+    // different arena, so the elements are moved into a new allocation.
+    dense3d_int_arena_array move_array(std::move(copy_array));
+    ASSERT(move_array == x);
+
+    dense3d_int_arena_array move_assign;
+    move_assign = std::move(y);
+    ASSERT(move_assign.get_allocator() == alloc);
+  }
+  size_t capacity = a.capacity();
+  ASSERT(capacity > 0);
+
+  // After the scope ends, the memory is reused.
+  for (int i = 0; i < 10; i++) {
+    arena_scope scope(a);
+    dense3d_int_arena_array x({4, 3, 2}, 0, alloc);
+    ASSERT_EQ(x.data(), first_data);
+  }
+  ASSERT_EQ(a.capacity(), capacity);
+
+  // Scopes can be nested.
+  {
+    arena_scope outer(a);
+    dense3d_int_arena_array x({4, 3, 2}, 0, alloc);
+    arena::mark_type m = a.mark();
+    {
+      arena_scope inner(a);
+      dense3d_int_arena_array y({4, 3, 2}, 0, alloc);
+      ASSERT(y.data() != x.data());
+    }
+    ASSERT_EQ(a.mark().next, m.next);
+  }
+}
+
+TEST(arena_allocator_big) {
+  arena a;
+  arena_allocator<float, 64> alloc(a);
+  std::vector<const float*> datas;
+  for (int i = 0; i < 3; i++) {
+    arena_scope scope(a);
+    // These allocations are bigger than the first block of the arena.
+    array_of_rank<float, 2, arena_allocator<float, 64>> x({1000, 100}, 1.0f, alloc);
+    array_of_rank<float, 2, arena_allocator<float, 64>> y({1000, 200}, 2.0f, alloc);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(x.data()) % 64, 0);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(y.data()) % 64, 0);
+    x.for_each_value([](float v) { ASSERT_EQ(v, 1.0f); });
+    y.for_each_value([](float v) { ASSERT_EQ(v, 2.0f); });
+    datas.push_back(y.data());
+  }
+  // The arena grew in the first iteration, and was reused after that.
+  ASSERT_EQ(datas[1], datas[2]);
+}
+
+TEST(arena_allocator_uninitialized) {
+  // This uses the arena of this thread.
+  arena_scope scope;
+  dense_array<int, 1, uninitialized_arena_allocator<int>> x(dense_shape<1>(100));
+  for (index_t i : x.i()) {
+    x(i) = static_cast<int>(i);
+  }
+  for (index_t i : x.i()) {
+    ASSERT_EQ(x(i), i);
+  }
+}
+
+TEST(arena_allocator_threads) {
+  // The default arena of each thread is different.
+  arena* main_arena = &arena_allocator<int>().get_arena();
+  arena* thread_arena = nullptr;
+  std::thread t([&]() {
+    arena_scope scope;
+    dense_array<int, 1, arena_allocator<int>> x({100}, 3);
+    thread_arena = &x.get_allocator().get_arena();
+  });
+  t.join();
+  ASSERT(thread_arena != main_arena);
+}
+
+} // namespace nda
@@ -335,6 +335,51 @@ TEST(array_tricky_copy) {
   check_pattern(dest);
 }
 
+template <class T>
+void test_transposed_copy(index_t width, index_t height) {
+  array_of_rank<T, 2> a({{-3, width}, {2, height}});
+  fill_pattern(a);
+
+  // Copy to an array where y is the innermost dimension.
+  array_of_rank<T, 2> b({{-3, width, height}, {2, height, 1}});
+  copy(a, b);
+  check_pattern(b);
+  ASSERT(equal(a.cref(), b.cref()));
+
+  // And back.
+  array_of_rank<T, 2> c(a.shape());
+  copy(b, c);
+  check_pattern(c);
+
+  // Copy part of the array.
+  array_of_rank<T, 2> d({{-2, width / 2}, {3, height / 2, 1}});
+  copy(a, d);
+  check_pattern(d);
+
+  array_of_rank<T, 2> e = make_move(b, a.shape());
+  check_pattern(e);
+}
+
+TEST(array_transposed_copy) {
+  test_transposed_copy<uint8_t>(100, 100);
+  test_transposed_copy<int16_t>(37, 130);
+  test_transposed_copy<int>(131, 75);
+  test_transposed_copy<float>(64, 64);
+  test_transposed_copy<double>(3, 200);
+
+  // Copy a chunky image to a planar image and back.
+  array_of_rank<int, 3> chunky({{-3, 57, 3}, {2, 43, 57 * 3}, {0, 3, 1}});
+  fill_pattern(chunky);
+  dense_array<int, 3> planar({{-3, 57}, {2, 43}, 3});
+  copy(chunky, planar);
+  check_pattern(planar);
+  ASSERT(equal(chunky.cref(), planar.cref()));
+
+  array_of_rank<int, 3> chunky2(chunky.shape());
+  copy(planar, chunky2);
+  check_pattern(chunky2);
+}
+
 TEST(array_for_each_value_scalar) {
   array_of_rank<int, 0> scalar;
   move_only token;
@@ -380,6 +425,38 @@ TEST(array_for_each_value) {
   }
 }
 
+TEST(array_for_each_value_multiple) {
+  dense_array<int, 3> a({{-2, 10}, {1, 8}, {0, 3}});
+  array_of_rank<int, 3> b({{-2, 10, 24}, {1, 8, 3}, {0, 3, 1}});
+  dense_array<int, 3> c({{-5, 20}, {-1, 12}, {0, 3}});
+  fill_pattern(a);
+  fill_pattern(b);
+  fill_pattern(c);
+
+  // The shape of the first array defines the values visited, the other arrays
+  // may be larger.
+  dense_array<int, 3> out(a.shape());
+  const dense_array<int, 3>& c_const = c;
+  for_each_value([](int& out, int a, int b, int c) { out = a * b + c; }, out, a, b.ref(), c_const);
+  for_all_indices(out.shape(), [&](int x, int y, int z) {
+    ASSERT_EQ(out(x, y, z), a(x, y, z) * b(x, y, z) + c(x, y, z));
+  });
+
+  // Each value is visited exactly once, even when the first array is not dense.
+  size_t count = 0;
+  for_each_value([&](int& b, const int& a) {
+    b += a;
+    count++;
+  }, b, a.cref());
+  ASSERT_EQ(count, a.size());
+  for_all_indices(b.shape(), [&](int x, int y, int z) {
+    ASSERT_EQ(b(x, y, z), pattern<int>(std::make_tuple(x, y, z)) * 2);
+  });
+
+  dense_array<int, 3> empty({{0, 0}, {1, 8}, {0, 3}});
+  for_each_value([](int&, int) { ASSERT(false); }, empty, a);
+}
+
 TEST(array_reshape_1d) {
   shape_of_rank<1> s({{-1, 9}});
   array_of_rank<int, 1> a(s);
@@ -0,0 +1,178 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "convolve.h"
+#include "test.h"
+
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace nda {
+
+// The index of `d` read by `i` with `border`, or `i` if `i` reads zero.
+template <class Dim>
+index_t reference_border_index(index_t i, const Dim& d, border_mode border) {
+  switch (border) {
+  case border_mode::zero: return i;
+  case border_mode::clamp: return std::min(std::max(i, d.min()), d.max());
+  case border_mode::mirror:
+    while (!d.is_in_range(i)) {
+      i = i < d.min() ? 2 * d.min() - 1 - i : 2 * d.max() + 1 - i;
+    }
+    return i;
+  }
+  return i;
+}
+
+template <class T, class Shape>
+double reference_read(
+    const array<T, Shape>& in, index_t x, index_t y, index_t c, border_mode border) {
+  x = reference_border_index(x, in.x(), border);
+  y = reference_border_index(y, in.y(), border);
+  return in.x().is_in_range(x) && in.y().is_in_range(y) ? in(x, y, c) : 0.0;
+}
+
+// The result of filtering `in` with the 2D kernel `kx(i) * ky(j)`, with a
+// direct loop over the taps.
+template <class T, class Shape, class TOut, class ShapeOut>
+double max_convolve_error(const array<T, Shape>& in, const array<TOut, ShapeOut>& out,
+    const dense_array<float, 1>& kx, const dense_array<float, 1>& ky, border_mode border) {
+  double error = 0;
+  for_all_indices(out.shape(), [&](index_t x, index_t y, index_t c) {
+    double sum = 0;
+    for (index_t j : ky.x()) {
+      for (index_t i : kx.x()) {
+        sum += kx(i) * ky(j) * reference_read(in, x + i, y + j, c, border);
+      }
+    }
+    if (std::is_integral<TOut>::value) {
+      sum = std::min(std::max(std::round(sum), 0.0), 1.0 * std::numeric_limits<TOut>::max());
+    }
+    error = std::max(error, std::abs(out(x, y, c) - sum));
+  });
+  return error;
+}
+
+template <class Image>
+Image make_random_image(index_t width, index_t height, index_t channels) {
+  using T = typename Image::value_type;
+  std::mt19937 rng;
+  std::uniform_int_distribution<int> random_value(0, 255);
+  Image image({width, height, channels});
+  generate(image, [&]() { return static_cast<T>(random_value(rng)); });
+  return image;
+}
+
+// Make a 1D kernel with the taps [`min`, `min` + `extent`).
+dense_array<float, 1> make_kernel(index_t min, index_t extent, float value = 0.0f) {
+  return dense_array<float, 1>(dense_shape<1>(dense_dim<>(min, extent)), value);
+}
+
+const border_mode borders[] = {border_mode::zero, border_mode::clamp, border_mode::mirror};
+
+template <class Image>
+void test_convolve_separable(index_t channels, double tolerance) {
+  const Image in = make_random_image<Image>(150, 90, channels);
+
+  // Kernels that are not centered, to check the direction of the taps.
+  dense_array<float, 1> kx = make_kernel(-1, 4);
+  kx(-1) = 0.125f;
+  kx(0) = 0.5f;
+  kx(1) = 0.25f;
+  kx(2) = 0.125f;
+  dense_array<float, 1> ky = make_kernel(-3, 5);
+  for (index_t j : ky.x()) {
+    ky(j) = 0.1f * (j + 4);
+  }
+
+  for (border_mode border : borders) {
+    // Include a border around the input in the output.
+    Image out({{-5, 160}, {-4, 98}, channels});
+    convolve_separable(in.cref(), out.ref(), kx.cref(), ky.cref(), border);
+    ASSERT_LT(max_convolve_error(in, out, kx, ky, border), tolerance);
+
+    Image out_par(out.shape());
+    convolve_separable(par, in.cref(), out_par.ref(), kx.cref(), ky.cref(), border);
+    ASSERT(out_par == out);
+  }
+}
+
+TEST(convolve_separable_planar) {
+  test_convolve_separable<planar_image<float>>(2, 1e-3);
+  test_convolve_separable<planar_image<uint8_t>>(2, 1.0001);
+}
+
+TEST(convolve_separable_chunky) {
+  test_convolve_separable<chunky_image<float, 3>>(3, 1e-3);
+  test_convolve_separable<chunky_image<uint8_t, 3>>(3, 1.0001);
+  test_convolve_separable<chunky_image<uint8_t, 4>>(4, 1.0001);
+  test_convolve_separable<chunky_image<uint16_t>>(2, 1.0001);
+}
+
+// Kernels of one tap copy the input, shifted by the index of the tap.
+TEST(convolve_separable_shift) {
+  const planar_image<int16_t> in = make_random_image<planar_image<int16_t>>(40, 30, 1);
+  dense_array<float, 1> kx = make_kernel(2, 1, 1.0f);
+  dense_array<float, 1> ky = make_kernel(-1, 1, 1.0f);
+  planar_image<int16_t> out({{0, 38}, {1, 29}, 1});
+  convolve_separable(in.cref(), out.ref(), kx.cref(), ky.cref());
+  for_all_indices(out.shape(), [&](index_t x, index_t y, index_t c) {
+    ASSERT_EQ(out(x, y, c), in(x + 2, y - 1, c));
+  });
+}
+
+template <class Image>
+void test_box_blur(index_t channels, double tolerance) {
+  const Image in = make_random_image<Image>(130, 100, channels);
+
+  const index_t radii[][2] = {{0, 0}, {1, 1}, {3, 5}, {10, 2}, {0, 7}};
+  for (const auto& radius : radii) {
+    const index_t taps_x = 2 * radius[0] + 1;
+    const index_t taps_y = 2 * radius[1] + 1;
+    dense_array<float, 1> kx = make_kernel(-radius[0], taps_x, 1.0f / taps_x);
+    dense_array<float, 1> ky = make_kernel(-radius[1], taps_y, 1.0f / taps_y);
+    for (border_mode border : borders) {
+      Image out({{-3, 136}, {-2, 104}, channels});
+      box_blur(in.cref(), out.ref(), radius[0], radius[1], border);
+      ASSERT_LT(max_convolve_error(in, out, kx, ky, border), tolerance);
+
+      Image out_par(out.shape());
+      box_blur(par, in.cref(), out_par.ref(), radius[0], radius[1], border);
+      ASSERT(out_par == out);
+    }
+  }
+
+  // Boxes larger than the image.
+  const Image small_in = make_random_image<Image>(13, 9, channels);
+  dense_array<float, 1> kx = make_kernel(-20, 41, 1.0f / 41);
+  dense_array<float, 1> ky = make_kernel(-15, 31, 1.0f / 31);
+  for (border_mode border : borders) {
+    Image out({{-2, 17}, {-3, 15}, channels});
+    box_blur(small_in.cref(), out.ref(), 20, 15, border);
+    ASSERT_LT(max_convolve_error(small_in, out, kx, ky, border), tolerance);
+  }
+}
+
+TEST(box_blur_planar) {
+  test_box_blur<planar_image<float>>(1, 1e-2);
+  test_box_blur<planar_image<uint8_t>>(3, 1.0001);
+}
+
+TEST(box_blur_chunky) {
+  test_box_blur<chunky_image<float, 4>>(4, 1e-2);
+  test_box_blur<chunky_image<uint8_t, 3>>(3, 1.0001);
+}
+
+} // namespace nda
@@ -14,6 +14,8 @@
 
 #include "ein_reduce.h"
 #include "matrix.h"
+#include "morton_shape.h"
+#include "tiled_shape.h"
 #include "test.h"
 
 #include <complex>
@@ -306,6 +308,402 @@ TEST(ein_reduce_max_2d) {
   }
 }
 
+TEST(ein_reduce_parallel) {
+  thread_pool pool(4);
+  parallel_policy policy(pool);
+
+  constexpr index_t M = 60;
+  constexpr index_t N = 70;
+  constexpr index_t K = 80;
+  matrix<int> A({M, K});
+  matrix<int> B({K, N});
+  fill_pattern(A);
+  fill_pattern(B);
+
+  matrix<int> AB_ref({M, N}, 0);
+  ein_reduce(ein<i, j>(AB_ref) += ein<i, k>(A) * ein<k, j>(B));
+
+  // The reduction dimension k is outermost, the result dimension j is split
+  // inside of it.
+  matrix<int> AB({M, N}, 0);
+  ein_reduce(policy, ein<i, j>(AB) += ein<i, k>(A) * ein<k, j>(B));
+  ASSERT(AB == AB_ref);
+
+  // The result dimension k is outermost.
+  matrix<int> AB_k_outer({M, N}, 0);
+  ein_reduce(policy, ein<i, k>(AB_k_outer) += ein<i, j>(A) * ein<j, k>(B));
+  ASSERT(AB_k_outer == AB_ref);
+
+  // A reduction to a scalar can't be parallelized.
+  int sum = 0;
+  ein_reduce(policy, ein(sum) += ein<i, j>(A));
+  int sum_ref = 0;
+  A.for_each_value([&](int x) { sum_ref += x; });
+  ASSERT_EQ(sum, sum_ref);
+
+  // Parallel max reduction over i and k.
+  array_of_rank<int, 3> T({40, 50, 60});
+  fill_pattern(T);
+  dense_array<int, 1> max_ik(dense_shape<1>{T.j().extent()}, std::numeric_limits<int>::min());
+  auto r = ein<j>(max_ik);
+  ein_reduce(policy, r = max(r, ein<i, j, k>(T)));
+  for (index_t j : T.j()) {
+    int max_ik_ref = std::numeric_limits<int>::min();
+    T(_, j, _).for_each_value([&](int i) { max_ik_ref = std::max(i, max_ik_ref); });
+    ASSERT_EQ(max_ik(j), max_ik_ref);
+  }
+}
+
+TEST(ein_reduce_matrix_product) {
+  matrix<float> A({30, 40});
+  matrix<float> B({40, 50});
+  fill_pattern(A);
+  fill_pattern(B);
+
+  matrix<float> AB_ref({30, 50});
+  for_all_indices(AB_ref.shape(), [&](index_t i, index_t j) {
+    AB_ref(i, j) = 0.0f;
+    for (index_t k : A.j()) {
+      AB_ref(i, j) += A(i, k) * B(k, j);
+    }
+  });
+  auto check = [&](const matrix<float>& AB) {
+    for_all_indices(AB.shape(), [&](index_t i, index_t j) {
+      ASSERT_LT(std::abs(AB(i, j) - AB_ref(i, j)), 1e-5f * std::abs(AB_ref(i, j)) + 1e-4f);
+    });
+  };
+
+  matrix<float> AB({30, 50}, 0.0f);
+  ein_reduce(ein<i, j>(AB) += ein<i, k>(A) * ein<k, j>(B));
+  check(AB);
+
+  // The same product, with the operands in the other order, and with the
+  // result accumulated to a transposed view.
+  matrix<float> AB2({30, 50}, 0.0f);
+  auto AB2_T = transpose<1, 0>(AB2.ref());
+  ein_reduce(ein<j, i>(AB2_T) += ein<k, j>(B) * ein<i, k>(A));
+  check(AB2);
+
+  // Operands addressed with transposed indices.
+  matrix<float> AT({40, 30});
+  matrix<float> BT({50, 40});
+  copy(transpose<1, 0>(A.cref()), AT);
+  copy(transpose<1, 0>(B.cref()), BT);
+  matrix<float> AB3({30, 50}, 0.0f);
+  ein_reduce(ein<i, j>(AB3) += ein<k, i>(AT) * ein<j, k>(BT));
+  check(AB3);
+
+  // Matrix-vector products.
+  vector<float> x({40}, 0.0f);
+  fill_pattern(x);
+  vector<float> Ax({30}, 0.0f);
+  ein_reduce(ein<i>(Ax) += ein<i, j>(A) * ein<j>(x));
+  vector<float> ATx({30}, 0.0f);
+  ein_reduce(ein<i>(ATx) += ein<j>(x) * ein<j, i>(AT));
+  for (index_t i : Ax.i()) {
+    float Ax_i = 0.0f;
+    for (index_t j : x.i()) {
+      Ax_i += A(i, j) * x(j);
+    }
+    ASSERT_LT(std::abs(Ax(i) - Ax_i), 1e-5f * std::abs(Ax_i) + 1e-4f);
+    ASSERT_LT(std::abs(ATx(i) - Ax_i), 1e-5f * std::abs(Ax_i) + 1e-4f);
+  }
+}
+
+// Matrix products of arrays that are not affine can't use gemm or gemv, and
+// must be computed with the loop nest.
+template <class Shape>
+void test_ein_reduce_matrix_product_non_affine() {
+  array<float, Shape> A({30, 40});
+  array<float, Shape> B({40, 50});
+  fill_pattern(A);
+  fill_pattern(B);
+
+  array<float, Shape> AB({30, 50}, 0.0f);
+  ein_reduce(ein<i, j>(AB) += ein<i, k>(A) * ein<k, j>(B));
+  for_all_indices(AB.shape(), [&](index_t i, index_t j) {
+    float AB_ij = 0.0f;
+    for (index_t k = 0; k < 40; k++) {
+      AB_ij += A(i, k) * B(k, j);
+    }
+    ASSERT_LT(std::abs(AB(i, j) - AB_ij), 1e-5f * std::abs(AB_ij) + 1e-4f);
+  });
+
+  vector<float> x({40}, 0.0f);
+  fill_pattern(x);
+  vector<float> Ax({30}, 0.0f);
+  ein_reduce(ein<i>(Ax) += ein<i, j>(A) * ein<j>(x));
+  for (index_t i : Ax.i()) {
+    float Ax_i = 0.0f;
+    for (index_t j : x.i()) {
+      Ax_i += A(i, j) * x(j);
+    }
+    ASSERT_LT(std::abs(Ax(i) - Ax_i), 1e-5f * std::abs(Ax_i) + 1e-4f);
+  }
+}
+
+TEST(ein_reduce_matrix_product_non_affine) {
+  test_ein_reduce_matrix_product_non_affine<tiled_shape<8, 8>>();
+  test_ein_reduce_matrix_product_non_affine<morton_shape<2>>();
+}
+
+TEST(ein_reduce_innermost) {
+  matrix<int> A({30, 40});
+  fill_pattern(A);
+  vector<short> x({40}, 0);
+  fill_pattern(x);
+
+  // Row sums, where j is the innermost loop because A is dense in j. The
+  // result is accumulated in a local variable.
+  vector<int> sums({30}, 0);
+  ein_reduce(ein<i>(sums) += ein<i, j>(A));
+  vector<int> sums_ref({30}, 0);
+  ein_reduce<ein_reduce_in_order_traits>(ein<i>(sums_ref) += ein<i, j>(A));
+  ASSERT(sums == sums_ref);
+
+  // A matrix-vector product that is not computed with gemv, because the
+  // operands have different types.
+  vector<int> Ax({30}, 0);
+  ein_reduce(ein<i>(Ax) += ein<i, j>(A) * cast<int>(ein<j>(x)));
+  for (index_t i : Ax.i()) {
+    int Ax_i = 0;
+    for (index_t j : x.i()) {
+      Ax_i += A(i, j) * x(j);
+    }
+    ASSERT_EQ(Ax(i), Ax_i);
+  }
+
+  // The result is also an operand, so it can't be accumulated in a local
+  // variable.
+  vector<int> max_j({30}, std::numeric_limits<int>::min());
+  auto r = ein<i>(max_j);
+  ein_reduce(r = max(r, ein<i, j>(A)));
+  for (index_t i : max_j.i()) {
+    int max_j_ref = std::numeric_limits<int>::min();
+    A(i, _).for_each_value([&](int x) { max_j_ref = std::max(x, max_j_ref); });
+    ASSERT_EQ(max_j(i), max_j_ref);
+  }
+
+  // The result is a view of the operand.
+  vector<int> y({40}, 0);
+  fill_pattern(y);
+  vector<int> y_ref({40}, 0);
+  copy(y, y_ref);
+  ein_reduce(ein<>(y(10)) += ein<j>(y));
+  ein_reduce<ein_reduce_in_order_traits>(ein<>(y_ref(10)) += ein<j>(y_ref));
+  ASSERT(y == y_ref);
+}
+
+TEST(ein_reduce_partials) {
+  // Use extents that are not a multiple of the number of partial results.
+  matrix<int> A({20, 37});
+  for_all_indices(A.shape(), [&](index_t i, index_t j) { A(i, j) = (i * 7 + j * 13) % 31 - 15; });
+  auto AT = transpose<1, 0>(A.cref());
+
+  // Integer reductions are exact, in any order.
+  vector<int> sums({20}, 0);
+  ein_reduce(ein<i>(sums) += ein<i, j>(A));
+  vector<int> sums_T({20}, 0);
+  ein_reduce(ein<i>(sums_T) += ein<j, i>(AT));
+  vector<int> diffs({20}, 1);
+  ein_reduce(ein<i>(diffs) -= ein<i, j>(A));
+  vector<int> sums_ref({20}, 0);
+  ein_reduce<ein_reduce_in_order_traits>(ein<i>(sums_ref) += ein<i, j>(A));
+  ASSERT(sums == sums_ref);
+  ASSERT(sums_T == sums_ref);
+  for (index_t i : diffs.i()) {
+    ASSERT_EQ(diffs(i), 1 - sums_ref(i));
+  }
+
+  // Use small factors so the products don't overflow.
+  matrix<int> B({20, 37});
+  for_all_indices(B.shape(), [&](index_t i, index_t j) { B(i, j) = (i + j) % 5 == 0 ? 2 : -1; });
+  vector<int> products({20}, 1);
+  ein_reduce(ein<i>(products) *= ein<i, j>(B));
+  vector<int> products_ref({20}, 1);
+  ein_reduce<ein_reduce_in_order_traits>(ein<i>(products_ref) *= ein<i, j>(B));
+  ASSERT(products == products_ref);
+
+  // Floating point reductions may be reassociated.
+  vector<float> x({1000}, 0.0f);
+  vector<float> y({1000}, 0.0f);
+  for (index_t i : x.i()) {
+    x(i) = std::sin(static_cast<float>(i));
+    y(i) = std::cos(static_cast<float>(i));
+  }
+  float dot = 0.0f;
+  ein_reduce(ein<>(dot) += ein<i>(x) * ein<i>(y));
+  float dot_ref = 0.0f;
+  ein_reduce<ein_reduce_in_order_traits>(ein<>(dot_ref) += ein<i>(x) * ein<i>(y));
+  double dot_exact = 0.0;
+  for (index_t i : x.i()) {
+    dot_exact += static_cast<double>(x(i)) * y(i);
+  }
+  ASSERT_LT(std::abs(dot - dot_exact), 1e-3);
+  ASSERT_LT(std::abs(dot_ref - dot_exact), 1e-3);
+}
+
+TEST(make_ein_reduce_reducers) {
+  // Use extents that are not a multiple of the number of partial results, so
+  // the loop over the remainder is also tested.
+  matrix<int> A({20, 37});
+  for_all_indices(A.shape(), [&](index_t i, index_t j) { A(i, j) = (i * 7 + j * 13) % 31 - 15; });
+  matrix<int> AT({37, 20});
+  copy(transpose<1, 0>(A.cref()), AT);
+
+  auto max_rows = make_ein_reduce<max_reducer, int, i>(ein<i, j>(A));
+  auto min_rows = make_ein_reduce<min_reducer, int, i>(ein<i, j>(A));
+  auto argmax_rows = make_ein_reduce<argmax_reducer, int, i>(ein<i, j>(A));
+  auto argmin_rows = make_ein_reduce<argmin_reducer, int, i>(ein<i, j>(A));
+  // These reductions have a strided innermost loop.
+  auto max_rows_T = make_ein_reduce<max_reducer, int, i>(ein<j, i>(AT));
+  auto argmax_rows_T = make_ein_reduce<argmax_reducer, int, i>(ein<j, i>(AT));
+  for (index_t i : A.i()) {
+    int max_ref = std::numeric_limits<int>::min();
+    int min_ref = std::numeric_limits<int>::max();
+    index_t argmax_ref = -1;
+    index_t argmin_ref = -1;
+    for (index_t j : A.j()) {
+      if (A(i, j) > max_ref) {
+        max_ref = A(i, j);
+        argmax_ref = j;
+      }
+      if (A(i, j) < min_ref) {
+        min_ref = A(i, j);
+        argmin_ref = j;
+      }
+    }
+    ASSERT_EQ(max_rows(i), max_ref);
+    ASSERT_EQ(min_rows(i), min_ref);
+    ASSERT_EQ(max_rows_T(i), max_ref);
+    ASSERT_EQ(argmax_rows(i).first, max_ref);
+    ASSERT_EQ(std::get<0>(argmax_rows(i).second), i);
+    ASSERT_EQ(std::get<1>(argmax_rows(i).second), argmax_ref);
+    ASSERT_EQ(argmin_rows(i).first, min_ref);
+    ASSERT_EQ(std::get<1>(argmin_rows(i).second), argmin_ref);
+    ASSERT_EQ(std::get<1>(argmax_rows_T(i).second), argmax_ref);
+  }
+
+  // The maximum of a whole matrix occurs many times, the argmax is the least
+  // index.
+  auto argmax_A = make_ein_reduce<argmax_reducer, int>(ein<i, j>(A));
+  ASSERT_EQ(argmax_A().first, 15);
+  ASSERT_EQ(std::get<0>(argmax_A().second), 0);
+  ASSERT_EQ(std::get<1>(argmax_A().second), 19);
+
+  vector<double> x({41}, 0.0);
+  for_all_indices(x.shape(), [&](index_t i) { x(i) = 1.0 + (i % 3) * 0.5; });
+  double prod_ref = 1.0;
+  x.for_each_value([&](double x_i) { prod_ref *= x_i; });
+  auto prod_x = make_ein_reduce<product_reducer, double>(ein<i>(x));
+  ASSERT_LT(std::abs(prod_x() - prod_ref), prod_ref * 1e-12);
+
+  vector<bool> b({40}, false);
+  auto any_b = [&]() { return make_ein_reduce<any_reducer, bool>(ein<i>(b))(); };
+  auto all_b = [&]() { return make_ein_reduce<all_reducer, bool>(ein<i>(b))(); };
+  ASSERT(!any_b());
+  ASSERT(!all_b());
+  b(33) = true;
+  ASSERT(any_b());
+  ASSERT(!all_b());
+  fill(b, true);
+  ASSERT(any_b());
+  ASSERT(all_b());
+
+  // Reductions can accumulate into an existing result.
+  vector<int> max_cols({37}, 0);
+  ein_reduce(max_assign(ein<j>(max_cols), ein<i, j>(A)));
+  for (index_t j : A.j()) {
+    int max_ref = 0;
+    for (index_t i : A.i()) {
+      max_ref = std::max(max_ref, A(i, j));
+    }
+    ASSERT_EQ(max_cols(j), max_ref);
+  }
+}
+
+TEST(ein_contract_matrix_chain) {
+  matrix<int> A({20, 30});
+  matrix<int> B({30, 5});
+  matrix<int> C({5, 40});
+  vector<int> x({40}, 0);
+  fill_pattern(A);
+  fill_pattern(B);
+  fill_pattern(C);
+  fill_pattern(x);
+
+  matrix<int> ABC_ref({20, 40}, 0);
+  ein_reduce(ein<i, l>(ABC_ref) += ein<i, j>(A) * ein<j, k>(B) * ein<k, l>(C));
+
+  matrix<int> ABC({20, 40}, 0);
+  ein_contract(ein<i, l>(ABC) += ein<i, j>(A) * ein<j, k>(B) * ein<k, l>(C));
+  ASSERT(ABC == ABC_ref);
+
+  // Subtract, with the factors in a different order.
+  ein_contract(ein<i, l>(ABC) -= ein<k, l>(C) * (ein<i, j>(A) * ein<j, k>(B)));
+  ABC.for_each_value([](int x) { ASSERT_EQ(x, 0); });
+
+  // Matrix-matrix-matrix-vector product, where one of the factors is an
+  // expression.
+  vector<int> ABCx_ref({20}, 0);
+  ein_reduce(
+      ein<i>(ABCx_ref) += ein<i, j>(A) * (ein<j, k>(B) + ein<j, k>(B)) * ein<k, l>(C) * ein<l>(x));
+  vector<int> ABCx({20}, 0);
+  ein_contract(
+      ein<i>(ABCx) += ein<i, j>(A) * (ein<j, k>(B) + ein<j, k>(B)) * ein<k, l>(C) * ein<l>(x));
+  ASSERT(ABCx == ABCx_ref);
+}
+
+// Operands that are not affine are copied into temporaries.
+template <class Shape>
+void test_ein_contract_non_affine() {
+  array<int, Shape> A({20, 30});
+  array<int, Shape> B({30, 5});
+  array<int, Shape> C({5, 40});
+  fill_pattern(A);
+  fill_pattern(B);
+  fill_pattern(C);
+
+  matrix<int> ABC_ref({20, 40}, 0);
+  ein_reduce(ein<i, l>(ABC_ref) += ein<i, j>(A) * ein<j, k>(B) * ein<k, l>(C));
+
+  array<int, Shape> ABC({20, 40}, 0);
+  ein_contract(ein<i, l>(ABC) += ein<i, j>(A) * ein<j, k>(B) * ein<k, l>(C));
+  for_all_indices(ABC_ref.shape(),
+      [&](index_t i, index_t l) { ASSERT_EQ(ABC(i, l), ABC_ref(i, l)); });
+}
+
+TEST(ein_contract_non_affine) {
+  test_ein_contract_non_affine<tiled_shape<8, 8>>();
+  test_ein_contract_non_affine<morton_shape<2>>();
+}
+
+TEST(ein_contract_trace) {
+  matrix<int> A({10, 15});
+  matrix<int> B({15, 20});
+  matrix<int> C({20, 10});
+  fill_pattern(A);
+  fill_pattern(B);
+  fill_pattern(C);
+
+  // tr(A*B*C), with a callable operand scaling each row of A.
+  auto scale = [](int i) { return i + 1; };
+  int tr_ref = 0;
+  ein_reduce(ein(tr_ref) += ein<i>(scale) * ein<i, j>(A) * ein<j, k>(B) * ein<k, i>(C));
+  int tr = 0;
+  ein_contract(ein(tr) += ein<i>(scale) * ein<i, j>(A) * ein<j, k>(B) * ein<k, i>(C));
+  ASSERT_EQ(tr, tr_ref);
+
+  // A diagonal operand, and an operand of a different type.
+  matrix<short> S({10, 10});
+  fill_pattern(S);
+  vector<int> d_ref({10}, 0);
+  ein_reduce(ein<i>(d_ref) += ein<i, i>(S) * ein<i, j>(A) * ein<j, k>(B) * ein<k, i>(C));
+  vector<int> d({10}, 0);
+  ein_contract(ein<i>(d) += ein<i, i>(S) * ein<i, j>(A) * ein<j, k>(B) * ein<k, i>(C));
+  ASSERT(d == d_ref);
+}
+
 TEST(ein_reduce_max_2d_carray) {
   array_of_rank<int, 3> T({4, 5, 8});
   fill_pattern(T);
@@ -0,0 +1,162 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "elementwise.h"
+#include "ein_reduce.h"
+#include "morton_shape.h"
+#include "tiled_shape.h"
+#include "test.h"
+
+namespace nda {
+
+TEST(elementwise_arithmetic) {
+  dense_array<int, 3> a({{-2, 10}, {1, 8}, {0, 3}});
+  array_of_rank<int, 3> b({{-2, 10, 24}, {1, 8, 3}, {0, 3, 1}});
+  dense_array<int, 3> c({{-5, 20}, {-1, 12}, {0, 3}});
+  fill_pattern(a);
+  fill_pattern(b);
+  fill_pattern(c);
+  const dense_array<int, 3>& c_const = c;
+
+  dense_array<int, 3> out(a.shape());
+  elementwise(out) = elementwise(a) * b + c_const;
+  for_all_indices(out.shape(), [&](int x, int y, int z) {
+    ASSERT_EQ(out(x, y, z), a(x, y, z) * b(x, y, z) + c(x, y, z));
+  });
+
+  elementwise(out) = (elementwise(a) - 3) / 2 - -elementwise(b.ref());
+  for_all_indices(out.shape(), [&](int x, int y, int z) {
+    ASSERT_EQ(out(x, y, z), (a(x, y, z) - 3) / 2 + b(x, y, z));
+  });
+
+  elementwise(out) = 2 * elementwise(a) + 1;
+  for_all_indices(out.shape(), [&](int x, int y, int z) {
+    ASSERT_EQ(out(x, y, z), 2 * a(x, y, z) + 1);
+  });
+
+  elementwise(out) = max(min(elementwise(a), 300000), c);
+  for_all_indices(out.shape(), [&](int x, int y, int z) {
+    ASSERT_EQ(out(x, y, z), std::max(std::min(a(x, y, z), 300000), c(x, y, z)));
+  });
+
+  // Assigning arrays and scalars.
+  elementwise(out) = 7;
+  out.for_each_value([](int x) { ASSERT_EQ(x, 7); });
+  elementwise(out) = elementwise(a);
+  ASSERT(out == a);
+}
+
+TEST(elementwise_update) {
+  dense_array<int, 2> a({{-2, 10}, {1, 8}});
+  array_of_rank<int, 2> b({{-2, 10, 8}, {1, 8, 1}});
+  fill_pattern(a);
+  fill_pattern(b);
+
+  // The destination can be an operand of the expression.
+  dense_array<int, 2> out(a);
+  elementwise(out) = elementwise(out) * 3 + b;
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_EQ(out(x, y), a(x, y) * 3 + b(x, y));
+  });
+
+  elementwise(out) -= elementwise(b) + 1;
+  elementwise(out) += 1;
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_EQ(out(x, y), a(x, y) * 3);
+  });
+
+  elementwise(out) /= 3;
+  ASSERT(out == a);
+
+  elementwise(out) *= elementwise(out);
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_EQ(out(x, y), a(x, y) * a(x, y));
+  });
+
+  // Updates of part of an array.
+  auto out_crop = out(r(2, 5), r(3, 6));
+  elementwise(out_crop) = 0;
+  for_all_indices(out.shape(), [&](int x, int y) {
+    if (out_crop.shape().is_in_range(x, y)) {
+      ASSERT_EQ(out(x, y), 0);
+    } else {
+      ASSERT_EQ(out(x, y), a(x, y) * a(x, y));
+    }
+  });
+}
+
+// Arrays with shapes that are not affine are evaluated with their shape_traits.
+TEST(elementwise_non_affine) {
+  dense_array<int, 2> a({{-2, 16}, {1, 16}});
+  fill_pattern(a);
+  tiled_array<int, 4, 4> b({{-2, 16}, {1, 16}});
+  copy(a, b);
+
+  morton_array<int, 2> out({{-2, 16}, {1, 16}});
+  elementwise(out) = elementwise(a) + 1;
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_EQ(out(x, y), a(x, y) + 1);
+  });
+
+  elementwise(out) += elementwise(b) * 2;
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_EQ(out(x, y), a(x, y) * 3 + 1);
+  });
+
+  auto b_crop = crop(b, interval<>(0, 10), interval<>(3, 7));
+  elementwise(b_crop) = elementwise(out) - elementwise(a);
+  for_all_indices(b.shape(), [&](int x, int y) {
+    if (b_crop.shape().is_in_range(x, y)) {
+      ASSERT_EQ(b(x, y), a(x, y) * 2 + 1);
+    } else {
+      ASSERT_EQ(b(x, y), a(x, y));
+    }
+  });
+}
+
+TEST(elementwise_math) {
+  dense_array<float, 2> a({{-3, 20}, {0, 10}});
+  int i = 0;
+  a.for_each_value([&](float& x) { x = (i++ % 97) * 0.1f + 0.05f; });
+
+  dense_array<float, 2> out(a.shape());
+  elementwise(out) = sqrt(exp(log(elementwise(a)))) + abs(-elementwise(a));
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_LT(std::abs(out(x, y) - (std::sqrt(a(x, y)) + a(x, y))), 1e-4f);
+  });
+
+  elementwise(out) = floor(elementwise(a)) + ceil(elementwise(a)) * round(elementwise(a));
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_EQ(out(x, y), std::floor(a(x, y)) + std::ceil(a(x, y)) * std::round(a(x, y)));
+  });
+
+  elementwise(out) = sin(elementwise(a)) * cos(elementwise(a)) - tanh(elementwise(a));
+  for_all_indices(out.shape(), [&](int x, int y) {
+    float expected = std::sin(a(x, y)) * std::cos(a(x, y)) - std::tanh(a(x, y));
+    ASSERT_LT(std::abs(out(x, y) - expected), 1e-5f);
+  });
+
+  dense_array<int, 2> rounded(a.shape());
+  elementwise(rounded) = cast<int>(elementwise(a) * 10.0f + 0.5f);
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_EQ(rounded(x, y), static_cast<int>(a(x, y) * 10.0f + 0.5f));
+  });
+
+  dense_array<uint8_t, 2> a_u8(a.shape());
+  elementwise(a_u8) = cast<uint8_t>(min(elementwise(rounded), 255));
+  for_all_indices(out.shape(), [&](int x, int y) {
+    ASSERT_EQ(a_u8(x, y), std::min(rounded(x, y), 255));
+  });
+}
+
+} // namespace nda
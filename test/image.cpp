@@ -89,8 +89,8 @@ void test_copy(index_t channels) {
   check_pattern(dest);
 
   array<T, ShapeDest> dest_cropped({{5, 30}, {3, 20}, channels});
-  copy(src, dest);
-  check_pattern(dest);
+  copy(src, dest_cropped);
+  check_pattern(dest_cropped);
 
   // If the src and dest shapes are the same, we should expect copies
   // to be about as fast as memcpy, even if the dest is cropped (so
@@ -124,6 +124,10 @@ void test_copy_all_types(index_t channels) {
   test_copy<int32_t, ShapeSrc, ShapeDest>(channels);
   test_copy<int16_t, ShapeSrc, ShapeDest>(channels);
   test_copy<int8_t, ShapeSrc, ShapeDest>(channels);
+  test_copy<uint8_t, ShapeSrc, ShapeDest>(channels);
+  test_copy<uint16_t, ShapeSrc, ShapeDest>(channels);
+  test_copy<float, ShapeSrc, ShapeDest>(channels);
+  test_copy<double, ShapeSrc, ShapeDest>(channels);
 }
 
 TEST(image_chunky_copy) {
@@ -155,6 +159,25 @@ TEST(image_deinterleave) {
   test_copy_all_types<chunky_image_shape<4>, planar_image_shape>(4);
 }
 
+// Interleaving and deinterleaving planar images where the channels are not
+// the outermost dimension, or only some of the channels.
+TEST(image_interleave_line_chunky) {
+  planar_image<uint8_t> line_chunky({{0, 37, 1}, {0, 20, 37 * 3}, {0, 3, 37}});
+  fill_pattern(line_chunky);
+
+  chunky_image<uint8_t, 3> chunky({37, 20, 3});
+  copy(line_chunky, chunky);
+  check_pattern(chunky);
+
+  planar_image<uint8_t> planar_to_line_chunky(line_chunky.shape());
+  copy(chunky, planar_to_line_chunky);
+  check_pattern(planar_to_line_chunky);
+
+  planar_image<uint8_t> two_channels({37, 20, 2});
+  copy(chunky, two_channels);
+  check_pattern(two_channels);
+}
+
 TEST(image_chunky_padded) {
   chunky_image<int, 4> src({40, 30, 4});
   fill_pattern(src);
@@ -60,4 +60,63 @@ TEST(small_matrix) {
   for_all_indices(move_assign.shape(), [&](int x, int y) { ASSERT_EQ(move_assign(x, y), x); });
 }
 
+template <class T>
+void test_multiply(index_t M, index_t N, index_t K) {
+  matrix<T> A({M, K});
+  matrix<T> B({K, N});
+  fill_pattern(A);
+  fill_pattern(B);
+
+  matrix<T> C({M, N});
+  multiply(A.cref(), B.cref(), C.ref());
+
+  for (index_t i : C.i()) {
+    for (index_t j : C.j()) {
+      T c_ij = 0;
+      for (index_t k : A.j()) {
+        c_ij += A(i, k) * B(k, j);
+      }
+      ASSERT_EQ(C(i, j), c_ij) << "i=" << i << ", j=" << j;
+    }
+  }
+}
+
+TEST(matrix_multiply) {
+  // Cover partial register tiles, and multiple cache blocks in each dimension.
+  for (index_t M : {1, 5, 13, 300}) {
+    for (index_t N : {1, 7, 33, 100}) {
+      for (index_t K : {0, 1, 3, 700}) {
+        test_multiply<int>(M, N, K);
+        test_multiply<short>(M, N, K);
+      }
+    }
+  }
+  test_multiply<int>(20, 5000, 10);
+  test_multiply<int64_t>(40, 50, 60);
+}
+
+TEST(matrix_multiply_float) {
+  matrix<float> A({50, 400});
+  matrix<float> B({400, 70});
+  fill_pattern(A);
+  fill_pattern(B);
+
+  // Multiply a cropped view of A.
+  auto A_crop = A(interval<>(10, 30), _);
+  matrix<double> C_ref({30, 70});
+  for_all_indices(C_ref.shape(), [&](index_t i, index_t j) {
+    double c_ij = 0;
+    for (index_t k : A.j()) {
+      c_ij += static_cast<double>(A_crop(i + 10, k)) * B(k, j);
+    }
+    C_ref(i, j) = c_ij;
+  });
+
+  matrix<float> C({30, 70});
+  multiply<float>(A_crop, B.cref(), C);
+  for_all_indices(C.shape(), [&](index_t i, index_t j) {
+    ASSERT_LT(std::abs(C(i, j) - C_ref(i, j)), 1e-4 * std::abs(C_ref(i, j)) + 1e-3);
+  });
+}
+
 } // namespace nda
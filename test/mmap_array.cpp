@@ -0,0 +1,140 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mmap_array.h"
+#include "temp_file.h"
+#include "test.h"
+
+namespace nda {
+
+TEST(mmap_array_create) {
+  temp_file file("ndarray_mmap_array");
+  using shape_type = shape<dim<>, dim<>, dense_dim<>>;
+  shape_type s({3, 10}, {-2, 5}, {0, 4});
+  {
+    auto a = make_mmap_array<int>(file.path(), s);
+    ASSERT(a.is_open());
+    ASSERT(a.shape() == make_compact(s));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(a.cref().data()) % internal::page_size(), 0);
+    a.ref().for_each_value([](int x) { ASSERT_EQ(x, 0); });
+    fill_pattern(a.ref());
+  }
+
+  mmap_array<int, shape_type> b(file.path());
+  ASSERT(b.is_open());
+  ASSERT(b.shape() == make_compact(s));
+  check_pattern(b.cref());
+
+  // The shape of the file is not compatible with these arrays.
+  ASSERT(!(mmap_array<double, shape_type>(file.path()).is_open()));
+  ASSERT(!(mmap_array<int, shape_of_rank<2>>(file.path()).is_open()));
+  ASSERT(!(mmap_array<int, dense_shape<3>>(file.path()).is_open()));
+
+  // Other shapes with the same rank are compatible.
+  mmap_array<int, shape_of_rank<3>> c(file.path());
+  ASSERT(c.is_open());
+  check_pattern(c.cref());
+}
+
+TEST(mmap_array_modes) {
+  temp_file file("ndarray_mmap_array");
+  dense_array<float, 2> x({100, 50});
+  fill_pattern(x);
+  {
+    auto a = make_mmap_copy(file.path(), x);
+    ASSERT(a.is_open());
+    ASSERT(a.cref() == x.cref());
+  }
+
+  {
+    // Writes to a copy-on-write mapping are not written to the file.
+    mmap_array<float, dense_shape<2>> a(file.path(), mmap_mode::copy_on_write);
+    ASSERT(a.is_open());
+    ASSERT(a.cref() == x.cref());
+    fill(a.ref(), 2.0f);
+    a.cref().for_each_value([](float v) { ASSERT_EQ(v, 2.0f); });
+  }
+  {
+    // Read-only mappings only provide const_array_refs.
+    mmap_array<const float, dense_shape<2>> a(file.path());
+    ASSERT(a.is_open());
+    ASSERT(a.mode() == mmap_mode::read_only);
+    ASSERT(a.ref() == x.cref());
+    static_assert(
+        std::is_same<decltype(a.ref()), const_array_ref<float, dense_shape<2>>>::value, "");
+    static_assert(!std::is_convertible<mmap_array<const float, dense_shape<2>>&,
+                      array_ref<float, dense_shape<2>>>::value,
+        "");
+
+    // Arrays of non-const elements can't be mapped read-only.
+    ASSERT(!(mmap_array<float, dense_shape<2>>(file.path(), mmap_mode::read_only).is_open()));
+  }
+
+  {
+    // Writes to a shared mapping are written to the file.
+    mmap_array<float, dense_shape<2>> a(file.path(), mmap_mode::shared);
+    ASSERT(a.is_open());
+    a.ref()(3, 4) = -1.0f;
+    a.flush();
+  }
+  mmap_array<float, dense_shape<2>> a(file.path());
+  ASSERT_EQ(a.cref()(3, 4), -1.0f);
+  ASSERT_EQ(a.cref()(4, 3), x(4, 3));
+
+  // Moving the mapping.
+  mmap_array<float, dense_shape<2>> b(std::move(a));
+  ASSERT(!a.is_open());
+  ASSERT(b.is_open());
+  ASSERT_EQ(b.cref()(3, 4), -1.0f);
+  b.advise_for_each_value();
+  b.close();
+  ASSERT(!b.is_open());
+}
+
+TEST(mmap_array_errors) {
+  ASSERT(!(mmap_array<int, dense_shape<1>>("/nonexistent/mmap_array").is_open()));
+  ASSERT(!(make_mmap_array<int>("/nonexistent/mmap_array", dense_shape<1>(10)).is_open()));
+
+  // A file that is not an mmap_array.
+  temp_file file("ndarray_mmap_array");
+  FILE* f = fopen(file.path(), "wb");
+  const char data[100] = "not an array";
+  fwrite(data, 1, sizeof(data), f);
+  fclose(f);
+  ASSERT(!(mmap_array<char, dense_shape<1>>(file.path()).is_open()));
+
+  // A file that is too small for the shape in its header.
+  {
+    auto a = make_mmap_array<int>(file.path(), dense_shape<1>(10000));
+    ASSERT(a.is_open());
+  }
+  ASSERT_EQ(truncate(file.path(), 8192), 0);
+  ASSERT(!(mmap_array<int, dense_shape<1>>(file.path()).is_open()));
+}
+
+TEST(mmap_array_advice) {
+  ASSERT(for_each_value_advice(dense_shape<2>(100, 100), 4) == mmap_advice::sequential);
+  // Transposed, but still dense.
+  ASSERT(for_each_value_advice(
+             shape_of_rank<2>(dim<>(0, 100, 100), dim<>(0, 100, 1)), 4) == mmap_advice::sequential);
+  // Small gaps between rows.
+  ASSERT(for_each_value_advice(
+             shape_of_rank<2>(dim<>(0, 100, 1), dim<>(0, 100, 128)), 4) == mmap_advice::sequential);
+  // Each value is on a different page.
+  ASSERT(for_each_value_advice(shape_of_rank<1>(dim<>(0, 100, 4096)), 4) == mmap_advice::random);
+  // Small crops of big rows.
+  ASSERT(for_each_value_advice(
+             shape_of_rank<2>(dim<>(0, 10, 1), dim<>(0, 100, 100000)), 4) == mmap_advice::random);
+}
+
+} // namespace nda
@@ -0,0 +1,289 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "morton_shape.h"
+#include "ein_reduce.h"
+#include "parallel.h"
+#include "test.h"
+
+#include <vector>
+
+namespace nda {
+
+TEST(morton_shape_offsets) {
+  morton_shape<2> s({8, 8});
+  s.resolve();
+  ASSERT(s.is_resolved());
+  ASSERT_EQ(s.masks()[0], 0x15);
+  ASSERT_EQ(s.masks()[1], 0x2a);
+  ASSERT_EQ(s.flat_min(), 0);
+  ASSERT_EQ(s.flat_extent(), 64);
+  ASSERT(s.is_compact());
+
+  ASSERT_EQ(s(0, 0), 0);
+  ASSERT_EQ(s(1, 0), 1);
+  ASSERT_EQ(s(0, 1), 2);
+  ASSERT_EQ(s(1, 1), 3);
+  ASSERT_EQ(s(2, 0), 4);
+  ASSERT_EQ(s(0, 2), 8);
+  ASSERT_EQ(s(7, 7), 63);
+
+  // Dimensions with fewer bits stop being interleaved.
+  morton_shape<2> wide({16, 2});
+  wide.resolve();
+  ASSERT_EQ(wide.masks()[0], 0x1d);
+  ASSERT_EQ(wide.masks()[1], 0x02);
+  ASSERT_EQ(wide.flat_extent(), 32);
+
+  // Every index maps to a different flat offset in the flat extent.
+  morton_shape<3> padded({{-3, 5}, {2, 7}, {0, 3}});
+  padded.resolve();
+  ASSERT_EQ(padded(-3, 2, 0), 0);
+  ASSERT(!padded.is_compact());
+  std::vector<int> used(padded.flat_extent(), 0);
+  for_all_indices(padded, [&](index_t x, index_t y, index_t z) {
+    index_t offset = padded(x, y, z);
+    ASSERT(padded.flat_min() <= offset && offset <= padded.flat_max());
+    used[offset]++;
+  });
+  for (int i : used) {
+    ASSERT_LT(i, 2);
+  }
+}
+
+TEST(morton_shape_for_each_run) {
+  morton_shape<2> s({8, 8});
+  s.resolve();
+  index_t runs = 0;
+  s.for_each_run([&](index_t begin, size_t count) {
+    ASSERT_EQ(begin, 0);
+    ASSERT_EQ(count, 64);
+    runs++;
+  });
+  ASSERT_EQ(runs, 1);
+
+  // The runs of a shape that isn't a power of two are increasing and cover
+  // every index.
+  morton_shape<3> padded({{-3, 11}, {2, 7}, {0, 5}});
+  padded.resolve();
+  std::vector<int> used(padded.flat_extent(), 0);
+  index_t end = -1;
+  padded.for_each_run([&](index_t begin, size_t count) {
+    ASSERT_LT(end, begin);
+    end = begin + count;
+    for (index_t i = begin; i < end; i++) {
+      used[i]++;
+    }
+  });
+  for_all_indices(padded, [&](index_t x, index_t y, index_t z) {
+    used[padded(x, y, z)]--;
+  });
+  for (int i : used) {
+    ASSERT_EQ(i, 0);
+  }
+}
+
+TEST(morton_array) {
+  morton_array<int, 2> a({{-2, 21}, {3, 13}});
+  ASSERT_EQ(a.width(), 21);
+  ASSERT_EQ(a.height(), 13);
+  ASSERT_EQ(a.size(), 21 * 13);
+  fill_pattern(a);
+  check_pattern(a);
+
+  // for_each_value visits every element exactly once, in storage order.
+  index_t sum = 0;
+  index_t count = 0;
+  const int* prev = nullptr;
+  a.for_each_value([&](const int& x) {
+    ASSERT(prev < &x);
+    prev = &x;
+    sum += x;
+    count++;
+  });
+  index_t expected_sum = 0;
+  for_each_index(a.shape(), [&](const index_of_rank<2>& i) { expected_sum += pattern<int>(i); });
+  ASSERT_EQ(count, 21 * 13);
+  ASSERT_EQ(sum, expected_sum);
+
+  morton_array<int, 2> b(a);
+  ASSERT(a == b);
+  b(3, 4) = 0;
+  ASSERT(a != b);
+
+  morton_array<int, 2> c(a.shape(), 7);
+  c.for_each_value([](int x) { ASSERT_EQ(x, 7); });
+}
+
+TEST(morton_array_copy) {
+  dense_array<int, 3> dense({{-2, 19}, {3, 12}, {1, 7}});
+  fill_pattern(dense);
+
+  morton_array<int, 3> morton({{-2, 19}, {3, 12}, {1, 7}});
+  copy(dense, morton);
+  check_pattern(morton);
+  for_all_indices(dense.shape(), [&](index_t x, index_t y, index_t z) {
+    ASSERT_EQ(morton(x, y, z), dense(x, y, z));
+  });
+
+  dense_array<int, 3> dense2(dense.shape());
+  copy(morton, dense2);
+  check_pattern(dense2);
+
+  // Copies to and from part of the arrays.
+  array_of_rank<int, 3> part({{3, 10}, {5, 4}, {2, 3}});
+  copy(morton, part);
+  check_pattern(part);
+
+  morton_array<int, 3> morton_part({{3, 10}, {5, 4}, {2, 3}});
+  copy(morton, morton_part);
+  check_pattern(morton_part);
+  copy(dense, morton_part);
+  check_pattern(morton_part);
+
+  morton_array<int, 3> morton2 =
+      make_copy(dense, morton_shape<3>({{-2, 19}, {3, 12}, {1, 7}}));
+  check_pattern(morton2);
+  dense_array<int, 3> dense3 = make_copy(morton2, dense.shape());
+  check_pattern(dense3);
+}
+
+TEST(morton_array_crop) {
+  morton_array<int, 2> a({30, 20});
+  fill_pattern(a);
+
+  auto a_crop = crop(a, interval<>(5, 10), interval<>(3, 12));
+  ASSERT_EQ(a_crop.x().min(), 5);
+  ASSERT_EQ(a_crop.x().extent(), 10);
+  ASSERT_EQ(a_crop.y().min(), 3);
+  ASSERT_EQ(a_crop.y().extent(), 12);
+  ASSERT_EQ(&a_crop(5, 3), &a(5, 3));
+  ASSERT_EQ(&a_crop(14, 14), &a(14, 14));
+  check_pattern(a_crop);
+
+  index_t count = 0;
+  a_crop.for_each_value([&](int& x) {
+    x = -1;
+    count++;
+  });
+  ASSERT_EQ(count, 10 * 12);
+  for_all_indices(a.shape(), [&](index_t x, index_t y) {
+    if (a_crop.shape().is_in_range(x, y)) {
+      ASSERT_EQ(a(x, y), -1);
+    } else {
+      ASSERT_EQ(a(x, y), pattern<int>(std::make_tuple(x, y)));
+    }
+  });
+
+  // Crops are clamped to the shape.
+  auto clamped = crop(a, interval<>(25, 10), interval<>(-5, 10));
+  ASSERT_EQ(clamped.x().extent(), 5);
+  ASSERT_EQ(clamped.y().extent(), 5);
+}
+
+TEST(morton_array_parallel) {
+  thread_pool pool(4);
+  parallel_policy policy(pool);
+
+  // The arrays are large enough to be split into several tasks.
+  dense_array<int, 2> dense({{-2, 300}, {3, 200}});
+  fill_pattern(dense);
+
+  morton_array<int, 2> morton({{-2, 300}, {3, 200}});
+  copy(policy, dense, morton);
+  check_pattern(morton);
+
+  dense_array<int, 2> dense2(dense.shape());
+  copy(policy, morton, dense2);
+  check_pattern(dense2);
+
+  morton_array<int, 2> morton2({{10, 250}, {20, 150}});
+  copy(policy, morton, morton2);
+  check_pattern(morton2);
+
+  auto morton_crop = crop(morton, interval<>(3, 250), interval<>(10, 150));
+  fill(policy, morton_crop, 7);
+  index_t count = 0;
+  for_all_indices(morton.shape(), [&](index_t x, index_t y) {
+    if (morton_crop.shape().is_in_range(x, y)) {
+      ASSERT_EQ(morton(x, y), 7);
+      count++;
+    } else {
+      ASSERT_EQ(morton(x, y), pattern<int>(std::make_tuple(x, y)));
+    }
+  });
+  ASSERT_EQ(count, 250 * 150);
+
+  std::atomic<index_t> visited(0);
+  for_each_value(policy, morton_crop, [&](int& x) {
+    x = 3;
+    visited++;
+  });
+  ASSERT_EQ(visited, 250 * 150);
+  morton_crop.for_each_value([](int x) { ASSERT_EQ(x, 3); });
+}
+
+TEST(morton_array_ein_reduce) {
+  enum { i = 0, j = 1, k = 2 };
+  dense_array<int, 2> dense({{-2, 37}, {3, 29}});
+  fill_pattern(dense);
+  morton_array<int, 2> morton({{-2, 37}, {3, 29}});
+  copy(dense, morton);
+
+  // The dims of a Morton array are intervals without strides, so these
+  // reductions use the generic loops.
+  dense_array<int, 1> col_sums({{-2, 37}}, 0);
+  ein_reduce(ein<i>(col_sums) += ein<i, j>(morton));
+  for (index_t x : col_sums.x()) {
+    int sum = 0;
+    for (index_t y : dense.y()) {
+      sum += dense(x, y);
+    }
+    ASSERT_EQ(col_sums(x), sum);
+  }
+
+  morton_array<int, 2> transposed({{3, 29}, {-2, 37}});
+  ein_reduce(ein<j, i>(transposed) = ein<i, j>(morton));
+  for_all_indices(dense.shape(), [&](index_t x, index_t y) {
+    ASSERT_EQ(transposed(y, x), dense(x, y));
+  });
+
+  morton_array<int, 2> product({{-2, 37}, {-2, 37}}, 0);
+  ein_reduce(ein<i, k>(product) += ein<i, j>(morton) * ein<j, k>(transposed));
+  for_all_indices(product.shape(), [&](index_t x, index_t z) {
+    int sum = 0;
+    for (index_t y : dense.y()) {
+      sum += dense(x, y) * dense(z, y);
+    }
+    ASSERT_EQ(product(x, z), sum);
+  });
+
+  // The result dims of a Morton array can be split into parallel tasks.
+  thread_pool pool(4);
+  parallel_policy policy(pool);
+  morton_array<int, 2> par_product({{-2, 37}, {-2, 37}}, 0);
+  ein_reduce(policy, ein<i, k>(par_product) += ein<i, j>(morton) * ein<j, k>(transposed));
+  ASSERT(par_product == product);
+}
+
+TEST(morton_array_empty) {
+  morton_array<int, 2> a;
+  ASSERT(a.empty());
+  a.for_each_value([](int) { ASSERT(false); });
+
+  morton_array<int, 2> b({0, 10});
+  ASSERT(b.empty());
+  ASSERT_EQ(b.shape().flat_extent(), 0);
+}
+
+} // namespace nda
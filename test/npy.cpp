@@ -0,0 +1,198 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "npy.h"
+#include "temp_file.h"
+#include "test.h"
+
+#include <string>
+
+namespace nda {
+
+namespace {
+
+// Write a .npy file with the header dictionary `dict` and the data `data`.
+void write_npy_file(const char* path, std::string dict, const void* data, size_t size) {
+  // Pad the header to align the data, like NumPy.
+  dict.resize((10 + dict.size() + 1 + 63) / 64 * 64 - 11, ' ');
+  dict += '\n';
+  std::string header = "\x93NUMPY";
+  header += '\x01';
+  header += '\x00';
+  internal::put_le<uint16_t>(header, static_cast<uint16_t>(dict.size()));
+  FILE* f = fopen(path, "wb");
+  fwrite(header.data(), 1, header.size(), f);
+  fwrite(dict.data(), 1, dict.size(), f);
+  fwrite(data, 1, size, f);
+  fclose(f);
+}
+
+// Check that the arrays `a` and `b` have the same values, with any strides.
+template <class A, class B>
+void assert_same_values(const A& a, const B& b) {
+  ASSERT(a.shape().min() == b.shape().min());
+  ASSERT(a.shape().extent() == b.shape().extent());
+  for_each_index(a.shape(), [&](const typename A::index_type& i) { ASSERT_EQ(a[i], b[i]); });
+}
+
+} // namespace
+
+TEST(npy_header) {
+  std::string header = internal::make_npy_header("<f4", {3, 4});
+  ASSERT_EQ(header.size() % 64, 0);
+  ASSERT_EQ(header.back(), '\n');
+  ASSERT_EQ(header.substr(0, 6), "\x93NUMPY");
+  ASSERT_EQ(header.find("{'descr': '<f4', 'fortran_order': False, 'shape': (3, 4), }"), 10);
+  ASSERT_EQ(internal::make_npy_header("|u1", {5}).find("'shape': (5,), }"), 51);
+  ASSERT_EQ(internal::make_npy_header("<i8", {}).find("'shape': (), }"), 51);
+
+  // The check value of CRC-32.
+  ASSERT_EQ(internal::crc32(0, "123456789", 9), 0xcbf43926);
+}
+
+TEST(npy_round_trip) {
+  temp_file file("ndarray_npy");
+  dense_array<float, 3> a({4, 5, 6});
+  fill_pattern(a);
+  ASSERT(save_npy(file.path(), a));
+
+  // The layout of the file is compatible with dense_shape<3>.
+  auto b = load_npy<float, dense_shape<3>>(file.path());
+  ASSERT(b.is_open());
+  ASSERT(b.is_mapped());
+  ASSERT(b.shape() == a.shape());
+  check_pattern(b.cref());
+
+  // The layout of the file is not compatible with this shape, the file is
+  // copied.
+  using transposed_shape = shape<dim<>, dim<>, dense_dim<>>;
+  auto c = load_npy<float, transposed_shape>(file.path());
+  ASSERT(c.is_open());
+  ASSERT(!c.is_mapped());
+  assert_same_values(c.cref(), a.cref());
+
+  // The type or rank doesn't match.
+  auto wrong_type = load_npy<int, dense_shape<3>>(file.path());
+  ASSERT(!wrong_type.is_open());
+  auto wrong_size = load_npy<double, dense_shape<3>>(file.path());
+  ASSERT(!wrong_size.is_open());
+  auto wrong_rank = load_npy<float, dense_shape<2>>(file.path());
+  ASSERT(!wrong_rank.is_open());
+  auto missing = load_npy<float, dense_shape<3>>("/nonexistent.npy");
+  ASSERT(!missing.is_open());
+
+  // Save an array that is not dense.
+  auto a_tr = transpose<2, 0, 1>(a.cref());
+  ASSERT(save_npy(file.path(), a_tr));
+  auto d = load_npy<float, dense_shape<3>>(file.path());
+  ASSERT(d.is_open());
+  ASSERT_EQ(d.shape().dim<0>().extent(), 6);
+  assert_same_values(d.cref(), a_tr);
+
+  // Writing to a copy-on-write mapping doesn't modify the file.
+  auto e = load_npy<float, dense_shape<3>>(file.path(), mmap_mode::copy_on_write);
+  fill(e.ref(), 0.0f);
+  auto f = load_npy<float, dense_shape<3>>(file.path());
+  ASSERT(f.cref() == d.cref());
+
+  // Arrays of non-const elements are mapped copy-on-write by default, and
+  // can be written via ref.
+  ASSERT(f.is_mapped());
+  f.ref()(0, 0, 0) = -1.0f;
+  ASSERT_EQ(f.cref()(0, 0, 0), -1.0f);
+
+  // Arrays of const elements are mapped read-only, and ref is a const_array_ref.
+  auto g = load_npy<const float, dense_shape<3>>(file.path());
+  ASSERT(g.is_mapped());
+  ASSERT(g.ref() == d.cref());
+  static_assert(
+      std::is_same<decltype(g.ref()), const_array_ref<float, dense_shape<3>>>::value, "");
+
+  // Arrays of non-const elements can't be mapped read-only, they are copied.
+  auto h = load_npy<float, dense_shape<3>>(file.path(), mmap_mode::read_only);
+  ASSERT(!h.is_mapped());
+  fill(h.ref(), 1.0f);
+  auto i = load_npy<const float, dense_shape<3>>(file.path());
+  ASSERT(i.cref() == d.cref());
+}
+
+TEST(npy_fortran_order) {
+  temp_file file("ndarray_npy");
+  // A Fortran order NumPy array of shape (2, 3). Axis 0 is dense, which is
+  // dimension 1.
+  const int16_t data[] = {0, 1, 2, 3, 4, 5};
+  write_npy_file(file.path(), "{'descr': '<i2', 'fortran_order': True, 'shape': (2, 3), }",
+      data, sizeof(data));
+  auto a = load_npy<int16_t, shape_of_rank<2>>(file.path());
+  ASSERT(a.is_mapped());
+  ASSERT_EQ(a.shape().dim<0>().extent(), 3);
+  ASSERT_EQ(a.shape().dim<1>().extent(), 2);
+  ASSERT_EQ(a.shape().dim<1>().stride(), 1);
+  for_all_indices(a.shape(), [&](index_t x, index_t y) { ASSERT_EQ(a.cref()(x, y), x * 2 + y); });
+
+  auto b = load_npy<int16_t, dense_shape<2>>(file.path());
+  ASSERT(!b.is_mapped());
+  assert_same_values(b.cref(), a.cref());
+}
+
+TEST(npy_byte_order) {
+  temp_file file("ndarray_npy");
+  // Big endian values 1, 2, 256.
+  const uint8_t data[] = {0, 1, 0, 2, 1, 0};
+  write_npy_file(file.path(), "{'descr': '>u2', 'fortran_order': False, 'shape': (3,), }",
+      data, sizeof(data));
+  auto a = load_npy<uint16_t, dense_shape<1>>(file.path());
+  ASSERT(a.is_open());
+  ASSERT_EQ(a.is_mapped(), !internal::is_little_endian());
+  ASSERT_EQ(a.cref()(0), 1);
+  ASSERT_EQ(a.cref()(1), 2);
+  ASSERT_EQ(a.cref()(2), 256);
+}
+
+TEST(npz_round_trip) {
+  temp_file file("ndarray_npy");
+  dense_array<double, 2> a({7, 3});
+  fill_pattern(a);
+  dense_array<uint8_t, 1> b(dense_shape<1>(11));
+  fill_pattern(b);
+  dense_array<std::complex<float>, 0> c;
+  c() = std::complex<float>(1.0f, 2.0f);
+  {
+    npz_writer npz(file.path());
+    ASSERT(npz.add("a", a));
+    ASSERT(npz.add("b", b));
+    ASSERT(npz.add("c", c));
+    ASSERT(npz.close());
+  }
+
+  npz_reader npz(file.path());
+  ASSERT(npz.is_open());
+  ASSERT(npz.names() == std::vector<std::string>({"a", "b", "c"}));
+  auto a2 = npz.load<double, dense_shape<2>>("a");
+  ASSERT(a2.is_mapped());
+  check_pattern(a2.cref());
+  auto b2 = npz.load<uint8_t, dense_shape<1>>("b");
+  ASSERT(b2.is_mapped());
+  check_pattern(b2.cref());
+  auto c2 = npz.load<std::complex<float>, dense_shape<0>>("c");
+  ASSERT(c2.is_open());
+  ASSERT(c2.cref()() == c());
+
+  auto missing = npz.load<double, dense_shape<2>>("d");
+  ASSERT(!missing.is_open());
+  auto shared = npz.load<double, dense_shape<2>>("a", mmap_mode::shared);
+  ASSERT(!shared.is_open());
+  ASSERT(!npz_reader("/nonexistent.npz").is_open());
+}
+
+} // namespace nda
@@ -0,0 +1,135 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel.h"
+#include "image.h"
+#include "test.h"
+
+namespace nda {
+
+TEST(parallel_for) {
+  for (int threads : {1, 2, 4}) {
+    thread_pool pool(threads);
+    ASSERT_EQ(pool.thread_count(), threads);
+    for (index_t extent : {0, 1, 7, 100, 1000}) {
+      std::vector<std::atomic<int>> visited(extent);
+      for (std::atomic<int>& i : visited) {
+        i = 0;
+      }
+      pool.parallel_for(interval<>(0, extent), 3, [&](const interval<>& r) {
+        ASSERT(r.extent() >= 3 || r.max() == extent - 1);
+        for (index_t i : r) {
+          visited[i]++;
+        }
+      });
+      for (const std::atomic<int>& i : visited) {
+        ASSERT_EQ(i, 1);
+      }
+    }
+  }
+}
+
+TEST(parallel_for_nested) {
+  thread_pool pool(4);
+  std::atomic<int> count(0);
+  pool.parallel_for(interval<>(0, 16), 1, [&](const interval<>& r) {
+    for (index_t i : r) {
+      (void)i;
+      pool.parallel_for(interval<>(0, 16), 1, [&](const interval<>& s) { count += s.extent(); });
+    }
+  });
+  ASSERT_EQ(count, 16 * 16);
+}
+
+TEST(parallel_copy) {
+  thread_pool pool(3);
+  parallel_policy policy(pool);
+
+  dense_array<int, 3> a({100, 60, 40});
+  fill_pattern(a);
+
+  dense_array<int, 3> b(a.shape());
+  copy(policy, a, b);
+  check_pattern(b);
+
+  // Copy a cropped region into a differently ordered array.
+  array_of_rank<int, 3> c({dim<>(3, 90, 1500), dim<>(2, 50, 1), dim<>(1, 30, 50)});
+  copy(policy, a, c);
+  check_pattern(c);
+
+  // Copy an array with only an outer dimension.
+  dense_array<int, 3> d({1, 1, 40});
+  copy(policy, a, d);
+  check_pattern(d);
+
+  // Copy with the global pool.
+  dense_array<int, 3> e({dense_dim<>(10, 20), dim<>(5, 10), dim<>(0, 40)});
+  copy(par, a, e);
+  check_pattern(e);
+
+  // Copies between chunky and planar images use the copy_shape_traits of the
+  // images for each task.
+  chunky_image<uint8_t, 3> chunky({300, 200, 3});
+  fill_pattern(chunky);
+  planar_image<uint8_t> planar({{10, 250}, {5, 180}, 3});
+  copy(policy, chunky, planar);
+  check_pattern(planar);
+  chunky_image<uint8_t, 3> chunky_copy({{10, 250}, {5, 180}, 3});
+  copy(policy, planar, chunky_copy);
+  check_pattern(chunky_copy);
+}
+
+TEST(parallel_fill_generate) {
+  thread_pool pool(4);
+  parallel_policy policy(pool);
+
+  array_of_rank<int, 3> a({dim<>(-3, 50, 200), dim<>(2, 40, 5), dim<>(0, 5, 1)});
+  fill(policy, a, 7);
+  a.for_each_value([](int i) { ASSERT_EQ(i, 7); });
+
+  std::atomic<int> next(0);
+  generate(policy, a, [&]() { return next++; });
+  // Every value should have been generated exactly once.
+  std::vector<int> values;
+  a.for_each_value([&](int i) { values.push_back(i); });
+  std::sort(values.begin(), values.end());
+  for (size_t i = 0; i < values.size(); i++) {
+    ASSERT_EQ(values[i], static_cast<int>(i));
+  }
+  ASSERT_EQ(next, static_cast<int>(a.size()));
+}
+
+TEST(parallel_for_each_value) {
+  thread_pool pool(4);
+  parallel_policy policy(pool);
+
+  dense_array<int, 3> a({64, 32, 16});
+  fill_pattern(a);
+  std::atomic<int64_t> sum(0);
+  for_each_value(policy, a, [&](int i) { sum += i; });
+  int64_t expected = 0;
+  a.for_each_value([&](int i) { expected += i; });
+  ASSERT_EQ(sum, expected);
+
+  for_each_value(policy, a.ref(), [](int& i) { i *= 2; });
+  for_each_index(a.shape(), [&](const dense_shape<3>::index_type& i) {
+    ASSERT_EQ(a(i), pattern<int>(i) * 2);
+  });
+
+  array<int, shape<>> scalar(shape<>{});
+  for_each_value(policy, scalar, [](int& i) { i = 3; });
+  ASSERT_EQ(scalar(), 3);
+}
+
+} // namespace nda
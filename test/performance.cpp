@@ -13,9 +13,20 @@
 // limitations under the License.
 
 #include "array.h"
+#include "convolve.h"
+#include "ein_reduce.h"
+#include "elementwise.h"
+#include "image.h"
+#include "matrix.h"
+#include "morton_shape.h"
+#include "parallel.h"
 #include "test.h"
+#include "tiled_shape.h"
+#include "vector_math.h"
 
+#include <cstdlib>
 #include <cstring>
+#include <vector>
 
 namespace nda {
 
@@ -103,6 +114,171 @@ TEST(performance_copy) {
   ASSERT_LT(copy_time, loop_time * 0.5);
 }
 
+TEST(performance_transposed_copy) {
+  dense_array<int, 2> a({2048, 2048});
+  fill_pattern(a);
+
+  // A transposed copy, where the innermost dimension of the src is the
+  // outermost dimension of the dst.
+  array_of_rank<int, 2> b({{0, 2048, 2048}, {0, 2048, 1}});
+  double copy_time = benchmark([&]() { copy(a, b); });
+  check_pattern(b);
+
+  array_of_rank<int, 2> c(b.shape());
+  double loop_time = benchmark([&] {
+    for (int y : c.y()) {
+      for (int x : c.x()) {
+        c(x, y) = a(x, y);
+      }
+    }
+  });
+  check_pattern(c);
+
+  dense_array<int, 2> d(a.shape());
+  double memcpy_time = benchmark([&] {
+    std::memcpy(&d(0, 0), &a(0, 0), static_cast<size_t>(a.size()) * sizeof(int));
+  });
+  check_pattern(d);
+
+  // The tiled copy should be much faster than reading or writing one of the
+  // arrays with a large stride, but it can't keep up with memcpy.
+  ASSERT_LT(copy_time, loop_time * 0.5);
+  ASSERT_LT(copy_time, memcpy_time * 10);
+}
+
+TEST(performance_deinterleave) {
+  chunky_image<uint8_t, 4> a({1024, 1024, 4});
+  fill_pattern(a);
+
+  planar_image<uint8_t> b({1024, 1024, 4});
+  double copy_time = benchmark([&]() { copy(a, b); });
+  check_pattern(b);
+
+  planar_image<uint8_t> c(b.shape());
+  double loop_time = benchmark([&] {
+    for (index_t y : c.y()) {
+      for (index_t x : c.x()) {
+        for (index_t i : c.c()) {
+          c(x, y, i) = a(x, y, i);
+        }
+      }
+    }
+  });
+  check_pattern(c);
+
+  // Deinterleaving with shuffles should be much faster than a loop over the
+  // pixels.
+  ASSERT_LT(copy_time, loop_time * 0.5);
+}
+
+TEST(performance_interleave) {
+  planar_image<uint8_t> a({1024, 1024, 4});
+  fill_pattern(a);
+
+  chunky_image<uint8_t, 4> b({1024, 1024, 4});
+  double copy_time = benchmark([&]() { copy(a, b); });
+  check_pattern(b);
+
+  chunky_image<uint8_t, 4> c(b.shape());
+  double loop_time = benchmark([&] {
+    for (index_t y : c.y()) {
+      for (index_t x : c.x()) {
+        for (index_t i : c.c()) {
+          c(x, y, i) = a(x, y, i);
+        }
+      }
+    }
+  });
+  check_pattern(c);
+
+  // Interleaving with shuffles should be much faster than a loop over the
+  // pixels.
+  ASSERT_LT(copy_time, loop_time * 0.5);
+}
+
+// A naive 2D convolution of `in` with `kernel_x(i) * kernel_y(j)`, with the
+// border clamped.
+template <class T>
+void naive_convolve(const planar_image<T>& in, planar_image<T>& out,
+    const dense_array<float, 1>& kernel_x, const dense_array<float, 1>& kernel_y) {
+  for (index_t c : out.c()) {
+    for (index_t y : out.y()) {
+      for (index_t x : out.x()) {
+        float sum = 0.0f;
+        for (index_t j : kernel_y.x()) {
+          for (index_t i : kernel_x.x()) {
+            sum += kernel_x(i) * kernel_y(j) * in(clamp(x + i, in.x()), clamp(y + j, in.y()), c);
+          }
+        }
+        out(x, y, c) = sum;
+      }
+    }
+  }
+}
+
+TEST(performance_convolve_separable) {
+  planar_image<float> a({1024, 1024, 3});
+  fill_pattern(a);
+  dense_array<float, 1> kernel(dense_shape<1>(dense_dim<>(-2, 5)));
+  const float weights[] = {0.0625f, 0.25f, 0.375f, 0.25f, 0.0625f};
+  for (index_t i : kernel.x()) {
+    kernel(i) = weights[i + 2];
+  }
+
+  planar_image<float> b(a.shape());
+  double convolve_time =
+      benchmark([&]() { convolve_separable(a.cref(), b.ref(), kernel.cref(), kernel.cref()); });
+
+  planar_image<float> c(a.shape());
+  double naive_time = benchmark([&]() { naive_convolve(a, c, kernel, kernel); });
+  // The weights are exact in binary, so the results are exact too.
+  ASSERT(b == c);
+
+  // The separable convolution should be much faster than the 2D loop.
+  ASSERT_LT(convolve_time, naive_time * 0.5);
+}
+
+TEST(performance_box_blur) {
+  planar_image<float> a({512, 512, 3});
+  fill_pattern(a);
+  const index_t radius = 16;
+  dense_array<float, 1> kernel(
+      dense_shape<1>(dense_dim<>(-radius, 2 * radius + 1)), 1.0f / (2 * radius + 1));
+
+  planar_image<float> b(a.shape());
+  double box_blur_time = benchmark([&]() { box_blur(a.cref(), b.ref(), radius, radius); });
+  assert_used(b);
+
+  planar_image<float> c(a.shape());
+  double convolve_time =
+      benchmark([&]() { convolve_separable(a.cref(), c.ref(), kernel.cref(), kernel.cref()); });
+  assert_used(c);
+
+  planar_image<float> d(a.shape());
+  double naive_time = benchmark([&]() { naive_convolve(a, d, kernel, kernel); });
+  assert_used(d);
+
+  // The running sums of the box blur should be faster than convolving with
+  // the box, and much faster than the 2D loop.
+  ASSERT_LT(box_blur_time, convolve_time * 0.75);
+  ASSERT_LT(box_blur_time, naive_time * 0.1);
+}
+
+TEST(performance_parallel_copy) {
+  array_of_rank<int, 3> a({dim<>(0, 200, 1), dim<>(0, 200, 200), dim<>(0, 200, 40000)});
+  fill_pattern(a);
+
+  array_of_rank<int, 3> b({dim<>(0, 200, 1), dim<>(0, 200, 40200), dim<>(0, 200, 200)});
+  double par_time = benchmark([&]() { copy(par, a, b); });
+  check_pattern(b);
+
+  double serial_time = benchmark([&]() { copy(a, b); });
+
+  // The parallel copy should not be much slower than the serial copy, even
+  // with only one thread.
+  ASSERT_LT(par_time, serial_time * 1.5);
+}
+
 TEST(performance_for_each_value) {
   array_of_rank<int, 12> a({2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2});
   double loop_time = benchmark([&]() {
@@ -118,4 +294,384 @@ TEST(performance_for_each_value) {
   ASSERT_LT(for_each_value_time, loop_time * 0.1);
 }
 
+TEST(performance_for_each_value_multiple) {
+  dense_array<float, 3> a({1024, 1024, 4});
+  dense_array<float, 3> b(a.shape());
+  dense_array<float, 3> c(a.shape());
+  fill_pattern(a);
+  fill_pattern(b);
+  fill_pattern(c);
+
+  dense_array<float, 3> out(a.shape());
+  double for_each_value_time = benchmark([&]() {
+    for_each_value([](float& out, float a, float b, float c) { out = a * b + c; }, out, a, b, c);
+  });
+  assert_used(out);
+
+  dense_array<float, 3> out_loop(a.shape());
+  double loop_time = benchmark([&]() {
+    const float* a_base = a.data();
+    const float* b_base = b.data();
+    const float* c_base = c.data();
+    float* out_base = out_loop.data();
+    for (size_t i = 0; i < a.size(); i++) {
+      out_base[i] = a_base[i] * b_base[i] + c_base[i];
+    }
+  });
+  assert_used(out_loop);
+  ASSERT(out == out_loop);
+
+  // The shapes are fused to one dense dimension, so this should be as fast as
+  // the loop over raw pointers.
+  ASSERT_LT(for_each_value_time, loop_time * 1.5);
+}
+
+TEST(performance_elementwise) {
+  enum { i = 0, j = 1, k = 2 };
+  dense_array<float, 3> a({3, 1024, 512});
+  dense_array<float, 3> b(a.shape());
+  fill_pattern(a);
+  fill_pattern(b);
+
+  dense_array<float, 3> c(a.shape());
+  double elementwise_time =
+      benchmark([&]() { elementwise(c) = elementwise(a) + elementwise(b) * 2.0f; });
+  assert_used(c);
+
+  dense_array<float, 3> c_ein(a.shape());
+  float two = 2.0f;
+  double ein_time = benchmark([&]() {
+    ein_reduce(ein<i, j, k>(c_ein) = ein<i, j, k>(a) + ein<i, j, k>(b) * ein(two));
+  });
+  assert_used(c_ein);
+
+  dense_array<float, 3> c_loop(a.shape());
+  double loop_time = benchmark([&]() {
+    const float* a_base = a.data();
+    const float* b_base = b.data();
+    float* c_base = c_loop.data();
+    for (size_t i = 0; i < a.size(); i++) {
+      c_base[i] = a_base[i] + b_base[i] * 2.0f;
+    }
+  });
+  assert_used(c_loop);
+  ASSERT(c == c_loop);
+
+  // The expression is evaluated in one loop over the fused dense dimensions,
+  // which should be about as fast as the loop over raw pointers. Both are
+  // limited by memory bandwidth, which is noisy, so allow some slack.
+  // ein_reduce loops over the small innermost dimension.
+  ASSERT_LT(elementwise_time, loop_time * 2.0);
+  ASSERT_LT(elementwise_time, ein_time * 0.75);
+}
+
+TEST(performance_vector_math) {
+  dense_array<float, 2> x({1000, 1000});
+  int i = 0;
+  x.for_each_value([&](float& v) { v = (i++ % 1013) * 0.01f - 5.0f; });
+  dense_array<float, 2> y(x.shape());
+
+  double exp_time = benchmark([&]() { vector_exp(x, y); });
+  assert_used(y);
+  double tanh_time = benchmark([&]() { vector_tanh(x, y); });
+  assert_used(y);
+  double erf_time = benchmark([&]() { vector_erf(x, y); });
+  assert_used(y);
+  double log_time = benchmark([&]() { vector_log(y, y); });
+  assert_used(y);
+
+  dense_array<float, 2> y_libm(x.shape());
+  double libm_exp_time =
+      benchmark([&]() { for_each_value([](float x, float& y) { y = std::exp(x); }, x, y_libm); });
+  assert_used(y_libm);
+  double libm_tanh_time =
+      benchmark([&]() { for_each_value([](float x, float& y) { y = std::tanh(x); }, x, y_libm); });
+  assert_used(y_libm);
+  double libm_erf_time =
+      benchmark([&]() { for_each_value([](float x, float& y) { y = std::erf(x); }, x, y_libm); });
+  assert_used(y_libm);
+  double libm_log_time =
+      benchmark([&]() { for_each_value([](float& y) { y = std::log(y); }, y_libm); });
+  assert_used(y_libm);
+
+  // The vector approximations should be several times faster than calling
+  // the scalar libm functions for each value.
+  ASSERT_LT(exp_time, libm_exp_time * 0.5);
+  ASSERT_LT(tanh_time, libm_tanh_time * 0.5);
+  ASSERT_LT(erf_time, libm_erf_time * 0.5);
+  ASSERT_LT(log_time, libm_log_time * 0.5);
+}
+
+TEST(performance_tiled_copy) {
+  dense_array<int, 2> a({2048, 2048});
+  fill_pattern(a);
+
+  tiled_array<int, 32, 32> tiled({2048, 2048});
+  double to_tiled_time = benchmark([&]() { copy(a, tiled); });
+  check_pattern(tiled);
+
+  dense_array<int, 2> b(a.shape());
+  double from_tiled_time = benchmark([&]() { copy(tiled, b); });
+  check_pattern(b);
+
+  dense_array<int, 2> c(a.shape());
+  double memcpy_time = benchmark([&] {
+    std::memcpy(&c(0, 0), &a(0, 0), static_cast<size_t>(a.size()) * sizeof(int));
+  });
+  check_pattern(c);
+
+  // Copies between tiled and linear layouts should be nearly as fast as memcpy.
+  // They are usually within 2x, but are limited by memory bandwidth, which is
+  // noisy.
+  ASSERT_LT(to_tiled_time, memcpy_time * 3.0);
+  ASSERT_LT(from_tiled_time, memcpy_time * 3.0);
+}
+
+// Sum each column of `a` to `sums`, like a vertical filter that processes one
+// column at a time.
+template <class T, class Shape, class U>
+void sum_columns(const array_ref<T, Shape>& a, const dense_array_ref<U, 1>& sums) {
+  for (index_t x : a.x()) {
+    U sum = 0;
+    for (index_t y : a.y()) {
+      sum += a(x, y);
+    }
+    sums(x) = sum;
+  }
+}
+
+TEST(performance_tiled_columns) {
+  dense_array<float, 2> linear({2048, 2048});
+  fill_pattern(linear);
+  tiled_array<float, 32, 32> tiled({2048, 2048});
+  copy(linear, tiled);
+
+  dense_array<float, 1> linear_sums(dense_shape<1>(2048));
+  double linear_time = benchmark([&]() { sum_columns(linear.cref(), linear_sums.ref()); });
+
+  dense_array<float, 1> tiled_sums(dense_shape<1>(2048));
+  double tiled_time = benchmark([&]() { sum_columns(tiled.cref(), tiled_sums.ref()); });
+  for (index_t x : linear_sums.x()) {
+    ASSERT_EQ(linear_sums(x), tiled_sums(x));
+  }
+
+  // Each column of the linear array touches a different page for every row,
+  // while the tiled array only touches a new page every 32 rows. The speedup
+  // is usually several times, but it depends on the caches and TLB of the
+  // machine, so only require a modest one.
+  ASSERT_LT(tiled_time, linear_time * 0.8);
+}
+
+// Sum the 3x3x3 neighborhood of each of `points` in `a` to `sums`, like a
+// stencil or ray marcher visiting points in no particular order.
+template <class T, class Shape, class U>
+void sum_neighborhoods(const array_ref<T, Shape>& a, const std::vector<index_of_rank<3>>& points,
+    const dense_array_ref<U, 1>& sums) {
+  for (index_t i : sums.x()) {
+    index_t x, y, z;
+    std::tie(x, y, z) = points[i];
+    U sum = 0;
+    for (index_t dz = -1; dz <= 1; dz++) {
+      for (index_t dy = -1; dy <= 1; dy++) {
+        for (index_t dx = -1; dx <= 1; dx++) {
+          sum += a(x + dx, y + dy, z + dz);
+        }
+      }
+    }
+    sums(i) = sum;
+  }
+}
+
+TEST(performance_morton_neighborhoods) {
+  dense_array<float, 3> dense({256, 256, 256});
+  fill_pattern(dense);
+  morton_array<float, 3> morton({256, 256, 256});
+  copy(dense, morton);
+
+  std::vector<index_of_rank<3>> points;
+  for (int i = 0; i < 1 << 16; i++) {
+    points.emplace_back(1 + rand() % 254, 1 + rand() % 254, 1 + rand() % 254);
+  }
+
+  dense_array<float, 1> dense_sums(dense_shape<1>(points.size()));
+  double dense_time =
+      benchmark([&]() { sum_neighborhoods(dense.cref(), points, dense_sums.ref()); });
+
+  dense_array<float, 1> morton_sums(dense_shape<1>(points.size()));
+  double morton_time =
+      benchmark([&]() { sum_neighborhoods(morton.cref(), points, morton_sums.ref()); });
+  for (index_t i : dense_sums.x()) {
+    ASSERT_EQ(dense_sums(i), morton_sums(i));
+  }
+
+  // The neighborhoods of the Morton array touch about 6 cache lines, vs. about
+  // 10 for the dense array, but computing each offset needs a `pdep` for each
+  // dimension. Which is faster depends on the machine, but the Morton array
+  // should not be much slower.
+  ASSERT_LT(morton_time, dense_time * 1.5);
+}
+
+// Allocate temporary images for strips of an image, like resample in the
+// resample example.
+template <class Alloc>
+void allocate_strip_temps(index_t width, index_t height, const Alloc& alloc) {
+  for (index_t y = 0; y < height; y += 64) {
+    arena_scope temps;
+    // The temporaries are initialized, like the temporaries of resample.
+    array_of_rank<float, 3, Alloc> strip({width, 64, 4}, 0.0f, alloc);
+    array_of_rank<float, 3, Alloc> strip_tr({64, width, 4}, 0.0f, alloc);
+    array_of_rank<float, 3, Alloc> out_tr({64, width / 2, 4}, 0.0f, alloc);
+    assert_used(strip);
+    assert_used(strip_tr);
+    assert_used(out_tr);
+  }
+}
+
+TEST(performance_arena_allocator) {
+  double std_time =
+      benchmark([&]() { allocate_strip_temps(1200, 900, std::allocator<float>()); });
+  double arena_time =
+      benchmark([&]() { allocate_strip_temps(1200, 900, arena_allocator<float>()); });
+
+  // When the temporaries are allocated from the system with mmap, they need to
+  // be faulted in for every strip, and the arena is several times faster. Once
+  // malloc adapts its mmap threshold, it can reuse the buffers too, so we can
+  // only expect the arena to be about as fast.
+  ASSERT_LT(arena_time, std_time * 1.5);
+}
+
+TEST(performance_ein_contract) {
+  enum { i = 0, j = 1, k = 2, l = 3 };
+  matrix<float> A({64, 64});
+  matrix<float> B({64, 64});
+  matrix<float> C({64, 64});
+  fill_pattern(A);
+  fill_pattern(B);
+  fill_pattern(C);
+
+  matrix<float> D_reduce({64, 64});
+  double reduce_time = benchmark([&]() {
+    fill(D_reduce, 0.0f);
+    ein_reduce(ein<i, l>(D_reduce) += ein<i, j>(A) * ein<j, k>(B) * ein<k, l>(C));
+  });
+  assert_used(D_reduce);
+
+  matrix<float> D_contract({64, 64});
+  double contract_time = benchmark([&]() {
+    fill(D_contract, 0.0f);
+    ein_contract(ein<i, l>(D_contract) += ein<i, j>(A) * ein<j, k>(B) * ein<k, l>(C));
+  });
+  assert_used(D_contract);
+
+  // Two rank 3 loop nests should be much faster than one rank 4 loop nest.
+  ASSERT_LT(contract_time, reduce_time * 0.25);
+}
+
+TEST(performance_ein_reduce_matrix_product) {
+  enum { i = 0, j = 1, k = 2 };
+  matrix<float> A({128, 256});
+  matrix<float> B({256, 128});
+  fill_pattern(A);
+  fill_pattern(B);
+
+  matrix<float> C_loop({128, 128});
+  double loop_time = benchmark([&]() {
+    for (index_t i : C_loop.i()) {
+      for (index_t j : C_loop.j()) {
+        C_loop(i, j) = 0.0f;
+      }
+      for (index_t k : A.j()) {
+        for (index_t j : C_loop.j()) {
+          C_loop(i, j) += A(i, k) * B(k, j);
+        }
+      }
+    }
+  });
+  assert_used(C_loop);
+
+  matrix<float> C({128, 128});
+  double ein_reduce_time = benchmark([&]() {
+    fill(C, 0.0f);
+    ein_reduce(ein<i, j>(C) += ein<i, k>(A) * ein<k, j>(B));
+  });
+  assert_used(C);
+
+  // The matrix product should be computed with gemm.
+  ASSERT_LT(ein_reduce_time, loop_time * 0.5);
+}
+
+TEST(performance_ein_reduce_innermost) {
+  enum { i = 0, j = 1 };
+  matrix<float> A({256, 1024});
+  vector<short> x({1024}, 0);
+  fill_pattern(A);
+  fill_pattern(x);
+
+  // This is not computed with gemv, because the operands have different types.
+  vector<float> y_in_order({256}, 0.0f);
+  double in_order_time = benchmark([&]() {
+    ein_reduce<ein_reduce_in_order_traits>(
+        ein<i>(y_in_order) += ein<i, j>(A) * cast<float>(ein<j>(x)));
+  });
+  assert_used(y_in_order);
+
+  vector<float> y({256}, 0.0f);
+  double ein_reduce_time =
+      benchmark([&]() { ein_reduce(ein<i>(y) += ein<i, j>(A) * cast<float>(ein<j>(x))); });
+  assert_used(y);
+
+  // Making j the innermost loop should be much faster than accessing A with a
+  // stride of a row in the innermost loop.
+  ASSERT_LT(ein_reduce_time, in_order_time * 0.5);
+}
+
+TEST(performance_ein_reduce_dot) {
+  enum { i = 0 };
+  vector<float> x({65536}, 1.0f);
+  vector<float> y({65536}, 2.0f);
+
+  float dot_in_order = 0.0f;
+  double in_order_time = benchmark([&]() {
+    dot_in_order = 0.0f;
+    ein_reduce<ein_reduce_in_order_traits>(ein<>(dot_in_order) += ein<i>(x) * ein<i>(y));
+  });
+
+  float dot = 0.0f;
+  double ein_reduce_time = benchmark([&]() {
+    dot = 0.0f;
+    ein_reduce(ein<>(dot) += ein<i>(x) * ein<i>(y));
+  });
+  ASSERT_EQ(dot, dot_in_order);
+
+  // Accumulating to several partial results should be much faster than a
+  // sequential reduction, which is limited by the latency of addition.
+  ASSERT_LT(ein_reduce_time, in_order_time * 0.5);
+}
+
+TEST(performance_make_ein_reduce_max) {
+  enum { i = 0, j = 1 };
+  matrix<float> A({256, 1024});
+  fill_pattern(A);
+
+  vector<float> max_loop({256}, 0.0f);
+  double loop_time = benchmark([&]() {
+    for (index_t i : A.i()) {
+      float max_i = A(i, 0);
+      for (index_t j : A.j()) {
+        max_i = std::max(max_i, A(i, j));
+      }
+      max_loop(i) = max_i;
+    }
+  });
+
+  vector<float> max_ein({256}, 0.0f);
+  double ein_reduce_time =
+      benchmark([&]() { max_ein = make_ein_reduce<max_reducer, float, i>(ein<i, j>(A)); });
+  ASSERT(max_ein == max_loop);
+
+  // The reduction with partial results should be much faster than the loop
+  // with a single accumulator.
+  ASSERT_LT(ein_reduce_time, loop_time * 0.5);
+}
+
 } // namespace nda
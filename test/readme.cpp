@@ -186,6 +186,12 @@ TEST(readme_ein_reduce) {
   auto r = ein<k>(max_xy);
   ein_reduce(r = max(r, ein<i, j, k>(T)));
 
+  // Equivalent to the reduction above:
+  ein_reduce(max_assign(ein<k>(max_xy), ein<i, j, k>(T)));
+
+  // The maximum of each row of A, and the index (i, j) of the maximum:
+  auto argmax_A = make_ein_reduce<argmax_reducer, float, i>(ein<i, j>(A));
+
   const float pi = std::acos(-1.0f);
 
   // Compute X1 = X2 = DFT[x]:
@@ -0,0 +1,50 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NDARRAY_TEST_TEMP_FILE_H
+#define NDARRAY_TEST_TEMP_FILE_H
+
+#include "test.h"
+
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+namespace nda {
+
+// A temporary file, named with `prefix`, that is removed when this object is
+// destroyed.
+class temp_file {
+  std::string path_;
+
+public:
+  explicit temp_file(const std::string& prefix = "ndarray") {
+    std::string path = "/tmp/" + prefix + "_XXXXXX";
+    int fd = mkstemp(&path[0]);
+    ASSERT(fd >= 0);
+    ::close(fd);
+    path_ = path;
+  }
+  ~temp_file() { unlink(path_.c_str()); }
+
+  temp_file(const temp_file&) = delete;
+  temp_file& operator=(const temp_file&) = delete;
+
+  const char* path() const { return path_.c_str(); }
+};
+
+} // namespace nda
+
+#endif // NDARRAY_TEST_TEMP_FILE_H
@@ -0,0 +1,314 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "tiled_shape.h"
+#include "ein_reduce.h"
+#include "parallel.h"
+#include "test.h"
+
+#include <vector>
+
+namespace nda {
+
+TEST(tiled_shape_offsets) {
+  tiled_shape<4, 2> s({10, 5});
+  s.resolve();
+  ASSERT(s.is_resolved());
+  ASSERT_EQ(s.tile_size(), 8);
+  // 3x3 tiles of 8 elements.
+  ASSERT_EQ(s.x().stride(), 8);
+  ASSERT_EQ(s.y().stride(), 24);
+  ASSERT_EQ(s.flat_min(), 0);
+  ASSERT_EQ(s.flat_extent(), 72);
+  ASSERT_EQ(s.size(), 50);
+  ASSERT(!s.is_compact());
+
+  // The elements of each tile are contiguous.
+  for (index_t y = 0; y < 2; y++) {
+    for (index_t x = 0; x < 4; x++) {
+      ASSERT_EQ(s(x, y), y * 4 + x);
+      ASSERT_EQ(s(x + 4, y + 2), 32 + y * 4 + x);
+    }
+  }
+
+  // Every index maps to a different flat offset in the flat extent.
+  std::vector<int> used(s.flat_extent(), 0);
+  for_all_indices(s, [&](index_t x, index_t y) {
+    index_t offset = s(x, y);
+    ASSERT(s.flat_min() <= offset && offset <= s.flat_max());
+    ASSERT_EQ(used[offset]++, 0);
+  });
+
+  tiled_shape<4, 2> tiled_mins({{-3, 10}, {2, 5}});
+  tiled_mins.resolve();
+  ASSERT_EQ(tiled_mins(-3, 2), 0);
+  ASSERT_EQ(tiled_mins(1, 2), 8);
+  ASSERT_EQ(tiled_mins(-3, 4), 24);
+  ASSERT_EQ(tiled_mins.flat_extent(), 72);
+}
+
+TEST(tiled_shape_strides) {
+  // Pad the rows of tiles to 4 tiles.
+  tiled_shape<8, 8> s({{0, 20, 64}, {0, 10}});
+  s.resolve();
+  ASSERT_EQ(s.x().stride(), 64);
+  ASSERT_EQ(s.y().stride(), 64 * 3);
+
+  tiled_shape<8, 8> padded({{0, 20, 64}, {0, 10, 64 * 4}});
+  padded.resolve();
+  ASSERT_EQ(padded.y().stride(), 64 * 4);
+  ASSERT_EQ(padded.flat_extent(), 64 * 4 + 64 * 3);
+}
+
+TEST(tiled_shape_for_each_index) {
+  tiled_shape<4, 4, 2> s({9, 6, 5});
+  s.resolve();
+  array_of_rank<int, 3> visited({9, 6, 5}, 0);
+  index_t count = 0;
+  for_each_index(s, [&](const index_of_rank<3>& i) {
+    visited(i)++;
+    count++;
+  });
+  ASSERT_EQ(count, 9 * 6 * 5);
+  visited.for_each_value([](int x) { ASSERT_EQ(x, 1); });
+}
+
+TEST(tiled_array) {
+  tiled_array<int, 8, 4> a({{-2, 21}, {3, 13}});
+  ASSERT_EQ(a.width(), 21);
+  ASSERT_EQ(a.height(), 13);
+  ASSERT_EQ(a.size(), 21 * 13);
+  fill_pattern(a);
+  check_pattern(a);
+
+  // for_each_value visits every element exactly once.
+  index_t sum = 0;
+  index_t count = 0;
+  a.for_each_value([&](int x) {
+    sum += x;
+    count++;
+  });
+  index_t expected_sum = 0;
+  for_each_index(a.shape(), [&](const index_of_rank<2>& i) { expected_sum += pattern<int>(i); });
+  ASSERT_EQ(count, 21 * 13);
+  ASSERT_EQ(sum, expected_sum);
+
+  tiled_array<int, 8, 4> b(a);
+  ASSERT(a == b);
+  b(3, 4) = 0;
+  ASSERT(a != b);
+
+  tiled_array<int, 8, 4> c(a.shape(), 7);
+  c.for_each_value([](int x) { ASSERT_EQ(x, 7); });
+}
+
+TEST(tiled_array_copy) {
+  dense_array<int, 2> linear({{-2, 37}, {3, 29}});
+  fill_pattern(linear);
+
+  tiled_array<int, 16, 8> tiled({{-2, 37}, {3, 29}});
+  copy(linear, tiled);
+  check_pattern(tiled);
+
+  dense_array<int, 2> linear2(linear.shape());
+  copy(tiled, linear2);
+  check_pattern(linear2);
+
+  // Copy between different tile sizes.
+  tiled_array<int, 4, 4> tiled2({{-2, 37}, {3, 29}});
+  copy(tiled, tiled2);
+  check_pattern(tiled2);
+
+  // Copies to and from part of the arrays.
+  array_of_rank<int, 2> part({{3, 20}, {10, 11}});
+  copy(tiled, part);
+  check_pattern(part);
+
+  tiled_array<int, 4, 4> tiled_part({{3, 20}, {10, 11}});
+  copy(tiled, tiled_part);
+  check_pattern(tiled_part);
+
+  tiled_array<int, 4, 4> tiled3 = make_copy(linear, tiled_shape<4, 4>({{-2, 37}, {3, 29}}));
+  check_pattern(tiled3);
+}
+
+TEST(tiled_array_3d) {
+  dense_array<int, 3> linear({9, 10, 11});
+  fill_pattern(linear);
+
+  array<int, tiled_shape<4, 4, 4>> tiled({9, 10, 11});
+  copy(linear, tiled);
+  check_pattern(tiled);
+  for_all_indices(linear.shape(), [&](index_t x, index_t y, index_t z) {
+    ASSERT_EQ(tiled(x, y, z), linear(x, y, z));
+  });
+
+  dense_array<int, 3> linear2(linear.shape());
+  copy(tiled, linear2);
+  check_pattern(linear2);
+}
+
+TEST(tiled_array_crop) {
+  tiled_array<int, 8, 8> a({30, 20});
+  fill_pattern(a);
+
+  auto a_crop = crop(a, interval<>(5, 10), interval<>(3, 12));
+  ASSERT_EQ(a_crop.x().min(), 5);
+  ASSERT_EQ(a_crop.x().extent(), 10);
+  ASSERT_EQ(a_crop.y().min(), 3);
+  ASSERT_EQ(a_crop.y().extent(), 12);
+  ASSERT_EQ(&a_crop(5, 3), &a(5, 3));
+  ASSERT_EQ(&a_crop(14, 14), &a(14, 14));
+  check_pattern(a_crop);
+
+  index_t count = 0;
+  a_crop.for_each_value([&](int& x) {
+    x = -1;
+    count++;
+  });
+  ASSERT_EQ(count, 10 * 12);
+  for_all_indices(a.shape(), [&](index_t x, index_t y) {
+    if (a_crop.shape().is_in_range(x, y)) {
+      ASSERT_EQ(a(x, y), -1);
+    } else {
+      ASSERT_EQ(a(x, y), pattern<int>(std::make_tuple(x, y)));
+    }
+  });
+
+  // Crops are clamped to the shape.
+  auto clamped = crop(a, interval<>(25, 10), interval<>(-5, 10));
+  ASSERT_EQ(clamped.x().extent(), 5);
+  ASSERT_EQ(clamped.y().extent(), 5);
+}
+
+TEST(tiled_array_for_each_value_multiple) {
+  dense_array<int, 2> linear({{-2, 37}, {3, 29}});
+  fill_pattern(linear);
+
+  tiled_array<int, 8, 8> tiled({{-2, 37}, {3, 29}});
+  for_each_value([](int& t, const int& l) { t = l; }, tiled, linear);
+  check_pattern(tiled);
+
+  tiled_array<int, 4, 8> tiled2({{0, 20}, {5, 20}});
+  dense_array<int, 2> sum({{0, 20}, {5, 20}});
+  for_each_value(
+      [](int& s, int& t2, int t, int l) {
+        t2 = t;
+        s = t + l;
+      },
+      sum, tiled2, tiled, linear);
+  check_pattern(tiled2);
+  for_all_indices(sum.shape(), [&](index_t x, index_t y) {
+    ASSERT_EQ(sum(x, y), 2 * linear(x, y));
+  });
+}
+
+TEST(tiled_array_parallel) {
+  thread_pool pool(4);
+  parallel_policy policy(pool);
+
+  // The arrays are large enough to be split into several tasks, which don't
+  // begin or end at the edges of tiles.
+  dense_array<int, 2> linear({{-2, 301}, {3, 203}});
+  fill_pattern(linear);
+
+  tiled_array<int, 8, 8> tiled({{-2, 301}, {3, 203}});
+  copy(policy, linear, tiled);
+  check_pattern(tiled);
+
+  dense_array<int, 2> linear2(linear.shape());
+  copy(policy, tiled, linear2);
+  check_pattern(linear2);
+
+  tiled_array<int, 16, 4> tiled2({{-2, 301}, {3, 203}});
+  copy(policy, tiled, tiled2);
+  check_pattern(tiled2);
+
+  auto tiled_crop = crop(tiled, interval<>(3, 250), interval<>(10, 150));
+  fill(policy, tiled_crop, 7);
+  index_t count = 0;
+  for_all_indices(tiled.shape(), [&](index_t x, index_t y) {
+    if (tiled_crop.shape().is_in_range(x, y)) {
+      ASSERT_EQ(tiled(x, y), 7);
+      count++;
+    } else {
+      ASSERT_EQ(tiled(x, y), pattern<int>(std::make_tuple(x, y)));
+    }
+  });
+  ASSERT_EQ(count, 250 * 150);
+
+  std::atomic<index_t> visited(0);
+  for_each_value(policy, tiled_crop, [&](int& x) {
+    x = 3;
+    visited++;
+  });
+  ASSERT_EQ(visited, 250 * 150);
+  tiled_crop.for_each_value([](int x) { ASSERT_EQ(x, 3); });
+}
+
+TEST(tiled_array_ein_reduce) {
+  enum { i = 0, j = 1, k = 2 };
+  dense_array<int, 2> linear({{-2, 37}, {3, 29}});
+  fill_pattern(linear);
+  tiled_array<int, 8, 8> tiled({{-2, 37}, {3, 29}});
+  copy(linear, tiled);
+
+  // Sums of the rows and columns of a tiled array.
+  dense_array<int, 1> row_sums({{3, 29}}, 0);
+  dense_array<int, 1> col_sums({{-2, 37}}, 0);
+  ein_reduce(ein<j>(row_sums) += ein<i, j>(tiled));
+  ein_reduce(ein<i>(col_sums) += ein<i, j>(tiled));
+  for (index_t y : row_sums.x()) {
+    int sum = 0;
+    for (index_t x : linear.x()) {
+      sum += linear(x, y);
+    }
+    ASSERT_EQ(row_sums(y), sum);
+  }
+  for (index_t x : col_sums.x()) {
+    int sum = 0;
+    for (index_t y : linear.y()) {
+      sum += linear(x, y);
+    }
+    ASSERT_EQ(col_sums(x), sum);
+  }
+
+  // A transpose, and a matrix product accumulated to a tiled array.
+  tiled_array<int, 4, 8> transposed({{3, 29}, {-2, 37}});
+  ein_reduce(ein<j, i>(transposed) = ein<i, j>(tiled));
+  for_all_indices(linear.shape(), [&](index_t x, index_t y) {
+    ASSERT_EQ(transposed(y, x), linear(x, y));
+  });
+
+  tiled_array<int, 8, 8> product({{-2, 37}, {-2, 37}}, 0);
+  ein_reduce(ein<i, k>(product) += ein<i, j>(tiled) * ein<j, k>(transposed));
+  for_all_indices(product.shape(), [&](index_t x, index_t z) {
+    int sum = 0;
+    for (index_t y : linear.y()) {
+      sum += linear(x, y) * linear(z, y);
+    }
+    ASSERT_EQ(product(x, z), sum);
+  });
+}
+
+TEST(tiled_array_empty) {
+  tiled_array<int, 8, 8> a;
+  ASSERT(a.empty());
+  a.for_each_value([](int) { ASSERT(false); });
+
+  tiled_array<int, 8, 8> b({0, 10});
+  ASSERT(b.empty());
+  ASSERT_EQ(b.shape().flat_extent(), 0);
+}
+
+} // namespace nda
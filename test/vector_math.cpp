@@ -0,0 +1,235 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "vector_math.h"
+#include "morton_shape.h"
+#include "tiled_shape.h"
+#include "test.h"
+
+#include <limits>
+
+namespace nda {
+
+// The reference results are computed in a type with more precision.
+template <class T>
+struct reference_math;
+
+template <>
+struct reference_math<float> {
+  using type = double;
+  static double exp(double x) { return std::exp(x); }
+  static double log(double x) { return std::log(x); }
+  static double tanh(double x) { return std::tanh(x); }
+  static double erf(double x) { return std::erf(x); }
+  static double sqrt(double x) { return std::sqrt(x); }
+};
+
+template <>
+struct reference_math<double> {
+  using type = long double;
+  static long double exp(long double x) { return std::exp(x); }
+  static long double log(long double x) { return std::log(x); }
+  static long double tanh(long double x) { return std::tanh(x); }
+  static long double erf(long double x) { return std::erf(x); }
+  static long double sqrt(long double x) { return std::sqrt(x); }
+};
+
+// The error of `y` in units of the last place of the correctly rounded result.
+// This is computed in the more precise type, so it can be measured near the
+// subnormal range even if subnormals are flushed to zero.
+template <class T, class R>
+double ulp_error(T y, R reference) {
+  T rounded = std::abs(static_cast<T>(reference));
+  R ulp = static_cast<R>(std::nextafter(rounded, std::numeric_limits<T>::infinity())) - rounded;
+  return static_cast<double>(std::abs(static_cast<R>(y) - reference) / ulp);
+}
+
+#ifdef __FAST_MATH__
+// -ffast-math allows the compiler to replace division and square roots with
+// less accurate approximations.
+const double approximate_division_error = 1.0;
+const double approximate_sqrt_error = 3.0;
+#else
+const double approximate_division_error = 0.0;
+const double approximate_sqrt_error = 0.0;
+#endif
+
+// Make an array of `n` values from `min` to `max`, or with logarithms from
+// `log2(min)` to `log2(max)`.
+template <class T>
+dense_array<T, 1> linear_sweep(T min, T max, index_t n) {
+  dense_array<T, 1> x(dense_shape<1>{n});
+  for (index_t i = 0; i < n; i++) {
+    x(i) = min + (max - min) * i / (n - 1);
+  }
+  return x;
+}
+template <class T>
+dense_array<T, 1> log_sweep(T min, T max, index_t n) {
+  dense_array<T, 1> x = linear_sweep<T>(std::log2(min), std::log2(max), n);
+  x.for_each_value([](T& i) { i = std::exp2(i); });
+  return x;
+}
+
+// The maximum error of `vector_fn(x, y)` compared to `reference_fn`.
+template <class T, class VectorFn, class ReferenceFn>
+double max_ulp_error(const dense_array<T, 1>& x, VectorFn vector_fn, ReferenceFn reference_fn) {
+  dense_array<T, 1> y(x.shape());
+  vector_fn(x, y);
+  double max_error = 0.0;
+  for (index_t i : x.x()) {
+    max_error = std::max(max_error, ulp_error(y(i), reference_fn(x(i))));
+  }
+  return max_error;
+}
+
+#define VECTOR_MATH_FN(name)                                                                       \
+  [](const dense_array<T, 1>& x, dense_array<T, 1>& y) { vector_##name(x, y); }
+#define REFERENCE_FN(name) reference_math<T>::name
+
+template <class T>
+void test_vector_math_accuracy() {
+  const index_t n = 1 << 20;
+  const T min_exp = std::log(std::numeric_limits<T>::min()) + 1;
+  const T max_exp = std::log(std::numeric_limits<T>::max() / 2);
+
+  double exp_error = max_ulp_error(
+      linear_sweep<T>(min_exp, max_exp, n), VECTOR_MATH_FN(exp), REFERENCE_FN(exp));
+  ASSERT_LT(exp_error, 1.5);
+
+  const T max = std::numeric_limits<T>::max() / 2;
+  double log_error = max_ulp_error(log_sweep<T>(std::numeric_limits<T>::denorm_min(), max, n),
+      VECTOR_MATH_FN(log), REFERENCE_FN(log));
+  ASSERT_LT(log_error, 1.0);
+  log_error = max_ulp_error(linear_sweep<T>(0.5, 2, n), VECTOR_MATH_FN(log), REFERENCE_FN(log));
+  ASSERT_LT(log_error, 1.0);
+
+  double tanh_error =
+      max_ulp_error(linear_sweep<T>(-25, 25, n), VECTOR_MATH_FN(tanh), REFERENCE_FN(tanh));
+  ASSERT_LT(tanh_error, 1.5 + approximate_division_error);
+  tanh_error = max_ulp_error(linear_sweep<T>(-1, 1, n), VECTOR_MATH_FN(tanh), REFERENCE_FN(tanh));
+  ASSERT_LT(tanh_error, 1.5 + approximate_division_error);
+
+  double erf_error =
+      max_ulp_error(linear_sweep<T>(-7, 7, n), VECTOR_MATH_FN(erf), REFERENCE_FN(erf));
+  ASSERT_LT(erf_error, 2.0);
+  erf_error = max_ulp_error(linear_sweep<T>(-1, 1, n), VECTOR_MATH_FN(erf), REFERENCE_FN(erf));
+  ASSERT_LT(erf_error, 2.0);
+
+  double sqrt_error = max_ulp_error(log_sweep<T>(std::numeric_limits<T>::min(), max, n),
+      VECTOR_MATH_FN(sqrt), REFERENCE_FN(sqrt));
+  ASSERT_LT(sqrt_error, 0.5 + 1e-6 + approximate_sqrt_error);
+}
+
+#undef VECTOR_MATH_FN
+#undef REFERENCE_FN
+
+TEST(vector_math_accuracy_float) { test_vector_math_accuracy<float>(); }
+TEST(vector_math_accuracy_double) { test_vector_math_accuracy<double>(); }
+
+template <class T>
+void test_vector_math_special_values() {
+  ASSERT_EQ(vector_exp(static_cast<T>(0)), 1);
+  ASSERT_EQ(vector_log(static_cast<T>(1)), 0);
+  ASSERT_EQ(vector_tanh(static_cast<T>(0)), 0);
+  ASSERT_EQ(vector_erf(static_cast<T>(0)), 0);
+  ASSERT_EQ(vector_tanh(static_cast<T>(100)), 1);
+  ASSERT_EQ(vector_erf(static_cast<T>(-100)), -1);
+  ASSERT_EQ(vector_exp(static_cast<T>(-1000)), 0);
+
+#ifndef __FAST_MATH__
+  // Subnormal results and arguments, which are flushed to zero with
+  // -ffast-math.
+  const T denorm_min = std::numeric_limits<T>::denorm_min();
+  ASSERT_EQ(vector_exp(std::log(denorm_min)), denorm_min);
+  ASSERT_LT(ulp_error(vector_log(denorm_min), std::log(static_cast<double>(denorm_min))), 1.0);
+  ASSERT_LT(ulp_error(vector_log(denorm_min * 1000), std::log(denorm_min * 1000.0)), 1.0);
+#endif
+
+#if !defined(__FINITE_MATH_ONLY__) || !__FINITE_MATH_ONLY__
+  const T inf = std::numeric_limits<T>::infinity();
+  const T nan = std::numeric_limits<T>::quiet_NaN();
+  ASSERT_EQ(vector_exp(inf), inf);
+  ASSERT_EQ(vector_exp(-inf), 0);
+  ASSERT_EQ(vector_exp(static_cast<T>(1000)), inf);
+  ASSERT(std::isnan(vector_exp(nan)));
+  ASSERT_EQ(vector_log(inf), inf);
+  ASSERT_EQ(vector_log(static_cast<T>(0)), -inf);
+  ASSERT(std::isnan(vector_log(static_cast<T>(-1))));
+  ASSERT(std::isnan(vector_log(nan)));
+  ASSERT_EQ(vector_tanh(inf), 1);
+  ASSERT_EQ(vector_tanh(-inf), -1);
+  ASSERT(std::isnan(vector_tanh(nan)));
+  ASSERT_EQ(vector_erf(inf), 1);
+  ASSERT_EQ(vector_erf(-inf), -1);
+  ASSERT(std::isnan(vector_erf(nan)));
+#endif
+}
+
+TEST(vector_math_special_values_float) { test_vector_math_special_values<float>(); }
+TEST(vector_math_special_values_double) { test_vector_math_special_values<double>(); }
+
+TEST(vector_math_shapes) {
+  dense_array<float, 3> x({{-2, 37}, {1, 10}, 3});
+  int i = 0;
+  x.for_each_value([&](float& v) { v = (i++ % 101) * 0.05f + 0.01f; });
+
+  // Cropped arrays, where the rows are not contiguous and do not fill
+  // vectors evenly.
+  dense_array<float, 3> y({{-1, 33}, {2, 7}, 3});
+  vector_log(x, y);
+  for_all_indices(y.shape(), [&](int a, int b, int c) {
+    ASSERT_LT(ulp_error(y(a, b, c), std::log(static_cast<double>(x(a, b, c)))), 1.0);
+  });
+
+  // Arrays with different strides are computed one value at a time.
+  array_of_rank<float, 3> y_strided({{-1, 33, 3}, {2, 7, 33 * 3}, {0, 3, 1}});
+  vector_exp(x, y_strided);
+  for_all_indices(y_strided.shape(), [&](int a, int b, int c) {
+    ASSERT_LT(ulp_error(y_strided(a, b, c), std::exp(static_cast<double>(x(a, b, c)))), 1.0);
+  });
+
+  // The result can replace the input.
+  dense_array<float, 3> z(x);
+  vector_sqrt(z, z);
+  for_all_indices(z.shape(), [&](int a, int b, int c) {
+    double expected = std::sqrt(static_cast<double>(x(a, b, c)));
+    ASSERT_LT(ulp_error(z(a, b, c), expected), 0.5 + 1e-6 + approximate_sqrt_error);
+  });
+  vector_tanh(z.ref(), z(r(0, 5), _, _));
+  for_all_indices(z.shape(), [&](int a, int b, int c) {
+    if (0 <= a && a < 5) {
+      double expected = std::tanh(static_cast<double>(std::sqrt(x(a, b, c))));
+      ASSERT_LT(ulp_error(z(a, b, c), expected), 2.0);
+    } else {
+      double expected = std::sqrt(static_cast<double>(x(a, b, c)));
+      ASSERT_LT(ulp_error(z(a, b, c), expected), 0.5 + 1e-6 + approximate_sqrt_error);
+    }
+  });
+
+  // Arrays with shapes that are not affine are computed one value at a time.
+  morton_array<float, 2> x_morton({{-2, 16}, {1, 10}});
+  copy(x(_, _, 0), x_morton);
+  dense_array<float, 2> y_dense({{-2, 16}, {1, 9}});
+  vector_exp(x_morton, y_dense);
+  for_all_indices(y_dense.shape(), [&](int a, int b) {
+    ASSERT_LT(ulp_error(y_dense(a, b), std::exp(static_cast<double>(x(a, b, 0)))), 1.0);
+  });
+  tiled_array<float, 4, 4> y_tiled({{-1, 13}, {2, 6}});
+  vector_log(x(_, _, 1), y_tiled);
+  for_all_indices(y_tiled.shape(), [&](int a, int b) {
+    ASSERT_LT(ulp_error(y_tiled(a, b), std::log(static_cast<double>(x(a, b, 1)))), 1.0);
+  });
+}
+
+} // namespace nda
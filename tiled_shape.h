@@ -0,0 +1,523 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/** \file tiled_shape.h
+ * \brief Optional shape type for arrays stored in tiles of compile-time
+ * constant size.
+ */
+#ifndef NDARRAY_TILED_SHAPE_H
+#define NDARRAY_TILED_SHAPE_H
+
+#include "array.h"
+
+namespace nda {
+
+namespace internal {
+
+// Used to expand a list of dim<> parameters from the tile extents.
+template <index_t TileExtent>
+struct tile_dim {
+  using type = dim<>;
+};
+
+template <index_t... TileExtents>
+constexpr index_t tile_extent(size_t d) {
+  const index_t extents[] = {TileExtents...};
+  return extents[d];
+}
+
+// The distance in flat indices between neighboring elements of dimension `d`
+// within a tile.
+template <index_t... TileExtents>
+constexpr index_t tile_inner_stride(size_t d) {
+  const index_t extents[] = {TileExtents...};
+  index_t result = 1;
+  for (size_t i = 0; i < d; i++) {
+    result *= extents[i];
+  }
+  return result;
+}
+
+} // namespace internal
+
+/** A shape that stores an array in tiles of `TileExtents...` elements. The
+ * elements within a tile are contiguous, with the first dimension innermost,
+ * and the tiles are laid out like a `shape` of tiles.
+ *
+ * The tiles are aligned to the `origin` of the shape, which is the min of the
+ * dims, unless the shape is a `crop` of another shape. The stride of each dim
+ * is the distance in flat indices between neighboring tiles in that dimension,
+ * and unknown strides are replaced with strides of a compact layout by
+ * `resolve`. Indices are mapped to flat offsets by:
+ *
+ *   `sum((x - o) % tile_extent*tile_inner_stride + (x - o) / tile_extent*stride)`
+ *
+ * for each dimension with index `x` and origin `o`. This layout keeps
+ * neighbors in all dimensions nearby in memory, which avoids TLB and cache
+ * misses when accessing large arrays in any order other than row major.
+ *
+ * Tiled shapes can be used with `array`, `array_ref`, `copy` and
+ * `for_each_value`, which iterate tile by tile. They cannot be sliced or
+ * cropped with `operator()`, use `crop` instead. */
+template <index_t... TileExtents>
+class tiled_shape {
+public:
+  /** Number of dims in this shape. */
+  static constexpr size_t rank() { return sizeof...(TileExtents); }
+  static_assert(sizeof...(TileExtents) > 0, "A tiled_shape must have at least one dimension.");
+
+  static constexpr bool is_scalar() { return false; }
+
+  /** The type of an index for this shape. */
+  using index_type = index_of_rank<rank()>;
+
+  using size_type = size_t;
+
+  /** The type of the dims tuple of this shape. */
+  using dims_type = internal::tuple_of_n<nda::dim<>, rank()>;
+
+  /** The type of the shape of the elements in a tile. */
+  using tile_shape_type = shape_of_rank<rank()>;
+
+  using dim_indices = decltype(internal::make_index_sequence<rank()>());
+
+  /** The extent of dimension `D` of a tile. */
+  template <size_t D>
+  static constexpr index_t tile_extent() {
+    return internal::tile_extent<TileExtents...>(D);
+  }
+
+  /** The number of elements in a tile. */
+  static constexpr index_t tile_size() {
+    return internal::tile_inner_stride<TileExtents...>(rank());
+  }
+
+private:
+  dims_type dims_;
+  index_type origin_;
+
+  template <class... Args>
+  using enable_if_same_rank = std::enable_if_t<(sizeof...(Args) == rank())>;
+
+  template <class... Args>
+  using enable_if_indices = std::enable_if_t<internal::all_of_type<index_t, Args...>::value>;
+
+  template <size_t Dim>
+  using enable_if_dim = std::enable_if_t<(Dim < rank())>;
+
+  // The index of the tile containing `at` in dimension `D`. `at` must not be
+  // less than the origin.
+  template <size_t D>
+  NDARRAY_INLINE NDARRAY_HOST_DEVICE index_t tile_index(index_t at) const {
+    const index_t x = at - std::get<D>(origin_);
+    assert(x >= 0);
+    return static_cast<index_t>(static_cast<size_t>(x) / static_cast<size_t>(tile_extent<D>()));
+  }
+
+  template <size_t D>
+  NDARRAY_INLINE NDARRAY_HOST_DEVICE index_t flat_offset(index_t at) const {
+    const index_t tile = tile_index<D>(at);
+    const index_t x = at - std::get<D>(origin_) - tile * tile_extent<D>();
+    return x * internal::tile_inner_stride<TileExtents...>(D) + tile * std::get<D>(dims_).stride();
+  }
+
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE index_t flat_offset(
+      const index_type& indices, internal::index_sequence<Is...>) const {
+    return internal::sum(flat_offset<Is>(std::get<Is>(indices))...);
+  }
+
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE index_t tile_flat_min(internal::index_sequence<Is...>) const {
+    return internal::sum(
+        tile_index<Is>(std::get<Is>(dims_).min()) * std::get<Is>(dims_).stride()...);
+  }
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE index_t tile_flat_max(internal::index_sequence<Is...>) const {
+    return internal::sum(
+        tile_index<Is>(std::get<Is>(dims_).max()) * std::get<Is>(dims_).stride()...);
+  }
+
+  // The tiles of each dimension, beginning at the origin.
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE index_type tile_counts(internal::index_sequence<Is...>) const {
+    return std::make_tuple((std::get<Is>(dims_).extent() > 0
+                                ? tile_index<Is>(std::get<Is>(dims_).max()) + 1
+                                : 0)...);
+  }
+
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE tile_shape_type tiles(internal::index_sequence<Is...>) const {
+    return {nda::dim<>(tile_index<Is>(std::get<Is>(dims_).min()),
+        tile_index<Is>(std::get<Is>(dims_).max()) - tile_index<Is>(std::get<Is>(dims_).min()) +
+            1)...};
+  }
+
+  template <size_t D>
+  NDARRAY_HOST_DEVICE nda::dim<> tile_dim(index_t tile) const {
+    const auto& d = std::get<D>(dims_);
+    const index_t tile_min = std::get<D>(origin_) + tile * tile_extent<D>();
+    const index_t min = std::max(d.min(), tile_min);
+    const index_t max = std::min(d.max(), tile_min + tile_extent<D>() - 1);
+    return nda::dim<>(min, max - min + 1, internal::tile_inner_stride<TileExtents...>(D));
+  }
+
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE tile_shape_type tile(
+      const index_type& t, internal::index_sequence<Is...>) const {
+    return {tile_dim<Is>(std::get<Is>(t))...};
+  }
+
+  // Loop over the tiles in `tiles`, with dimension 0 innermost. These loops
+  // are written without lambdas so `fn` can be inlined.
+  template <class Fn>
+  NDARRAY_INLINE NDARRAY_HOST_DEVICE void for_each_tile(std::integral_constant<size_t, 0>,
+      const tile_shape_type& tiles, index_type& t, Fn&& fn) const {
+    for (index_t i : tiles.template dim<0>()) {
+      std::get<0>(t) = i;
+      tile_shape_type tile_t = tile(t);
+      fn(tile_t, flat_offset(tile_t.min(), dim_indices()));
+    }
+  }
+  template <size_t D, class Fn>
+  NDARRAY_INLINE NDARRAY_HOST_DEVICE void for_each_tile(std::integral_constant<size_t, D>,
+      const tile_shape_type& tiles, index_type& t, Fn&& fn) const {
+    for (index_t i : tiles.template dim<D>()) {
+      std::get<D>(t) = i;
+      for_each_tile(std::integral_constant<size_t, D - 1>(), tiles, t, fn);
+    }
+  }
+
+  template <size_t... Is>
+  NDARRAY_HOST_DEVICE bool is_origin_valid(internal::index_sequence<Is...>) const {
+    return internal::all((std::get<Is>(dims_).min() >= std::get<Is>(origin_))...);
+  }
+
+  template <class Intervals, size_t... Is>
+  NDARRAY_HOST_DEVICE dims_type crop_dims(
+      const Intervals& intervals, internal::index_sequence<Is...>) const {
+    return std::make_tuple(
+        nda::dim<>(std::max(std::get<Is>(dims_).min(), std::get<Is>(intervals).min()),
+            std::min(std::get<Is>(dims_).max(), std::get<Is>(intervals).max()) -
+                std::max(std::get<Is>(dims_).min(), std::get<Is>(intervals).min()) + 1,
+            std::get<Is>(dims_).stride())...);
+  }
+
+public:
+  /** Construct a tiled shape from a list of `dims`, with the origin at the min
+   * of the dims. The strides of the dims are the strides between tiles. */
+  NDARRAY_HOST_DEVICE tiled_shape() : origin_(min()) {}
+  NDARRAY_HOST_DEVICE tiled_shape(const typename internal::tile_dim<TileExtents>::type&... dims)
+      : dims_(dims...), origin_(min()) {}
+  NDARRAY_HOST_DEVICE tiled_shape(const tiled_shape&) = default;
+  NDARRAY_HOST_DEVICE tiled_shape(tiled_shape&&) = default;
+  NDARRAY_HOST_DEVICE tiled_shape& operator=(const tiled_shape&) = default;
+  NDARRAY_HOST_DEVICE tiled_shape& operator=(tiled_shape&&) = default;
+
+  /** Replace unknown strides with the strides of a compact layout of the
+   * tiles, placed after the tiles of dims with known strides. */
+  NDARRAY_HOST_DEVICE void resolve() {
+    auto dims = internal::tuple_to_array<nda::dim<>>(dims_);
+    auto counts = internal::tuple_to_array<index_t>(tile_counts(dim_indices()));
+    index_t next = tile_size();
+    for (size_t d = 0; d < rank(); d++) {
+      if (!internal::is_dynamic(dims[d].stride())) {
+        next = std::max(next, dims[d].stride() * counts[d]);
+      }
+    }
+    for (size_t d = 0; d < rank(); d++) {
+      if (internal::is_dynamic(dims[d].stride())) {
+        dims[d].set_stride(next);
+        next *= counts[d];
+      }
+    }
+    dims_ = internal::array_to_tuple(dims);
+  }
+
+  /** Check if all strides of the shape are known. */
+  NDARRAY_HOST_DEVICE bool is_resolved() const {
+    return internal::is_resolved(dims_, dim_indices());
+  }
+
+  /** Returns `true` if the indices or intervals `args` are in interval of this shape. */
+  template <class... Args, class = enable_if_same_rank<Args...>>
+  NDARRAY_HOST_DEVICE bool is_in_range(const std::tuple<Args...>& args) const {
+    return internal::is_in_range(dims_, args, dim_indices());
+  }
+  template <class... Args, class = enable_if_same_rank<Args...>>
+  NDARRAY_HOST_DEVICE bool is_in_range(Args... args) const {
+    return internal::is_in_range(dims_, std::make_tuple(args...), dim_indices());
+  }
+
+  /** Compute the flat offset of the index `indices`. */
+  NDARRAY_HOST_DEVICE index_t operator()(const index_type& indices) const {
+    return flat_offset(indices, dim_indices());
+  }
+  NDARRAY_HOST_DEVICE index_t operator[](const index_type& indices) const {
+    return flat_offset(indices, dim_indices());
+  }
+  template <class... Args, class = enable_if_same_rank<Args...>, class = enable_if_indices<Args...>>
+  NDARRAY_HOST_DEVICE index_t operator()(Args... indices) const {
+    return flat_offset(std::make_tuple(indices...), dim_indices());
+  }
+
+  /** Make a shape with the same layout as this shape, with the dims clamped to
+   * `intervals`. The cropped shape maps indices to the same flat offsets as
+   * this shape, so it can be used with the same base pointer. */
+  template <class... Intervals, class = enable_if_same_rank<Intervals...>>
+  NDARRAY_HOST_DEVICE tiled_shape crop(const std::tuple<Intervals...>& intervals) const {
+    tiled_shape result;
+    result.dims_ = crop_dims(intervals, dim_indices());
+    result.origin_ = origin_;
+    assert(result.is_origin_valid(dim_indices()) || result.empty());
+    return result;
+  }
+  template <class... Intervals, class = enable_if_same_rank<Intervals...>>
+  NDARRAY_HOST_DEVICE tiled_shape crop(const Intervals&... intervals) const {
+    return crop(std::make_tuple(intervals...));
+  }
+
+  /** Get a specific dim `D` of this shape. */
+  template <size_t D, class = enable_if_dim<D>>
+  NDARRAY_HOST_DEVICE auto& dim() {
+    return std::get<D>(dims_);
+  }
+  template <size_t D, class = enable_if_dim<D>>
+  NDARRAY_HOST_DEVICE const auto& dim() const {
+    return std::get<D>(dims_);
+  }
+
+  /** Get a tuple of all of the dims of this shape. */
+  NDARRAY_HOST_DEVICE dims_type& dims() { return dims_; }
+  NDARRAY_HOST_DEVICE const dims_type& dims() const { return dims_; }
+
+  /** The index at the beginning of the first tile. */
+  NDARRAY_HOST_DEVICE const index_type& origin() const { return origin_; }
+
+  NDARRAY_HOST_DEVICE index_type min() const { return internal::mins(dims(), dim_indices()); }
+  NDARRAY_HOST_DEVICE index_type max() const { return internal::maxs(dims(), dim_indices()); }
+  NDARRAY_HOST_DEVICE index_type extent() const { return internal::extents(dims(), dim_indices()); }
+  NDARRAY_HOST_DEVICE index_type stride() const { return internal::strides(dims(), dim_indices()); }
+
+  /** Compute the min, max, or extent of the flat offsets of this shape. This
+   * includes all of the elements of the tiles that intersect the shape. */
+  NDARRAY_HOST_DEVICE index_t flat_min() const {
+    return empty() ? 0 : tile_flat_min(dim_indices());
+  }
+  NDARRAY_HOST_DEVICE index_t flat_max() const {
+    return empty() ? -1 : tile_flat_max(dim_indices()) + tile_size() - 1;
+  }
+  NDARRAY_HOST_DEVICE size_type flat_extent() const {
+    index_t e = flat_max() - flat_min() + 1;
+    return e < 0 ? 0 : static_cast<size_type>(e);
+  }
+
+  /** Compute the total number of indices in this shape. */
+  NDARRAY_HOST_DEVICE size_type size() const {
+    index_t s = internal::product(extent(), dim_indices());
+    return s < 0 ? 0 : static_cast<size_type>(s);
+  }
+
+  /** A shape is empty if its size is 0. */
+  NDARRAY_HOST_DEVICE bool empty() const { return size() == 0; }
+
+  /** Returns `true` if there are no unaddressable flat indices between the
+   * first and last addressable flat elements. This is only true if the tiles
+   * do not extend beyond the shape. */
+  NDARRAY_HOST_DEVICE bool is_compact() const { return flat_extent() <= size(); }
+
+  /** Returns `true` if this shape projects to a set of flat indices that is a
+   * subset of the other shape's projection to flat indices, with an offset
+   * `offset`. */
+  template <typename OtherShape>
+  NDARRAY_HOST_DEVICE bool is_subset_of(const OtherShape& other, index_t offset) const {
+    return flat_min() >= other.flat_min() + offset && flat_max() <= other.flat_max() + offset;
+  }
+
+  /** Get the shape of the indices of the tiles intersecting this shape. */
+  NDARRAY_HOST_DEVICE tile_shape_type tiles() const { return tiles(dim_indices()); }
+
+  /** Get the shape of the part of tile `t` in this shape. The strides of the
+   * result are the strides of the elements within a tile. */
+  NDARRAY_HOST_DEVICE tile_shape_type tile(const index_type& t) const {
+    return tile(t, dim_indices());
+  }
+
+  /** Call `fn(tile, offset)` for each tile intersecting this shape, where
+   * `tile` is the shape of the part of the tile in this shape, and `offset` is
+   * the flat offset of the min of `tile`. */
+  template <class Fn>
+  NDARRAY_HOST_DEVICE void for_each_tile(Fn&& fn) const {
+    if (empty()) { return; }
+    index_type t;
+    for_each_tile(std::integral_constant<size_t, rank() - 1>(), tiles(), t, fn);
+  }
+
+  /** Provide some aliases for common interpretations of dimensions
+   * `i`, `j`, `k` as dimensions 0, 1, 2, respectively. */
+  NDARRAY_HOST_DEVICE auto& i() { return dim<0>(); }
+  NDARRAY_HOST_DEVICE const auto& i() const { return dim<0>(); }
+  NDARRAY_HOST_DEVICE auto& j() { return dim<1>(); }
+  NDARRAY_HOST_DEVICE const auto& j() const { return dim<1>(); }
+  NDARRAY_HOST_DEVICE auto& k() { return dim<2>(); }
+  NDARRAY_HOST_DEVICE const auto& k() const { return dim<2>(); }
+
+  /** Provide some aliases for common interpretations of dimensions
+   * `x`, `y`, `z` or `c`, `w` as dimensions 0, 1, 2, 3 respectively. */
+  NDARRAY_HOST_DEVICE auto& x() { return dim<0>(); }
+  NDARRAY_HOST_DEVICE const auto& x() const { return dim<0>(); }
+  NDARRAY_HOST_DEVICE auto& y() { return dim<1>(); }
+  NDARRAY_HOST_DEVICE const auto& y() const { return dim<1>(); }
+  NDARRAY_HOST_DEVICE auto& z() { return dim<2>(); }
+  NDARRAY_HOST_DEVICE const auto& z() const { return dim<2>(); }
+  NDARRAY_HOST_DEVICE auto& c() { return dim<2>(); }
+  NDARRAY_HOST_DEVICE const auto& c() const { return dim<2>(); }
+  NDARRAY_HOST_DEVICE auto& w() { return dim<3>(); }
+  NDARRAY_HOST_DEVICE const auto& w() const { return dim<3>(); }
+
+  /** Assuming this array represents an image with dimensions {width,
+   * height, channels}, get the extent of those dimensions. */
+  NDARRAY_HOST_DEVICE index_t width() const { return x().extent(); }
+  NDARRAY_HOST_DEVICE index_t height() const { return y().extent(); }
+  NDARRAY_HOST_DEVICE index_t channels() const { return c().extent(); }
+
+  /** Assuming this array represents a matrix with dimensions {rows,
+   * cols}, get the extent of those dimensions. */
+  NDARRAY_HOST_DEVICE index_t rows() const { return i().extent(); }
+  NDARRAY_HOST_DEVICE index_t columns() const { return j().extent(); }
+
+  /** A tiled shape is equal to another tiled shape if the dims and the origins
+   * of both shapes are equal. */
+  NDARRAY_HOST_DEVICE bool operator==(const tiled_shape& other) const {
+    return dims_ == other.dims_ && origin_ == other.origin_;
+  }
+  NDARRAY_HOST_DEVICE bool operator!=(const tiled_shape& other) const {
+    return !operator==(other);
+  }
+};
+
+/** Arrays stored in tiles of `TileExtents...` elements. */
+template <class T, index_t TileX, index_t TileY, class Alloc = std::allocator<T>>
+using tiled_array = array<T, tiled_shape<TileX, TileY>, Alloc>;
+template <class T, index_t TileX, index_t TileY>
+using tiled_array_ref = array_ref<T, tiled_shape<TileX, TileY>>;
+template <class T, index_t TileX, index_t TileY>
+using const_tiled_array_ref = tiled_array_ref<const T, TileX, TileY>;
+
+/** Make an `array_ref` of the part of `a` in `intervals`, with the same layout. */
+template <class T, index_t... TileExtents, class... Intervals>
+array_ref<T, tiled_shape<TileExtents...>> crop(
+    const array_ref<T, tiled_shape<TileExtents...>>& a, const Intervals&... intervals) {
+  return make_array_ref(a.base(), a.shape().crop(intervals...));
+}
+template <class T, index_t... TileExtents, class Alloc, class... Intervals>
+array_ref<T, tiled_shape<TileExtents...>> crop(
+    array<T, tiled_shape<TileExtents...>, Alloc>& a, const Intervals&... intervals) {
+  return crop(a.ref(), intervals...);
+}
+template <class T, index_t... TileExtents, class Alloc, class... Intervals>
+array_ref<const T, tiled_shape<TileExtents...>> crop(
+    const array<T, tiled_shape<TileExtents...>, Alloc>& a, const Intervals&... intervals) {
+  return crop(a.cref(), intervals...);
+}
+
+/** Tiled shapes iterate over the indices and values of each tile, one tile at
+ * a time. */
+template <index_t... TileExtents>
+class shape_traits<tiled_shape<TileExtents...>> {
+public:
+  using shape_type = tiled_shape<TileExtents...>;
+  using tile_shape_type = typename shape_type::tile_shape_type;
+
+  template <class Fn>
+  static void for_each_index(const shape_type& s, Fn&& fn) {
+    s.for_each_tile(
+        [&](const tile_shape_type& tile, index_t) { for_each_index_in_order(tile, fn); });
+  }
+
+  template <class Ptr, class Fn>
+  static void for_each_value(const shape_type& s, Ptr base, Fn&& fn) {
+    s.for_each_tile([&](const tile_shape_type& tile, index_t offset) {
+      if (tile.size() == static_cast<size_t>(shape_type::tile_size())) {
+        // Tiles entirely inside the shape are contiguous.
+        for_each_value_in_order(dense_shape<1>(shape_type::tile_size()), base + offset, fn);
+      } else {
+        for_each_value_in_order(tile, base + offset, fn);
+      }
+    });
+  }
+};
+
+/** Copies from a tiled shape visit each tile of the source, and copies to a
+ * tiled shape visit each tile of the destination. Within a tile, the copy is
+ * a copy between two affine shapes. */
+template <index_t... TileExtents, class ShapeDst>
+class copy_shape_traits<tiled_shape<TileExtents...>, ShapeDst> {
+public:
+  using src_shape_type = tiled_shape<TileExtents...>;
+  using dst_shape_type = ShapeDst;
+  using tile_shape_type = typename src_shape_type::tile_shape_type;
+
+  template <class Fn, class TSrc, class TDst>
+  static void for_each_value(
+      const src_shape_type& shape_src, TSrc src, const ShapeDst& shape_dst, TDst dst, Fn&& fn) {
+    shape_src.crop(shape_dst.dims())
+        .for_each_tile([&](const tile_shape_type& tile, index_t offset) {
+          for_each_value_in_order(tile, tile, src + offset, shape_dst, dst, fn);
+        });
+  }
+};
+
+template <class ShapeSrc, index_t... TileExtents>
+class copy_shape_traits<ShapeSrc, tiled_shape<TileExtents...>> {
+public:
+  using src_shape_type = ShapeSrc;
+  using dst_shape_type = tiled_shape<TileExtents...>;
+  using tile_shape_type = typename dst_shape_type::tile_shape_type;
+
+  template <class Fn, class TSrc, class TDst>
+  static void for_each_value(
+      const ShapeSrc& shape_src, TSrc src, const dst_shape_type& shape_dst, TDst dst, Fn&& fn) {
+    shape_dst.for_each_tile([&](const tile_shape_type& tile, index_t offset) {
+      for_each_value_in_order(tile, shape_src, src, tile, dst + offset, fn);
+    });
+  }
+};
+
+template <index_t... SrcTileExtents, index_t... DstTileExtents>
+class copy_shape_traits<tiled_shape<SrcTileExtents...>, tiled_shape<DstTileExtents...>> {
+public:
+  using src_shape_type = tiled_shape<SrcTileExtents...>;
+  using dst_shape_type = tiled_shape<DstTileExtents...>;
+
+  template <class Fn, class TSrc, class TDst>
+  static void for_each_value(const src_shape_type& shape_src, TSrc src,
+      const dst_shape_type& shape_dst, TDst dst, Fn&& fn) {
+    using dst_tile_shape_type = typename dst_shape_type::tile_shape_type;
+    using src_tile_shape_type = typename src_shape_type::tile_shape_type;
+    shape_dst.for_each_tile([&](const dst_tile_shape_type& dst_tile, index_t dst_offset) {
+      // Each source tile intersecting the destination tile is a copy between
+      // two affine shapes.
+      shape_src.crop(dst_tile.dims())
+          .for_each_tile([&](const src_tile_shape_type& src_tile, index_t src_offset) {
+            for_each_value_in_order(
+                src_tile, src_tile, src + src_offset, dst_tile, dst + dst_offset, fn);
+          });
+    });
+  }
+};
+
+} // namespace nda
+
+#endif // NDARRAY_TILED_SHAPE_H